@@ -1,10 +1,15 @@
 #include "agent_loop.h"
 #include "agent/context_builder.h"
+#include "agent/session_compactor.h"
 #include "mimi_config.h"
 #include "bus/message_bus.h"
 #include "llm/llm_proxy.h"
+#include "llm/llm_usage.h"
 #include "memory/session_mgr.h"
 #include "tools/tool_registry.h"
+#include "tools/tool_runner.h"
+#include "gateway/ws_server.h"
+#include "perf/perf_trace.h"
 #ifdef MIMI_HAS_DISPLAY
 #include "display/display_ui.h"
 #include "power/sleep_manager.h"
@@ -18,13 +23,14 @@
 #include <stdlib.h>
 #include "esp_log.h"
 #include "esp_heap_caps.h"
-#include "esp_random.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "cJSON.h"
 
 static const char *TAG = "agent";
 
-#define TOOL_OUTPUT_SIZE  (8 * 1024)
-
 /* Build the assistant content array from llm_response_t for the messages history.
  * Returns a cJSON array with text and tool_use blocks. */
 static cJSON *build_assistant_content(const llm_response_t *resp)
@@ -60,210 +66,722 @@ static cJSON *build_assistant_content(const llm_response_t *resp)
     return content;
 }
 
-/* Build the user message with tool_result blocks */
-static cJSON *build_tool_results(const llm_response_t *resp, char *tool_output, size_t tool_output_size)
+/* ── Tool memo ────────────────────────────────────────────────── */
+
+/* Outputs of the side-effecting calls (not parallel-safe) a preempted turn
+ * already ran: its rerun takes them back instead of moving the servo or
+ * writing the file a second time. Worker-local, dropped once a turn of the
+ * chat ends without being preempted. */
+typedef struct {
+    char *name;
+    char *input;
+    char *output;
+} tool_memo_entry_t;
+
+typedef struct {
+    tool_memo_entry_t e[MIMI_AGENT_TOOL_MEMO];
+    int count;
+} tool_memo_t;
+
+static void tool_memo_clear(tool_memo_t *m)
 {
-    cJSON *content = cJSON_CreateArray();
+    for (int i = 0; i < m->count; i++) {
+        free(m->e[i].name);
+        free(m->e[i].input);
+        free(m->e[i].output);
+    }
+    m->count = 0;
+}
+
+/* Output of an identical earlier call (caller frees it), or NULL. The entry
+ * is consumed: a second identical call in the rerun runs for real. */
+static char *tool_memo_take(tool_memo_t *m, const char *name, const char *input)
+{
+    for (int i = 0; i < m->count; i++) {
+        tool_memo_entry_t *e = &m->e[i];
+        if (strcmp(e->name, name) != 0 || strcmp(e->input, input) != 0) continue;
+        char *output = e->output;
+        free(e->name);
+        free(e->input);
+        memmove(e, e + 1, (--m->count - i) * sizeof(*e));
+        return output;
+    }
+    return NULL;
+}
+
+static void tool_memo_put(tool_memo_t *m, const char *name, const char *input, const char *output)
+{
+    if (m->count >= MIMI_AGENT_TOOL_MEMO) return;
+    tool_memo_entry_t e = { strdup(name), strdup(input), strdup(output) };
+    if (!e.name || !e.input || !e.output) {
+        free(e.name);
+        free(e.input);
+        free(e.output);
+        return;
+    }
+    m->e[m->count++] = e;
+}
 
+/* Build the user message with tool_result blocks (independent calls run in parallel) */
+static cJSON *build_tool_results(const llm_response_t *resp, tool_memo_t *memo,
+                                 char *tool_output, size_t tool_output_size)
+{
+    tool_job_t jobs[MIMI_MAX_TOOL_CALLS];
+    tool_job_t run[MIMI_MAX_TOOL_CALLS];
+    int run_idx[MIMI_MAX_TOOL_CALLS];
+    int run_count = 0;
     for (int i = 0; i < resp->call_count; i++) {
         const llm_tool_call_t *call = &resp->calls[i];
+        jobs[i] = (tool_job_t){ .name = call->name, .input = call->input };
+        if (!tool_registry_is_parallel_safe(call->name)
+            && (jobs[i].output = tool_memo_take(memo, call->name, call->input))) {
+            ESP_LOGI(TAG, "Tool %s already ran before the preemption, reusing its result", call->name);
+            continue;
+        }
+        run_idx[run_count] = i;
+        run[run_count++] = jobs[i];
+    }
+    tool_runner_run(run, run_count, tool_output, tool_output_size);
+    for (int k = 0; k < run_count; k++) {
+        tool_job_t *job = &jobs[run_idx[k]];
+        job->output = run[k].output;
+        if (job->output && !tool_registry_is_parallel_safe(job->name)) {
+            tool_memo_put(memo, job->name, job->input, job->output);
+        }
+    }
 
-        /* Execute tool */
-        tool_output[0] = '\0';
-        tool_registry_execute(call->name, call->input, tool_output, tool_output_size);
+    cJSON *content = cJSON_CreateArray();
+    for (int i = 0; i < resp->call_count; i++) {
+        const llm_tool_call_t *call = &resp->calls[i];
+        const char *result = jobs[i].output ? jobs[i].output : "Error: out of memory";
 
-        ESP_LOGI(TAG, "Tool %s result: %d bytes", call->name, (int)strlen(tool_output));
+        ESP_LOGI(TAG, "Tool %s result: %d bytes", call->name, (int)strlen(result));
 
         /* Build tool_result block */
         cJSON *result_block = cJSON_CreateObject();
         cJSON_AddStringToObject(result_block, "type", "tool_result");
         cJSON_AddStringToObject(result_block, "tool_use_id", call->id);
-        cJSON_AddStringToObject(result_block, "content", tool_output);
+        cJSON_AddStringToObject(result_block, "content", result);
         cJSON_AddItemToArray(content, result_block);
+        free(jobs[i].output);
     }
 
     return content;
 }
 
-static void agent_loop_task(void *arg)
+/* Rolling summary of the compacted history, after the cached prefix */
+static void append_session_summary(char *buf, size_t size, const char *chat_id)
 {
-    ESP_LOGI(TAG, "Agent loop started on core %d", xPortGetCoreID());
-
-    /* Allocate large buffers from PSRAM */
-    char *system_prompt = heap_caps_calloc(1, MIMI_CONTEXT_BUF_SIZE, MALLOC_CAP_SPIRAM);
-    char *history_json = heap_caps_calloc(1, MIMI_LLM_STREAM_BUF_SIZE, MALLOC_CAP_SPIRAM);
-    char *tool_output = heap_caps_calloc(1, TOOL_OUTPUT_SIZE, MALLOC_CAP_SPIRAM);
-
-    if (!system_prompt || !history_json || !tool_output) {
-        ESP_LOGE(TAG, "Failed to allocate PSRAM buffers");
-        vTaskDelete(NULL);
-        return;
+    static const char header[] = "\n\n## Earlier in this conversation\n";
+    size_t len = strlen(buf);
+    if (len + sizeof(header) + 64 >= size) return;
+
+    size_t room = size - len - (sizeof(header) - 1);
+    if (room > MIMI_SESSION_SUMMARY_MAX) room = MIMI_SESSION_SUMMARY_MAX;
+    if (session_get_summary(chat_id, buf + len + sizeof(header) - 1, room) == ESP_OK) {
+        memcpy(buf + len, header, sizeof(header) - 1);
+    } else {
+        buf[len] = '\0';
     }
+}
 
-    const char *tools_json = tool_registry_get_tools_json();
+typedef struct {
+    const mimi_msg_t *msg;
+    bool streamed;              /* deltas went out, a cancel must retract them */
+} turn_stream_t;
 
-    while (1) {
-        mimi_msg_t msg;
-        esp_err_t err = message_bus_pop_inbound(&msg, UINT32_MAX);
-        if (err != ESP_OK) continue;
+/* Stream reply fragments to WebSocket clients as the LLM produces them */
+static void on_llm_delta(const char *text, size_t len, void *ctx)
+{
+    turn_stream_t *stream = (turn_stream_t *)ctx;
+    if (strcmp(stream->msg->channel, MIMI_CHAN_WEBSOCKET) == 0) {
+        ws_server_send_delta(stream->msg->chat_id, text, len);
+        stream->streamed = true;
+    }
+}
 
-        ESP_LOGI(TAG, "Processing message from %s:%s", msg.channel, msg.chat_id);
+/* ── Agent workers ────────────────────────────────────────────── */
+
+/* Each worker runs one turn at a time with its own buffers */
+typedef struct {
+    int   id;
+    char *system_prompt;
+    char *history_json;
+    char *tool_output;
+    llm_body_cache_t *body_cache;
+    tool_memo_t memo;
+} agent_worker_t;
+
+static agent_worker_t s_workers[MIMI_AGENT_WORKERS];
+static int s_worker_count = 0;
+
+/* Every worker pops from the inbound queue. A message whose chat already has
+ * a turn running on another worker is parked behind it, and that worker
+ * runs it next: one chat's messages stay in order, different chats run
+ * concurrently. A parked message also preempts the running turn
+ * (MIMI_AGENT_PREEMPT): the turn is cancelled at its next check and its
+ * message is merged into the parked one. Parked messages of one channel are
+ * merged as well, and a fresh turn whose chat is in a burst (its previous
+ * message came less than MIMI_AGENT_BURST_MS ago) waits
+ * MIMI_AGENT_COALESCE_MS for more. */
+typedef struct {
+    char       chat_id[32];     /* chat of the running turn, "" when idle */
+    mimi_msg_t backlog[MIMI_AGENT_CHAT_BACKLOG];
+    int        backlog_count;
+    volatile bool cancel;       /* checked between iterations and by the HTTP layer */
+    bool       stop;            /* /stop: drop the turn instead of merging it */
+    bool       compacting;      /* held by a session compaction, not a turn */
+    bool       burst;           /* claimed right after another message of the chat */
+} chat_slot_t;
+
+static chat_slot_t s_slots[MIMI_AGENT_WORKERS];     /* one per worker */
+static SemaphoreHandle_t s_sched_lock = NULL;
+static int64_t s_last_active_us = 0;    /* last message claimed or chat released, s_sched_lock */
+
+/* Last arrival per recently seen chat, for burst detection (s_sched_lock) */
+typedef struct {
+    char    chat_id[32];
+    int64_t at_us;
+} chat_arrival_t;
+
+static chat_arrival_t s_arrivals[MIMI_AGENT_WORKERS * 2];
+
+/* One turn: the ReAct loop for msg, then the reply.
+ * @return true if it was cancelled before replying (msg->content is the caller's either way) */
+static bool run_turn(agent_worker_t *w, mimi_msg_t *msg)
+{
+    ESP_LOGI(TAG, "[%d] Processing message from %s:%s", w->id, msg->channel, msg->chat_id);
+    chat_slot_t *slot = &s_slots[w->id];
+    esp_err_t err = ESP_OK;
+    bool cancelled = false;
+    turn_stream_t stream = { .msg = msg };
+    perf_span_t turn_span = perf_begin(PERF_TURN);
+    /* Typing indicator for the whole turn, kept alive by the dispatcher */
+    message_bus_set_activity(msg->channel, msg->chat_id, true);
 #ifdef MIMI_HAS_SERVOS
-        /* Enregistrer le canal pour les alertes sentinelle */
-        tool_perception_set_chat(msg.channel, msg.chat_id);
-        /* Reaction corporelle : surprise a la reception du message */
-        body_animator_set_mood(MOOD_EXCITED);
-        vTaskDelay(pdMS_TO_TICKS(500));
+    /* Enregistrer le canal pour les alertes sentinelle */
+    tool_perception_set_chat(msg->channel, msg->chat_id);
+    /* Reaction corporelle : surprise a la reception du message */
+    body_animator_set_mood(MOOD_EXCITED);
+    vTaskDelay(pdMS_TO_TICKS(500));
 #endif
 #ifdef MIMI_HAS_DISPLAY
-        display_ui_set_state(DISPLAY_THINKING);
-        sleep_manager_reset_timer();
+    display_ui_set_state(DISPLAY_THINKING);
+    sleep_manager_reset_timer();
 #endif
 #ifdef MIMI_HAS_SERVOS
-        body_animator_set_state(DISPLAY_THINKING);
-        body_animator_set_mood(MOOD_FOCUSED);
+    body_animator_set_state(DISPLAY_THINKING);
+    body_animator_set_mood(MOOD_FOCUSED);
 #endif
 
-        /* 1. Build system prompt */
-        context_build_system_prompt(system_prompt, MIMI_CONTEXT_BUF_SIZE);
-
-        /* 2. Load session history into cJSON array */
-        session_get_history_json(msg.chat_id, history_json,
-                                 MIMI_LLM_STREAM_BUF_SIZE, MIMI_AGENT_MAX_HISTORY);
-
-        cJSON *messages = cJSON_Parse(history_json);
-        if (!messages) messages = cJSON_CreateArray();
-
-        /* 3. Append current user message */
-        cJSON *user_msg = cJSON_CreateObject();
-        cJSON_AddStringToObject(user_msg, "role", "user");
-        cJSON_AddStringToObject(user_msg, "content", msg.content);
-        cJSON_AddItemToArray(messages, user_msg);
-
-        /* 4. ReAct loop */
-        char *final_text = NULL;
-        int iteration = 0;
-
-        while (iteration < MIMI_AGENT_MAX_TOOL_ITER) {
-            /* Send "working" indicator before each API call */
-            {
-                static const char *working_phrases[] = {
-                    "mimi\xF0\x9F\x98\x97is working...",
-                    "mimi\xF0\x9F\x90\xBE is thinking...",
-                    "mimi\xF0\x9F\x92\xAD is pondering...",
-                    "mimi\xF0\x9F\x8C\x99 is on it...",
-                    "mimi\xE2\x9C\xA8 is cooking...",
-                };
-                const int phrase_count = sizeof(working_phrases) / sizeof(working_phrases[0]);
-                mimi_msg_t status = {0};
-                strncpy(status.channel, msg.channel, sizeof(status.channel) - 1);
-                strncpy(status.chat_id, msg.chat_id, sizeof(status.chat_id) - 1);
-                status.content = strdup(working_phrases[esp_random() % phrase_count]);
-                if (status.content) message_bus_push_outbound(&status);
-            }
+    /* 1. Build system prompt */
+    perf_span_t span = perf_begin(PERF_PROMPT);
+    size_t system_static_len = 0;
+    context_build_system_prompt(w->system_prompt, MIMI_CONTEXT_BUF_SIZE, &system_static_len);
+    append_session_summary(w->system_prompt, MIMI_CONTEXT_BUF_SIZE, msg->chat_id);
+    perf_end(span);
+
+    /* 2. Load session history into cJSON array */
+    span = perf_begin(PERF_HISTORY);
+    session_get_history_json(msg->chat_id, w->history_json,
+                             MIMI_LLM_STREAM_BUF_SIZE, MIMI_AGENT_MAX_HISTORY);
+
+    cJSON *messages = cJSON_Parse(w->history_json);
+    if (!messages) messages = cJSON_CreateArray();
+    perf_end(span);
+
+    /* 3. Append current user message */
+    cJSON *user_msg = cJSON_CreateObject();
+    cJSON_AddStringToObject(user_msg, "role", "user");
+    cJSON_AddStringToObject(user_msg, "content", msg->content);
+    cJSON_AddItemToArray(messages, user_msg);
+
+    /* 4. ReAct loop — each iteration only serializes the messages it appended */
+    char *final_text = NULL;
+    int iteration = 0;
+    int64_t turn_deadline = esp_timer_get_time() + (int64_t)MIMI_AGENT_TURN_BUDGET_MS * 1000;
+    llm_usage_t turn_usage = {0};
+    int turn_calls = 0;
+    bool over_budget = false;
+
+    while (iteration < MIMI_AGENT_MAX_TOOL_ITER) {
+        if (slot->cancel) {
+            cancelled = true;
+            break;
+        }
+        /* Daily token budget, checked before every call so tool loops stop too */
+        if (llm_usage_check(msg->chat_id) != ESP_OK) {
+            over_budget = true;
+            break;
+        }
 
-            llm_response_t resp;
-            err = llm_chat_tools(system_prompt, messages, tools_json, &resp);
+        llm_request_t req = {
+            .system_prompt = w->system_prompt,
+            .system_static_len = system_static_len,
+            .messages = messages,
+            .tools_json = tool_registry_get_tools_json(),
+            .on_delta = on_llm_delta,
+            .cb_ctx = &stream,
+            .body_cache = w->body_cache,
+            .deadline_us = turn_deadline,
+            .cancel = &slot->cancel,
+        };
+        llm_response_t resp;
+        err = llm_chat_request(&req, &resp);
+
+        if (err == ESP_ERR_NOT_FINISHED) {
+            cancelled = true;
+            break;
+        }
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "LLM call failed: %s", esp_err_to_name(err));
+            break;
+        }
 
-            if (err != ESP_OK) {
-                ESP_LOGE(TAG, "LLM call failed: %s", esp_err_to_name(err));
-                break;
+        llm_usage_record(msg->chat_id, &resp.usage);
+        turn_usage.input_tokens += resp.usage.input_tokens;
+        turn_usage.output_tokens += resp.usage.output_tokens;
+        turn_usage.cache_read_tokens += resp.usage.cache_read_tokens;
+        turn_usage.cache_write_tokens += resp.usage.cache_write_tokens;
+        turn_calls++;
+
+        if (!resp.tool_use) {
+            /* Normal completion — save final text and break */
+            if (resp.text && resp.text_len > 0) {
+                final_text = strdup(resp.text);
             }
+            llm_response_free(&resp);
+            break;
+        }
 
-            if (!resp.tool_use) {
-                /* Normal completion — save final text and break */
-                if (resp.text && resp.text_len > 0) {
-                    final_text = strdup(resp.text);
-                }
-                llm_response_free(&resp);
-                break;
-            }
+        ESP_LOGI(TAG, "Tool use iteration %d: %d calls", iteration + 1, resp.call_count);
 
-            ESP_LOGI(TAG, "Tool use iteration %d: %d calls", iteration + 1, resp.call_count);
+        /* Append assistant message with content array */
+        cJSON *asst_msg = cJSON_CreateObject();
+        cJSON_AddStringToObject(asst_msg, "role", "assistant");
+        cJSON_AddItemToObject(asst_msg, "content", build_assistant_content(&resp));
+        cJSON_AddItemToArray(messages, asst_msg);
 
-            /* Append assistant message with content array */
-            cJSON *asst_msg = cJSON_CreateObject();
-            cJSON_AddStringToObject(asst_msg, "role", "assistant");
-            cJSON_AddItemToObject(asst_msg, "content", build_assistant_content(&resp));
-            cJSON_AddItemToArray(messages, asst_msg);
+        /* Execute tools and append results */
+        cJSON *tool_results = build_tool_results(&resp, &w->memo, w->tool_output, MIMI_TOOL_OUTPUT_SIZE);
+        cJSON *result_msg = cJSON_CreateObject();
+        cJSON_AddStringToObject(result_msg, "role", "user");
+        cJSON_AddItemToObject(result_msg, "content", tool_results);
+        cJSON_AddItemToArray(messages, result_msg);
 
-            /* Execute tools and append results */
-            cJSON *tool_results = build_tool_results(&resp, tool_output, TOOL_OUTPUT_SIZE);
-            cJSON *result_msg = cJSON_CreateObject();
-            cJSON_AddStringToObject(result_msg, "role", "user");
-            cJSON_AddItemToObject(result_msg, "content", tool_results);
-            cJSON_AddItemToArray(messages, result_msg);
+        llm_response_free(&resp);
+        iteration++;
+    }
 
-            llm_response_free(&resp);
-            iteration++;
-        }
+    cJSON_Delete(messages);
+    llm_body_cache_reset(w->body_cache);   /* its fragments point into messages */
 
-        cJSON_Delete(messages);
+    if (turn_calls > 0) {
+        ESP_LOGI(TAG, "Turn usage (%s, %d calls): in=%u out=%u cache_read=%u cache_write=%u",
+                 msg->chat_id, turn_calls,
+                 (unsigned)turn_usage.input_tokens, (unsigned)turn_usage.output_tokens,
+                 (unsigned)turn_usage.cache_read_tokens, (unsigned)turn_usage.cache_write_tokens);
+        llm_usage_end_turn(msg->chat_id);
+    }
 
-        /* 5. Send response */
-        if (final_text && final_text[0]) {
-            /* Save to session (only user text + final assistant text) */
-            session_append(msg.chat_id, "user", msg.content);
-            session_append(msg.chat_id, "assistant", final_text);
+    /* 5. Send response */
+    bool replied = final_text && final_text[0];
+    if (replied) {
+        /* Save to session (only user text + final assistant text) */
+        span = perf_begin(PERF_SESSION_SAVE);
+        session_append(msg->chat_id, "user", msg->content);
+        session_append(msg->chat_id, "assistant", final_text);
+        perf_end(span);
+        session_compactor_note_turn(msg->chat_id);
 
 #ifdef MIMI_HAS_DISPLAY
-            /* Afficher la reponse + notification banner + mood fier */
-            display_ui_set_message(final_text);
-            display_ui_notify_message();
-            display_ui_set_mood(MOOD_PROUD);
-            display_ui_set_state(DISPLAY_IDLE);
+        /* Afficher la reponse + notification banner + mood fier */
+        display_ui_set_message(final_text);
+        display_ui_notify_message();
+        display_ui_set_mood(MOOD_PROUD);
+        display_ui_set_state(DISPLAY_IDLE);
 #endif
 #ifdef MIMI_HAS_SERVOS
-            body_animator_set_mood(MOOD_PROUD);
-            body_animator_set_state(DISPLAY_IDLE);
+        body_animator_set_mood(MOOD_PROUD);
+        body_animator_set_state(DISPLAY_IDLE);
 #endif
 
-            /* Push response to outbound */
-            mimi_msg_t out = {0};
-            strncpy(out.channel, msg.channel, sizeof(out.channel) - 1);
-            strncpy(out.chat_id, msg.chat_id, sizeof(out.chat_id) - 1);
-            out.content = final_text;  /* transfer ownership */
+        /* Push response to outbound */
+        mimi_msg_t out = {0};
+        strncpy(out.channel, msg->channel, sizeof(out.channel) - 1);
+        strncpy(out.chat_id, msg->chat_id, sizeof(out.chat_id) - 1);
+        out.content = final_text;  /* transfer ownership */
+        message_bus_push_outbound(&out);
+    } else if (cancelled) {
+        ESP_LOGI(TAG, "[%d] Turn for %s cancelled after %d calls", w->id, msg->chat_id, turn_calls);
+        free(final_text);
+        /* The rerun (or nothing, after /stop) replaces what was streamed */
+        if (stream.streamed) ws_server_send_reset(msg->chat_id);
+#ifdef MIMI_HAS_DISPLAY
+        display_ui_set_state(DISPLAY_IDLE);
+#endif
+#ifdef MIMI_HAS_SERVOS
+        body_animator_set_state(DISPLAY_IDLE);
+#endif
+    } else {
+        /* Error or empty response */
+        free(final_text);
+        mimi_msg_t out = {0};
+        strncpy(out.channel, msg->channel, sizeof(out.channel) - 1);
+        strncpy(out.chat_id, msg->chat_id, sizeof(out.chat_id) - 1);
+        out.content = strdup(over_budget
+            ? "This chat has used its daily token budget. It resets at midnight UTC."
+            : err == ESP_ERR_TIMEOUT
+            ? "The AI service is busy right now, please try again in a minute."
+            : "Sorry, I encountered an error.");
+        if (out.content) {
             message_bus_push_outbound(&out);
-        } else {
-            /* Error or empty response */
-            free(final_text);
-            mimi_msg_t out = {0};
-            strncpy(out.channel, msg.channel, sizeof(out.channel) - 1);
-            strncpy(out.chat_id, msg.chat_id, sizeof(out.chat_id) - 1);
-            out.content = strdup("Sorry, I encountered an error.");
-            if (out.content) {
-                message_bus_push_outbound(&out);
-            }
+        }
 #ifdef MIMI_HAS_DISPLAY
-            display_ui_set_state(DISPLAY_IDLE);
+        display_ui_set_state(DISPLAY_IDLE);
 #endif
 #ifdef MIMI_HAS_SERVOS
-            body_animator_set_state(DISPLAY_IDLE);
-            body_animator_set_mood(MOOD_NEUTRAL);
+        body_animator_set_state(DISPLAY_IDLE);
+        body_animator_set_mood(MOOD_NEUTRAL);
 #endif
+    }
+    message_bus_set_activity(msg->channel, msg->chat_id, false);
+    perf_end(turn_span);
+
+    /* Log memory status */
+    ESP_LOGI(TAG, "Free PSRAM: %d bytes",
+             (int)heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
+    return cancelled && !replied;
+}
+
+/* ── Per-chat ordering ────────────────────────────────────────── */
+
+/* Pop + claim by one worker at a time: two messages of a chat popped by two
+ * workers could otherwise be claimed in the wrong order */
+static SemaphoreHandle_t s_pop_lock = NULL;
+
+/* s_sched_lock held */
+static chat_slot_t *slot_of_chat(const char *chat_id)
+{
+    for (int i = 0; i < MIMI_AGENT_WORKERS; i++) {
+        if (s_slots[i].chat_id[0] && strcmp(s_slots[i].chat_id, chat_id) == 0) return &s_slots[i];
+    }
+    return NULL;
+}
+
+/* "<a>\n\n<b>" on the heap, NULL if out of memory */
+static char *join_messages(const char *a, const char *b)
+{
+    size_t la = strlen(a), lb = strlen(b);
+    char *j = malloc(la + lb + 3);
+    if (!j) return NULL;
+    memcpy(j, a, la);
+    memcpy(j + la, "\n\n", 2);
+    memcpy(j + la + 2, b, lb + 1);
+    return j;
+}
+
+/* Behind a running turn: merged into the last parked message when it comes
+ * from the same channel (none of them has started yet), else parked as is.
+ * s_sched_lock held. */
+static bool park_message(chat_slot_t *busy, mimi_msg_t *msg)
+{
+    if (busy->backlog_count > 0) {
+        mimi_msg_t *last = &busy->backlog[busy->backlog_count - 1];
+        char *joined = (strcmp(last->channel, msg->channel) == 0)
+                       ? join_messages(last->content, msg->content) : NULL;
+        if (joined) {
+            free(last->content);
+            last->content = joined;
+            free(msg->content);
+            msg->content = NULL;
+            return true;
+        }
+    }
+    if (busy->backlog_count >= MIMI_AGENT_CHAT_BACKLOG) return false;
+    busy->backlog[busy->backlog_count++] = *msg;
+    msg->content = NULL;
+    return true;
+}
+
+/* Record a message of chat_id arriving at now_us.
+ * @return true if the chat's previous one came less than MIMI_AGENT_BURST_MS before.
+ * s_sched_lock held. */
+static bool note_arrival(const char *chat_id, int64_t now_us)
+{
+    chat_arrival_t *e = &s_arrivals[0];
+    for (int i = 0; i < MIMI_AGENT_WORKERS * 2; i++) {
+        chat_arrival_t *a = &s_arrivals[i];
+        if (strcmp(a->chat_id, chat_id) == 0) {
+            e = a;
+            break;
         }
+        if (a->at_us < e->at_us) e = a;     /* else reuse the oldest */
+    }
+    bool burst = strcmp(e->chat_id, chat_id) == 0
+                 && now_us - e->at_us < (int64_t)MIMI_AGENT_BURST_MS * 1000;
+    snprintf(e->chat_id, sizeof(e->chat_id), "%s", chat_id);
+    e->at_us = now_us;
+    return burst;
+}
+
+/* true: w now holds msg's chat and runs it; false: msg was handed over */
+static bool sched_claim(agent_worker_t *w, mimi_msg_t *msg)
+{
+    bool claimed = false;
+    xSemaphoreTake(s_sched_lock, portMAX_DELAY);
+    s_last_active_us = esp_timer_get_time();
+    bool burst = note_arrival(msg->chat_id, s_last_active_us);
+    chat_slot_t *busy = slot_of_chat(msg->chat_id);
+    if (!busy) {
+        chat_slot_t *own = &s_slots[w->id];
+        snprintf(own->chat_id, sizeof(own->chat_id), "%s", msg->chat_id);
+        own->cancel = false;
+        own->stop = false;
+        own->burst = burst;
+        claimed = true;
+    } else if (park_message(busy, msg)) {
+        /* A compaction always yields: it is retried at the next idle spell */
+        if (MIMI_AGENT_PREEMPT || busy->compacting) busy->cancel = true;
+    }
+    xSemaphoreGive(s_sched_lock);
+
+    if (!claimed && msg->content) {
+        ESP_LOGW(TAG, "Chat %s backlog full, dropping message", msg->chat_id);
+        free(msg->content);
+    }
+    return claimed;
+}
 
-        /* Free inbound message content */
-        free(msg.content);
+/* Next parked message of w's chat into msg, or release the chat.
+ * carry: content of a preempted turn, put in front of that next message. */
+static bool sched_next(agent_worker_t *w, mimi_msg_t *msg, char *carry)
+{
+    chat_slot_t *slot = &s_slots[w->id];
+    bool more = false;
+    xSemaphoreTake(s_sched_lock, portMAX_DELAY);
+    if (slot->stop) {
+        free(carry);        /* /stop: the cancelled turn is dropped */
+        carry = NULL;
+        tool_memo_clear(&w->memo);
+    }
+    if (slot->backlog_count > 0) {
+        *msg = slot->backlog[0];
+        memmove(&slot->backlog[0], &slot->backlog[1],
+                (--slot->backlog_count) * sizeof(slot->backlog[0]));
+        more = true;
+    } else {
+        slot->chat_id[0] = '\0';
+        s_last_active_us = esp_timer_get_time();
+    }
+    slot->cancel = false;
+    slot->stop = false;
+    xSemaphoreGive(s_sched_lock);
+
+    if (carry && more) {
+        char *joined = join_messages(carry, msg->content);
+        if (joined) {
+            free(msg->content);
+            msg->content = joined;
+        }
+    }
+    free(carry);
+    return more;
+}
 
-        /* Log memory status */
-        ESP_LOGI(TAG, "Free PSRAM: %d bytes",
-                 (int)heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
+/* Coalescing window before a chat's first turn: a burst of short messages
+ * becomes one turn. What the other workers pop for the chat meanwhile is
+ * parked, then folded into msg. Only taken when the chat is in a burst, so
+ * a lone message starts at once; skipped too when no other worker is idle,
+ * as nobody would pop them (they still preempt the turn once it runs). */
+static void sched_coalesce(agent_worker_t *w, mimi_msg_t *msg)
+{
+    if (MIMI_AGENT_COALESCE_MS <= 0) return;
+    chat_slot_t *slot = &s_slots[w->id];
+
+    int idle = 0;
+    xSemaphoreTake(s_sched_lock, portMAX_DELAY);
+    bool burst = slot->burst;
+    for (int i = 0; i < s_worker_count; i++) {
+        if (i != w->id && !s_slots[i].chat_id[0]) idle++;
     }
+    xSemaphoreGive(s_sched_lock);
+    if (!burst || !idle) return;
+
+    vTaskDelay(pdMS_TO_TICKS(MIMI_AGENT_COALESCE_MS));
+
+    int merged = 0;
+    xSemaphoreTake(s_sched_lock, portMAX_DELAY);
+    while (slot->backlog_count > 0 && strcmp(slot->backlog[0].channel, msg->channel) == 0) {
+        char *joined = join_messages(msg->content, slot->backlog[0].content);
+        if (!joined) break;
+        free(msg->content);
+        free(slot->backlog[0].content);
+        msg->content = joined;
+        memmove(&slot->backlog[0], &slot->backlog[1],
+                (--slot->backlog_count) * sizeof(slot->backlog[0]));
+        merged++;
+    }
+    if (!slot->stop) slot->cancel = false;  /* set by parking, but nothing had started */
+    xSemaphoreGive(s_sched_lock);
+
+    if (merged) ESP_LOGI(TAG, "[%d] Coalesced %d messages for %s", w->id, merged + 1, msg->chat_id);
+}
+
+/* Turns for msg's chat until its backlog is empty; frees the contents */
+static void run_chat(agent_worker_t *w, mimi_msg_t *msg)
+{
+    bool more;
+    sched_coalesce(w, msg);
+    do {
+        bool preempted = run_turn(w, msg);
+        char *carry = msg->content;
+        if (!preempted) {
+            free(carry);
+            carry = NULL;
+            tool_memo_clear(&w->memo);
+        }
+        more = sched_next(w, msg, carry);
+    } while (more);
+}
+
+bool agent_loop_cancel(const char *chat_id)
+{
+    if (!s_sched_lock) return false;
+    xSemaphoreTake(s_sched_lock, portMAX_DELAY);
+    chat_slot_t *slot = slot_of_chat(chat_id);
+    bool stopped = false;
+    if (slot) {
+        /* A compaction is no reply to stop and keeps running; only the
+         * messages parked behind it are dropped */
+        stopped = !slot->compacting || slot->backlog_count > 0;
+        if (!slot->compacting) {
+            slot->cancel = true;
+            slot->stop = true;
+        }
+        for (int i = 0; i < slot->backlog_count; i++) free(slot->backlog[i].content);
+        slot->backlog_count = 0;
+    }
+    xSemaphoreGive(s_sched_lock);
+
+    if (stopped) ESP_LOGI(TAG, "Turn for %s stopped on request", chat_id);
+    return stopped;
+}
+
+/* Idle worker: compact a queued session, holding its chat like a turn */
+static void run_compaction(agent_worker_t *w)
+{
+    char chat_id[32];
+    if (!session_compactor_take(chat_id, sizeof(chat_id))) return;
+
+    xSemaphoreTake(s_sched_lock, portMAX_DELAY);
+    bool busy = slot_of_chat(chat_id) != NULL;
+    if (!busy) {
+        snprintf(s_slots[w->id].chat_id, sizeof(s_slots[0].chat_id), "%s", chat_id);
+        s_slots[w->id].cancel = false;
+        s_slots[w->id].stop = false;
+        s_slots[w->id].compacting = true;
+    }
+    xSemaphoreGive(s_sched_lock);
+    if (busy) {
+        /* A turn of that chat started meanwhile: try again at the next idle spell */
+        session_compactor_requeue(chat_id);
+        return;
+    }
+
+    if (session_compactor_run(chat_id, &s_slots[w->id].cancel) == ESP_ERR_NOT_FINISHED) {
+        ESP_LOGI(TAG, "[%d] Compaction of %s yields to a new message", w->id, chat_id);
+        session_compactor_requeue(chat_id);
+    }
+    xSemaphoreTake(s_sched_lock, portMAX_DELAY);
+    s_slots[w->id].compacting = false;
+    xSemaphoreGive(s_sched_lock);
+
+    mimi_msg_t msg;
+    if (sched_next(w, &msg, NULL)) run_chat(w, &msg);
+}
+
+static void agent_worker_task(void *arg)
+{
+    agent_worker_t *w = (agent_worker_t *)arg;
+    ESP_LOGI(TAG, "Agent worker %d started on core %d", w->id, xPortGetCoreID());
+
+    while (1) {
+        mimi_msg_t msg;
+        xSemaphoreTake(s_pop_lock, portMAX_DELAY);
+        /* Bounded wait: the lock changes hands regularly, so a compaction
+         * queued by a turn that ended meanwhile is seen by an idle worker */
+        esp_err_t err = message_bus_pop_inbound(&msg, MIMI_AGENT_POP_POLL_MS);
+        bool claimed = (err == ESP_OK) && sched_claim(w, &msg);
+        xSemaphoreGive(s_pop_lock);
+
+        if (err == ESP_ERR_TIMEOUT) {
+            /* No message for a while with a large session queued: compact it now */
+            xSemaphoreTake(s_sched_lock, portMAX_DELAY);
+            bool idle = esp_timer_get_time() - s_last_active_us >=
+                        (int64_t)MIMI_SESSION_COMPACT_IDLE_MS * 1000;
+            xSemaphoreGive(s_sched_lock);
+            if (idle && session_compactor_pending()) run_compaction(w);
+            continue;
+        }
+        if (claimed) run_chat(w, &msg);
+    }
+}
+
+static bool worker_alloc(agent_worker_t *w)
+{
+    /* Allocate large buffers from PSRAM */
+    w->system_prompt = heap_caps_calloc(1, MIMI_CONTEXT_BUF_SIZE, MALLOC_CAP_SPIRAM);
+    w->history_json = heap_caps_calloc(1, MIMI_LLM_STREAM_BUF_SIZE, MALLOC_CAP_SPIRAM);
+    w->tool_output = heap_caps_calloc(1, MIMI_TOOL_OUTPUT_SIZE, MALLOC_CAP_SPIRAM);
+    w->body_cache = llm_body_cache_create();
+    if (w->system_prompt && w->history_json && w->tool_output && w->body_cache) return true;
+
+    free(w->system_prompt);
+    free(w->history_json);
+    free(w->tool_output);
+    if (w->body_cache) llm_body_cache_free(w->body_cache);
+    return false;
 }
 
 esp_err_t agent_loop_init(void)
 {
+    s_sched_lock = xSemaphoreCreateMutex();
+    s_pop_lock = xSemaphoreCreateMutex();
+    if (!s_sched_lock || !s_pop_lock) return ESP_ERR_NO_MEM;
+    esp_err_t err = session_compactor_init();
+    if (err != ESP_OK) return err;
+
     ESP_LOGI(TAG, "Agent loop initialized");
     return ESP_OK;
 }
 
 esp_err_t agent_loop_start(void)
 {
-    BaseType_t ret = xTaskCreatePinnedToCore(
-        agent_loop_task, "agent_loop",
-        MIMI_AGENT_STACK, NULL,
-        MIMI_AGENT_PRIO, NULL, MIMI_AGENT_CORE);
+    /* As many workers as PSRAM allows, keeping a reserve for responses and sessions */
+    const size_t per_worker = MIMI_CONTEXT_BUF_SIZE + MIMI_LLM_STREAM_BUF_SIZE +
+                              MIMI_TOOL_OUTPUT_SIZE;
+    for (int i = 0; i < MIMI_AGENT_WORKERS; i++) {
+        if (i > 0 && heap_caps_get_free_size(MALLOC_CAP_SPIRAM) <
+                     per_worker + MIMI_AGENT_PSRAM_RESERVE) {
+            break;
+        }
+        agent_worker_t *w = &s_workers[i];
+        w->id = i;
+        if (!worker_alloc(w)) {
+            ESP_LOGE(TAG, "Failed to allocate PSRAM buffers for worker %d", i);
+            break;
+        }
+
+        char name[16];
+        snprintf(name, sizeof(name), "agent_%d", i);
+        if (xTaskCreatePinnedToCore(agent_worker_task, name, MIMI_AGENT_STACK, w,
+                                    MIMI_AGENT_PRIO, NULL, MIMI_AGENT_CORE) != pdPASS) {
+            break;
+        }
+        s_worker_count = i + 1;
+    }
 
-    return (ret == pdPASS) ? ESP_OK : ESP_FAIL;
+    ESP_LOGI(TAG, "%d agent worker(s) started", s_worker_count);
+    return (s_worker_count > 0) ? ESP_OK : ESP_FAIL;
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "esp_err.h"
+#include <stdbool.h>
 
 /**
  * Initialize the agent loop.
@@ -8,7 +9,17 @@
 esp_err_t agent_loop_init(void);
 
 /**
- * Start the agent loop task (runs on Core 1).
- * Consumes from inbound queue, calls Claude API, pushes to outbound queue.
+ * Start the agent worker tasks (Core 1), as many as PSRAM allows up to
+ * MIMI_AGENT_WORKERS. They consume from the inbound queue, one turn per chat
+ * at a time, call the LLM and push to the outbound queue.
  */
 esp_err_t agent_loop_start(void);
+
+/**
+ * Stop chat_id's running turn (at its next check, within
+ * MIMI_HTTP_CANCEL_POLL_MS while an LLM call connects or waits) and drop its
+ * queued messages; nothing is replied or saved for them. A session compaction
+ * holding the chat is not stopped.
+ * @return false if there was neither a turn nor a queued message to stop
+ */
+bool agent_loop_cancel(const char *chat_id);
@@ -6,33 +6,150 @@
 #endif
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "esp_log.h"
+#include "esp_heap_caps.h"
 #include "cJSON.h"
 
 static const char *TAG = "context";
 
-static size_t append_file(char *buf, size_t size, size_t offset, const char *path, const char *header)
+/* ── Section cache ────────────────────────────────────────────── */
+
+/* The prompt files stay in PSRAM between turns with a fingerprint of their
+ * content; a section is reread only after context_invalidate() bumped its
+ * generation (a write from a tool or the memory store) or, for the recent
+ * notes, when the day changes. The stable prefix is reassembled only when a
+ * fingerprint actually changed, so it stays byte-identical across turns. */
+typedef enum {
+    SEC_SOUL = 0,
+    SEC_USER,
+    SEC_MEMORY,
+    SEC_RECENT,         /* last 3 daily notes, after the stable prefix */
+    SEC_COUNT
+} section_id_t;
+
+typedef struct {
+    char    *text;          /* PSRAM, NULL when missing or empty */
+    size_t   len;
+    bool     present;       /* file exists (SOUL / USER get a header even if empty) */
+    uint32_t fp;            /* FNV-1a of text */
+    uint32_t gen;           /* bumped by context_invalidate() */
+    uint32_t loaded_gen;    /* gen the text was read at */
+    bool     loaded;
+} section_t;
+
+static section_t s_sections[SEC_COUNT];
+static char s_recent_date[16];          /* day the recent notes were read on */
+static char *s_scratch = NULL;          /* PSRAM, MIMI_CONTEXT_BUF_SIZE: section reads */
+static char *s_prefix = NULL;           /* PSRAM, MIMI_CONTEXT_BUF_SIZE: assembled stable prefix */
+static size_t s_prefix_len = 0;
+static uint32_t s_prefix_fp = 0;        /* fingerprint of the sections it was built from */
+static uint32_t s_prefix_gen = 0;       /* times it was reassembled */
+static SemaphoreHandle_t s_lock = NULL; /* shared by the agent workers and the writers */
+
+static uint32_t fnv1a(uint32_t h, const void *data, size_t len)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static void today_str(char *buf, size_t size)
+{
+    time_t now;
+    time(&now);
+    struct tm tm;
+    localtime_r(&now, &tm);
+    strftime(buf, size, "%Y-%m-%d", &tm);
+}
+
+/* Section content into s_scratch. @return its length; *present: file found */
+static size_t read_section(section_id_t id, bool *present)
 {
-    FILE *f = fopen(path, "r");
-    if (!f) return offset;
+    const size_t cap = MIMI_CONTEXT_BUF_SIZE;
+    s_scratch[0] = '\0';
+    *present = true;
 
-    if (header && offset < size - 1) {
-        offset += snprintf(buf + offset, size - offset, "\n## %s\n\n", header);
+    switch (id) {
+    case SEC_SOUL:
+    case SEC_USER: {
+        FILE *f = fopen(id == SEC_SOUL ? MIMI_SOUL_FILE : MIMI_USER_FILE, "r");
+        if (!f) {
+            *present = false;
+            return 0;
+        }
+        size_t n = fread(s_scratch, 1, cap - 1, f);
+        s_scratch[n] = '\0';
+        fclose(f);
+        return n;
     }
+    case SEC_MEMORY:
+        /* Same 4 KB cap as before the cache */
+        if (memory_read_long_term(s_scratch, 4096) != ESP_OK) {
+            *present = false;
+            s_scratch[0] = '\0';
+        }
+        return strlen(s_scratch);
+    case SEC_RECENT:
+        memory_read_recent(s_scratch, 4096, 3);
+        return strlen(s_scratch);
+    default:
+        return 0;
+    }
+}
+
+/* Reread the section if it was invalidated. @return true if its content changed */
+static bool section_refresh(section_id_t id)
+{
+    section_t *sec = &s_sections[id];
+    bool day_changed = false;
+    if (id == SEC_RECENT) {
+        char today[16];
+        today_str(today, sizeof(today));
+        day_changed = strcmp(today, s_recent_date) != 0;
+        if (day_changed) memcpy(s_recent_date, today, sizeof(today));
+    }
+    if (sec->loaded && sec->loaded_gen == sec->gen && !day_changed) return false;
 
-    size_t n = fread(buf + offset, 1, size - offset - 1, f);
-    offset += n;
-    buf[offset] = '\0';
-    fclose(f);
-    return offset;
+    bool present;
+    size_t len = read_section(id, &present);
+    uint32_t fp = fnv1a(2166136261u, s_scratch, len);
+    sec->loaded = true;
+    sec->loaded_gen = sec->gen;
+    if (sec->present == present && sec->len == len && sec->fp == fp) return false;
+
+    free(sec->text);
+    sec->text = NULL;
+    sec->len = 0;
+    if (len) {
+        sec->text = heap_caps_malloc(len + 1, MALLOC_CAP_SPIRAM);
+        if (!sec->text) {
+            ESP_LOGW(TAG, "No memory for prompt section %d", (int)id);
+            sec->loaded = false;        /* retried next turn */
+            len = 0;
+        } else {
+            memcpy(sec->text, s_scratch, len + 1);
+        }
+    }
+    sec->len = len;
+    sec->present = present;
+    sec->fp = fp;
+    return true;
 }
 
-esp_err_t context_build_system_prompt(char *buf, size_t size)
+/* Preamble + personality + user info + long-term memory into s_prefix */
+static void assemble_prefix(void)
 {
     size_t off = 0;
 
-    off += snprintf(buf + off, size - off,
+    off += snprintf(s_prefix + off, MIMI_CONTEXT_BUF_SIZE - off,
         "# MimiClaw\n\n"
         "You are MimiClaw, a personal AI assistant running on an ESP32-S3 device.\n"
         "You communicate through Telegram and WebSocket.\n"
@@ -87,31 +204,120 @@ esp_err_t context_build_system_prompt(char *buf, size_t size)
         "- You should proactively save memory without being asked. If the user tells you their name, preferences, or important facts, persist them immediately.\n");
 
     /* Bootstrap files */
-    off = append_file(buf, size, off, MIMI_SOUL_FILE, "Personality");
-    off = append_file(buf, size, off, MIMI_USER_FILE, "User Info");
+    static const char *const headers[] = { [SEC_SOUL] = "Personality", [SEC_USER] = "User Info" };
+    for (int id = SEC_SOUL; id <= SEC_USER; id++) {
+        const section_t *sec = &s_sections[id];
+        if (!sec->present || off >= MIMI_CONTEXT_BUF_SIZE - 1) continue;
+        off += snprintf(s_prefix + off, MIMI_CONTEXT_BUF_SIZE - off, "\n## %s\n\n%s",
+                        headers[id], sec->text ? sec->text : "");
+    }
 
     /* Long-term memory */
-    char mem_buf[4096];
-    if (memory_read_long_term(mem_buf, sizeof(mem_buf)) == ESP_OK && mem_buf[0]) {
-        off += snprintf(buf + off, size - off, "\n## Long-term Memory\n\n%s\n", mem_buf);
+    const section_t *mem = &s_sections[SEC_MEMORY];
+    if (mem->len && off < MIMI_CONTEXT_BUF_SIZE - 1) {
+        off += snprintf(s_prefix + off, MIMI_CONTEXT_BUF_SIZE - off,
+                        "\n## Long-term Memory\n\n%s\n", mem->text);
+    }
+
+    if (off > MIMI_CONTEXT_BUF_SIZE - 1) off = MIMI_CONTEXT_BUF_SIZE - 1;
+    s_prefix_len = off;
+    s_prefix_gen++;
+}
+
+esp_err_t context_builder_init(void)
+{
+    s_scratch = heap_caps_calloc(1, MIMI_CONTEXT_BUF_SIZE, MALLOC_CAP_SPIRAM);
+    s_prefix = heap_caps_calloc(1, MIMI_CONTEXT_BUF_SIZE, MALLOC_CAP_SPIRAM);
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_scratch || !s_prefix || !s_lock) {
+        ESP_LOGE(TAG, "Failed to allocate the prompt cache");
+        return ESP_ERR_NO_MEM;
     }
+    ESP_LOGI(TAG, "Context builder initialized");
+    return ESP_OK;
+}
+
+void context_invalidate(const char *path)
+{
+    if (!s_lock) return;
+    static const size_t dir_len = sizeof(MIMI_SPIFFS_MEMORY_DIR) - 1;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int id = 0; id < SEC_COUNT; id++) {
+        bool hit = !path;
+        if (path) {
+            switch (id) {
+            case SEC_SOUL:   hit = strcmp(path, MIMI_SOUL_FILE) == 0; break;
+            case SEC_USER:   hit = strcmp(path, MIMI_USER_FILE) == 0; break;
+            case SEC_MEMORY: hit = strcmp(path, MIMI_MEMORY_FILE) == 0; break;
+            case SEC_RECENT:
+                hit = strncmp(path, MIMI_SPIFFS_MEMORY_DIR, dir_len) == 0 && path[dir_len] == '/' &&
+                      strcmp(path, MIMI_MEMORY_FILE) != 0;
+                break;
+            }
+        }
+        if (hit) s_sections[id].gen++;
+    }
+    xSemaphoreGive(s_lock);
+}
+
+uint32_t context_prefix_fingerprint(void)
+{
+    if (!s_lock) return 0;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    uint32_t fp = s_prefix_fp;
+    xSemaphoreGive(s_lock);
+    return fp;
+}
+
+esp_err_t context_build_system_prompt(char *buf, size_t size, size_t *static_len)
+{
+    if (!s_lock) return ESP_ERR_INVALID_STATE;
+    size_t off;
+    int reloaded = 0;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int id = 0; id < SEC_COUNT; id++) {
+        if (section_refresh((section_id_t)id)) reloaded++;
+    }
+
+    /* Stable prefix: reassembled only if one of its sections changed */
+    uint32_t fp = 2166136261u;
+    for (int id = SEC_SOUL; id <= SEC_MEMORY; id++) {
+        fp = fnv1a(fp, &s_sections[id].fp, sizeof(uint32_t));
+        fp = fnv1a(fp, &s_sections[id].present, sizeof(bool));
+    }
+    if (!s_prefix_len || fp != s_prefix_fp) {
+        assemble_prefix();
+        s_prefix_fp = fp;
+    }
+    off = s_prefix_len < size - 1 ? s_prefix_len : size - 1;
+    memcpy(buf, s_prefix, off);
+    buf[off] = '\0';
+
+    /* Fin de la partie stable — tout ce qui suit change d'un tour a l'autre */
+    if (static_len) *static_len = off;
 
     /* Recent daily notes (last 3 days) */
-    char recent_buf[4096];
-    if (memory_read_recent(recent_buf, sizeof(recent_buf), 3) == ESP_OK && recent_buf[0]) {
-        off += snprintf(buf + off, size - off, "\n## Recent Notes\n\n%s\n", recent_buf);
+    const section_t *recent = &s_sections[SEC_RECENT];
+    if (recent->len && off < size - 1) {
+        off += snprintf(buf + off, size - off, "\n## Recent Notes\n\n%s\n", recent->text);
     }
+    uint32_t prefix_gen = s_prefix_gen;
+    xSemaphoreGive(s_lock);
 
 #ifdef MIMI_HAS_SERVOS
     /* Perception en temps reel — conscience spatiale */
-    {
+    if (off < size - 1) {
         char percep_buf[512];
         body_animator_build_perception(percep_buf, sizeof(percep_buf));
         off += snprintf(buf + off, size - off, "\n## Current Perception\n\n%s\n", percep_buf);
     }
 #endif
 
-    ESP_LOGI(TAG, "System prompt built: %d bytes", (int)off);
+    if (off > size - 1) off = size - 1;
+    ESP_LOGI(TAG, "System prompt built: %d bytes (%d static, prefix v%u, %d sections reread)",
+             (int)off, static_len ? (int)*static_len : 0, (unsigned)prefix_gen, reloaded);
     return ESP_OK;
 }
 
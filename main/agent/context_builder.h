@@ -2,15 +2,35 @@
 
 #include "esp_err.h"
 #include <stddef.h>
+#include <stdint.h>
+
+/** Allocate the section cache (PSRAM). Call after memory_store_init(). */
+esp_err_t context_builder_init(void);
+
+/**
+ * A file that feeds the system prompt was written: its section is reread
+ * on the next build. Daily notes under MIMI_SPIFFS_MEMORY_DIR invalidate
+ * the recent notes; NULL invalidates everything. Other paths are ignored.
+ */
+void context_invalidate(const char *path);
+
+/** Fingerprint of the current stable prefix (0 before the first build). */
+uint32_t context_prefix_fingerprint(void);
 
 /**
  * Build the system prompt from bootstrap files (SOUL.md, USER.md)
  * and memory context (MEMORY.md + recent daily notes).
  *
- * @param buf   Output buffer (caller allocates, recommend MIMI_CONTEXT_BUF_SIZE)
- * @param size  Buffer size
+ * Sections that rarely change come first; the per-turn parts (recent notes,
+ * perception) are appended last so the leading bytes can be prompt-cached.
+ * The files are cached in PSRAM and only reread after context_invalidate(),
+ * so the stable prefix is byte-identical from one turn to the next.
+ *
+ * @param buf         Output buffer (caller allocates, recommend MIMI_CONTEXT_BUF_SIZE)
+ * @param size        Buffer size
+ * @param static_len  Output: length of the stable prefix of buf (may be NULL)
  */
-esp_err_t context_build_system_prompt(char *buf, size_t size);
+esp_err_t context_build_system_prompt(char *buf, size_t size, size_t *static_len);
 
 /**
  * Build the complete messages JSON array for LLM call.
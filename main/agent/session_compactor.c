@@ -0,0 +1,150 @@
+#include "session_compactor.h"
+#include "mimi_config.h"
+#include "llm/llm_proxy.h"
+#include "llm/llm_usage.h"
+#include "memory/session_mgr.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "cJSON.h"
+
+static const char *TAG = "compactor";
+
+static const char *SUMMARY_SYSTEM_PROMPT =
+    "You maintain the memory of a long chat between a user and an assistant. "
+    "Merge the previous summary and the new messages into one updated summary. "
+    "Keep facts about the user, decisions, open tasks, names, numbers and anything "
+    "the assistant promised; drop greetings and small talk. Write plain text in the "
+    "conversation's language, at most 250 words. Reply with the summary only.";
+
+static char s_pending[MIMI_SESSION_COMPACT_PENDING][32];
+static int s_pending_count = 0;
+static SemaphoreHandle_t s_lock = NULL;    /* s_pending, shared by the agent workers */
+static SemaphoreHandle_t s_commit_lock = NULL;  /* session_commit_compaction's temp files */
+
+esp_err_t session_compactor_init(void)
+{
+    s_lock = xSemaphoreCreateMutex();
+    s_commit_lock = xSemaphoreCreateMutex();
+    return (s_lock && s_commit_lock) ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+/* Append chat_id unless already queued. @return true if added */
+static bool enqueue(const char *chat_id)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    bool queued = false;
+    bool known = false;
+    for (int i = 0; i < s_pending_count && !known; i++) {
+        known = (strcmp(s_pending[i], chat_id) == 0);
+    }
+    if (!known && s_pending_count < MIMI_SESSION_COMPACT_PENDING) {   /* full: next turn will retry */
+        strncpy(s_pending[s_pending_count], chat_id, sizeof(s_pending[0]) - 1);
+        s_pending[s_pending_count][sizeof(s_pending[0]) - 1] = '\0';
+        s_pending_count++;
+        queued = true;
+    }
+    xSemaphoreGive(s_lock);
+    return queued;
+}
+
+void session_compactor_note_turn(const char *chat_id)
+{
+    uint32_t tokens = session_estimate_tokens(chat_id);
+    if (tokens < MIMI_SESSION_COMPACT_TOKENS) return;
+
+    if (enqueue(chat_id)) ESP_LOGI(TAG, "Session %s at ~%u tokens, compaction queued", chat_id, (unsigned)tokens);
+}
+
+void session_compactor_requeue(const char *chat_id)
+{
+    enqueue(chat_id);
+}
+
+bool session_compactor_pending(void)
+{
+    return s_pending_count > 0;
+}
+
+bool session_compactor_take(char *chat_id, size_t size)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    bool found = s_pending_count > 0;
+    if (found) {
+        snprintf(chat_id, size, "%s", s_pending[0]);
+        memmove(&s_pending[0], &s_pending[1], (--s_pending_count) * sizeof(s_pending[0]));
+    }
+    xSemaphoreGive(s_lock);
+    return found;
+}
+
+/* Summarizer input: previous summary + transcript of the older messages */
+static char *build_input(const char *chat_id, const char *transcript)
+{
+    size_t size = MIMI_SESSION_SUMMARY_MAX + strlen(transcript) + 96;
+    char *buf = heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+    if (!buf) return NULL;
+
+    int n = snprintf(buf, size, "Previous summary:\n");
+    if (session_get_summary(chat_id, buf + n, MIMI_SESSION_SUMMARY_MAX) != ESP_OK) {
+        snprintf(buf + n, size - n, "(none)");
+    }
+    n += strlen(buf + n);
+    snprintf(buf + n, size - n, "\n\nNew messages:\n%s", transcript);
+    return buf;
+}
+
+esp_err_t session_compactor_run(const char *chat_id, const volatile bool *cancel)
+{
+    if (llm_usage_check(chat_id) != ESP_OK) return ESP_ERR_INVALID_STATE;
+
+    char *transcript = NULL;
+    esp_err_t err = session_get_compactable(chat_id, MIMI_SESSION_COMPACT_KEEP,
+                                            &transcript, MIMI_SESSION_COMPACT_INPUT);
+    if (err != ESP_OK) return err;
+
+    char *input = build_input(chat_id, transcript);
+    free(transcript);
+    if (!input) return ESP_ERR_NO_MEM;
+
+    cJSON *messages = cJSON_CreateArray();
+    cJSON *msg = cJSON_CreateObject();
+    cJSON_AddStringToObject(msg, "role", "user");
+    cJSON_AddStringToObject(msg, "content", input);
+    cJSON_AddItemToArray(messages, msg);
+    free(input);
+
+    llm_request_t req = {
+        .system_prompt = SUMMARY_SYSTEM_PROMPT,
+        .messages = messages,
+        .cancel = cancel,
+    };
+    llm_response_t resp;
+    err = llm_chat_request(&req, &resp);
+    cJSON_Delete(messages);
+    if (err == ESP_ERR_NOT_FINISHED) return err;
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Summary of %s failed: %s", chat_id, esp_err_to_name(err));
+        return err;
+    }
+    llm_usage_record(chat_id, &resp.usage);
+
+    if (resp.text_len == 0) {
+        llm_response_free(&resp);
+        return ESP_FAIL;
+    }
+    if (resp.text_len >= MIMI_SESSION_SUMMARY_MAX) resp.text[MIMI_SESSION_SUMMARY_MAX - 1] = '\0';
+
+    xSemaphoreTake(s_commit_lock, portMAX_DELAY);
+    err = session_commit_compaction(chat_id, resp.text, MIMI_SESSION_COMPACT_KEEP);
+    xSemaphoreGive(s_commit_lock);
+    ESP_LOGI(TAG, "Session %s: summary %d bytes, now ~%u tokens", chat_id,
+             (int)strlen(resp.text), (unsigned)session_estimate_tokens(chat_id));
+    llm_response_free(&resp);
+    return err;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * Rolling session summaries. After a turn, a chat whose session grew past
+ * MIMI_SESSION_COMPACT_TOKENS is queued; once an agent worker has been idle
+ * for MIMI_SESSION_COMPACT_IDLE_MS its older messages are summarized by the
+ * LLM and replaced by the summary, keeping only a short verbatim tail.
+ * The worker holds the chat like a turn, so it never overlaps one; a message
+ * for the chat cancels the summary, and the chat is queued again.
+ */
+
+esp_err_t session_compactor_init(void);
+
+/** Queue chat_id for compaction if its session is large enough. */
+void session_compactor_note_turn(const char *chat_id);
+
+bool session_compactor_pending(void);
+
+/** Put a taken chat back at the end of the queue (it was busy). */
+void session_compactor_requeue(const char *chat_id);
+
+/** Dequeue the next chat to compact. @return false if none */
+bool session_compactor_take(char *chat_id, size_t size);
+
+/**
+ * Compact chat_id (blocking LLM call).
+ * @param cancel  set to abandon the call, the session is left as it was
+ * @return ESP_ERR_NOT_FINISHED if cancelled
+ */
+esp_err_t session_compactor_run(const char *chat_id, const volatile bool *cancel);
@@ -1,19 +1,38 @@
 #include "message_bus.h"
 #include "mimi_config.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
 #include <string.h>
 
 static const char *TAG = "bus";
 
 static QueueHandle_t s_inbound_queue;
 static QueueHandle_t s_outbound_queue;
+static EventGroupHandle_t s_outbound_event;     /* BUS_OUTBOUND_BIT: reply queued or presence changed */
+
+#define BUS_OUTBOUND_BIT    BIT0
+
+typedef struct {
+    char    channel[16];
+    char    chat_id[32];        /* "" when free */
+    bool    busy;
+    bool    changed;            /* not shown yet */
+    int64_t next_us;            /* busy: next refresh */
+} activity_t;
+
+static activity_t s_activity[MIMI_BUS_ACTIVITY_SLOTS];
+static SemaphoreHandle_t s_activity_lock;
 
 esp_err_t message_bus_init(void)
 {
     s_inbound_queue = xQueueCreate(MIMI_BUS_QUEUE_LEN, sizeof(mimi_msg_t));
     s_outbound_queue = xQueueCreate(MIMI_BUS_QUEUE_LEN, sizeof(mimi_msg_t));
+    s_activity_lock = xSemaphoreCreateMutex();
+    s_outbound_event = xEventGroupCreate();
 
-    if (!s_inbound_queue || !s_outbound_queue) {
+    if (!s_inbound_queue || !s_outbound_queue || !s_activity_lock || !s_outbound_event) {
         ESP_LOGE(TAG, "Failed to create message queues");
         return ESP_ERR_NO_MEM;
     }
@@ -46,6 +65,7 @@ esp_err_t message_bus_push_outbound(const mimi_msg_t *msg)
         ESP_LOGW(TAG, "Outbound queue full, dropping message");
         return ESP_ERR_NO_MEM;
     }
+    xEventGroupSetBits(s_outbound_event, BUS_OUTBOUND_BIT);
     return ESP_OK;
 }
 
@@ -57,3 +77,78 @@ esp_err_t message_bus_pop_outbound(mimi_msg_t *msg, uint32_t timeout_ms)
     }
     return ESP_OK;
 }
+
+void message_bus_wait_outbound(uint32_t timeout_ms)
+{
+    TickType_t ticks = (timeout_ms == UINT32_MAX) ? portMAX_DELAY : pdMS_TO_TICKS(timeout_ms);
+    xEventGroupWaitBits(s_outbound_event, BUS_OUTBOUND_BIT, pdTRUE, pdFALSE, ticks);
+}
+
+/* ── Presence ─────────────────────────────────────────────────── */
+
+esp_err_t message_bus_set_activity(const char *channel, const char *chat_id, bool busy)
+{
+    activity_t *e = NULL, *free_e = NULL;
+    xSemaphoreTake(s_activity_lock, portMAX_DELAY);
+    for (int i = 0; i < MIMI_BUS_ACTIVITY_SLOTS; i++) {
+        activity_t *a = &s_activity[i];
+        if (!a->chat_id[0]) {
+            if (!free_e) free_e = a;
+        } else if (strcmp(a->chat_id, chat_id) == 0 && strcmp(a->channel, channel) == 0) {
+            e = a;
+            break;
+        }
+    }
+    if (!e && busy && free_e) {
+        e = free_e;
+        strncpy(e->channel, channel, sizeof(e->channel) - 1);
+        e->channel[sizeof(e->channel) - 1] = '\0';
+        strncpy(e->chat_id, chat_id, sizeof(e->chat_id) - 1);
+        e->chat_id[sizeof(e->chat_id) - 1] = '\0';
+    }
+    if (e) {
+        e->busy = busy;
+        e->changed = true;
+    }
+    xSemaphoreGive(s_activity_lock);
+
+    if (!e) {
+        if (busy) ESP_LOGW(TAG, "Activity table full, no typing indicator for %s", chat_id);
+        return busy ? ESP_ERR_NO_MEM : ESP_OK;
+    }
+
+    /* Wake the dispatcher without taking a slot of the outbound queue */
+    xEventGroupSetBits(s_outbound_event, BUS_OUTBOUND_BIT);
+    return ESP_OK;
+}
+
+bool message_bus_next_activity(mimi_msg_t *out, bool *busy, uint32_t *wait_ms)
+{
+    int64_t now = esp_timer_get_time();
+    int64_t next = INT64_MAX;
+    bool found = false;
+
+    xSemaphoreTake(s_activity_lock, portMAX_DELAY);
+    for (int i = 0; i < MIMI_BUS_ACTIVITY_SLOTS && !found; i++) {
+        activity_t *a = &s_activity[i];
+        if (!a->chat_id[0]) continue;
+        if (a->changed || (a->busy && now >= a->next_us)) {
+            memset(out, 0, sizeof(*out));
+            memcpy(out->channel, a->channel, sizeof(out->channel));
+            memcpy(out->chat_id, a->chat_id, sizeof(out->chat_id));
+            *busy = a->busy;
+            a->changed = false;
+            a->next_us = now + (int64_t)MIMI_TYPING_REFRESH_MS * 1000;
+            if (!a->busy) a->chat_id[0] = '\0';
+            found = true;
+        } else if (a->busy && a->next_us < next) {
+            next = a->next_us;
+        }
+    }
+    xSemaphoreGive(s_activity_lock);
+
+    if (!found) {
+        *wait_ms = (next == INT64_MAX) ? UINT32_MAX : (uint32_t)((next - now) / 1000 + 1);
+    }
+    return found;
+}
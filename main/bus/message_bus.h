@@ -1,6 +1,7 @@
 #pragma once
 
 #include "esp_err.h"
+#include <stdbool.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
 
@@ -44,3 +45,26 @@ esp_err_t message_bus_push_outbound(const mimi_msg_t *msg);
  * Caller must free msg->content when done.
  */
 esp_err_t message_bus_pop_outbound(mimi_msg_t *msg, uint32_t timeout_ms);
+
+/**
+ * Block until a message was pushed outbound or a presence changed since the
+ * last call, or timeout_ms (UINT32_MAX: forever) passed. For the dispatcher,
+ * which then drains both without blocking.
+ */
+void message_bus_wait_outbound(uint32_t timeout_ms);
+
+/*
+ * Presence: whether the agent is working on a chat. Not queued as messages:
+ * one entry per chat, which the outbound dispatcher turns into a typing
+ * indicator, refreshed every MIMI_TYPING_REFRESH_MS while the chat stays busy.
+ * A change wakes the dispatcher (message_bus_wait_outbound) through an event
+ * group bit, so it never takes a slot of the outbound queue.
+ */
+esp_err_t message_bus_set_activity(const char *channel, const char *chat_id, bool busy);
+
+/**
+ * Take the next presence change or refresh that is due (out->content is NULL).
+ * @param wait_ms  set when none is due: time until the next refresh, UINT32_MAX if none
+ * @return true with *busy set, false if nothing is due
+ */
+bool message_bus_next_activity(mimi_msg_t *out, bool *busy, uint32_t *wait_ms);
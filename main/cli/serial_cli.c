@@ -3,15 +3,21 @@
 #include "wifi/wifi_manager.h"
 #include "telegram/telegram_bot.h"
 #include "llm/llm_proxy.h"
+#include "llm/llm_router.h"
+#include "llm/llm_usage.h"
 #include "memory/memory_store.h"
 #include "memory/session_mgr.h"
 #include "proxy/http_proxy.h"
+#include "http/http_client.h"
+#include "pool/buf_pool.h"
+#include "perf/perf_trace.h"
 #include "tools/tool_web_search.h"
 #include "portal/captive_portal.h"
 #include "ota/ota_manager.h"
 
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include "esp_log.h"
 #include "esp_console.h"
 #include "esp_system.h"
@@ -104,6 +110,30 @@ static int cmd_set_model(int argc, char **argv)
     return 0;
 }
 
+/* --- set_fallback_model command --- */
+static struct {
+    struct arg_str *model;
+    struct arg_end *end;
+} fallback_args;
+
+static int cmd_set_fallback_model(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **)&fallback_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, fallback_args.end, argv[0]);
+        return 1;
+    }
+    const char *model = fallback_args.model->sval[0];
+    if (strcmp(model, "none") == 0) {
+        llm_set_fallback_model(NULL);
+        printf("Fallback model cleared.\n");
+    } else {
+        llm_set_fallback_model(model);
+        printf("Fallback model set.\n");
+    }
+    return 0;
+}
+
 /* --- set_provider command --- */
 static struct {
     struct arg_str *provider;
@@ -117,16 +147,79 @@ static int cmd_set_provider(int argc, char **argv)
         arg_print_errors(stderr, provider_args.end, argv[0]);
         return 1;
     }
-    const char *p = provider_args.provider->sval[0];
-    if (strcmp(p, "kimi") == 0) {
-        llm_set_provider(LLM_PROVIDER_KIMI);
-    } else if (strcmp(p, "anthropic") == 0 || strcmp(p, "claude") == 0) {
-        llm_set_provider(LLM_PROVIDER_ANTHROPIC);
-    } else {
-        printf("Provider inconnu '%s'. Options: anthropic, kimi\n", p);
+    const char *name = provider_args.provider->sval[0];
+    llm_provider_t p;
+    if (strcmp(name, "claude") == 0) {
+        p = LLM_PROVIDER_ANTHROPIC;
+    } else if (!llm_provider_from_id(name, &p)) {
+        printf("Provider inconnu '%s'. Options: anthropic, kimi, openai\n", name);
+        return 1;
+    }
+    llm_set_provider(p);
+    printf("Provider: %s (model %s)\n", llm_get_provider_name(), llm_get_model());
+    return 0;
+}
+
+/* --- llm_backend command --- */
+static struct {
+    struct arg_str *name;
+    struct arg_str *key;
+    struct arg_str *model;
+    struct arg_str *url;
+    struct arg_end *end;
+} backend_args;
+
+static const char *const s_cb_state_names[] = { "closed", "OPEN", "half-open" };
+
+static void print_backend(llm_provider_t p)
+{
+    llm_backend_info_t info;
+    llm_route_stats_t rs;
+    llm_backend_get_info(p, &info);
+    llm_router_get_stats(p, &rs);
+
+    printf("%-9s %s%s\n", info.id, info.has_key ? "live" : "no key",
+           info.preferred ? " (preferred)" : "");
+    printf("  model %s, url %s\n", info.model, info.url);
+    printf("  ttfb p50 %u ms p95 %u ms, errors %u%% of %u, calls %u/%u failed, circuit %s",
+           (unsigned)rs.p50_ms, (unsigned)rs.p95_ms, rs.err_pct, rs.samples,
+           (unsigned)rs.failures, (unsigned)rs.calls, s_cb_state_names[rs.state]);
+    if (rs.state == LLM_CB_OPEN) printf(" (%u s left)", (unsigned)(rs.open_ms / 1000));
+    printf("\n");
+}
+
+static int cmd_llm_backend(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **)&backend_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, backend_args.end, argv[0]);
+        return 1;
+    }
+
+    /* Sans argument : etat de tous les backends */
+    if (backend_args.name->count == 0) {
+        for (int p = 0; p < LLM_PROVIDER_COUNT; p++) print_backend((llm_provider_t)p);
+        return 0;
+    }
+
+    llm_provider_t p;
+    if (!llm_provider_from_id(backend_args.name->sval[0], &p)) {
+        printf("Backend inconnu '%s'. Options: anthropic, kimi, openai\n",
+               backend_args.name->sval[0]);
         return 1;
     }
-    printf("Provider: %s\n", llm_get_provider_name());
+    /* "none" resets a field (key cleared, model/url back to default) */
+    const char *vals[3] = { NULL, NULL, NULL };
+    struct arg_str *opts[3] = { backend_args.key, backend_args.model, backend_args.url };
+    for (int i = 0; i < 3; i++) {
+        if (opts[i]->count == 0) continue;
+        vals[i] = (strcmp(opts[i]->sval[0], "none") == 0) ? "" : opts[i]->sval[0];
+    }
+    if (llm_backend_configure(p, vals[0], vals[1], vals[2]) != ESP_OK) {
+        printf("Failed to save backend config.\n");
+        return 1;
+    }
+    print_backend(p);
     return 0;
 }
 
@@ -206,6 +299,108 @@ static int cmd_heap_info(int argc, char **argv)
     return 0;
 }
 
+/* --- llm_stats command --- */
+static int cmd_llm_stats(int argc, char **argv)
+{
+    llm_conn_stats_t st;
+    llm_get_conn_stats(&st);
+    printf("Provider:   %s\n", llm_get_provider_name());
+    printf("Requests:   %u\n", (unsigned)st.requests);
+    printf("Handshakes: %u\n", (unsigned)st.handshakes);
+    printf("Reused:     %u\n", (unsigned)st.reuses);
+    printf("Reconnects: %u\n", (unsigned)st.reconnects);
+    printf("Rate limited: %u\n", (unsigned)st.rate_limited);
+    printf("Retries:    %u\n", (unsigned)st.retries);
+    printf("Fallbacks:  %u (model: %s)\n", (unsigned)st.fallbacks,
+           llm_get_fallback_model()[0] ? llm_get_fallback_model() : "none");
+    printf("Failovers:  %u\n", (unsigned)st.failovers);
+    return 0;
+}
+
+/* --- usage command --- */
+static struct {
+    struct arg_lit *reset;
+    struct arg_end *end;
+} usage_args;
+
+static int cmd_usage(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **)&usage_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, usage_args.end, argv[0]);
+        return 1;
+    }
+    if (usage_args.reset->count) {
+        llm_usage_reset();
+        printf("Usage counters cleared.\n");
+        return 0;
+    }
+
+    uint32_t def = llm_usage_get_default_budget();
+    printf("Daily budget: %u tokens per chat%s\n", (unsigned)def, def ? "" : " (unlimited)");
+    llm_usage_chat_t c;
+    for (int i = 0; llm_usage_get_chat(i, &c); i++) {
+        uint32_t budget = c.budget ? c.budget : def;
+        printf("%s", c.chat_id);
+        if (budget) printf("  [%u/%u today]", (unsigned)llm_usage_billed(&c.today), (unsigned)budget);
+        printf("\n");
+        const llm_usage_totals_t *sets[2] = { &c.today, &c.total };
+        static const char *const names[2] = { "today", "total" };
+        for (int k = 0; k < 2; k++) {
+            printf("  %-5s %u turns, %u calls: in %u out %u cache_read %u cache_write %u\n",
+                   names[k], (unsigned)sets[k]->turns, (unsigned)sets[k]->calls,
+                   (unsigned)sets[k]->input_tokens, (unsigned)sets[k]->output_tokens,
+                   (unsigned)sets[k]->cache_read_tokens, (unsigned)sets[k]->cache_write_tokens);
+        }
+    }
+    return 0;
+}
+
+/* --- usage_budget command --- */
+static struct {
+    struct arg_int *tokens;
+    struct arg_str *chat_id;
+    struct arg_end *end;
+} usage_budget_args;
+
+static int cmd_usage_budget(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **)&usage_budget_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, usage_budget_args.end, argv[0]);
+        return 1;
+    }
+    int tokens = usage_budget_args.tokens->ival[0];
+    if (tokens < 0) {
+        printf("Budget must be >= 0\n");
+        return 1;
+    }
+    const char *chat_id = usage_budget_args.chat_id->count
+        ? usage_budget_args.chat_id->sval[0] : NULL;
+    llm_usage_set_budget(chat_id, (uint32_t)tokens);
+    printf("Daily budget for %s: %d tokens%s\n", chat_id ? chat_id : "all chats", tokens,
+           tokens ? "" : (chat_id ? " (default)" : " (unlimited)"));
+    return 0;
+}
+
+/* --- buf_pool command --- */
+static int cmd_buf_pool(int argc, char **argv)
+{
+    buf_pool_stats_t st;
+    buf_pool_get_stats(&st);
+    for (int c = 0; c < BUF_POOL_CLASSES; c++) {
+        printf("Class %5d B: %d/%d free\n", (int)st.class_size[c],
+               st.class_free[c], st.class_total[c]);
+    }
+    printf("Leases:      %u (hits %u, heap %u, grows %u)\n",
+           (unsigned)st.leases, (unsigned)st.hits, (unsigned)st.misses, (unsigned)st.grows);
+    printf("In use:      %u (peak %u)\n", (unsigned)st.in_use, (unsigned)st.peak_in_use);
+    printf("Largest PSRAM block: before pool %d, after %d, now %d, min %d\n",
+           (int)st.largest_before, (int)st.largest_after,
+           (int)st.largest_now, (int)st.largest_min);
+    return 0;
+}
+
 /* --- set_proxy command --- */
 static struct {
     struct arg_str *host;
@@ -233,6 +428,111 @@ static int cmd_clear_proxy(int argc, char **argv)
     return 0;
 }
 
+/* --- http_stats command --- */
+static int cmd_http_stats(int argc, char **argv)
+{
+    http_host_stats_t h;
+    printf("%-24s %6s %5s %5s %6s %8s %8s %7s %7s\n",
+           "Host", "Reqs", "Errs", "New", "Reused", "KB in", "KB out", "TTFB", "Avg");
+    for (int i = 0; http_client_get_host_stats(i, &h); i++) {
+        uint32_t n = h.requests ? h.requests : 1;
+        printf("%-24.24s %6u %5u %5u %6u %8u %8u %5ums %5ums\n", h.host,
+               (unsigned)h.requests, (unsigned)h.errors, (unsigned)h.connects,
+               (unsigned)h.reuses, (unsigned)(h.bytes_in / 1024),
+               (unsigned)(h.bytes_decoded / 1024),
+               (unsigned)(h.ttfb_ms_total / n), (unsigned)(h.time_ms_total / n));
+    }
+    return 0;
+}
+
+/* --- perf command --- */
+static struct {
+    struct arg_lit *json;
+    struct arg_int *trace;
+    struct arg_lit *reset;
+    struct arg_end *end;
+} perf_args;
+
+static esp_err_t stdout_sink(void *ctx, const char *data, size_t len)
+{
+    fwrite(data, 1, len, stdout);
+    return ESP_OK;
+}
+
+/* "850us", "12.3ms", "20.1s" */
+static const char *fmt_us(char *buf, size_t size, uint32_t us)
+{
+    if (us < 1000) snprintf(buf, size, "%uus", (unsigned)us);
+    else if (us < 1000000) snprintf(buf, size, "%u.%ums", (unsigned)(us / 1000), (unsigned)(us % 1000 / 100));
+    else snprintf(buf, size, "%u.%us", (unsigned)(us / 1000000), (unsigned)(us % 1000000 / 100000));
+    return buf;
+}
+
+static int cmd_perf(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **)&perf_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, perf_args.end, argv[0]);
+        return 1;
+    }
+    if (perf_args.reset->count) {
+        perf_reset();
+        printf("Perf counters cleared.\n");
+        return 0;
+    }
+    if (perf_args.trace->count) {
+        /* Markers let scripts/trace_to_perfetto.py find it in a serial capture */
+        printf("--- trace begin ---\n");
+        esp_err_t err = perf_export_chrome((uint32_t)perf_args.trace->ival[0], stdout_sink, NULL);
+        printf("\n--- trace end ---\n");
+        fflush(stdout);
+        return err == ESP_OK ? 0 : 1;
+    }
+    if (perf_args.json->count) {
+        char *json = perf_dump_json();
+        if (!json) {
+            printf("Out of memory\n");
+            return 1;
+        }
+        printf("%s\n", json);
+        free(json);
+        return 0;
+    }
+
+    char a[5][16];
+    printf("%-13s %6s %8s %8s %8s %8s %8s\n", "Phase", "Count", "Avg", "p50", "p95", "p99", "Max");
+    for (int p = 0; p < PERF_PHASE_COUNT; p++) {
+        perf_stats_t st;
+        perf_get_stats((perf_phase_t)p, &st);
+        if (!st.count) continue;
+        printf("%-13s %6u %8s %8s %8s %8s %8s\n", perf_phase_name((perf_phase_t)p),
+               (unsigned)st.count, fmt_us(a[0], sizeof(a[0]), (uint32_t)(st.total_us / st.count)),
+               fmt_us(a[1], sizeof(a[1]), st.p50_us), fmt_us(a[2], sizeof(a[2]), st.p95_us),
+               fmt_us(a[3], sizeof(a[3]), st.p99_us), fmt_us(a[4], sizeof(a[4]), st.max_us));
+    }
+    return 0;
+}
+
+/* --- proxy_stats command --- */
+static int cmd_proxy_stats(int argc, char **argv)
+{
+    proxy_pool_stats_t st;
+    proxy_pool_get_stats(&st);
+    printf("Proxy:      %s\n", http_proxy_is_enabled() ? "enabled" : "disabled");
+    printf("Tunnels:    %u opened (%u offered a session ticket)\n",
+           (unsigned)st.opens, (unsigned)st.ticket_offers);
+    if (st.opens) {
+        printf("Open time:  %u ms avg, %u recv calls per CONNECT\n",
+               (unsigned)(st.open_ms_total / st.opens), (unsigned)(st.connect_recvs / st.opens));
+    }
+    printf("Proxy DNS:  %u lookups, %u cached\n", (unsigned)st.dns_lookups, (unsigned)st.dns_hits);
+    printf("Reused:     %u\n", (unsigned)st.reuses);
+    printf("Stale:      %u, expired %u\n", (unsigned)st.stale, (unsigned)st.expired);
+    printf("Idle now:   %u/%d, tickets cached for %u hosts\n",
+           st.idle, MIMI_PROXY_POOL_SIZE, st.sessions);
+    return 0;
+}
+
 /* --- set_search_key command --- */
 static struct {
     struct arg_str *key;
@@ -290,8 +590,18 @@ static int cmd_config_show(int argc, char **argv)
     print_config("WiFi Pass",  MIMI_NVS_WIFI,   MIMI_NVS_KEY_PASS,     MIMI_SECRET_WIFI_PASS,  true);
     print_config("TG Token",   MIMI_NVS_TG,     MIMI_NVS_KEY_TG_TOKEN, MIMI_SECRET_TG_TOKEN,   true);
     print_config("Provider",   MIMI_NVS_LLM,    MIMI_NVS_KEY_PROVIDER, "anthropic",             false);
-    print_config("API Key",    MIMI_NVS_LLM,    MIMI_NVS_KEY_API_KEY,  MIMI_SECRET_API_KEY,    true);
-    print_config("Model",      MIMI_NVS_LLM,    MIMI_NVS_KEY_MODEL,    MIMI_SECRET_MODEL,      false);
+    /* Cles par backend ; les valeurs build-time vont au backend prefere */
+    for (int p = 0; p < LLM_PROVIDER_COUNT; p++) {
+        const char *id = llm_provider_id((llm_provider_t)p);
+        bool pref = (p == (int)llm_get_provider());
+        char key[16], label[24];
+        snprintf(key, sizeof(key), MIMI_NVS_KEY_BACKEND_KEY, id);
+        snprintf(label, sizeof(label), "%s key", id);
+        print_config(label, MIMI_NVS_LLM, key, pref ? MIMI_SECRET_API_KEY : "", true);
+        snprintf(key, sizeof(key), MIMI_NVS_KEY_BACKEND_MODEL, id);
+        snprintf(label, sizeof(label), "%s model", id);
+        print_config(label, MIMI_NVS_LLM, key, pref ? MIMI_SECRET_MODEL : "", false);
+    }
     print_config("Proxy Host", MIMI_NVS_PROXY,  MIMI_NVS_KEY_PROXY_HOST, MIMI_SECRET_PROXY_HOST, false);
     print_config("Proxy Port", MIMI_NVS_PROXY,  MIMI_NVS_KEY_PROXY_PORT, MIMI_SECRET_PROXY_PORT, false);
     print_config("Search Key", MIMI_NVS_SEARCH, MIMI_NVS_KEY_API_KEY,  MIMI_SECRET_SEARCH_KEY, true);
@@ -446,7 +756,7 @@ esp_err_t serial_cli_init(void)
     esp_console_cmd_register(&tg_token_cmd);
 
     /* set_api_key */
-    api_key_args.key = arg_str1(NULL, NULL, "<key>", "Anthropic API key");
+    api_key_args.key = arg_str1(NULL, NULL, "<key>", "API key of the preferred provider");
     api_key_args.end = arg_end(1);
     esp_console_cmd_t api_key_cmd = {
         .command = "set_api_key",
@@ -461,23 +771,48 @@ esp_err_t serial_cli_init(void)
     model_args.end = arg_end(1);
     esp_console_cmd_t model_cmd = {
         .command = "set_model",
-        .help = "Set LLM model (default: " MIMI_LLM_DEFAULT_MODEL ")",
+        .help = "Set LLM model of the preferred provider",
         .func = &cmd_set_model,
         .argtable = &model_args,
     };
     esp_console_cmd_register(&model_cmd);
 
+    /* set_fallback_model */
+    fallback_args.model = arg_str1(NULL, NULL, "<model|none>", "Model used when the primary is overloaded");
+    fallback_args.end = arg_end(1);
+    esp_console_cmd_t fallback_cmd = {
+        .command = "set_fallback_model",
+        .help = "Set fallback LLM model for 429/529 overloads ('none' to disable)",
+        .func = &cmd_set_fallback_model,
+        .argtable = &fallback_args,
+    };
+    esp_console_cmd_register(&fallback_cmd);
+
     /* set_provider */
-    provider_args.provider = arg_str1(NULL, NULL, "<provider>", "anthropic or kimi");
+    provider_args.provider = arg_str1(NULL, NULL, "<provider>", "anthropic, kimi or openai");
     provider_args.end = arg_end(1);
     esp_console_cmd_t provider_cmd = {
         .command = "set_provider",
-        .help = "Set LLM provider (anthropic, kimi)",
+        .help = "Set preferred LLM provider (anthropic, kimi, openai)",
         .func = &cmd_set_provider,
         .argtable = &provider_args,
     };
     esp_console_cmd_register(&provider_cmd);
 
+    /* llm_backend */
+    backend_args.name = arg_str0(NULL, NULL, "<backend>", "anthropic, kimi or openai");
+    backend_args.key = arg_str0("k", "key", "<key|none>", "API key");
+    backend_args.model = arg_str0("m", "model", "<model|none>", "Model");
+    backend_args.url = arg_str0("u", "url", "<url|none>", "Endpoint URL");
+    backend_args.end = arg_end(4);
+    esp_console_cmd_t backend_cmd = {
+        .command = "llm_backend",
+        .help = "Show LLM backends and router health, or configure one",
+        .func = &cmd_llm_backend,
+        .argtable = &backend_args,
+    };
+    esp_console_cmd_register(&backend_cmd);
+
     /* memory_read */
     esp_console_cmd_t mem_read_cmd = {
         .command = "memory_read",
@@ -524,6 +859,45 @@ esp_err_t serial_cli_init(void)
     };
     esp_console_cmd_register(&heap_cmd);
 
+    /* llm_stats */
+    esp_console_cmd_t llm_stats_cmd = {
+        .command = "llm_stats",
+        .help = "Show LLM connection reuse counters",
+        .func = &cmd_llm_stats,
+    };
+    esp_console_cmd_register(&llm_stats_cmd);
+
+    /* usage */
+    usage_args.reset = arg_lit0("r", "reset", "Clear all counters");
+    usage_args.end = arg_end(1);
+    esp_console_cmd_t usage_cmd = {
+        .command = "usage",
+        .help = "Show token usage per chat (today and total)",
+        .func = &cmd_usage,
+        .argtable = &usage_args,
+    };
+    esp_console_cmd_register(&usage_cmd);
+
+    /* usage_budget */
+    usage_budget_args.tokens = arg_int1(NULL, NULL, "<tokens>", "Daily tokens, 0 = unlimited / default");
+    usage_budget_args.chat_id = arg_str0(NULL, NULL, "<chat_id>", "Only this chat");
+    usage_budget_args.end = arg_end(2);
+    esp_console_cmd_t usage_budget_cmd = {
+        .command = "usage_budget",
+        .help = "Set the daily token budget per chat (default or one chat)",
+        .func = &cmd_usage_budget,
+        .argtable = &usage_budget_args,
+    };
+    esp_console_cmd_register(&usage_budget_cmd);
+
+    /* buf_pool */
+    esp_console_cmd_t buf_pool_cmd = {
+        .command = "buf_pool",
+        .help = "Show response buffer pool and PSRAM fragmentation counters",
+        .func = &cmd_buf_pool,
+    };
+    esp_console_cmd_register(&buf_pool_cmd);
+
     /* set_search_key */
     search_key_args.key = arg_str1(NULL, NULL, "<key>", "Brave Search API key");
     search_key_args.end = arg_end(1);
@@ -555,6 +929,35 @@ esp_err_t serial_cli_init(void)
     };
     esp_console_cmd_register(&clear_proxy_cmd);
 
+    /* http_stats */
+    esp_console_cmd_t http_stats_cmd = {
+        .command = "http_stats",
+        .help = "Show HTTP requests, reuse and latency per host",
+        .func = &cmd_http_stats,
+    };
+    esp_console_cmd_register(&http_stats_cmd);
+
+    /* perf */
+    perf_args.json = arg_lit0("j", "json", "Dump stats and recent spans as JSON");
+    perf_args.trace = arg_int0("t", "trace", "<seconds>", "Chrome trace of the last seconds (0: all)");
+    perf_args.reset = arg_lit0("r", "reset", "Clear all histograms");
+    perf_args.end = arg_end(1);
+    esp_console_cmd_t perf_cmd = {
+        .command = "perf",
+        .help = "Show latency percentiles per turn phase",
+        .func = &cmd_perf,
+        .argtable = &perf_args,
+    };
+    esp_console_cmd_register(&perf_cmd);
+
+    /* proxy_stats */
+    esp_console_cmd_t proxy_stats_cmd = {
+        .command = "proxy_stats",
+        .help = "Show proxy tunnel pool statistics",
+        .func = &cmd_proxy_stats,
+    };
+    esp_console_cmd_register(&proxy_stats_cmd);
+
     /* config_show */
     esp_console_cmd_t config_show_cmd = {
         .command = "config_show",
@@ -4,6 +4,7 @@
 #include "mimi_config.h"
 #include "ota/ota_manager.h"
 #include "power/battery_monitor.h"
+#include "perf/perf_trace.h"
 #ifdef MIMI_HAS_SERVOS
 #include "hardware/sonar_radar.h"
 #endif
@@ -1249,6 +1250,7 @@ static void display_task(void *arg)
             continue;
         }
 
+        perf_span_t frame = perf_begin(PERF_DISP_FRAME);
         switch (state) {
         case DISPLAY_IDLE:
             draw_idle();
@@ -1288,6 +1290,7 @@ static void display_task(void *arg)
         draw_banner();
 
         fb_flush();
+        perf_end(frame);
         s_frame_count++;
 
         /* FPS adaptatif */
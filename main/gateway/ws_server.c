@@ -1,6 +1,9 @@
 #include "ws_server.h"
 #include "mimi_config.h"
 #include "bus/message_bus.h"
+#include "agent/agent_loop.h"
+#include "perf/perf_trace.h"
+#include "pool/buf_pool.h"
 
 #include <string.h>
 #include <stdlib.h>
@@ -67,6 +70,28 @@ static void remove_client(int fd)
     }
 }
 
+static esp_err_t lease_sink(void *ctx, const char *data, size_t len)
+{
+    return buf_pool_append((buf_lease_t *)ctx, data, len);
+}
+
+/* {"type":"trace"} → the frame is itself a Chrome trace (perf_export_chrome) */
+static void send_trace(httpd_req_t *req, uint32_t seconds)
+{
+    buf_lease_t out;
+    if (buf_pool_acquire(&out, 16 * 1024) != ESP_OK) return;
+    if (perf_export_chrome(seconds, lease_sink, &out) == ESP_OK) {
+        httpd_ws_frame_t pkt = {
+            .type = HTTPD_WS_TYPE_TEXT,
+            .payload = (uint8_t *)out.data,
+            .len = out.len,
+        };
+        esp_err_t err = httpd_ws_send_frame(req, &pkt);
+        if (err != ESP_OK) ESP_LOGW(TAG, "Trace send failed: %s", esp_err_to_name(err));
+    }
+    buf_pool_release(&out);
+}
+
 static esp_err_t ws_handler(httpd_req_t *req)
 {
     if (req->method == HTTP_GET) {
@@ -134,6 +159,13 @@ static esp_err_t ws_handler(httpd_req_t *req)
         if (msg.content) {
             message_bus_push_inbound(&msg);
         }
+    } else if (type && cJSON_IsString(type) && strcmp(type->valuestring, "stop") == 0) {
+        /* Abandon the running turn of this client's chat */
+        agent_loop_cancel(client ? client->chat_id : "ws_unknown");
+    } else if (type && cJSON_IsString(type) && strcmp(type->valuestring, "trace") == 0) {
+        cJSON *secs = cJSON_GetObjectItem(root, "seconds");
+        send_trace(req, cJSON_IsNumber(secs) ? (uint32_t)secs->valuedouble
+                                             : MIMI_PERF_TRACE_SECONDS);
     }
 
     cJSON_Delete(root);
@@ -168,7 +200,7 @@ esp_err_t ws_server_start(void)
     return ESP_OK;
 }
 
-esp_err_t ws_server_send(const char *chat_id, const char *text)
+static esp_err_t ws_send_frame(const char *chat_id, const char *type, const char *text)
 {
     if (!s_server) return ESP_ERR_INVALID_STATE;
 
@@ -180,7 +212,7 @@ esp_err_t ws_server_send(const char *chat_id, const char *text)
 
     /* Build response JSON */
     cJSON *resp = cJSON_CreateObject();
-    cJSON_AddStringToObject(resp, "type", "response");
+    cJSON_AddStringToObject(resp, "type", type);
     cJSON_AddStringToObject(resp, "content", text);
     cJSON_AddStringToObject(resp, "chat_id", chat_id);
 
@@ -206,6 +238,33 @@ esp_err_t ws_server_send(const char *chat_id, const char *text)
     return ret;
 }
 
+esp_err_t ws_server_send(const char *chat_id, const char *text)
+{
+    return ws_send_frame(chat_id, "response", text);
+}
+
+esp_err_t ws_server_send_delta(const char *chat_id, const char *text, size_t len)
+{
+    char *frag = malloc(len + 1);
+    if (!frag) return ESP_ERR_NO_MEM;
+    memcpy(frag, text, len);
+    frag[len] = '\0';
+
+    esp_err_t ret = ws_send_frame(chat_id, "delta", frag);
+    free(frag);
+    return ret;
+}
+
+esp_err_t ws_server_send_status(const char *chat_id, const char *state)
+{
+    return ws_send_frame(chat_id, "status", state);
+}
+
+esp_err_t ws_server_send_reset(const char *chat_id)
+{
+    return ws_send_frame(chat_id, "reset", "");
+}
+
 esp_err_t ws_server_stop(void)
 {
     if (s_server) {
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "esp_err.h"
+#include <stddef.h>
 
 /**
  * Initialize and start the WebSocket server on MIMI_WS_PORT.
@@ -8,7 +9,12 @@
  *
  * Protocol:
  *   Inbound:  {"type":"message","content":"hello","chat_id":"ws_client1"}
- *   Outbound: {"type":"response","content":"Hi!","chat_id":"ws_client1"}
+ *             {"type":"stop"}
+ *             {"type":"trace","seconds":10}   → one Chrome trace frame ({"type":"trace","traceEvents":[...]})
+ *   Outbound: {"type":"delta","content":"H","chat_id":"ws_client1"}   (while streaming)
+ *             {"type":"status","content":"working","chat_id":"ws_client1"} (repeated while working, "idle" once done)
+ *             {"type":"reset","content":"","chat_id":"ws_client1"}    (discard the deltas so far)
+ *             {"type":"response","content":"Hi!","chat_id":"ws_client1"}
  */
 esp_err_t ws_server_start(void);
 
@@ -19,6 +25,24 @@ esp_err_t ws_server_start(void);
  */
 esp_err_t ws_server_send(const char *chat_id, const char *text);
 
+/**
+ * Send a partial reply fragment while the LLM response is streaming.
+ * The final "response" frame still carries the complete text.
+ */
+esp_err_t ws_server_send_delta(const char *chat_id, const char *text, size_t len);
+
+/**
+ * Tell the client whether the agent is working on its message.
+ * @param state  "working" or "idle"
+ */
+esp_err_t ws_server_send_status(const char *chat_id, const char *state);
+
+/**
+ * Tell the client to drop the deltas streamed so far: the turn was cancelled
+ * (preempted by a newer message, or /stop) before its "response" frame.
+ */
+esp_err_t ws_server_send_reset(const char *chat_id);
+
 /**
  * Stop the WebSocket server.
  */
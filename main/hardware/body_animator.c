@@ -4,6 +4,7 @@
 #include "hardware/sonar_radar.h"
 #include "input/gesture_detect.h"
 #include "power/battery_monitor.h"
+#include "perf/perf_trace.h"
 #include "mimi_config.h"
 
 #include "freertos/FreeRTOS.h"
@@ -877,7 +878,9 @@ static void body_animator_task(void *arg)
         }
 
         /* Lecture ultrason */
+        perf_span_t span = perf_begin(PERF_SONAR);
         int dist = ultrasonic_read_cm();
+        perf_end(span);
         bool was_present = s_presence_active;
 
         if (dist > 0 && dist < MIMI_US_DETECT_CM) {
@@ -0,0 +1,637 @@
+#include "http_client.h"
+#include "http_gzip.h"
+#include "mimi_config.h"
+#include "proxy/http_proxy.h"
+
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <sys/select.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_http_client.h"
+#include "esp_crt_bundle.h"
+
+static const char *TAG = "http";
+
+#define HTTP_READ_BUF   4096
+
+static SemaphoreHandle_t s_lock = NULL;     /* direct pool + stats */
+
+static int req_port(const http_req_t *req)
+{
+    if (req->port) return req->port;
+    return req->plain_http ? 80 : 443;
+}
+
+static bool req_is_head(const http_req_t *req)
+{
+    return strcmp(req->method, "HEAD") == 0;
+}
+
+static bool req_cancelled(const http_req_t *req)
+{
+    return req->cancel && *req->cancel;
+}
+
+/* ── Per-request state ────────────────────────────────────────── */
+
+typedef struct {
+    const http_req_t *req;
+    int      status;
+    bool     connected;         /* a new connection was opened */
+    int64_t  sent_us;           /* request fully written */
+    int64_t  first_byte_us;
+    uint32_t bytes;             /* as received */
+    uint32_t bytes_decoded;     /* as passed to on_body */
+    http_gzip_t *gz;            /* Content-Encoding: gzip */
+    esp_err_t gz_err;
+} exchange_t;
+
+/* Start of an attempt (the first, or the resend on a fresh connection) */
+static void ex_reset(exchange_t *ex)
+{
+    ex->connected = false;
+    ex->status = 0;
+    ex->gz_err = ESP_OK;
+    if (ex->gz) {
+        http_gzip_free(ex->gz);
+        ex->gz = NULL;
+    }
+}
+
+static void ex_status(exchange_t *ex, int status)
+{
+    ex->status = status;
+    if (ex->req->on_status) ex->req->on_status(ex->req->ctx, status);
+}
+
+/* Every header goes through here, whatever the transport */
+static void ex_header(exchange_t *ex, const char *key, const char *value)
+{
+    const http_req_t *req = ex->req;
+    if (strcasecmp(key, "Content-Encoding") == 0) {
+        /* Only ever sent back because we asked: the body is decoded below */
+        if (req->accept_gzip && strcasecmp(value, "gzip") == 0 && !req_is_head(req) && !ex->gz) {
+            ex->gz = http_gzip_new();
+            if (!ex->gz) ex->gz_err = ESP_ERR_NO_MEM;
+        }
+        return;
+    }
+    if (req->on_header) req->on_header(req->ctx, key, value);
+}
+
+static esp_err_t ex_deliver(void *ctx, const char *data, size_t len)
+{
+    exchange_t *ex = (exchange_t *)ctx;
+    ex->bytes_decoded += len;
+    return ex->req->on_body ? ex->req->on_body(ex->req->ctx, data, len) : ESP_OK;
+}
+
+/* Every body byte goes through here, whatever the transport */
+static esp_err_t ex_body(exchange_t *ex, const char *data, size_t len)
+{
+    int64_t now = esp_timer_get_time();
+    if (!ex->first_byte_us) ex->first_byte_us = now;
+    ex->bytes += len;
+    if (req_cancelled(ex->req)) return ESP_ERR_NOT_FINISHED;
+    if (ex->req->deadline_us && now > ex->req->deadline_us) return ESP_ERR_TIMEOUT;
+    if (ex->gz_err != ESP_OK) return ex->gz_err;
+    if (ex->gz) return http_gzip_feed(ex->gz, data, len, ex_deliver, ex);
+    return ex_deliver(ex, data, len);
+}
+
+/* Per-read timeout, clipped to what is left before the deadline (<= 0: expired) */
+static int req_timeout_ms(const http_req_t *req)
+{
+    int t = req->timeout_ms ? req->timeout_ms : MIMI_HTTP_TIMEOUT_MS;
+    if (req->deadline_us) {
+        int64_t left = (req->deadline_us - esp_timer_get_time()) / 1000;
+        if (left < t) t = (int)left;
+    }
+    return t;
+}
+
+/* Connect and the wait for the response are done in slices of this length
+ * when the request can be cancelled, so a cancel is seen within a slice */
+static int req_wait_slice_ms(const http_req_t *req, int timeout_ms)
+{
+    return (req->cancel && timeout_ms > MIMI_HTTP_CANCEL_POLL_MS)
+        ? MIMI_HTTP_CANCEL_POLL_MS : timeout_ms;
+}
+
+/* Wait for sock to have data, checking the cancel flag between slices.
+ * Polling esp_http_client_fetch_headers() instead would log a warning at
+ * every slice that ends without data. */
+static esp_err_t req_wait_readable(const http_req_t *req, int sock, int64_t until)
+{
+    for (;;) {
+        if (req_cancelled(req)) return ESP_ERR_NOT_FINISHED;
+        int64_t left_ms = (until - esp_timer_get_time()) / 1000;
+        if (left_ms <= 0) return ESP_ERR_TIMEOUT;
+        int slice = req_wait_slice_ms(req, left_ms > INT32_MAX ? INT32_MAX : (int)left_ms);
+        fd_set set;
+        FD_ZERO(&set);
+        FD_SET(sock, &set);
+        struct timeval tv = { .tv_sec = slice / 1000, .tv_usec = (slice % 1000) * 1000 };
+        int n = select(sock + 1, &set, NULL, NULL, &tv);
+        if (n > 0) return ESP_OK;
+        if (n < 0 && errno != EINTR) return ESP_OK;     /* let the read report it */
+    }
+}
+
+static esp_err_t req_send_body(const http_req_t *req, http_write_fn_t write, void *wctx)
+{
+    if (req->body_fn) return req->body_fn(req->body_ctx, write, wctx);
+    if (req->body && req->body_len) return write(wctx, req->body, req->body_len);
+    return ESP_OK;
+}
+
+/* ── Per-host statistics ──────────────────────────────────────── */
+
+static http_host_stats_t s_hosts[MIMI_HTTP_STATS_HOSTS];
+static int s_host_count = 0;
+
+static void stats_record(const http_req_t *req, const exchange_t *ex, bool reused,
+                         esp_err_t err, int64_t t0)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    http_host_stats_t *h = NULL;
+    for (int i = 0; i < s_host_count && !h; i++) {
+        if (strcmp(s_hosts[i].host, req->host) == 0) h = &s_hosts[i];
+    }
+    if (!h && s_host_count < MIMI_HTTP_STATS_HOSTS) {
+        h = &s_hosts[s_host_count++];
+        strncpy(h->host, req->host, sizeof(h->host) - 1);
+    }
+    if (h) {
+        h->requests++;
+        if (err != ESP_OK) h->errors++;
+        if (reused) {
+            h->reuses++;
+        } else {
+            h->connects++;
+        }
+        h->bytes_in += ex->bytes;
+        h->bytes_decoded += ex->bytes_decoded;
+        if (ex->first_byte_us && ex->sent_us) {
+            h->ttfb_ms_total += (uint32_t)((ex->first_byte_us - ex->sent_us) / 1000);
+        }
+        h->time_ms_total += (uint32_t)((esp_timer_get_time() - t0) / 1000);
+    }
+    xSemaphoreGive(s_lock);
+}
+
+/* ── Direct path: esp_http_client kept alive per host ─────────── */
+
+/* esp_http_client keeps the socket open between requests on the same handle
+ * as long as the server allows it, so a handle is kept per host and lent to
+ * one request at a time. */
+typedef struct {
+    esp_http_client_handle_t client;
+    char     host[48];
+    int      port;
+    bool     plain;
+    bool     in_use;
+    bool     drop;              /* clean up on release (one-off, or host forgotten) */
+    int64_t  last_used_us;
+    char     hdr_keys[HTTP_MAX_HEADERS][32];    /* set on the handle by the last request */
+} direct_conn_t;
+
+static direct_conn_t s_direct[MIMI_HTTP_DIRECT_POOL];
+
+static esp_err_t direct_event_handler(esp_http_client_event_t *evt)
+{
+    /* Body bytes are pulled with esp_http_client_read(), not from ON_DATA */
+    exchange_t *ex = (exchange_t *)evt->user_data;
+    if (!ex) return ESP_OK;
+    if (evt->event_id == HTTP_EVENT_ON_CONNECTED) {
+        ex->connected = true;
+    } else if (evt->event_id == HTTP_EVENT_ON_HEADER) {
+        ex_header(ex, evt->header_key, evt->header_value);
+    }
+    return ESP_OK;
+}
+
+static void direct_format_url(const http_req_t *req, char *url, size_t size)
+{
+    snprintf(url, size, "%s://%s:%d%s", req->plain_http ? "http" : "https",
+             req->host, req_port(req), req->path);
+}
+
+static esp_http_client_handle_t direct_client_new(const http_req_t *req)
+{
+    char url[256];
+    direct_format_url(req, url, sizeof(url));
+    esp_http_client_config_t config = {
+        .url = url,
+        .event_handler = direct_event_handler,
+        .timeout_ms = MIMI_HTTP_TIMEOUT_MS,
+        .buffer_size = 4096,
+        .buffer_size_tx = 4096,
+        .crt_bundle_attach = req->plain_http ? NULL : esp_crt_bundle_attach,
+        .keep_alive_enable = true,      /* TCP keepalive: notice dead peers */
+        /* Connect step by step (ESP_ERR_HTTP_CONNECTING), so that a cancel is
+         * seen during the TCP connect and the TLS handshake; HTTPS only */
+        .is_async = !req->plain_http,
+    };
+    return esp_http_client_init(&config);
+}
+
+/* Lend a handle for host, reusing its kept-alive socket when there is one.
+ * All slots busy: a one-off slot in *tmp, cleaned up on release. */
+static direct_conn_t *direct_acquire(const http_req_t *req, direct_conn_t *tmp)
+{
+    int port = req_port(req);
+    int64_t now = esp_timer_get_time();
+    direct_conn_t *c = NULL;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < MIMI_HTTP_DIRECT_POOL && !c; i++) {
+        direct_conn_t *s = &s_direct[i];
+        if (!s->in_use && s->client && s->port == port && s->plain == req->plain_http &&
+            strcmp(s->host, req->host) == 0) {
+            c = s;
+        }
+    }
+    if (!c) {
+        /* Empty slot, else the least recently used idle one */
+        for (int i = 0; i < MIMI_HTTP_DIRECT_POOL; i++) {
+            direct_conn_t *s = &s_direct[i];
+            if (s->in_use) continue;
+            if (!s->client) { c = s; break; }
+            if (!c || s->last_used_us < c->last_used_us) c = s;
+        }
+        if (c && c->client) {
+            esp_http_client_cleanup(c->client);
+            c->client = NULL;
+        }
+    }
+    if (c) c->in_use = true;
+    xSemaphoreGive(s_lock);
+
+    if (!c) {
+        memset(tmp, 0, sizeof(*tmp));
+        c = tmp;
+    }
+    if (!c->client) {
+        memset(c->hdr_keys, 0, sizeof(c->hdr_keys));
+        strncpy(c->host, req->host, sizeof(c->host) - 1);
+        c->host[sizeof(c->host) - 1] = '\0';
+        c->port = port;
+        c->plain = req->plain_http;
+        c->drop = false;
+        c->client = direct_client_new(req);
+    } else if (now - c->last_used_us > (int64_t)MIMI_HTTP_KEEPALIVE_IDLE_MS * 1000) {
+        /* Le serveur l'a tres probablement deja fermee */
+        esp_http_client_close(c->client);
+    }
+    if (c == tmp) c->drop = true;
+    c->in_use = true;
+    return c;
+}
+
+/* keep: the exchange completed, the socket can serve the next request */
+static void direct_release(direct_conn_t *c, bool keep)
+{
+    if (c->client) esp_http_client_set_user_data(c->client, NULL);
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (!keep || c->drop) {
+        /* Etat de la connexion inconnu: repartir d'un handle neuf */
+        if (c->client) esp_http_client_cleanup(c->client);
+        c->client = NULL;
+    }
+    c->last_used_us = esp_timer_get_time();
+    c->in_use = false;
+    xSemaphoreGive(s_lock);
+}
+
+static esp_err_t direct_write(void *wctx, const char *data, size_t len)
+{
+    esp_http_client_handle_t client = (esp_http_client_handle_t)wctx;
+    while (len > 0) {
+        int n = esp_http_client_write(client, data, len);
+        if (n <= 0) return ESP_ERR_HTTP_WRITE_DATA;
+        data += n;
+        len -= n;
+    }
+    return ESP_OK;
+}
+
+static esp_http_client_method_t method_of(const char *m)
+{
+    if (strcmp(m, "POST") == 0) return HTTP_METHOD_POST;
+    if (strcmp(m, "HEAD") == 0) return HTTP_METHOD_HEAD;
+    return HTTP_METHOD_GET;
+}
+
+/* One request/response exchange on a lent handle */
+static esp_err_t direct_exchange(direct_conn_t *c, const http_req_t *req, exchange_t *ex,
+                                 char *buf, size_t buf_size)
+{
+    esp_http_client_handle_t client = c->client;
+    if (!client) return ESP_FAIL;
+
+    char url[256];
+    direct_format_url(req, url, sizeof(url));
+    esp_http_client_set_url(client, url);
+    esp_http_client_set_method(client, method_of(req->method));
+    int timeout_ms = req_timeout_ms(req);
+    esp_http_client_set_user_data(client, ex);
+
+    /* Headers stick to the handle: remove the previous request's first */
+    for (int i = 0; i < HTTP_MAX_HEADERS; i++) {
+        if (c->hdr_keys[i][0]) esp_http_client_delete_header(client, c->hdr_keys[i]);
+        c->hdr_keys[i][0] = '\0';
+        const http_header_t *h = &req->headers[i];
+        if (!h->key) continue;
+        esp_http_client_set_header(client, h->key, h->value);
+        snprintf(c->hdr_keys[i], sizeof(c->hdr_keys[i]), "%s", h->key);
+    }
+    if (req->accept_gzip) {
+        esp_http_client_set_header(client, "Accept-Encoding", "gzip");
+    } else {
+        esp_http_client_delete_header(client, "Accept-Encoding");
+    }
+
+    /* TLS connects in slices; the request is sent with the whole timeout.
+     * Plain HTTP is not async (is_async): its one blocking connect gets it all. */
+    size_t body_len = (req->body || req->body_fn) ? req->body_len : 0;
+    int64_t until = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+    esp_http_client_set_timeout_ms(client, req->plain_http ? timeout_ms
+                                                           : req_wait_slice_ms(req, timeout_ms));
+    esp_err_t err;
+    while ((err = esp_http_client_open(client, body_len)) == ESP_ERR_HTTP_CONNECTING) {
+        if (req_cancelled(req)) return ESP_ERR_NOT_FINISHED;
+        if (esp_timer_get_time() > until) return ESP_ERR_HTTP_CONNECT;
+        vTaskDelay(1);          /* handshake waiting on the peer: don't spin */
+    }
+    if (err != ESP_OK) return err;
+    esp_http_client_set_timeout_ms(client, timeout_ms);
+    err = req_send_body(req, direct_write, client);
+    if (err != ESP_OK) return err;
+    ex->sent_us = esp_timer_get_time();
+
+    /* The first byte can take long (an LLM thinking): wait for it on the
+     * socket in slices, then read the headers. A TLS record that carries no
+     * response (a session ticket) sends the read back to waiting. */
+    int64_t hdr;
+    until = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+    int sock = req->cancel ? esp_http_client_get_socket(client) : -1;
+    if (sock >= 0) esp_http_client_set_timeout_ms(client, req_wait_slice_ms(req, timeout_ms));
+    for (;;) {
+        if (sock >= 0) {
+            err = req_wait_readable(req, sock, until);
+            if (err != ESP_OK) return err;
+        }
+        hdr = esp_http_client_fetch_headers(client);
+        if (hdr != -ESP_ERR_HTTP_EAGAIN) break;
+        if (sock < 0 || esp_timer_get_time() > until) return ESP_ERR_TIMEOUT;
+    }
+    esp_http_client_set_timeout_ms(client, timeout_ms);
+    /* Negative means error, except for a chunked response (no length) */
+    if (hdr < 0 && !esp_http_client_is_chunked_response(client)) {
+        return ESP_ERR_HTTP_FETCH_HEADER;
+    }
+    ex_status(ex, esp_http_client_get_status_code(client));
+    if (req_is_head(req)) return ESP_OK;
+
+    int n;
+    while ((n = esp_http_client_read(client, buf, buf_size)) > 0) {
+        err = ex_body(ex, buf, n);
+        if (err != ESP_OK) return err;
+    }
+    return (n < 0) ? ESP_FAIL : ESP_OK;
+}
+
+static esp_err_t direct_request(const http_req_t *req, exchange_t *ex, http_result_t *res)
+{
+    buf_lease_t rd;
+    if (buf_pool_acquire(&rd, HTTP_READ_BUF) != ESP_OK) return ESP_ERR_NO_MEM;
+
+    esp_err_t err = ESP_FAIL;
+    for (int attempt = 0; attempt < 2; attempt++) {
+        direct_conn_t tmp;
+        direct_conn_t *c = direct_acquire(req, &tmp);
+        ex_reset(ex);
+        err = direct_exchange(c, req, ex, rd.data, rd.cap);
+        res->reused = !ex->connected && err != ESP_ERR_HTTP_CONNECT;
+        /* HEAD: the body length is unknown to us, don't trust the socket after it */
+        direct_release(c, err == ESP_OK && !req_is_head(req));
+
+        if (err == ESP_OK) break;
+        /* Only a reused socket that failed before any response byte is safe
+         * to resend: the server closed it while idle and never saw the request. */
+        if (attempt > 0 || ex->connected || ex->status != 0 || err == ESP_ERR_TIMEOUT ||
+            err == ESP_ERR_NOT_FINISHED || err == ESP_ERR_HTTP_CONNECT) break;
+        res->reconnected = true;
+        ESP_LOGW(TAG, "Keep-alive connection to %s lost (%s), reconnecting",
+                 req->host, esp_err_to_name(err));
+    }
+
+    buf_pool_release(&rd);
+    return err;
+}
+
+/* ── Proxy path: HTTP over a pooled CONNECT tunnel ───────────── */
+
+static void px_status(void *ctx, int status)
+{
+    ex_status((exchange_t *)ctx, status);
+}
+
+static void px_header(void *ctx, const char *key, const char *value)
+{
+    ex_header((exchange_t *)ctx, key, value);
+}
+
+static esp_err_t px_body(void *ctx, const char *data, size_t len)
+{
+    return ex_body((exchange_t *)ctx, data, len);
+}
+
+static esp_err_t px_write(void *wctx, const char *data, size_t len)
+{
+    return (proxy_conn_write((proxy_conn_t *)wctx, data, len) < 0)
+        ? ESP_ERR_HTTP_WRITE_DATA : ESP_OK;
+}
+
+static esp_err_t proxy_exchange(proxy_conn_t *conn, const http_req_t *req, exchange_t *ex)
+{
+    char head[768];
+    int port = req_port(req);
+    int n = (port == 443)
+        ? snprintf(head, sizeof(head), "%s %s HTTP/1.1\r\nHost: %s\r\n",
+                   req->method, req->path, req->host)
+        : snprintf(head, sizeof(head), "%s %s HTTP/1.1\r\nHost: %s:%d\r\n",
+                   req->method, req->path, req->host, port);
+    for (int i = 0; i < HTTP_MAX_HEADERS && n < (int)sizeof(head); i++) {
+        const http_header_t *h = &req->headers[i];
+        if (h->key) n += snprintf(head + n, sizeof(head) - n, "%s: %s\r\n", h->key, h->value);
+    }
+    if (n < (int)sizeof(head) && req->accept_gzip) {
+        n += snprintf(head + n, sizeof(head) - n, "Accept-Encoding: gzip\r\n");
+    }
+    if (n < (int)sizeof(head) && (req->body || req->body_fn)) {
+        n += snprintf(head + n, sizeof(head) - n, "Content-Length: %u\r\n",
+                      (unsigned)req->body_len);
+    }
+    if (n < (int)sizeof(head)) n += snprintf(head + n, sizeof(head) - n, "\r\n");
+    if (n >= (int)sizeof(head)) return ESP_ERR_INVALID_SIZE;
+
+    if (proxy_conn_write(conn, head, n) < 0) return ESP_ERR_HTTP_WRITE_DATA;
+    esp_err_t err = req_send_body(req, px_write, conn);
+    if (err != ESP_OK) return err;
+    ex->sent_us = esp_timer_get_time();
+
+    /* Done at the last body byte; the tunnel then goes back to the pool */
+    proxy_resp_t resp;
+    proxy_resp_cb_t cb = {
+        .on_status = px_status, .on_header = px_header, .on_body = px_body, .ctx = ex,
+    };
+    proxy_resp_init(&resp, &cb, req_is_head(req));
+    return proxy_conn_read_response(conn, &resp, req_timeout_ms(req), req->cancel);
+}
+
+static esp_err_t proxy_request(const http_req_t *req, exchange_t *ex, http_result_t *res)
+{
+    if (req->plain_http) {
+        ESP_LOGE(TAG, "Plain HTTP is not supported through the proxy (%s)", req->host);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    esp_err_t err = ESP_FAIL;
+    for (int attempt = 0; attempt < 2; attempt++) {
+        proxy_conn_t *conn = proxy_conn_acquire(req->host, req_port(req), req_timeout_ms(req),
+                                                req->cancel);
+        if (!conn) return req_cancelled(req) ? ESP_ERR_NOT_FINISHED : ESP_ERR_HTTP_CONNECT;
+        ex_reset(ex);
+        res->reused = proxy_conn_is_reused(conn);
+        ex->connected = !res->reused;
+        err = proxy_exchange(conn, req, ex);
+        proxy_conn_release(conn);   /* pooled only after a complete keep-alive response */
+
+        if (err == ESP_OK) break;
+        /* Resend only if the pooled tunnel was already dead: the write failed,
+         * or the server closed or reset it before sending a single byte. A
+         * timeout is not that: the server may be working on the request, and
+         * a slow POST would run twice. */
+        if (!res->reused ||
+            (err != ESP_ERR_HTTP_CONNECTION_CLOSED && err != ESP_ERR_HTTP_WRITE_DATA)) break;
+        res->reconnected = true;
+        ESP_LOGW(TAG, "Pooled tunnel to %s lost (%s), reconnecting",
+                 req->host, esp_err_to_name(err));
+    }
+    return err;
+}
+
+/* ── Public API ───────────────────────────────────────────────── */
+
+esp_err_t http_client_init(void)
+{
+    s_lock = xSemaphoreCreateMutex();
+    return s_lock ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+esp_err_t http_client_request(const http_req_t *req, http_result_t *res)
+{
+    http_result_t local;
+    if (!res) res = &local;
+    memset(res, 0, sizeof(*res));
+
+    if (req->deadline_us && req_timeout_ms(req) <= 0) return ESP_ERR_TIMEOUT;
+    if (req->cancel && *req->cancel) return ESP_ERR_NOT_FINISHED;
+
+    exchange_t ex = { .req = req };
+    int64_t t0 = esp_timer_get_time();
+    esp_err_t err = http_proxy_is_enabled()
+        ? proxy_request(req, &ex, res)
+        : direct_request(req, &ex, res);
+    res->status = ex.status;
+    if (ex.gz) {
+        /* A body cut short inside the gzip stream is an error too */
+        if (err == ESP_OK) err = http_gzip_finish(ex.gz);
+        http_gzip_free(ex.gz);
+        ex.gz = NULL;
+    }
+
+    if (err == ESP_ERR_NOT_FINISHED) {
+        ESP_LOGI(TAG, "%s %s%s cancelled", req->method, req->host, req->path);
+    } else if (err != ESP_OK) {
+        ESP_LOGW(TAG, "%s %s%s failed: %s (status %d)", req->method, req->host,
+                 req->path, esp_err_to_name(err), ex.status);
+    }
+    stats_record(req, &ex, res->reused, err, t0);
+    return err;
+}
+
+static esp_err_t lease_on_body(void *ctx, const char *data, size_t len)
+{
+    return buf_pool_append((buf_lease_t *)ctx, data, len);
+}
+
+esp_err_t http_client_fetch(const http_req_t *req, buf_lease_t *out, http_result_t *res)
+{
+    http_req_t r = *req;
+    r.on_body = lease_on_body;
+    r.ctx = out;
+    r.on_status = NULL;
+    r.on_header = NULL;
+    return http_client_request(&r, res);
+}
+
+void http_client_parse_url(const char *url, char *host, size_t host_size, int *port,
+                           bool *plain_http, char *path, size_t path_size)
+{
+    const char *h = strstr(url, "://");
+    h = h ? h + 3 : url;
+    *plain_http = (strncmp(url, "http://", 7) == 0);
+    *port = *plain_http ? 80 : 443;
+
+    size_t hlen = strcspn(h, ":/?");
+    if (hlen >= host_size) hlen = host_size - 1;
+    memcpy(host, h, hlen);
+    host[hlen] = '\0';
+
+    const char *rest = h + strcspn(h, ":/?");
+    if (*rest == ':') {
+        *port = atoi(rest + 1);
+        rest += strcspn(rest, "/?");
+    }
+    snprintf(path, path_size, "%s%s", (*rest == '/') ? "" : "/", rest);
+}
+
+void http_client_forget_host(const char *host)
+{
+    if (!s_lock) return;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < MIMI_HTTP_DIRECT_POOL; i++) {
+        direct_conn_t *c = &s_direct[i];
+        if (!c->client || strcmp(c->host, host) != 0) continue;
+        if (c->in_use) {
+            c->drop = true;
+        } else {
+            esp_http_client_cleanup(c->client);
+            c->client = NULL;
+        }
+    }
+    xSemaphoreGive(s_lock);
+}
+
+bool http_client_get_host_stats(int i, http_host_stats_t *out)
+{
+    bool ok = false;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (i >= 0 && i < s_host_count) {
+        *out = s_hosts[i];
+        ok = true;
+    }
+    xSemaphoreGive(s_lock);
+    return ok;
+}
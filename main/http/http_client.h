@@ -0,0 +1,108 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "pool/buf_pool.h"
+
+/*
+ * One HTTP(S) client for every outbound call (LLM, Telegram, search, time,
+ * OTA checks). The request is described once; the transport is picked here:
+ * esp_http_client handles kept alive per host when going direct, pooled
+ * CONNECT tunnels (proxy/http_proxy.h) when a proxy is configured.
+ *
+ * The response is streamed to callbacks: status, headers, then body bytes as
+ * they arrive (gunzipped on the fly for accept_gzip requests). A kept-alive
+ * connection that turns out to be dead before any response byte is replaced
+ * and the request resent once; nothing else is retried at this level.
+ */
+
+typedef esp_err_t (*http_write_fn_t)(void *wctx, const char *data, size_t len);
+
+typedef struct {
+    const char *key;
+    const char *value;
+} http_header_t;
+
+#define HTTP_MAX_HEADERS    6
+
+typedef struct {
+    const char *method;             /* "GET", "POST" or "HEAD" */
+    const char *host;
+    int         port;               /* 0: 443, or 80 with plain_http */
+    bool        plain_http;         /* no TLS (direct path only) */
+    const char *path;               /* with the query string */
+    http_header_t headers[HTTP_MAX_HEADERS];    /* unused entries: key NULL */
+    bool        accept_gzip;        /* send Accept-Encoding: gzip; on_body still gets plain bytes */
+
+    /* Body: a buffer, or a writer called with the connection's write
+     * function (body_len must then be known beforehand). */
+    const char *body;
+    size_t      body_len;
+    esp_err_t (*body_fn)(void *body_ctx, http_write_fn_t write, void *wctx);
+    void       *body_ctx;
+
+    int         timeout_ms;         /* connect and each read */
+    int64_t     deadline_us;        /* esp_timer time the response must be done by, 0: none */
+    const volatile bool *cancel;    /* or NULL; set by another task to abort, seen within
+                                     * MIMI_HTTP_CANCEL_POLL_MS while connecting or waiting
+                                     * for the response, and as its bytes arrive */
+
+    /* Response callbacks, all optional */
+    void (*on_status)(void *ctx, int status);
+    void (*on_header)(void *ctx, const char *key, const char *value);
+    esp_err_t (*on_body)(void *ctx, const char *data, size_t len);
+    void       *ctx;
+} http_req_t;
+
+typedef struct {
+    int  status;            /* 0: no response */
+    bool reused;            /* sent on a kept-alive connection */
+    bool reconnected;       /* resent after that connection turned out stale */
+} http_result_t;
+
+/** Per-host counters, both transports */
+typedef struct {
+    char     host[48];
+    uint32_t requests;
+    uint32_t errors;        /* transport errors (not HTTP error statuses) */
+    uint32_t connects;      /* new connections opened */
+    uint32_t reuses;        /* requests on a kept-alive connection */
+    uint32_t bytes_in;      /* body bytes received (on the wire) */
+    uint32_t bytes_decoded; /* body bytes after gzip decoding */
+    uint32_t ttfb_ms_total; /* request sent → first body byte */
+    uint32_t time_ms_total; /* whole request */
+} http_host_stats_t;
+
+esp_err_t http_client_init(void);
+
+/**
+ * Run one request.
+ * @return ESP_OK once the whole response was received (any HTTP status),
+ *         ESP_ERR_TIMEOUT past deadline_us, ESP_ERR_NOT_FINISHED once *cancel
+ *         was set (the connection is closed), or a transport / on_body error
+ */
+esp_err_t http_client_request(const http_req_t *req, http_result_t *res);
+
+/**
+ * Convenience: run req and append the body to out, an acquired lease
+ * (req's on_body / ctx are ignored).
+ */
+esp_err_t http_client_fetch(const http_req_t *req, buf_lease_t *out, http_result_t *res);
+
+/**
+ * "http[s]://host[:port]/path" → parts. host and path are truncated to
+ * their sizes; path defaults to "/".
+ */
+void http_client_parse_url(const char *url, char *host, size_t host_size, int *port,
+                           bool *plain_http, char *path, size_t path_size);
+
+/** Drop the kept-alive direct connection(s) to host, if any. */
+void http_client_forget_host(const char *host);
+
+/**
+ * Copy host entry i (0-based).
+ * @return false past the last entry
+ */
+bool http_client_get_host_stats(int i, http_host_stats_t *out);
@@ -0,0 +1,208 @@
+#include "http_gzip.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_rom_crc.h"
+#include "rom/miniz.h"
+
+static const char *TAG = "gzip";
+
+/* Header flags (RFC 1952 2.3.1) */
+#define GZ_FHCRC     0x02
+#define GZ_FEXTRA    0x04
+#define GZ_FNAME     0x08
+#define GZ_FCOMMENT  0x10
+
+/* Stream parts, in order; the optional ones are skipped per the flags */
+typedef enum {
+    GZ_HEADER = 0,
+    GZ_EXTRA_LEN,
+    GZ_EXTRA,
+    GZ_NAME,
+    GZ_COMMENT,
+    GZ_HCRC,
+    GZ_DEFLATE,
+    GZ_TRAILER,
+    GZ_DONE,
+} gz_state_t;
+
+struct http_gzip {
+    tinfl_decompressor inflator;
+    gz_state_t state;
+    uint8_t  flags;
+    uint8_t  field[10];         /* fixed header, FEXTRA length, trailer */
+    size_t   got;               /* bytes of the current part so far */
+    size_t   extra_len;
+    uint32_t crc;
+    uint32_t size;
+    size_t   dict_ofs;
+    uint8_t  dict[TINFL_LZ_DICT_SIZE];  /* output ring = inflate history */
+};
+
+http_gzip_t *http_gzip_new(void)
+{
+    http_gzip_t *gz = heap_caps_malloc(sizeof(http_gzip_t), MALLOC_CAP_SPIRAM);
+    if (!gz) return NULL;
+    tinfl_init(&gz->inflator);
+    gz->state = GZ_HEADER;
+    gz->flags = 0;
+    gz->got = 0;
+    gz->extra_len = 0;
+    gz->crc = 0;
+    gz->size = 0;
+    gz->dict_ofs = 0;
+    return gz;
+}
+
+void http_gzip_free(http_gzip_t *gz)
+{
+    free(gz);
+}
+
+/* The part after `from` that the header flags ask for */
+static gz_state_t next_part(const http_gzip_t *gz, gz_state_t from)
+{
+    static const uint8_t flag_of[] = {
+        [GZ_EXTRA_LEN] = GZ_FEXTRA, [GZ_NAME] = GZ_FNAME,
+        [GZ_COMMENT] = GZ_FCOMMENT, [GZ_HCRC] = GZ_FHCRC,
+    };
+    for (int s = from + 1; s < GZ_DEFLATE; s++) {
+        if (s != GZ_EXTRA && (gz->flags & flag_of[s])) return (gz_state_t)s;
+    }
+    return GZ_DEFLATE;
+}
+
+static uint32_t le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* Inflate as much of in as possible; out gets each decoded run */
+static esp_err_t inflate_some(http_gzip_t *gz, const uint8_t **in, size_t *left,
+                              http_write_fn_t out, void *ctx)
+{
+    tinfl_status st;
+    do {
+        size_t in_n = *left;
+        size_t out_n = TINFL_LZ_DICT_SIZE - gz->dict_ofs;
+        st = tinfl_decompress(&gz->inflator, *in, &in_n, gz->dict, gz->dict + gz->dict_ofs,
+                              &out_n, TINFL_FLAG_HAS_MORE_INPUT);
+        *in += in_n;
+        *left -= in_n;
+        if (out_n) {
+            const uint8_t *o = gz->dict + gz->dict_ofs;
+            gz->crc = esp_rom_crc32_le(gz->crc, o, out_n);
+            gz->size += out_n;
+            gz->dict_ofs = (gz->dict_ofs + out_n) & (TINFL_LZ_DICT_SIZE - 1);
+            esp_err_t err = out(ctx, (const char *)o, out_n);
+            if (err != ESP_OK) return err;
+        }
+        if (st < TINFL_STATUS_DONE) {
+            ESP_LOGW(TAG, "Corrupt deflate data (status %d)", (int)st);
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+        /* Ne devrait pas arriver: tinfl consomme tout avant de redemander */
+        if (in_n == 0 && out_n == 0 && st == TINFL_STATUS_NEEDS_MORE_INPUT && *left) {
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+    } while (st == TINFL_STATUS_HAS_MORE_OUTPUT || (st == TINFL_STATUS_NEEDS_MORE_INPUT && *left));
+
+    if (st == TINFL_STATUS_DONE) {
+        gz->state = GZ_TRAILER;
+        gz->got = 0;
+    }
+    return ESP_OK;
+}
+
+esp_err_t http_gzip_feed(http_gzip_t *gz, const char *data, size_t len,
+                         http_write_fn_t out, void *ctx)
+{
+    const uint8_t *p = (const uint8_t *)data;
+
+    while (len > 0) {
+        switch (gz->state) {
+        case GZ_HEADER:
+            gz->field[gz->got++] = *p++;
+            len--;
+            if (gz->got < 10) break;
+            if (gz->field[0] != 0x1f || gz->field[1] != 0x8b || gz->field[2] != 8) {
+                ESP_LOGW(TAG, "Not a gzip stream");
+                return ESP_ERR_INVALID_RESPONSE;
+            }
+            gz->flags = gz->field[3];
+            gz->got = 0;
+            gz->state = next_part(gz, GZ_HEADER);
+            break;
+
+        case GZ_EXTRA_LEN:
+            gz->field[gz->got++] = *p++;
+            len--;
+            if (gz->got < 2) break;
+            gz->extra_len = gz->field[0] | (gz->field[1] << 8);
+            gz->got = 0;
+            gz->state = gz->extra_len ? GZ_EXTRA : next_part(gz, GZ_EXTRA);
+            break;
+
+        case GZ_EXTRA: {
+            size_t n = gz->extra_len - gz->got;
+            if (n > len) n = len;
+            gz->got += n;
+            p += n;
+            len -= n;
+            if (gz->got == gz->extra_len) {
+                gz->got = 0;
+                gz->state = next_part(gz, GZ_EXTRA);
+            }
+            break;
+        }
+
+        case GZ_NAME:
+        case GZ_COMMENT:
+            /* Zero-terminated */
+            len--;
+            if (*p++ == 0) gz->state = next_part(gz, gz->state);
+            break;
+
+        case GZ_HCRC:
+            p++;
+            len--;
+            if (++gz->got == 2) {
+                gz->got = 0;
+                gz->state = GZ_DEFLATE;
+            }
+            break;
+
+        case GZ_DEFLATE: {
+            esp_err_t err = inflate_some(gz, &p, &len, out, ctx);
+            if (err != ESP_OK) return err;
+            break;
+        }
+
+        case GZ_TRAILER:
+            gz->field[gz->got++] = *p++;
+            len--;
+            if (gz->got < 8) break;
+            if (le32(gz->field) != gz->crc || le32(gz->field + 4) != gz->size) {
+                ESP_LOGW(TAG, "CRC or length mismatch (%u bytes decoded)", (unsigned)gz->size);
+                return ESP_ERR_INVALID_RESPONSE;
+            }
+            gz->state = GZ_DONE;
+            break;
+
+        case GZ_DONE:
+            /* Further members / padding: not sent by the servers we talk to */
+            return ESP_OK;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t http_gzip_finish(http_gzip_t *gz)
+{
+    if (gz->state == GZ_DONE) return ESP_OK;
+    if (gz->state == GZ_HEADER && gz->got == 0) return ESP_OK;
+    ESP_LOGW(TAG, "Truncated gzip stream (%u bytes decoded)", (unsigned)gz->size);
+    return ESP_ERR_INVALID_RESPONSE;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stddef.h>
+#include <stdint.h>
+#include "http_client.h"
+
+/*
+ * Streaming gzip (RFC 1952) decoder on top of the ROM inflater (tinfl).
+ * Compressed bytes are fed as they come off the socket; decoded bytes are
+ * passed on in chunks of up to 32 KB through the 32 KB history window, so
+ * the compressed body is never buffered.
+ */
+
+typedef struct http_gzip http_gzip_t;
+
+/** ~43 KB in PSRAM, NULL if out of memory */
+http_gzip_t *http_gzip_new(void);
+
+void http_gzip_free(http_gzip_t *gz);
+
+/**
+ * Decode len more compressed bytes, calling out for every decoded chunk.
+ * @return ESP_ERR_INVALID_RESPONSE on a malformed stream, or out's error
+ */
+esp_err_t http_gzip_feed(http_gzip_t *gz, const char *data, size_t len,
+                         http_write_fn_t out, void *ctx);
+
+/**
+ * End of the body: the stream must be complete and its CRC and length
+ * match (an empty body is accepted, e.g. 304).
+ */
+esp_err_t http_gzip_finish(http_gzip_t *gz);
@@ -0,0 +1,265 @@
+#include "json_tok.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+/* ── Tokenizer ────────────────────────────────────────────────── */
+
+static int tok_new(jtok_t *toks, int *count, int max_tokens,
+                   jtok_type_t type, int start, int end, int parent)
+{
+    if (*count >= max_tokens) return JTOK_ERR_NOMEM;
+    jtok_t *t = &toks[*count];
+    t->type = type;
+    t->start = start;
+    t->end = end;
+    t->size = 0;
+    t->parent = parent;
+    if (parent >= 0) toks[parent].size++;
+    return (*count)++;
+}
+
+static int hexval(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+int json_tok_parse(const char *js, size_t len, jtok_t *toks, int max_tokens)
+{
+    int count = 0;
+    int parent = -1;
+
+    for (size_t pos = 0; pos < len; pos++) {
+        char c = js[pos];
+        int r;
+
+        switch (c) {
+        case '{':
+        case '[':
+            r = tok_new(toks, &count, max_tokens, (c == '{') ? JTOK_OBJECT : JTOK_ARRAY,
+                        (int)pos, -1, parent);
+            if (r < 0) return r;
+            parent = r;
+            break;
+
+        case '}':
+        case ']':
+            if (parent < 0) return JTOK_ERR_INVAL;
+            if (toks[parent].type != ((c == '}') ? JTOK_OBJECT : JTOK_ARRAY)) return JTOK_ERR_INVAL;
+            toks[parent].end = (int)pos + 1;
+            parent = toks[parent].parent;
+            break;
+
+        case '"': {
+            size_t start = pos + 1;
+            for (pos = start; pos < len && js[pos] != '"'; pos++) {
+                if (js[pos] == '\\') {
+                    if (++pos >= len) return JTOK_ERR_PART;
+                    if (js[pos] == 'u') {
+                        for (int k = 0; k < 4; k++) {
+                            if (++pos >= len) return JTOK_ERR_PART;
+                            if (hexval(js[pos]) < 0) return JTOK_ERR_INVAL;
+                        }
+                    } else if (!strchr("\"\\/bfnrt", js[pos])) {
+                        return JTOK_ERR_INVAL;
+                    }
+                } else if ((unsigned char)js[pos] < 0x20) {
+                    return JTOK_ERR_INVAL;
+                }
+            }
+            if (pos >= len) return JTOK_ERR_PART;
+            r = tok_new(toks, &count, max_tokens, JTOK_STRING, (int)start, (int)pos, parent);
+            if (r < 0) return r;
+            break;
+        }
+
+        case ' ': case '\t': case '\r': case '\n':
+        case ':': case ',':
+            break;
+
+        default: {
+            if (!strchr("-0123456789tfn", c)) return JTOK_ERR_INVAL;
+            size_t start = pos;
+            while (pos < len && !strchr(" \t\r\n,:]}", js[pos])) {
+                if ((unsigned char)js[pos] < 0x20) return JTOK_ERR_INVAL;
+                pos++;
+            }
+            r = tok_new(toks, &count, max_tokens, JTOK_PRIMITIVE, (int)start, (int)pos, parent);
+            if (r < 0) return r;
+            pos--;  /* the delimiter is handled by the loop */
+            break;
+        }
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (toks[i].end < 0) return JTOK_ERR_PART;
+    }
+    return count;
+}
+
+/* ── Navigation ───────────────────────────────────────────────── */
+
+int json_tok_skip(const jtok_t *toks, int count, int i)
+{
+    if (toks[i].type != JTOK_OBJECT && toks[i].type != JTOK_ARRAY) return i + 1;
+    int end = toks[i].end;
+    for (i++; i < count && toks[i].start < end; i++) {}
+    return i;
+}
+
+int json_tok_get(const char *js, const jtok_t *toks, int count, int obj, const char *key)
+{
+    if (obj < 0 || obj >= count || toks[obj].type != JTOK_OBJECT) return -1;
+
+    int i = obj + 1;
+    for (int k = 0; k + 1 < toks[obj].size && i < count; k += 2) {
+        int val = json_tok_skip(toks, count, i);
+        if (val >= count) return -1;
+        if (json_tok_eq(js, toks, i, key)) return val;
+        i = json_tok_skip(toks, count, val);
+    }
+    return -1;
+}
+
+int json_tok_at(const jtok_t *toks, int count, int arr, int idx)
+{
+    if (arr < 0 || arr >= count || toks[arr].type != JTOK_ARRAY) return -1;
+    if (idx < 0 || idx >= toks[arr].size) return -1;
+
+    int i = arr + 1;
+    while (idx-- > 0 && i < count) i = json_tok_skip(toks, count, i);
+    return (i < count) ? i : -1;
+}
+
+bool json_tok_eq(const char *js, const jtok_t *toks, int i, const char *s)
+{
+    if (i < 0 || toks[i].type != JTOK_STRING) return false;
+    size_t n = strlen(s);
+    return json_tok_raw_len(toks, i) == n && memcmp(js + toks[i].start, s, n) == 0;
+}
+
+bool json_tok_is_null(const char *js, const jtok_t *toks, int i)
+{
+    if (i < 0) return true;
+    return toks[i].type == JTOK_PRIMITIVE && js[toks[i].start] == 'n';
+}
+
+long json_tok_long(const char *js, const jtok_t *toks, int i, long def)
+{
+    if (i < 0 || toks[i].type != JTOK_PRIMITIVE) return def;
+    char c = js[toks[i].start];
+    if (c != '-' && (c < '0' || c > '9')) return def;
+
+    char num[24];
+    size_t n = json_tok_raw_len(toks, i);
+    if (n >= sizeof(num)) n = sizeof(num) - 1;
+    memcpy(num, js + toks[i].start, n);
+    num[n] = '\0';
+    return strtol(num, NULL, 10);
+}
+
+/* ── String decoding ──────────────────────────────────────────── */
+
+static size_t utf8_put(char *out, unsigned cp)
+{
+    if (cp < 0x80) {
+        out[0] = (char)cp;
+        return 1;
+    } else if (cp < 0x800) {
+        out[0] = (char)(0xC0 | (cp >> 6));
+        out[1] = (char)(0x80 | (cp & 0x3F));
+        return 2;
+    } else if (cp < 0x10000) {
+        out[0] = (char)(0xE0 | (cp >> 12));
+        out[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (cp & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (cp >> 18));
+    out[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (cp & 0x3F));
+    return 4;
+}
+
+static unsigned hex4(const char *p)
+{
+    return (unsigned)(hexval(p[0]) << 12 | hexval(p[1]) << 8 | hexval(p[2]) << 4 | hexval(p[3]));
+}
+
+size_t json_tok_str(const char *js, const jtok_t *toks, int i, char *out, size_t out_size)
+{
+    if (out_size == 0) return 0;
+    if (i < 0 || toks[i].type != JTOK_STRING) {
+        out[0] = '\0';
+        return 0;
+    }
+
+    const char *p = js + toks[i].start;
+    const char *end = js + toks[i].end;
+    size_t o = 0;
+
+    while (p < end) {
+        char enc[4];
+        size_t n;
+
+        if (*p != '\\') {
+            /* Copy the unescaped run in one go */
+            const char *bs = memchr(p, '\\', end - p);
+            n = (bs ? bs : end) - p;
+            if (n > out_size - 1 - o) n = out_size - 1 - o;
+            memcpy(out + o, p, n);
+            o += n;
+            p += n;
+            if (o == out_size - 1) break;
+            continue;
+        }
+
+        /* Escapes were validated by the tokenizer */
+        p++;
+        switch (*p) {
+        case 'b': enc[0] = '\b'; n = 1; p++; break;
+        case 'f': enc[0] = '\f'; n = 1; p++; break;
+        case 'n': enc[0] = '\n'; n = 1; p++; break;
+        case 'r': enc[0] = '\r'; n = 1; p++; break;
+        case 't': enc[0] = '\t'; n = 1; p++; break;
+        case 'u': {
+            unsigned cp = hex4(p + 1);
+            p += 5;
+            if (cp >= 0xD800 && cp <= 0xDBFF) {
+                /* High surrogate: combine with a following low surrogate */
+                if (end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+                    unsigned lo = hex4(p + 2);
+                    if (lo >= 0xDC00 && lo <= 0xDFFF) {
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                        p += 6;
+                    } else {
+                        cp = 0xFFFD;
+                    }
+                } else {
+                    cp = 0xFFFD;
+                }
+            } else if (cp >= 0xDC00 && cp <= 0xDFFF) {
+                cp = 0xFFFD;    /* lone low surrogate */
+            }
+            n = utf8_put(enc, cp);
+            break;
+        }
+        default:  /* " \ / */
+            enc[0] = *p++;
+            n = 1;
+            break;
+        }
+
+        if (n > out_size - 1 - o) break;    /* never split a character */
+        memcpy(out + o, enc, n);
+        o += n;
+    }
+
+    out[o] = '\0';
+    return o;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * jsmn-style JSON tokenizer: one pass over a buffer fills a caller-provided
+ * array of tokens (type + byte range), no allocation and no DOM. Values are
+ * looked up by walking the flat token array and decoded on demand.
+ */
+
+typedef enum {
+    JTOK_UNDEF = 0,
+    JTOK_OBJECT,
+    JTOK_ARRAY,
+    JTOK_STRING,        /* start/end exclude the quotes; still escaped */
+    JTOK_PRIMITIVE,     /* number, true, false, null */
+} jtok_type_t;
+
+typedef struct {
+    jtok_type_t type;
+    int start;          /* byte offset in the input */
+    int end;            /* one past the last byte */
+    int size;           /* direct children (objects count keys and values) */
+    int parent;         /* index of the enclosing container, -1 for the root */
+} jtok_t;
+
+#define JTOK_ERR_NOMEM  (-1)    /* more tokens than max_tokens */
+#define JTOK_ERR_INVAL  (-2)    /* malformed input */
+#define JTOK_ERR_PART   (-3)    /* input ends inside a value */
+
+/**
+ * Tokenize len bytes of js.
+ * @return number of tokens used, or a JTOK_ERR_* code
+ */
+int json_tok_parse(const char *js, size_t len, jtok_t *toks, int max_tokens);
+
+/** Index of the first token after the subtree rooted at i. */
+int json_tok_skip(const jtok_t *toks, int count, int i);
+
+/** Value token for key in object obj, or -1. */
+int json_tok_get(const char *js, const jtok_t *toks, int count, int obj, const char *key);
+
+/** Token of element idx in array arr, or -1. */
+int json_tok_at(const jtok_t *toks, int count, int arr, int idx);
+
+/** True if token i is a string whose raw bytes equal s. */
+bool json_tok_eq(const char *js, const jtok_t *toks, int i, const char *s);
+
+/** True if token i is the literal null (or absent: i < 0). */
+bool json_tok_is_null(const char *js, const jtok_t *toks, int i);
+
+/** Integer value of primitive token i, or def if it is not a number. */
+long json_tok_long(const char *js, const jtok_t *toks, int i, long def);
+
+/**
+ * Decode string token i (escapes, \uXXXX, surrogate pairs) into out,
+ * truncating to out_size - 1 bytes. Always NUL-terminates when out_size > 0.
+ * Decoded length never exceeds the raw length, so out_size = raw + 1 never truncates.
+ * @return decoded length
+ */
+size_t json_tok_str(const char *js, const jtok_t *toks, int i, char *out, size_t out_size);
+
+/** Raw (escaped) length of token i. */
+static inline size_t json_tok_raw_len(const jtok_t *toks, int i)
+{
+    return (size_t)(toks[i].end - toks[i].start);
+}
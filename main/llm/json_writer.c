@@ -0,0 +1,161 @@
+#include "json_writer.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+void json_writer_init(json_writer_t *w, json_sink_fn_t sink, void *ctx)
+{
+    w->sink = sink;
+    w->ctx = ctx;
+    w->used = 0;
+    w->total = 0;
+    w->err = ESP_OK;
+}
+
+static void jw_drain(json_writer_t *w)
+{
+    if (w->used == 0) return;
+    if (w->err == ESP_OK) {
+        w->err = w->sink(w->ctx, w->buf, w->used);
+    }
+    w->used = 0;
+}
+
+void jw_raw(json_writer_t *w, const char *data, size_t len)
+{
+    w->total += len;
+    if (!w->sink || w->err != ESP_OK) return;
+
+    while (len > 0) {
+        size_t room = sizeof(w->buf) - w->used;
+        size_t n = (len < room) ? len : room;
+        memcpy(w->buf + w->used, data, n);
+        w->used += n;
+        data += n;
+        len -= n;
+        if (w->used == sizeof(w->buf)) jw_drain(w);
+    }
+}
+
+void jw_lit(json_writer_t *w, const char *s)
+{
+    jw_raw(w, s, strlen(s));
+}
+
+void jw_strn(json_writer_t *w, const char *s, size_t len)
+{
+    jw_raw(w, "\"", 1);
+
+    /* Runs of characters that need no escaping are copied in one go */
+    size_t run = 0;
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)s[i];
+        const char *esc = NULL;
+        char ubuf[7];
+        switch (c) {
+        case '"':  esc = "\\\""; break;
+        case '\\': esc = "\\\\"; break;
+        case '\b': esc = "\\b"; break;
+        case '\f': esc = "\\f"; break;
+        case '\n': esc = "\\n"; break;
+        case '\r': esc = "\\r"; break;
+        case '\t': esc = "\\t"; break;
+        default:
+            if (c < 0x20) {
+                snprintf(ubuf, sizeof(ubuf), "\\u%04x", c);
+                esc = ubuf;
+            }
+            break;
+        }
+        if (!esc) continue;
+        jw_raw(w, s + run, i - run);
+        jw_lit(w, esc);
+        run = i + 1;
+    }
+    jw_raw(w, s + run, len - run);
+
+    jw_raw(w, "\"", 1);
+}
+
+void jw_str(json_writer_t *w, const char *s)
+{
+    if (!s) s = "";
+    jw_strn(w, s, strlen(s));
+}
+
+void jw_int(json_writer_t *w, long v)
+{
+    char num[24];
+    int n = snprintf(num, sizeof(num), "%ld", v);
+    jw_raw(w, num, n);
+}
+
+/* Same formatting rules as cJSON's print_number() */
+static void jw_number(json_writer_t *w, const cJSON *item)
+{
+    double d = item->valuedouble;
+    char num[32];
+    int n;
+
+    if (isnan(d) || isinf(d)) {
+        n = snprintf(num, sizeof(num), "null");
+    } else if (d == (double)item->valueint) {
+        n = snprintf(num, sizeof(num), "%d", item->valueint);
+    } else {
+        n = snprintf(num, sizeof(num), "%1.15g", d);
+        double test = 0;
+        if (sscanf(num, "%lg", &test) != 1 || test != d) {
+            n = snprintf(num, sizeof(num), "%1.17g", d);
+        }
+    }
+    jw_raw(w, num, n);
+}
+
+void jw_value(json_writer_t *w, const cJSON *item)
+{
+    if (!item) {
+        jw_lit(w, "null");
+        return;
+    }
+
+    switch (item->type & 0xFF) {
+    case cJSON_NULL:   jw_lit(w, "null"); break;
+    case cJSON_False:  jw_lit(w, "false"); break;
+    case cJSON_True:   jw_lit(w, "true"); break;
+    case cJSON_Number: jw_number(w, item); break;
+    case cJSON_String: jw_str(w, item->valuestring); break;
+    case cJSON_Raw:
+        if (item->valuestring) jw_lit(w, item->valuestring);
+        break;
+    case cJSON_Array: {
+        jw_raw(w, "[", 1);
+        for (const cJSON *c = item->child; c; c = c->next) {
+            jw_value(w, c);
+            if (c->next) jw_raw(w, ",", 1);
+        }
+        jw_raw(w, "]", 1);
+        break;
+    }
+    case cJSON_Object: {
+        jw_raw(w, "{", 1);
+        for (const cJSON *c = item->child; c; c = c->next) {
+            jw_str(w, c->string);
+            jw_raw(w, ":", 1);
+            jw_value(w, c);
+            if (c->next) jw_raw(w, ",", 1);
+        }
+        jw_raw(w, "}", 1);
+        break;
+    }
+    default:
+        jw_lit(w, "null");
+        break;
+    }
+}
+
+esp_err_t jw_flush(json_writer_t *w)
+{
+    if (w->sink) jw_drain(w);
+    return w->err;
+}
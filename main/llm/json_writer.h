@@ -0,0 +1,52 @@
+#pragma once
+
+#include "esp_err.h"
+#include "cJSON.h"
+#include <stddef.h>
+
+/*
+ * Streaming JSON emitter. Output goes through a small fixed buffer to a
+ * sink callback, so a request body can be written to the socket without
+ * ever existing as one contiguous string. With a NULL sink the writer only
+ * counts bytes, which gives the Content-Length for a second, real pass.
+ */
+
+#define JSON_WRITER_BUF_SIZE  512
+
+/** Receives each filled buffer. Returns ESP_OK or an error that stops the writer. */
+typedef esp_err_t (*json_sink_fn_t)(void *ctx, const char *data, size_t len);
+
+typedef struct {
+    json_sink_fn_t sink;    /* NULL: count only */
+    void *ctx;
+    char buf[JSON_WRITER_BUF_SIZE];
+    size_t used;
+    size_t total;           /* bytes emitted so far */
+    esp_err_t err;          /* first sink error, sticky */
+} json_writer_t;
+
+void json_writer_init(json_writer_t *w, json_sink_fn_t sink, void *ctx);
+
+/** Append bytes verbatim (structural JSON written by the caller). */
+void jw_raw(json_writer_t *w, const char *data, size_t len);
+
+/** Append a NUL-terminated literal verbatim. */
+void jw_lit(json_writer_t *w, const char *s);
+
+/** Append a quoted, escaped JSON string of len bytes. */
+void jw_strn(json_writer_t *w, const char *s, size_t len);
+
+/** Append a quoted, escaped JSON string (NULL → ""). */
+void jw_str(json_writer_t *w, const char *s);
+
+/** Append an integer. */
+void jw_int(json_writer_t *w, long v);
+
+/** Serialize a cJSON tree exactly as cJSON_PrintUnformatted would. */
+void jw_value(json_writer_t *w, const cJSON *item);
+
+/**
+ * Hand the buffered tail to the sink.
+ * @return the first sink error, or ESP_OK
+ */
+esp_err_t jw_flush(json_writer_t *w);
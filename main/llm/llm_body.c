@@ -0,0 +1,435 @@
+#include "llm_body.h"
+#include "mimi_config.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+
+static const char *TAG = "llm";
+
+/* ── Request body ─────────────────────────────────────────────── */
+
+void llm_body_measure(llm_body_t *body)
+{
+    json_writer_t w;
+    json_writer_init(&w, NULL, NULL);
+    body->emit(&w, body->arg);
+    body->len = w.total;
+}
+
+esp_err_t llm_body_send(const llm_body_t *body, json_sink_fn_t sink, void *ctx)
+{
+    json_writer_t w;
+    json_writer_init(&w, sink, ctx);
+    body->emit(&w, body->arg);
+    esp_err_t err = jw_flush(&w);
+    if (err == ESP_OK && w.total != body->len) {
+        /* Le contenu a change entre les deux passes: Content-Length faux */
+        ESP_LOGE(TAG, "Body length mismatch (%d != %d)", (int)w.total, (int)body->len);
+        err = ESP_ERR_INVALID_SIZE;
+    }
+    return err;
+}
+
+/* ══════════════════════════════════════════════════════════════════
+ * TRADUCTION ANTHROPIC → OPENAI (pour Kimi)
+ * ══════════════════════════════════════════════════════════════════ */
+
+/* Les textes (prompt, messages, resultats d'outils) sont references, pas copies:
+ * the translated tree must be deleted before the source messages. */
+static void add_str_ref(cJSON *obj, const char *key, const char *str)
+{
+    cJSON_AddItemToObject(obj, key, cJSON_CreateStringReference(str));
+}
+
+/* Traduit un message Anthropic (tool_use/tool_result) → format OpenAI (tool_calls/role:tool).
+ * Appends zero or more messages to oai_msgs (one per tool_result block). */
+static void translate_message_to_openai(const cJSON *msg, cJSON *oai_msgs)
+{
+    cJSON *role = cJSON_GetObjectItem(msg, "role");
+    cJSON *content = cJSON_GetObjectItem(msg, "content");
+    if (!role || !cJSON_IsString(role)) return;
+
+    if (strcmp(role->valuestring, "user") == 0) {
+        if (cJSON_IsString(content)) {
+            /* Message texte simple */
+            cJSON *oai = cJSON_CreateObject();
+            cJSON_AddStringToObject(oai, "role", "user");
+            add_str_ref(oai, "content", content->valuestring);
+            cJSON_AddItemToArray(oai_msgs, oai);
+
+        } else if (cJSON_IsArray(content)) {
+            /* Contient des blocs tool_result → messages role:tool */
+            cJSON *block;
+            cJSON_ArrayForEach(block, content) {
+                cJSON *btype = cJSON_GetObjectItem(block, "type");
+                if (!btype || strcmp(btype->valuestring, "tool_result") != 0) continue;
+
+                cJSON *tool_id = cJSON_GetObjectItem(block, "tool_use_id");
+                cJSON *result = cJSON_GetObjectItem(block, "content");
+
+                cJSON *oai = cJSON_CreateObject();
+                cJSON_AddStringToObject(oai, "role", "tool");
+                if (tool_id && cJSON_IsString(tool_id))
+                    cJSON_AddStringToObject(oai, "tool_call_id", tool_id->valuestring);
+                if (result && cJSON_IsString(result))
+                    add_str_ref(oai, "content", result->valuestring);
+                else
+                    cJSON_AddStringToObject(oai, "content", "");
+                cJSON_AddItemToArray(oai_msgs, oai);
+            }
+        }
+
+    } else if (strcmp(role->valuestring, "assistant") == 0) {
+        if (cJSON_IsString(content)) {
+            /* Message texte simple */
+            cJSON *oai = cJSON_CreateObject();
+            cJSON_AddStringToObject(oai, "role", "assistant");
+            add_str_ref(oai, "content", content->valuestring);
+            cJSON_AddItemToArray(oai_msgs, oai);
+
+        } else if (cJSON_IsArray(content)) {
+            /* Contient text + blocs tool_use → assistant + tool_calls */
+            cJSON *oai = cJSON_CreateObject();
+            cJSON_AddStringToObject(oai, "role", "assistant");
+
+            const char *text_val = NULL;
+            cJSON *tool_calls = NULL;
+
+            cJSON *block;
+            cJSON_ArrayForEach(block, content) {
+                cJSON *btype = cJSON_GetObjectItem(block, "type");
+                if (!btype) continue;
+
+                if (strcmp(btype->valuestring, "text") == 0) {
+                    cJSON *t = cJSON_GetObjectItem(block, "text");
+                    if (t && cJSON_IsString(t)) text_val = t->valuestring;
+
+                } else if (strcmp(btype->valuestring, "tool_use") == 0) {
+                    if (!tool_calls) tool_calls = cJSON_CreateArray();
+
+                    cJSON *tc = cJSON_CreateObject();
+                    cJSON *id = cJSON_GetObjectItem(block, "id");
+                    cJSON *name = cJSON_GetObjectItem(block, "name");
+                    cJSON *input = cJSON_GetObjectItem(block, "input");
+
+                    if (id && cJSON_IsString(id))
+                        cJSON_AddStringToObject(tc, "id", id->valuestring);
+                    cJSON_AddStringToObject(tc, "type", "function");
+
+                    cJSON *func = cJSON_CreateObject();
+                    if (name && cJSON_IsString(name))
+                        cJSON_AddStringToObject(func, "name", name->valuestring);
+                    if (input) {
+                        char *args = cJSON_PrintUnformatted(input);
+                        if (args) {
+                            cJSON_AddStringToObject(func, "arguments", args);
+                            free(args);
+                        }
+                    }
+                    cJSON_AddItemToObject(tc, "function", func);
+                    cJSON_AddItemToArray(tool_calls, tc);
+                }
+            }
+
+            if (text_val)
+                add_str_ref(oai, "content", text_val);
+            else
+                cJSON_AddNullToObject(oai, "content");
+
+            if (tool_calls)
+                cJSON_AddItemToObject(oai, "tool_calls", tool_calls);
+
+            cJSON_AddItemToArray(oai_msgs, oai);
+        }
+    }
+}
+
+/* ── Emission du body (chat avec tools) ──────────────────────── */
+
+static void emit_cache_control(json_writer_t *w)
+{
+    jw_lit(w, ",\"cache_control\":{\"type\":\"ephemeral\"}");
+}
+
+/* Anthropic "system" as content blocks: the static prefix carries the cache
+ * breakpoint, the dynamic tail (recent notes, perception) follows it. */
+static void emit_anthropic_system(json_writer_t *w, const char *prompt, size_t static_len)
+{
+    size_t total = prompt ? strlen(prompt) : 0;
+    if (static_len == 0 || static_len > total) {
+        jw_str(w, prompt);
+        return;
+    }
+
+    jw_lit(w, "[{\"type\":\"text\",\"text\":");
+    jw_strn(w, prompt, static_len);
+    emit_cache_control(w);
+    jw_lit(w, "}");
+    if (total > static_len) {
+        jw_lit(w, ",{\"type\":\"text\",\"text\":");
+        jw_strn(w, prompt + static_len, total - static_len);
+        jw_lit(w, "}");
+    }
+    jw_lit(w, "]");
+}
+
+/* Everything up to and including the opening of the messages array.
+ * *elems counts the array elements emitted so far. */
+static void emit_body_prefix(json_writer_t *w, const llm_body_ctx_t *ctx, int *elems)
+{
+    const char *prompt = ctx->req->system_prompt;
+
+    jw_lit(w, "{\"model\":");
+    jw_str(w, ctx->model);
+    jw_lit(w, ",\"max_tokens\":");
+    jw_int(w, MIMI_LLM_MAX_TOKENS);
+    jw_lit(w, ",\"stream\":true");
+    /* Kimi reports usage in its last chunk on its own, OpenAI only on request */
+    if (ctx->provider == LLM_PROVIDER_OPENAI) {
+        jw_lit(w, ",\"stream_options\":{\"include_usage\":true}");
+    }
+
+    if (is_openai_fmt(ctx->provider)) {
+        if (ctx->tools) {
+            jw_lit(w, ",\"tools\":");
+            jw_value(w, ctx->tools);
+            jw_lit(w, ",\"tool_choice\":\"auto\"");
+        }
+        jw_lit(w, ",\"messages\":[");
+        /* System prompt comme premier message */
+        if (prompt && prompt[0]) {
+            jw_lit(w, "{\"role\":\"system\",\"content\":");
+            jw_str(w, prompt);
+            jw_lit(w, "}");
+            (*elems)++;
+        }
+    } else {
+        jw_lit(w, ",\"system\":");
+        emit_anthropic_system(w, prompt, ctx->req->system_static_len);
+        if (ctx->tools) {
+            jw_lit(w, ",\"tools\":");
+            jw_value(w, ctx->tools);
+        }
+        jw_lit(w, ",\"messages\":[");
+    }
+}
+
+/* One source (Anthropic-format) message, translated for OpenAI-format backends */
+static void emit_body_message(json_writer_t *w, const llm_body_ctx_t *ctx,
+                              const cJSON *msg, int *elems)
+{
+    if (!is_openai_fmt(ctx->provider)) {
+        if (*elems) jw_lit(w, ",");
+        jw_value(w, msg);
+        (*elems)++;
+        return;
+    }
+
+    /* Textes references, pas copies: l'arbre traduit est ephemere */
+    cJSON *oai = cJSON_CreateArray();
+    translate_message_to_openai(msg, oai);
+    const cJSON *m;
+    cJSON_ArrayForEach(m, oai) {
+        if (*elems) jw_lit(w, ",");
+        jw_value(w, m);
+        (*elems)++;
+    }
+    cJSON_Delete(oai);
+}
+
+void llm_body_emit_chat(json_writer_t *w, const void *arg)
+{
+    const llm_body_ctx_t *ctx = (const llm_body_ctx_t *)arg;
+    int elems = 0;
+
+    emit_body_prefix(w, ctx, &elems);
+    const cJSON *msg;
+    cJSON_ArrayForEach(msg, ctx->req->messages) {
+        emit_body_message(w, ctx, msg, &elems);
+    }
+    jw_lit(w, "]}");
+}
+
+/* ── Cache du body (par tour) ─────────────────────────────────── */
+
+/* Serialized bytes of the prefix and of each message already sent in this
+ * turn, back to back in one PSRAM buffer. A later call re-encodes only the
+ * messages appended since, then writes the whole buffer out verbatim. */
+typedef struct {
+    const cJSON *item;      /* source message (identity) */
+    size_t end;             /* data offset just past this fragment */
+    int elems;              /* array elements emitted up to here (comma state) */
+} body_frag_t;
+
+struct llm_body_cache {
+    uint32_t prefix_key;    /* 0: empty */
+    size_t prefix_end;
+    int prefix_elems;
+
+    body_frag_t *frags;
+    int frag_count;
+    int frag_cap;
+
+    char *data;
+    size_t len;
+    size_t cap;
+    bool oom;
+
+    /* Stats du tour */
+    uint32_t calls;
+    size_t bytes_reused;
+    size_t bytes_encoded;
+    int64_t encode_us;
+};
+
+llm_body_cache_t *llm_body_cache_create(void)
+{
+    return heap_caps_calloc(1, sizeof(llm_body_cache_t), MALLOC_CAP_SPIRAM);
+}
+
+void llm_body_cache_reset(llm_body_cache_t *cache)
+{
+    if (!cache) return;
+    if (cache->calls > 1) {
+        ESP_LOGI(TAG, "Body cache: %u calls, %d bytes reused, %d encoded in %d ms",
+                 (unsigned)cache->calls, (int)cache->bytes_reused,
+                 (int)cache->bytes_encoded, (int)(cache->encode_us / 1000));
+    }
+    cache->prefix_key = 0;
+    cache->prefix_end = 0;
+    cache->prefix_elems = 0;
+    cache->frag_count = 0;
+    cache->len = 0;
+    cache->oom = false;
+    cache->calls = 0;
+    cache->bytes_reused = 0;
+    cache->bytes_encoded = 0;
+    cache->encode_us = 0;
+}
+
+void llm_body_cache_free(llm_body_cache_t *cache)
+{
+    if (!cache) return;
+    free(cache->frags);
+    free(cache->data);
+    free(cache);
+}
+
+static esp_err_t cache_sink(void *ctx, const char *data, size_t len)
+{
+    llm_body_cache_t *c = (llm_body_cache_t *)ctx;
+    if (c->len + len > c->cap) {
+        size_t new_cap = c->cap ? c->cap : 8192;
+        while (new_cap < c->len + len) new_cap *= 2;
+        char *tmp = heap_caps_realloc(c->data, new_cap, MALLOC_CAP_SPIRAM);
+        if (!tmp) {
+            c->oom = true;
+            return ESP_ERR_NO_MEM;
+        }
+        c->data = tmp;
+        c->cap = new_cap;
+    }
+    memcpy(c->data + c->len, data, len);
+    c->len += len;
+    return ESP_OK;
+}
+
+/* FNV-1a over everything the prefix bytes depend on */
+static uint32_t fnv1a(uint32_t h, const void *data, size_t len)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static uint32_t body_prefix_key(const llm_body_ctx_t *ctx)
+{
+    const char *prompt = ctx->req->system_prompt ? ctx->req->system_prompt : "";
+    uint32_t h = 2166136261u;
+    h = fnv1a(h, &ctx->provider, sizeof(ctx->provider));
+    h = fnv1a(h, ctx->model, strlen(ctx->model));
+    h = fnv1a(h, &ctx->tools, sizeof(ctx->tools));
+    h = fnv1a(h, &ctx->req->system_static_len, sizeof(ctx->req->system_static_len));
+    h = fnv1a(h, prompt, strlen(prompt));
+    return h ? h : 1;
+}
+
+static bool cache_push_frag(llm_body_cache_t *c, const cJSON *item, int elems)
+{
+    if (c->frag_count == c->frag_cap) {
+        int new_cap = c->frag_cap ? c->frag_cap * 2 : 16;
+        body_frag_t *tmp = heap_caps_realloc(c->frags, new_cap * sizeof(body_frag_t),
+                                             MALLOC_CAP_SPIRAM);
+        if (!tmp) return false;
+        c->frags = tmp;
+        c->frag_cap = new_cap;
+    }
+    c->frags[c->frag_count++] = (body_frag_t){ .item = item, .end = c->len, .elems = elems };
+    return true;
+}
+
+/* Bring the cache in line with ctx: keep the matching leading part, encode the
+ * rest. Messages may only be appended to between calls of one turn. */
+esp_err_t llm_body_cache_update(llm_body_cache_t *c, const llm_body_ctx_t *ctx)
+{
+    int64_t t0 = esp_timer_get_time();
+    json_writer_t w;
+    json_writer_init(&w, cache_sink, c);
+    c->oom = false;
+
+    uint32_t key = body_prefix_key(ctx);
+    if (key != c->prefix_key) {
+        c->prefix_key = 0;
+        c->frag_count = 0;
+        c->len = 0;
+        int elems = 0;
+        emit_body_prefix(&w, ctx, &elems);
+        if (jw_flush(&w) != ESP_OK) goto fail;
+        c->prefix_key = key;
+        c->prefix_end = c->len;
+        c->prefix_elems = elems;
+    }
+
+    /* Longest run of messages identical to what is cached */
+    int i = 0;
+    const cJSON *msg = ctx->req->messages ? ctx->req->messages->child : NULL;
+    while (msg && i < c->frag_count && c->frags[i].item == msg) {
+        msg = msg->next;
+        i++;
+    }
+    c->frag_count = i;
+    c->len = i ? c->frags[i - 1].end : c->prefix_end;
+    size_t reused = c->len;
+
+    int elems = i ? c->frags[i - 1].elems : c->prefix_elems;
+    for (; msg; msg = msg->next) {
+        emit_body_message(&w, ctx, msg, &elems);
+        if (jw_flush(&w) != ESP_OK || !cache_push_frag(c, msg, elems)) goto fail;
+    }
+
+    c->calls++;
+    c->bytes_reused += reused;
+    c->bytes_encoded += c->len - reused;
+    c->encode_us += esp_timer_get_time() - t0;
+    return ESP_OK;
+
+fail:
+    ESP_LOGW(TAG, "Body cache out of memory, encoding without it");
+    c->prefix_key = 0;
+    c->frag_count = 0;
+    c->len = 0;
+    return ESP_ERR_NO_MEM;
+}
+
+void llm_body_emit_cached(json_writer_t *w, const void *arg)
+{
+    const llm_body_cache_t *c = (const llm_body_cache_t *)arg;
+    jw_raw(w, c->data, c->len);
+    jw_lit(w, "]}");
+}
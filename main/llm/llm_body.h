@@ -0,0 +1,61 @@
+#pragma once
+
+#include "llm_proxy.h"
+#include "llm/json_writer.h"
+
+/*
+ * Request body of llm_chat_request(): the emitters for both wire formats and
+ * the per-turn cache of the bytes already serialized. llm_proxy sends the
+ * result; nothing here touches the network or FreeRTOS.
+ */
+
+/* Kimi and generic endpoints speak the OpenAI chat.completions format */
+static inline bool is_openai_fmt(llm_provider_t p)
+{
+    return p != LLM_PROVIDER_ANTHROPIC;
+}
+
+/* ── Request body ─────────────────────────────────────────────── */
+
+/* A request body is never materialized as one string: its emitter runs once
+ * against a counting writer to get Content-Length, then again straight into
+ * the socket through the writer's small buffer. */
+typedef struct {
+    void (*emit)(json_writer_t *w, const void *arg);
+    const void *arg;
+    size_t len;
+} llm_body_t;
+
+/** Run the emitter against a counting writer: sets body->len. */
+void llm_body_measure(llm_body_t *body);
+
+/** Run the emitter again into sink; ESP_ERR_INVALID_SIZE if it no longer matches body->len. */
+esp_err_t llm_body_send(const llm_body_t *body, json_sink_fn_t sink, void *ctx);
+
+/* ── Chat request ─────────────────────────────────────────────── */
+
+/* Body layout, identical for both providers:
+ *   prefix   {"model":..,"max_tokens":..,"stream":true,<system/tools>,"messages":[<system msg>
+ *   messages one fragment per source message, comma-separated
+ *   suffix   ]}
+ * Messages come last so the body of iteration N+1 of a ReAct turn starts with
+ * the exact bytes of iteration N, which the body cache exploits. */
+typedef struct {
+    const llm_request_t *req;
+    llm_provider_t provider;
+    char model[64];         /* snapshot: both writer passes must see the same bytes */
+    const cJSON *tools;     /* cached tools tree, or NULL */
+} llm_body_ctx_t;
+
+/** Emitter of the whole request described by arg (const llm_body_ctx_t *). */
+void llm_body_emit_chat(json_writer_t *w, const void *arg);
+
+/**
+ * Bring cache in line with ctx: keep the leading messages already encoded in
+ * this turn, encode the ones appended since. On ESP_ERR_NO_MEM the cache is
+ * left empty and the request is emitted with llm_body_emit_chat() instead.
+ */
+esp_err_t llm_body_cache_update(llm_body_cache_t *cache, const llm_body_ctx_t *ctx);
+
+/** Emitter of the cached bytes (arg: the cache, after llm_body_cache_update()). */
+void llm_body_emit_cached(json_writer_t *w, const void *arg);
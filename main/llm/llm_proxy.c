@@ -1,432 +1,321 @@
 #include "llm_proxy.h"
 #include "mimi_config.h"
-#include "proxy/http_proxy.h"
+#include "llm/llm_stream.h"
+#include "llm/json_writer.h"
+#include "llm/llm_body.h"
+#include "perf/perf_trace.h"
+#include "llm/llm_router.h"
+#include "llm/llm_retry.h"
+#include "http/http_client.h"
+#include "pool/buf_pool.h"
 
 #include <string.h>
 #include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "esp_log.h"
-#include "esp_http_client.h"
-#include "esp_crt_bundle.h"
-#include "esp_heap_caps.h"
+#include "esp_timer.h"
 #include "nvs.h"
 #include "cJSON.h"
 
 static const char *TAG = "llm";
 
-static char s_api_key[128] = {0};
-static char s_model[64] = MIMI_LLM_DEFAULT_MODEL;
+/* ── Backends ─────────────────────────────────────────────────── */
+
+/* Every provider with an API key is a live backend; s_provider is only the
+ * preferred one. The router picks among them per call. */
+typedef struct {
+    const char *id;             /* CLI / NVS name */
+    const char *label;
+    const char *default_url;
+    const char *default_model;
+    char api_key[128];
+    char model[64];
+    char url[128];
+    char host[64];              /* parsed from url */
+    char path[64];
+    int  port;
+    bool plain_http;
+} llm_backend_t;
+
+static llm_backend_t s_backends[LLM_PROVIDER_COUNT] = {
+    [LLM_PROVIDER_ANTHROPIC] = { "anthropic", "Anthropic", MIMI_LLM_API_URL, MIMI_LLM_DEFAULT_MODEL },
+    [LLM_PROVIDER_KIMI]      = { "kimi", "Kimi", MIMI_KIMI_API_URL, MIMI_KIMI_DEFAULT_MODEL },
+    [LLM_PROVIDER_OPENAI]    = { "openai", "OpenAI-compatible", MIMI_OPENAI_API_URL, MIMI_OPENAI_DEFAULT_MODEL },
+};
+static char s_fallback_model[64] = {0};    /* used after repeated overloads, "" = none */
 static llm_provider_t s_provider = LLM_PROVIDER_ANTHROPIC;
 
-/* ── Response buffer ──────────────────────────────────────────── */
+static llm_conn_stats_t s_stats = {0};
+static SemaphoreHandle_t s_lock = NULL;     /* s_stats + tools cache, shared by the agent workers */
 
-typedef struct {
-    char *data;
-    size_t len;
-    size_t cap;
-} resp_buf_t;
+static void stat_inc(uint32_t *counter)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    (*counter)++;
+    xSemaphoreGive(s_lock);
+}
+
+/* ── Response sink ────────────────────────────────────────────── */
 
-static esp_err_t resp_buf_init(resp_buf_t *rb, size_t initial_cap)
+/* Where response body bytes go: straight into the SSE parser for a successful
+ * streaming call, otherwise into a (small) buffer for error bodies. */
+typedef struct {
+    llm_stream_t *stream;   /* NULL: buffer the whole body */
+    buf_lease_t rb;         /* error body, leased from the buffer pool */
+    int status;
+    esp_err_t stream_err;
+    llm_retry_hints_t hints;
+    int64_t first_byte_us;  /* first body byte (router latency), 0 if none */
+} llm_sink_t;
+
+static void sink_init(llm_sink_t *sink, llm_stream_t *stream)
 {
-    rb->data = heap_caps_calloc(1, initial_cap, MALLOC_CAP_SPIRAM);
-    if (!rb->data) return ESP_ERR_NO_MEM;
-    rb->len = 0;
-    rb->cap = initial_cap;
-    return ESP_OK;
+    memset(sink, 0, sizeof(*sink));
+    sink->stream = stream;
+    llm_retry_hints_init(&sink->hints);
 }
 
-static esp_err_t resp_buf_append(resp_buf_t *rb, const char *data, size_t len)
+static void sink_write(llm_sink_t *sink, const char *data, size_t len)
 {
-    while (rb->len + len >= rb->cap) {
-        size_t new_cap = rb->cap * 2;
-        char *tmp = heap_caps_realloc(rb->data, new_cap, MALLOC_CAP_SPIRAM);
-        if (!tmp) return ESP_ERR_NO_MEM;
-        rb->data = tmp;
-        rb->cap = new_cap;
+    if (!sink->first_byte_us) sink->first_byte_us = esp_timer_get_time();
+    if (sink->stream && sink->status == 200) {
+        if (sink->stream_err == ESP_OK) {
+            sink->stream_err = llm_stream_feed(sink->stream, data, len);
+        }
+        return;
     }
-    memcpy(rb->data + rb->len, data, len);
-    rb->len += len;
-    rb->data[rb->len] = '\0';
-    return ESP_OK;
+    buf_pool_append(&sink->rb, data, len);
 }
 
-static void resp_buf_free(resp_buf_t *rb)
+/* ── HTTP event handler ───────────────────────────────────────── */
+
+/* http_client callbacks: every response goes through the sink */
+static void sink_cb_status(void *ctx, int status)
 {
-    free(rb->data);
-    rb->data = NULL;
-    rb->len = 0;
-    rb->cap = 0;
+    ((llm_sink_t *)ctx)->status = status;
 }
 
-/* ── HTTP event handler ───────────────────────────────────────── */
+static void sink_cb_header(void *ctx, const char *key, const char *value)
+{
+    llm_retry_hints_header(&((llm_sink_t *)ctx)->hints, key, value, time(NULL));
+}
 
-static esp_err_t http_event_handler(esp_http_client_event_t *evt)
+static esp_err_t sink_cb_body(void *ctx, const char *data, size_t len)
 {
-    resp_buf_t *rb = (resp_buf_t *)evt->user_data;
-    if (evt->event_id == HTTP_EVENT_ON_DATA) {
-        resp_buf_append(rb, (const char *)evt->data, evt->data_len);
-    }
+    sink_write((llm_sink_t *)ctx, data, len);
     return ESP_OK;
 }
 
 /* ── Helpers provider ─────────────────────────────────────────── */
 
-static const char *get_api_url(void)
+static void backend_set_url(llm_backend_t *b, const char *url)
 {
-    return (s_provider == LLM_PROVIDER_KIMI)
-        ? MIMI_KIMI_API_URL : MIMI_LLM_API_URL;
+    strncpy(b->url, url, sizeof(b->url) - 1);
+    b->url[sizeof(b->url) - 1] = '\0';
+    http_client_parse_url(url, b->host, sizeof(b->host), &b->port, &b->plain_http,
+                          b->path, sizeof(b->path));
 }
 
-static const char *get_api_host(void)
+/* Read one per-backend NVS string ("key_kimi", "model_openai", ...) */
+static bool backend_nvs_get(nvs_handle_t nvs, const char *fmt, const llm_backend_t *b,
+                            char *out, size_t size)
 {
-    return (s_provider == LLM_PROVIDER_KIMI)
-        ? "api.moonshot.ai" : "api.anthropic.com";
+    char key[16];
+    snprintf(key, sizeof(key), fmt, b->id);
+    size_t len = size;
+    return nvs_get_str(nvs, key, out, &len) == ESP_OK && out[0];
 }
 
-static const char *get_api_path(void)
+static esp_err_t backend_nvs_set(const char *fmt, const llm_backend_t *b, const char *val)
 {
-    return (s_provider == LLM_PROVIDER_KIMI)
-        ? "/v1/chat/completions" : "/v1/messages";
+    char key[16];
+    snprintf(key, sizeof(key), fmt, b->id);
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(MIMI_NVS_LLM, NVS_READWRITE, &nvs);
+    if (err != ESP_OK) return err;
+    if (val && val[0]) {
+        err = nvs_set_str(nvs, key, val);
+    } else {
+        nvs_erase_key(nvs, key);    /* absent is fine */
+    }
+    if (err == ESP_OK) err = nvs_commit(nvs);
+    nvs_close(nvs);
+    return err;
 }
 
 /* ── Init ─────────────────────────────────────────────────────── */
 
-esp_err_t llm_proxy_init(void)
+/* Build-time key and model belong to the preferred backend */
+static void apply_build_secrets(llm_backend_t *b)
 {
-    /* Valeurs par defaut (build-time) */
     if (MIMI_SECRET_API_KEY[0] != '\0') {
-        strncpy(s_api_key, MIMI_SECRET_API_KEY, sizeof(s_api_key) - 1);
+        strncpy(b->api_key, MIMI_SECRET_API_KEY, sizeof(b->api_key) - 1);
     }
     if (MIMI_SECRET_MODEL[0] != '\0') {
-        strncpy(s_model, MIMI_SECRET_MODEL, sizeof(s_model) - 1);
+        strncpy(b->model, MIMI_SECRET_MODEL, sizeof(b->model) - 1);
+    }
+}
+
+esp_err_t llm_proxy_init(void)
+{
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock) return ESP_ERR_NO_MEM;
+    esp_err_t err = llm_router_init();
+    if (err != ESP_OK) return err;
+
+    for (int p = 0; p < LLM_PROVIDER_COUNT; p++) {
+        llm_backend_t *b = &s_backends[p];
+        strncpy(b->model, b->default_model, sizeof(b->model) - 1);
+        backend_set_url(b, b->default_url);
     }
 
-    /* NVS overrides (priorite la plus haute) */
     nvs_handle_t nvs;
-    if (nvs_open(MIMI_NVS_LLM, NVS_READONLY, &nvs) == ESP_OK) {
+    if (nvs_open(MIMI_NVS_LLM, NVS_READWRITE, &nvs) == ESP_OK) {
         char tmp[128] = {0};
         size_t len;
 
-        /* Provider en premier (pour choisir le modele par defaut) */
+        /* Provider prefere en premier */
         len = sizeof(tmp);
         if (nvs_get_str(nvs, MIMI_NVS_KEY_PROVIDER, tmp, &len) == ESP_OK && tmp[0]) {
-            if (strcmp(tmp, "kimi") == 0) {
-                s_provider = LLM_PROVIDER_KIMI;
-                /* Modele Kimi par defaut si pas d'override build-time */
-                if (MIMI_SECRET_MODEL[0] == '\0') {
-                    strncpy(s_model, MIMI_KIMI_DEFAULT_MODEL, sizeof(s_model) - 1);
-                }
-            }
+            llm_provider_from_id(tmp, &s_provider);
         }
 
-        /* API Key */
-        len = sizeof(tmp);
-        memset(tmp, 0, sizeof(tmp));
-        if (nvs_get_str(nvs, MIMI_NVS_KEY_API_KEY, tmp, &len) == ESP_OK && tmp[0]) {
-            strncpy(s_api_key, tmp, sizeof(s_api_key) - 1);
+        /* Anciennes cles globales (api_key / model) → cles du backend prefere */
+        llm_backend_t *pref = &s_backends[s_provider];
+        const char *legacy[2][2] = {
+            { MIMI_NVS_KEY_API_KEY, MIMI_NVS_KEY_BACKEND_KEY },
+            { MIMI_NVS_KEY_MODEL,   MIMI_NVS_KEY_BACKEND_MODEL },
+        };
+        for (int i = 0; i < 2; i++) {
+            len = sizeof(tmp);
+            memset(tmp, 0, sizeof(tmp));
+            if (nvs_get_str(nvs, legacy[i][0], tmp, &len) != ESP_OK || !tmp[0]) continue;
+            char key[16];
+            snprintf(key, sizeof(key), legacy[i][1], pref->id);
+            size_t cur_len = 0;
+            if (nvs_get_str(nvs, key, NULL, &cur_len) != ESP_OK) nvs_set_str(nvs, key, tmp);
+            nvs_erase_key(nvs, legacy[i][0]);
+            ESP_LOGI(TAG, "Migrated NVS %s to %s", legacy[i][0], key);
+        }
+        nvs_commit(nvs);
+
+        /* Valeurs build-time pour le backend prefere, puis NVS par backend */
+        apply_build_secrets(pref);
+        for (int p = 0; p < LLM_PROVIDER_COUNT; p++) {
+            llm_backend_t *b = &s_backends[p];
+            backend_nvs_get(nvs, MIMI_NVS_KEY_BACKEND_KEY, b, b->api_key, sizeof(b->api_key));
+            backend_nvs_get(nvs, MIMI_NVS_KEY_BACKEND_MODEL, b, b->model, sizeof(b->model));
+            if (backend_nvs_get(nvs, MIMI_NVS_KEY_BACKEND_URL, b, tmp, sizeof(tmp))) {
+                backend_set_url(b, tmp);
+            }
         }
 
-        /* Model (override final) */
-        len = sizeof(tmp);
-        memset(tmp, 0, sizeof(tmp));
-        if (nvs_get_str(nvs, MIMI_NVS_KEY_MODEL, tmp, &len) == ESP_OK && tmp[0]) {
-            strncpy(s_model, tmp, sizeof(s_model) - 1);
+        /* Fallback model (optionnel) */
+        len = sizeof(s_fallback_model);
+        if (nvs_get_str(nvs, MIMI_NVS_KEY_FALLBACK, s_fallback_model, &len) != ESP_OK) {
+            s_fallback_model[0] = '\0';
         }
 
         nvs_close(nvs);
+    } else {
+        apply_build_secrets(&s_backends[s_provider]);
     }
 
-    if (s_api_key[0]) {
-        ESP_LOGI(TAG, "LLM proxy init OK (provider: %s, model: %s)",
-                 llm_get_provider_name(), s_model);
+    int live = 0;
+    for (int p = 0; p < LLM_PROVIDER_COUNT; p++) {
+        if (!s_backends[p].api_key[0]) continue;
+        live++;
+        ESP_LOGI(TAG, "Backend %s: model %s%s", s_backends[p].id, s_backends[p].model,
+                 p == (int)s_provider ? " (preferred)" : "");
+    }
+    if (live) {
+        ESP_LOGI(TAG, "LLM proxy init OK (%d backend%s)", live, live > 1 ? "s" : "");
     } else {
         ESP_LOGW(TAG, "No API key. Use CLI: set_api_key <KEY>");
     }
     return ESP_OK;
 }
 
-/* ── Direct path: esp_http_client ───────────────────────────── */
+/* ── Request body ─────────────────────────────────────────────── */
 
-static esp_err_t llm_http_direct(const char *post_data, resp_buf_t *rb, int *out_status)
+/* Serialized cJSON tree as a body (llm_chat) */
+static void emit_cjson(json_writer_t *w, const void *arg)
 {
-    esp_http_client_config_t config = {
-        .url = get_api_url(),
-        .event_handler = http_event_handler,
-        .user_data = rb,
-        .timeout_ms = 120 * 1000,
-        .buffer_size = 4096,
-        .buffer_size_tx = 4096,
-        .crt_bundle_attach = esp_crt_bundle_attach,
-    };
-
-    esp_http_client_handle_t client = esp_http_client_init(&config);
-    if (!client) return ESP_FAIL;
-
-    esp_http_client_set_method(client, HTTP_METHOD_POST);
-    esp_http_client_set_header(client, "Content-Type", "application/json");
-
-    if (s_provider == LLM_PROVIDER_KIMI) {
-        char auth[160];
-        snprintf(auth, sizeof(auth), "Bearer %s", s_api_key);
-        esp_http_client_set_header(client, "Authorization", auth);
-    } else {
-        esp_http_client_set_header(client, "x-api-key", s_api_key);
-        esp_http_client_set_header(client, "anthropic-version", MIMI_LLM_API_VERSION);
-    }
-
-    esp_http_client_set_post_field(client, post_data, strlen(post_data));
-
-    esp_err_t err = esp_http_client_perform(client);
-    *out_status = esp_http_client_get_status_code(client);
-    esp_http_client_cleanup(client);
-    return err;
+    jw_value(w, (const cJSON *)arg);
 }
 
-/* ── Proxy path: HTTP over CONNECT tunnel ────────────────────── */
+/* ── HTTP call ────────────────────────────────────────────────── */
 
-static esp_err_t llm_http_via_proxy(const char *post_data, resp_buf_t *rb, int *out_status)
+static esp_err_t llm_body_write(void *ctx, http_write_fn_t write, void *wctx)
 {
-    const char *host = get_api_host();
-    const char *path = get_api_path();
-
-    proxy_conn_t *conn = proxy_conn_open(host, 443, 30000);
-    if (!conn) return ESP_ERR_HTTP_CONNECT;
-
-    int body_len = strlen(post_data);
-    char header[512];
-    int hlen;
-
-    if (s_provider == LLM_PROVIDER_KIMI) {
-        hlen = snprintf(header, sizeof(header),
-            "POST %s HTTP/1.1\r\n"
-            "Host: %s\r\n"
-            "Content-Type: application/json\r\n"
-            "Authorization: Bearer %s\r\n"
-            "Content-Length: %d\r\n"
-            "Connection: close\r\n\r\n",
-            path, host, s_api_key, body_len);
-    } else {
-        hlen = snprintf(header, sizeof(header),
-            "POST %s HTTP/1.1\r\n"
-            "Host: %s\r\n"
-            "Content-Type: application/json\r\n"
-            "x-api-key: %s\r\n"
-            "anthropic-version: %s\r\n"
-            "Content-Length: %d\r\n"
-            "Connection: close\r\n\r\n",
-            path, host, s_api_key, MIMI_LLM_API_VERSION, body_len);
-    }
-
-    if (proxy_conn_write(conn, header, hlen) < 0 ||
-        proxy_conn_write(conn, post_data, body_len) < 0) {
-        proxy_conn_close(conn);
-        return ESP_ERR_HTTP_WRITE_DATA;
-    }
-
-    /* Lire la reponse complete */
-    char tmp[4096];
-    while (1) {
-        int n = proxy_conn_read(conn, tmp, sizeof(tmp), 120000);
-        if (n <= 0) break;
-        if (resp_buf_append(rb, tmp, n) != ESP_OK) break;
-    }
-    proxy_conn_close(conn);
-
-    /* Parser la ligne de statut HTTP */
-    *out_status = 0;
-    if (rb->len > 5 && strncmp(rb->data, "HTTP/", 5) == 0) {
-        const char *sp = strchr(rb->data, ' ');
-        if (sp) *out_status = atoi(sp + 1);
-    }
-
-    /* Retirer les headers HTTP, garder le body */
-    char *body = strstr(rb->data, "\r\n\r\n");
-    if (body) {
-        body += 4;
-        size_t blen = rb->len - (body - rb->data);
-        memmove(rb->data, body, blen);
-        rb->len = blen;
-        rb->data[rb->len] = '\0';
-    }
-
-    return ESP_OK;
+    return llm_body_send((const llm_body_t *)ctx, write, wctx);
 }
 
-/* ── Dispatch HTTP ────────────────────────────────────────────── */
-
-static esp_err_t llm_http_call(const char *post_data, resp_buf_t *rb, int *out_status)
+/* body->len must already be set by llm_body_measure(). Transport (direct
+ * keep-alive or proxy tunnel) and stale-connection resends are http_client's. */
+static esp_err_t llm_http_call(llm_provider_t p, const llm_body_t *body,
+                               llm_sink_t *sink, const volatile bool *cancel, int *out_status)
 {
-    if (http_proxy_is_enabled()) {
-        return llm_http_via_proxy(post_data, rb, out_status);
+    const llm_backend_t *b = &s_backends[p];
+    char auth[160];
+
+    http_req_t req = {
+        .method = "POST",
+        .host = b->host,
+        .port = b->port,
+        .plain_http = b->plain_http,
+        .path = b->path,
+        .body_len = body->len,
+        .body_fn = llm_body_write,
+        .body_ctx = (void *)body,
+        .accept_gzip = true,        /* SSE too: decoded as each compressed block lands */
+        .timeout_ms = 120 * 1000,
+        .cancel = cancel,
+        .on_status = sink_cb_status,
+        .on_header = sink_cb_header,
+        .on_body = sink_cb_body,
+        .ctx = sink,
+    };
+    req.headers[0] = (http_header_t){ "Content-Type", "application/json" };
+    if (is_openai_fmt(p)) {
+        snprintf(auth, sizeof(auth), "Bearer %s", b->api_key);
+        req.headers[1] = (http_header_t){ "Authorization", auth };
     } else {
-        return llm_http_direct(post_data, rb, out_status);
+        req.headers[1] = (http_header_t){ "x-api-key", b->api_key };
+        req.headers[2] = (http_header_t){ "anthropic-version", MIMI_LLM_API_VERSION };
     }
-}
 
-/* ── Extraction texte Anthropic ───────────────────────────────── */
+    http_result_t res;
+    esp_err_t err = http_client_request(&req, &res);
+    *out_status = sink->status;
 
-static void extract_text_anthropic(cJSON *root, char *buf, size_t size)
-{
-    buf[0] = '\0';
-    cJSON *content = cJSON_GetObjectItem(root, "content");
-    if (!content || !cJSON_IsArray(content)) return;
-
-    size_t off = 0;
-    cJSON *block;
-    cJSON_ArrayForEach(block, content) {
-        cJSON *btype = cJSON_GetObjectItem(block, "type");
-        if (!btype || strcmp(btype->valuestring, "text") != 0) continue;
-        cJSON *text = cJSON_GetObjectItem(block, "text");
-        if (!text || !cJSON_IsString(text)) continue;
-        size_t tlen = strlen(text->valuestring);
-        size_t copy = (tlen < size - off - 1) ? tlen : size - off - 1;
-        memcpy(buf + off, text->valuestring, copy);
-        off += copy;
-    }
-    buf[off] = '\0';
-}
-
-/* ── Extraction texte OpenAI ──────────────────────────────────── */
-
-static void extract_text_openai(cJSON *root, char *buf, size_t size)
-{
-    buf[0] = '\0';
-    cJSON *choices = cJSON_GetObjectItem(root, "choices");
-    if (!choices || !cJSON_IsArray(choices) || cJSON_GetArraySize(choices) == 0) return;
-
-    cJSON *choice0 = cJSON_GetArrayItem(choices, 0);
-    cJSON *message = cJSON_GetObjectItem(choice0, "message");
-    if (!message) return;
-
-    cJSON *content = cJSON_GetObjectItem(message, "content");
-    if (content && cJSON_IsString(content)) {
-        strncpy(buf, content->valuestring, size - 1);
-        buf[size - 1] = '\0';
+    stat_inc(&s_stats.requests);
+    if (res.reconnected) stat_inc(&s_stats.reconnects);
+    if (res.reused) {
+        stat_inc(&s_stats.reuses);
+    } else {
+        stat_inc(&s_stats.handshakes);
     }
+    return err;
 }
 
 /* ══════════════════════════════════════════════════════════════════
  * TRADUCTION ANTHROPIC → OPENAI (pour Kimi)
  * ══════════════════════════════════════════════════════════════════ */
 
-/* Traduit les messages Anthropic (tool_use/tool_result) → format OpenAI (tool_calls/role:tool) */
-static cJSON *translate_messages_to_openai(const char *system_prompt, cJSON *messages)
-{
-    cJSON *oai_msgs = cJSON_CreateArray();
-
-    /* System prompt comme premier message */
-    if (system_prompt && system_prompt[0]) {
-        cJSON *sys = cJSON_CreateObject();
-        cJSON_AddStringToObject(sys, "role", "system");
-        cJSON_AddStringToObject(sys, "content", system_prompt);
-        cJSON_AddItemToArray(oai_msgs, sys);
-    }
-
-    cJSON *msg;
-    cJSON_ArrayForEach(msg, messages) {
-        cJSON *role = cJSON_GetObjectItem(msg, "role");
-        cJSON *content = cJSON_GetObjectItem(msg, "content");
-        if (!role || !cJSON_IsString(role)) continue;
-
-        if (strcmp(role->valuestring, "user") == 0) {
-            if (cJSON_IsString(content)) {
-                /* Message texte simple */
-                cJSON *oai = cJSON_CreateObject();
-                cJSON_AddStringToObject(oai, "role", "user");
-                cJSON_AddStringToObject(oai, "content", content->valuestring);
-                cJSON_AddItemToArray(oai_msgs, oai);
-
-            } else if (cJSON_IsArray(content)) {
-                /* Contient des blocs tool_result → messages role:tool */
-                cJSON *block;
-                cJSON_ArrayForEach(block, content) {
-                    cJSON *btype = cJSON_GetObjectItem(block, "type");
-                    if (!btype || strcmp(btype->valuestring, "tool_result") != 0) continue;
-
-                    cJSON *tool_id = cJSON_GetObjectItem(block, "tool_use_id");
-                    cJSON *result = cJSON_GetObjectItem(block, "content");
-
-                    cJSON *oai = cJSON_CreateObject();
-                    cJSON_AddStringToObject(oai, "role", "tool");
-                    if (tool_id && cJSON_IsString(tool_id))
-                        cJSON_AddStringToObject(oai, "tool_call_id", tool_id->valuestring);
-                    if (result && cJSON_IsString(result))
-                        cJSON_AddStringToObject(oai, "content", result->valuestring);
-                    else
-                        cJSON_AddStringToObject(oai, "content", "");
-                    cJSON_AddItemToArray(oai_msgs, oai);
-                }
-            }
-
-        } else if (strcmp(role->valuestring, "assistant") == 0) {
-            if (cJSON_IsString(content)) {
-                /* Message texte simple */
-                cJSON *oai = cJSON_CreateObject();
-                cJSON_AddStringToObject(oai, "role", "assistant");
-                cJSON_AddStringToObject(oai, "content", content->valuestring);
-                cJSON_AddItemToArray(oai_msgs, oai);
-
-            } else if (cJSON_IsArray(content)) {
-                /* Contient text + blocs tool_use → assistant + tool_calls */
-                cJSON *oai = cJSON_CreateObject();
-                cJSON_AddStringToObject(oai, "role", "assistant");
-
-                const char *text_val = NULL;
-                cJSON *tool_calls = NULL;
-
-                cJSON *block;
-                cJSON_ArrayForEach(block, content) {
-                    cJSON *btype = cJSON_GetObjectItem(block, "type");
-                    if (!btype) continue;
-
-                    if (strcmp(btype->valuestring, "text") == 0) {
-                        cJSON *t = cJSON_GetObjectItem(block, "text");
-                        if (t && cJSON_IsString(t)) text_val = t->valuestring;
-
-                    } else if (strcmp(btype->valuestring, "tool_use") == 0) {
-                        if (!tool_calls) tool_calls = cJSON_CreateArray();
-
-                        cJSON *tc = cJSON_CreateObject();
-                        cJSON *id = cJSON_GetObjectItem(block, "id");
-                        cJSON *name = cJSON_GetObjectItem(block, "name");
-                        cJSON *input = cJSON_GetObjectItem(block, "input");
-
-                        if (id && cJSON_IsString(id))
-                            cJSON_AddStringToObject(tc, "id", id->valuestring);
-                        cJSON_AddStringToObject(tc, "type", "function");
-
-                        cJSON *func = cJSON_CreateObject();
-                        if (name && cJSON_IsString(name))
-                            cJSON_AddStringToObject(func, "name", name->valuestring);
-                        if (input) {
-                            char *args = cJSON_PrintUnformatted(input);
-                            if (args) {
-                                cJSON_AddStringToObject(func, "arguments", args);
-                                free(args);
-                            }
-                        }
-                        cJSON_AddItemToObject(tc, "function", func);
-                        cJSON_AddItemToArray(tool_calls, tc);
-                    }
-                }
-
-                if (text_val)
-                    cJSON_AddStringToObject(oai, "content", text_val);
-                else
-                    cJSON_AddNullToObject(oai, "content");
-
-                if (tool_calls)
-                    cJSON_AddItemToObject(oai, "tool_calls", tool_calls);
-
-                cJSON_AddItemToArray(oai_msgs, oai);
-            }
-        }
-    }
-
-    return oai_msgs;
+/* Les textes (prompt, messages, resultats d'outils) sont references, pas copies:
+ * the translated tree must be deleted before the source messages. */
+static void add_str_ref(cJSON *obj, const char *key, const char *str)
+{
+    cJSON_AddItemToObject(obj, key, cJSON_CreateStringReference(str));
 }
 
 /* Traduit les tools Anthropic (input_schema) → format OpenAI (function/parameters) */
-static char *translate_tools_to_openai(const char *anthropic_tools_json)
+static cJSON *translate_tools_to_openai(const char *anthropic_tools_json)
 {
     cJSON *anthropic = cJSON_Parse(anthropic_tools_json);
     if (!anthropic) return NULL;
@@ -451,63 +340,56 @@ static char *translate_tools_to_openai(const char *anthropic_tools_json)
     }
 
     cJSON_Delete(anthropic);
-    char *json = cJSON_PrintUnformatted(oai);
-    cJSON_Delete(oai);
-    return json;
+    return oai;
 }
 
-/* Parse la reponse OpenAI/Kimi → llm_response_t */
-static void parse_openai_response(cJSON *root, llm_response_t *resp)
-{
-    cJSON *choices = cJSON_GetObjectItem(root, "choices");
-    if (!choices || !cJSON_IsArray(choices) || cJSON_GetArraySize(choices) == 0) return;
-
-    cJSON *choice0 = cJSON_GetArrayItem(choices, 0);
-    cJSON *message = cJSON_GetObjectItem(choice0, "message");
-    if (!message) return;
+/* ── Cache des tools ──────────────────────────────────────────── */
 
-    /* finish_reason: "tool_calls" → continuer, "stop" → fin */
-    cJSON *finish = cJSON_GetObjectItem(choice0, "finish_reason");
-    if (finish && cJSON_IsString(finish)) {
-        resp->tool_use = (strcmp(finish->valuestring, "tool_calls") == 0);
-    }
+/* The registry builds its tools JSON once at boot, so the parsed (and, for
+ * OpenAI-format backends, translated) array is kept and attached to each
+ * request by reference instead of being parsed again on every call.
+ * One tree per wire format, so failing over does not re-translate. */
+static const char *s_tools_src[2] = {NULL};
+static cJSON *s_tools_tree[2] = {NULL};
 
-    /* Texte de la reponse */
-    cJSON *content = cJSON_GetObjectItem(message, "content");
-    if (content && cJSON_IsString(content) && strlen(content->valuestring) > 0) {
-        resp->text = strdup(content->valuestring);
-        if (resp->text) resp->text_len = strlen(resp->text);
+static cJSON *build_tools_tree(const char *tools_json, int f)
+{
+    if (s_tools_tree[f] && s_tools_src[f] == tools_json) {
+        return s_tools_tree[f];
     }
 
-    /* Tool calls */
-    cJSON *tool_calls = cJSON_GetObjectItem(message, "tool_calls");
-    if (tool_calls && cJSON_IsArray(tool_calls)) {
-        cJSON *tc;
-        cJSON_ArrayForEach(tc, tool_calls) {
-            if (resp->call_count >= MIMI_MAX_TOOL_CALLS) break;
-
-            llm_tool_call_t *call = &resp->calls[resp->call_count];
-
-            cJSON *id = cJSON_GetObjectItem(tc, "id");
-            if (id && cJSON_IsString(id))
-                strncpy(call->id, id->valuestring, sizeof(call->id) - 1);
+    cJSON_Delete(s_tools_tree[f]);
+    s_tools_tree[f] = NULL;
+    s_tools_src[f] = NULL;
 
-            cJSON *func = cJSON_GetObjectItem(tc, "function");
-            if (func) {
-                cJSON *name = cJSON_GetObjectItem(func, "name");
-                if (name && cJSON_IsString(name))
-                    strncpy(call->name, name->valuestring, sizeof(call->name) - 1);
-
-                cJSON *args = cJSON_GetObjectItem(func, "arguments");
-                if (args && cJSON_IsString(args)) {
-                    call->input = strdup(args->valuestring);
-                    if (call->input) call->input_len = strlen(call->input);
-                }
-            }
-
-            resp->call_count++;
+    cJSON *tree;
+    if (f) {
+        tree = translate_tools_to_openai(tools_json);
+    } else {
+        tree = cJSON_Parse(tools_json);
+        /* Breakpoint after the last tool: the whole tools array is cached */
+        cJSON *last = cJSON_GetArrayItem(tree, cJSON_GetArraySize(tree) - 1);
+        if (last) {
+            cJSON *cc = cJSON_CreateObject();
+            cJSON_AddStringToObject(cc, "type", "ephemeral");
+            cJSON_AddItemToObject(last, "cache_control", cc);
         }
     }
+
+    if (tree) {
+        s_tools_tree[f] = tree;
+        s_tools_src[f] = tools_json;
+    }
+    return tree;
+}
+
+/* Built once by whichever worker gets there first; read-only afterwards */
+static cJSON *get_tools_tree(const char *tools_json, llm_provider_t provider)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    cJSON *tree = build_tools_tree(tools_json, is_openai_fmt(provider) ? 1 : 0);
+    xSemaphoreGive(s_lock);
+    return tree;
 }
 
 /* ── Public: chat simple (retro-compat) ───────────────────────── */
@@ -515,25 +397,29 @@ static void parse_openai_response(cJSON *root, llm_response_t *resp)
 esp_err_t llm_chat(const char *system_prompt, const char *messages_json,
                    char *response_buf, size_t buf_size)
 {
-    if (s_api_key[0] == '\0') {
+    /* Legacy path: preferred backend only, no routing */
+    llm_provider_t p = s_provider;
+    const llm_backend_t *b = &s_backends[p];
+    if (b->api_key[0] == '\0') {
         snprintf(response_buf, buf_size, "Error: No API key configured");
         return ESP_ERR_INVALID_STATE;
     }
 
     cJSON *body = cJSON_CreateObject();
-    cJSON_AddStringToObject(body, "model", s_model);
+    cJSON_AddStringToObject(body, "model", b->model);
     cJSON_AddNumberToObject(body, "max_tokens", MIMI_LLM_MAX_TOKENS);
+    cJSON_AddBoolToObject(body, "stream", true);
 
     cJSON *messages = cJSON_Parse(messages_json);
 
-    if (s_provider == LLM_PROVIDER_KIMI) {
+    if (is_openai_fmt(p)) {
         /* Format OpenAI : system comme message, pas comme champ */
         cJSON *oai_msgs = cJSON_CreateArray();
 
         if (system_prompt && system_prompt[0]) {
             cJSON *sys = cJSON_CreateObject();
             cJSON_AddStringToObject(sys, "role", "system");
-            cJSON_AddStringToObject(sys, "content", system_prompt);
+            add_str_ref(sys, "content", system_prompt);
             cJSON_AddItemToArray(oai_msgs, sys);
         }
 
@@ -567,70 +453,68 @@ esp_err_t llm_chat(const char *system_prompt, const char *messages_json,
         }
     }
 
-    char *post_data = cJSON_PrintUnformatted(body);
-    cJSON_Delete(body);
-    if (!post_data) {
-        snprintf(response_buf, buf_size, "Error: Failed to build request");
-        return ESP_ERR_NO_MEM;
-    }
+    llm_body_t post = { .emit = emit_cjson, .arg = body };
+    llm_body_measure(&post);
 
     ESP_LOGI(TAG, "Calling %s API (model: %s, body: %d bytes)",
-             llm_get_provider_name(), s_model, (int)strlen(post_data));
-
-    resp_buf_t rb;
-    if (resp_buf_init(&rb, MIMI_LLM_STREAM_BUF_SIZE) != ESP_OK) {
-        free(post_data);
+             b->label, b->model, (int)post.len);
+
+    /* Streamed like llm_chat_request: text is decoded event by event instead
+     * of buffering the whole JSON body and parsing it afterwards */
+    llm_response_t resp;
+    llm_stream_t stream;
+    llm_stream_init(&stream,
+                    is_openai_fmt(p) ? LLM_STREAM_OPENAI : LLM_STREAM_ANTHROPIC,
+                    &resp, NULL, NULL);
+    llm_sink_t sink;
+    sink_init(&sink, &stream);
+    if (buf_pool_acquire(&sink.rb, 1024) != ESP_OK) {
+        llm_stream_free(&stream);
+        cJSON_Delete(body);
         snprintf(response_buf, buf_size, "Error: Out of memory");
         return ESP_ERR_NO_MEM;
     }
 
     int status = 0;
-    esp_err_t err = llm_http_call(post_data, &rb, &status);
-    free(post_data);
+    esp_err_t err = llm_http_call(p, &post, &sink, NULL, &status);
+    cJSON_Delete(body);
 
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "HTTP request failed: %s", esp_err_to_name(err));
-        resp_buf_free(&rb);
         snprintf(response_buf, buf_size, "Error: HTTP request failed (%s)",
                  esp_err_to_name(err));
-        return err;
-    }
-
-    if (status != 200) {
+    } else if (status != 200) {
         ESP_LOGE(TAG, "API returned status %d", status);
         snprintf(response_buf, buf_size, "API error (HTTP %d): %.200s",
-                 status, rb.data ? rb.data : "");
-        resp_buf_free(&rb);
-        return ESP_FAIL;
-    }
-
-    cJSON *root = cJSON_Parse(rb.data);
-    resp_buf_free(&rb);
-
-    if (!root) {
-        snprintf(response_buf, buf_size, "Error: Failed to parse response");
-        return ESP_FAIL;
+                 status, sink.rb.data ? sink.rb.data : "");
+        err = ESP_FAIL;
+    } else {
+        err = (sink.stream_err != ESP_OK) ? sink.stream_err : llm_stream_finish(&stream);
+        if (err != ESP_OK) {
+            snprintf(response_buf, buf_size, "Error: %s",
+                     stream.error[0] ? stream.error : "Failed to parse response");
+        }
     }
+    llm_stream_free(&stream);
+    buf_pool_release(&sink.rb);
 
-    if (s_provider == LLM_PROVIDER_KIMI) {
-        extract_text_openai(root, response_buf, buf_size);
-    } else {
-        extract_text_anthropic(root, response_buf, buf_size);
+    if (err != ESP_OK) {
+        llm_response_free(&resp);
+        return err;
     }
-    cJSON_Delete(root);
 
-    if (response_buf[0] == '\0') {
-        snprintf(response_buf, buf_size, "No response from %s API",
-                 llm_get_provider_name());
+    if (resp.text_len == 0) {
+        snprintf(response_buf, buf_size, "No response from %s API", b->label);
     } else {
-        ESP_LOGI(TAG, "%s response: %d bytes",
-                 llm_get_provider_name(), (int)strlen(response_buf));
+        snprintf(response_buf, buf_size, "%s", resp.text);
+        ESP_LOGI(TAG, "%s response: %d bytes", b->label, (int)resp.text_len);
     }
+    llm_response_free(&resp);
 
     return ESP_OK;
 }
 
-/* ── Public: chat avec tools (non-streaming) ──────────────────── */
+/* ── Public: chat avec tools ──────────────────────────────────── */
 
 void llm_response_free(llm_response_t *resp)
 {
@@ -650,160 +534,222 @@ esp_err_t llm_chat_tools(const char *system_prompt,
                          const char *tools_json,
                          llm_response_t *resp)
 {
-    memset(resp, 0, sizeof(*resp));
-
-    if (s_api_key[0] == '\0') return ESP_ERR_INVALID_STATE;
-
-    cJSON *body = cJSON_CreateObject();
-    cJSON_AddStringToObject(body, "model", s_model);
-    cJSON_AddNumberToObject(body, "max_tokens", MIMI_LLM_MAX_TOKENS);
-
-    if (s_provider == LLM_PROVIDER_KIMI) {
-        /* ── Format OpenAI/Kimi ── */
-        cJSON *oai_msgs = translate_messages_to_openai(system_prompt, messages);
-        cJSON_AddItemToObject(body, "messages", oai_msgs);
+    llm_request_t req = {
+        .system_prompt = system_prompt,
+        .messages = messages,
+        .tools_json = tools_json,
+    };
+    return llm_chat_request(&req, resp);
+}
 
-        if (tools_json) {
-            char *oai_tools_str = translate_tools_to_openai(tools_json);
-            if (oai_tools_str) {
-                cJSON *oai_tools = cJSON_Parse(oai_tools_str);
-                if (oai_tools) {
-                    cJSON_AddItemToObject(body, "tools", oai_tools);
-                    cJSON_AddStringToObject(body, "tool_choice", "auto");
-                }
-                free(oai_tools_str);
-            }
-        }
-    } else {
-        /* ── Format Anthropic ── */
-        cJSON_AddStringToObject(body, "system", system_prompt);
+/* ── Attempts ─────────────────────────────────────────────────── */
 
-        cJSON *msgs_copy = cJSON_Duplicate(messages, 1);
-        cJSON_AddItemToObject(body, "messages", msgs_copy);
+static bool is_cancelled(const llm_request_t *req)
+{
+    return req->cancel && *req->cancel;
+}
 
-        if (tools_json) {
-            cJSON *tools = cJSON_Parse(tools_json);
-            if (tools) {
-                cJSON_AddItemToObject(body, "tools", tools);
-            }
-        }
+/* Backoff sleep in short steps so a cancelled call does not sit it out */
+static void wait_backoff(const llm_request_t *req, int ms)
+{
+    while (ms > 0 && !is_cancelled(req)) {
+        int step = ms < 250 ? ms : 250;
+        vTaskDelay(pdMS_TO_TICKS(step));
+        ms -= step;
     }
+}
 
-    char *post_data = cJSON_PrintUnformatted(body);
-    cJSON_Delete(body);
-    if (!post_data) return ESP_ERR_NO_MEM;
-
-    ESP_LOGI(TAG, "Calling %s API with tools (model: %s, body: %d bytes)",
-             llm_get_provider_name(), s_model, (int)strlen(post_data));
-
-    /* Appel HTTP */
-    resp_buf_t rb;
-    if (resp_buf_init(&rb, MIMI_LLM_STREAM_BUF_SIZE) != ESP_OK) {
-        free(post_data);
+static esp_err_t llm_attempt(llm_body_ctx_t *ctx, llm_response_t *resp, llm_attempt_t *out)
+{
+    const llm_request_t *req = ctx->req;
+    memset(resp, 0, sizeof(*resp));
+    *out = (llm_attempt_t){ .hint_ms = -1 };
+
+    perf_span_t body_span = perf_begin(PERF_LLM_BODY);
+    llm_body_t post = { .emit = llm_body_emit_chat, .arg = ctx };
+    if (req->body_cache && llm_body_cache_update(req->body_cache, ctx) == ESP_OK) {
+        post.emit = llm_body_emit_cached;
+        post.arg = req->body_cache;
+    }
+    llm_body_measure(&post);
+    perf_end(body_span);
+
+    ESP_LOGI(TAG, "Calling %s API with tools (model: %s, body: %d bytes, stream)",
+             s_backends[ctx->provider].label, ctx->model, (int)post.len);
+
+    /* Appel HTTP — seul un body d'erreur est bufferise, le reste va au parser SSE */
+    llm_stream_t stream;
+    llm_stream_init(&stream,
+                    is_openai_fmt(ctx->provider) ? LLM_STREAM_OPENAI : LLM_STREAM_ANTHROPIC,
+                    resp, req->on_delta, req->cb_ctx);
+    llm_sink_t sink;
+    sink_init(&sink, &stream);
+    if (buf_pool_acquire(&sink.rb, 1024) != ESP_OK) {
+        llm_stream_free(&stream);
         return ESP_ERR_NO_MEM;
     }
 
     int status = 0;
-    esp_err_t err = llm_http_call(post_data, &rb, &status);
-    free(post_data);
-
-    if (err != ESP_OK) {
+    int64_t t0 = esp_timer_get_time();
+    esp_err_t err = llm_http_call(ctx->provider, &post, &sink, req->cancel, &status);
+    perf_record(PERF_LLM_HTTP, t0, esp_timer_get_time() - t0);
+    out->status = status;
+    out->hint_ms = llm_retry_hint_ms(&sink.hints);
+    if (sink.first_byte_us) {
+        out->ttfb_ms = (uint32_t)((sink.first_byte_us - t0) / 1000);
+        perf_record(PERF_LLM_TTFB, t0, sink.first_byte_us - t0);
+    }
+
+    esp_err_t stream_err = ESP_OK;
+    if (err == ESP_OK && status != 200) {
+        ESP_LOGE(TAG, "API error %d: %.500s", status, sink.rb.data ? sink.rb.data : "");
+    } else if (err != ESP_OK && err != ESP_ERR_NOT_FINISHED) {   /* not cancelled */
         ESP_LOGE(TAG, "HTTP request failed: %s", esp_err_to_name(err));
-        resp_buf_free(&rb);
-        return err;
+    } else if (err == ESP_OK) {
+        stream_err = (sink.stream_err != ESP_OK) ? sink.stream_err : llm_stream_finish(&stream);
     }
+    llm_retry_classify(out, err, stream_err, stream.error);
+    if (err == ESP_OK) err = (status != 200) ? ESP_FAIL : stream_err;
+    out->emitted = (resp->text_len > 0);
 
-    if (status != 200) {
-        ESP_LOGE(TAG, "API error %d: %.500s", status, rb.data ? rb.data : "");
-        resp_buf_free(&rb);
-        return ESP_FAIL;
-    }
+    llm_stream_free(&stream);
+    buf_pool_release(&sink.rb);
+    if (err != ESP_OK) llm_response_free(resp);
+    return err;
+}
 
-    /* Parse JSON */
-    cJSON *root = cJSON_Parse(rb.data);
-    resp_buf_free(&rb);
+/* ── Routing ──────────────────────────────────────────────────── */
 
-    if (!root) {
-        ESP_LOGE(TAG, "Failed to parse API response JSON");
-        return ESP_FAIL;
+/* Best configured backend outside skip_mask, -1 if none is left */
+static int pick_backend(uint32_t skip_mask)
+{
+    bool usable[LLM_PROVIDER_COUNT];
+    llm_provider_t order[LLM_PROVIDER_COUNT];
+    for (int p = 0; p < LLM_PROVIDER_COUNT; p++) {
+        usable[p] = s_backends[p].api_key[0] != '\0' && !(skip_mask & (1u << p));
     }
+    if (llm_router_rank(usable, s_provider, order) > 0) return order[0];
 
-    if (s_provider == LLM_PROVIDER_KIMI) {
-        /* ── Parse format OpenAI ── */
-        parse_openai_response(root, resp);
-    } else {
-        /* ── Parse format Anthropic ── */
-        cJSON *stop_reason = cJSON_GetObjectItem(root, "stop_reason");
-        if (stop_reason && cJSON_IsString(stop_reason)) {
-            resp->tool_use = (strcmp(stop_reason->valuestring, "tool_use") == 0);
-        }
+    /* Every candidate circuit is open: still try, preferred first */
+    if (usable[s_provider]) return s_provider;
+    for (int p = 0; p < LLM_PROVIDER_COUNT; p++) {
+        if (usable[p]) return p;
+    }
+    return -1;
+}
 
-        cJSON *content = cJSON_GetObjectItem(root, "content");
-        if (content && cJSON_IsArray(content)) {
-            /* Accumuler la taille totale du texte */
-            size_t total_text = 0;
-            cJSON *block;
-            cJSON_ArrayForEach(block, content) {
-                cJSON *btype = cJSON_GetObjectItem(block, "type");
-                if (btype && strcmp(btype->valuestring, "text") == 0) {
-                    cJSON *text = cJSON_GetObjectItem(block, "text");
-                    if (text && cJSON_IsString(text))
-                        total_text += strlen(text->valuestring);
-                }
-            }
+/* Point ctx at backend p (model and tools in its wire format) */
+static void ctx_use_backend(llm_body_ctx_t *ctx, llm_provider_t p)
+{
+    ctx->provider = p;
+    memset(ctx->model, 0, sizeof(ctx->model));
+    strncpy(ctx->model, s_backends[p].model, sizeof(ctx->model) - 1);
+    ctx->tools = ctx->req->tools_json ? get_tools_tree(ctx->req->tools_json, p) : NULL;
+}
 
-            /* Allouer et copier le texte */
-            if (total_text > 0) {
-                resp->text = calloc(1, total_text + 1);
-                if (resp->text) {
-                    cJSON_ArrayForEach(block, content) {
-                        cJSON *btype = cJSON_GetObjectItem(block, "type");
-                        if (!btype || strcmp(btype->valuestring, "text") != 0) continue;
-                        cJSON *text = cJSON_GetObjectItem(block, "text");
-                        if (!text || !cJSON_IsString(text)) continue;
-                        size_t tlen = strlen(text->valuestring);
-                        memcpy(resp->text + resp->text_len, text->valuestring, tlen);
-                        resp->text_len += tlen;
-                    }
-                    resp->text[resp->text_len] = '\0';
-                }
-            }
+/* ── Retry loop hooks ─────────────────────────────────────────── */
 
-            /* Extraire les blocs tool_use */
-            cJSON_ArrayForEach(block, content) {
-                cJSON *btype = cJSON_GetObjectItem(block, "type");
-                if (!btype || strcmp(btype->valuestring, "tool_use") != 0) continue;
-                if (resp->call_count >= MIMI_MAX_TOOL_CALLS) break;
+/* One llm_chat_request() as llm_retry_run() drives it */
+typedef struct {
+    llm_body_ctx_t  ctx;
+    llm_response_t *resp;
+    uint32_t        failed;     /* backends that already failed this call */
+} llm_call_t;
 
-                llm_tool_call_t *call = &resp->calls[resp->call_count];
+static esp_err_t call_attempt(void *arg, llm_attempt_t *at)
+{
+    llm_call_t *c = (llm_call_t *)arg;
+    return llm_attempt(&c->ctx, c->resp, at);
+}
 
-                cJSON *id = cJSON_GetObjectItem(block, "id");
-                if (id && cJSON_IsString(id))
-                    strncpy(call->id, id->valuestring, sizeof(call->id) - 1);
+static void call_report(void *arg, bool ok, uint32_t ttfb_ms)
+{
+    llm_call_t *c = (llm_call_t *)arg;
+    llm_router_report(c->ctx.provider, ok, ttfb_ms);
+}
 
-                cJSON *name = cJSON_GetObjectItem(block, "name");
-                if (name && cJSON_IsString(name))
-                    strncpy(call->name, name->valuestring, sizeof(call->name) - 1);
+static bool call_failover(void *arg, int status)
+{
+    llm_call_t *c = (llm_call_t *)arg;
+    c->failed |= 1u << c->ctx.provider;
+    int next = pick_backend(c->failed);
+    if (next < 0) return false;
+    ESP_LOGW(TAG, "%s failed (HTTP %d), failing over to %s",
+             s_backends[c->ctx.provider].label, status, s_backends[next].label);
+    ctx_use_backend(&c->ctx, next);
+    return true;
+}
 
-                cJSON *input = cJSON_GetObjectItem(block, "input");
-                if (input) {
-                    char *input_str = cJSON_PrintUnformatted(input);
-                    if (input_str) {
-                        call->input = input_str;
-                        call->input_len = strlen(input_str);
-                    }
-                }
+/* The fallback model names a model of the preferred backend */
+static bool call_fallback(void *arg)
+{
+    llm_call_t *c = (llm_call_t *)arg;
+    if (c->ctx.provider != s_provider || !s_fallback_model[0] ||
+        strcmp(c->ctx.model, s_fallback_model) == 0) {
+        return false;
+    }
+    ESP_LOGW(TAG, "%s overloaded, falling back to %s", c->ctx.model, s_fallback_model);
+    strncpy(c->ctx.model, s_fallback_model, sizeof(c->ctx.model) - 1);
+    return true;
+}
 
-                resp->call_count++;
-            }
-        }
-    }
+static bool call_cancelled(void *arg)
+{
+    return is_cancelled(((llm_call_t *)arg)->ctx.req);
+}
+
+static int64_t call_now_us(void *arg)
+{
+    return esp_timer_get_time();
+}
 
-    cJSON_Delete(root);
+static void call_wait(void *arg, int ms)
+{
+    wait_backoff(((llm_call_t *)arg)->ctx.req, ms);
+}
+
+esp_err_t llm_chat_request(const llm_request_t *req, llm_response_t *resp)
+{
+    memset(resp, 0, sizeof(*resp));
+
+    int p = pick_backend(0);
+    if (p < 0) return ESP_ERR_INVALID_STATE;
+
+    llm_call_t call = { .ctx = { .req = req }, .resp = resp };
+    ctx_use_backend(&call.ctx, p);
+    perf_span_t span = perf_begin(PERF_LLM_CALL);
+
+    int64_t deadline = req->deadline_us ? req->deadline_us
+        : esp_timer_get_time() + (int64_t)MIMI_LLM_RETRY_BUDGET_MS * 1000;
+    const llm_retry_ops_t ops = {
+        .attempt = call_attempt,
+        .report = call_report,
+        .failover = call_failover,
+        .fallback = call_fallback,
+        .cancelled = call_cancelled,
+        .now_us = call_now_us,
+        .wait = call_wait,
+        .ctx = &call,
+    };
+    llm_retry_counts_t counts = {0};
+    esp_err_t err = llm_retry_run(&ops, deadline, &counts);
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_stats.retries += counts.retries;
+    s_stats.failovers += counts.failovers;
+    s_stats.fallbacks += counts.fallbacks;
+    s_stats.rate_limited += counts.rate_limited;
+    xSemaphoreGive(s_lock);
+    perf_end(span);
+
+    if (err != ESP_OK) return err;
 
     ESP_LOGI(TAG, "Response: %d bytes text, %d tool calls, stop=%s",
              (int)resp->text_len, resp->call_count,
              resp->tool_use ? "tool_use" : "end_turn");
+    ESP_LOGI(TAG, "Usage: in=%u out=%u cache_read=%u cache_write=%u",
+             (unsigned)resp->usage.input_tokens, (unsigned)resp->usage.output_tokens,
+             (unsigned)resp->usage.cache_read_tokens, (unsigned)resp->usage.cache_write_tokens);
 
     return ESP_OK;
 }
@@ -812,47 +758,97 @@ esp_err_t llm_chat_tools(const char *system_prompt,
 
 esp_err_t llm_set_api_key(const char *api_key)
 {
-    nvs_handle_t nvs;
-    ESP_ERROR_CHECK(nvs_open(MIMI_NVS_LLM, NVS_READWRITE, &nvs));
-    ESP_ERROR_CHECK(nvs_set_str(nvs, MIMI_NVS_KEY_API_KEY, api_key));
-    ESP_ERROR_CHECK(nvs_commit(nvs));
-    nvs_close(nvs);
+    return llm_backend_configure(s_provider, api_key, NULL, NULL);
+}
+
+esp_err_t llm_set_model(const char *model)
+{
+    return llm_backend_configure(s_provider, NULL, model, NULL);
+}
 
-    strncpy(s_api_key, api_key, sizeof(s_api_key) - 1);
-    ESP_LOGI(TAG, "API key saved");
+esp_err_t llm_backend_configure(llm_provider_t p, const char *api_key,
+                                const char *model, const char *url)
+{
+    if (p >= LLM_PROVIDER_COUNT) return ESP_ERR_INVALID_ARG;
+    llm_backend_t *b = &s_backends[p];
+    esp_err_t err = ESP_OK;
+
+    if (api_key) {
+        err = backend_nvs_set(MIMI_NVS_KEY_BACKEND_KEY, b, api_key);
+        if (err != ESP_OK) return err;
+        memset(b->api_key, 0, sizeof(b->api_key));
+        strncpy(b->api_key, api_key, sizeof(b->api_key) - 1);
+        ESP_LOGI(TAG, "%s API key %s", b->label, api_key[0] ? "saved" : "cleared");
+    }
+    if (model) {
+        err = backend_nvs_set(MIMI_NVS_KEY_BACKEND_MODEL, b, model);
+        if (err != ESP_OK) return err;
+        memset(b->model, 0, sizeof(b->model));
+        strncpy(b->model, model[0] ? model : b->default_model, sizeof(b->model) - 1);
+        ESP_LOGI(TAG, "%s model: %s", b->label, b->model);
+    }
+    if (url) {
+        err = backend_nvs_set(MIMI_NVS_KEY_BACKEND_URL, b, url);
+        if (err != ESP_OK) return err;
+        /* The kept-alive connection points at the old host */
+        http_client_forget_host(b->host);
+        backend_set_url(b, url[0] ? url : b->default_url);
+        ESP_LOGI(TAG, "%s URL: %s", b->label, b->url);
+    }
     return ESP_OK;
 }
 
-esp_err_t llm_set_model(const char *model)
+void llm_backend_get_info(llm_provider_t p, llm_backend_info_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    if (p >= LLM_PROVIDER_COUNT) return;
+    const llm_backend_t *b = &s_backends[p];
+    out->id = b->id;
+    out->label = b->label;
+    out->model = b->model;
+    out->url = b->url;
+    out->has_key = b->api_key[0] != '\0';
+    out->preferred = (p == s_provider);
+}
+
+esp_err_t llm_set_fallback_model(const char *model)
 {
     nvs_handle_t nvs;
     ESP_ERROR_CHECK(nvs_open(MIMI_NVS_LLM, NVS_READWRITE, &nvs));
-    ESP_ERROR_CHECK(nvs_set_str(nvs, MIMI_NVS_KEY_MODEL, model));
+    if (model && model[0]) {
+        ESP_ERROR_CHECK(nvs_set_str(nvs, MIMI_NVS_KEY_FALLBACK, model));
+    } else {
+        nvs_erase_key(nvs, MIMI_NVS_KEY_FALLBACK);
+    }
     ESP_ERROR_CHECK(nvs_commit(nvs));
     nvs_close(nvs);
 
-    strncpy(s_model, model, sizeof(s_model) - 1);
-    ESP_LOGI(TAG, "Model set to: %s", s_model);
+    memset(s_fallback_model, 0, sizeof(s_fallback_model));
+    if (model) strncpy(s_fallback_model, model, sizeof(s_fallback_model) - 1);
+    ESP_LOGI(TAG, "Fallback model: %s", s_fallback_model[0] ? s_fallback_model : "(none)");
     return ESP_OK;
 }
 
+const char *llm_get_fallback_model(void)
+{
+    return s_fallback_model;
+}
+
 esp_err_t llm_set_provider(llm_provider_t provider)
 {
+    if (provider >= LLM_PROVIDER_COUNT) return ESP_ERR_INVALID_ARG;
+
     nvs_handle_t nvs;
     ESP_ERROR_CHECK(nvs_open(MIMI_NVS_LLM, NVS_READWRITE, &nvs));
-    const char *val = (provider == LLM_PROVIDER_KIMI) ? "kimi" : "anthropic";
-    ESP_ERROR_CHECK(nvs_set_str(nvs, MIMI_NVS_KEY_PROVIDER, val));
-
-    /* Auto-switch modele par defaut + clear NVS model override */
-    const char *default_model = (provider == LLM_PROVIDER_KIMI)
-        ? MIMI_KIMI_DEFAULT_MODEL : MIMI_LLM_DEFAULT_MODEL;
-    nvs_erase_key(nvs, MIMI_NVS_KEY_MODEL);
+    ESP_ERROR_CHECK(nvs_set_str(nvs, MIMI_NVS_KEY_PROVIDER, s_backends[provider].id));
     ESP_ERROR_CHECK(nvs_commit(nvs));
     nvs_close(nvs);
 
+    /* Models are per backend now, nothing to reset. Other backends stay live
+     * (and keep their connection) for failover. */
     s_provider = provider;
-    strncpy(s_model, default_model, sizeof(s_model) - 1);
-    ESP_LOGI(TAG, "Provider: %s, model: %s", val, s_model);
+    ESP_LOGI(TAG, "Preferred provider: %s, model: %s",
+             s_backends[provider].id, s_backends[provider].model);
     return ESP_OK;
 }
 
@@ -863,5 +859,33 @@ llm_provider_t llm_get_provider(void)
 
 const char *llm_get_provider_name(void)
 {
-    return (s_provider == LLM_PROVIDER_KIMI) ? "Kimi" : "Anthropic";
+    return s_backends[s_provider].label;
+}
+
+const char *llm_get_model(void)
+{
+    return s_backends[s_provider].model;
+}
+
+const char *llm_provider_id(llm_provider_t p)
+{
+    return (p < LLM_PROVIDER_COUNT) ? s_backends[p].id : "?";
+}
+
+bool llm_provider_from_id(const char *id, llm_provider_t *out)
+{
+    for (int p = 0; p < LLM_PROVIDER_COUNT; p++) {
+        if (strcmp(id, s_backends[p].id) == 0) {
+            *out = (llm_provider_t)p;
+            return true;
+        }
+    }
+    return false;
+}
+
+void llm_get_conn_stats(llm_conn_stats_t *out)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *out = s_stats;
+    xSemaphoreGive(s_lock);
 }
@@ -3,38 +3,74 @@
 #include "esp_err.h"
 #include "cJSON.h"
 #include <stddef.h>
+#include <stdint.h>
 #include <stdbool.h>
 
 #include "mimi_config.h"
 
-/* Fournisseur LLM */
+/* Fournisseur LLM (backend) */
 typedef enum {
     LLM_PROVIDER_ANTHROPIC = 0,
     LLM_PROVIDER_KIMI = 1,
+    LLM_PROVIDER_OPENAI = 2,        /* any OpenAI-compatible endpoint */
+    LLM_PROVIDER_COUNT,
 } llm_provider_t;
 
 /**
- * Initialize the LLM proxy. Reads API key and model from build-time secrets, then NVS.
+ * Initialize the LLM proxy. Reads keys, models and URLs of every backend
+ * from build-time secrets, then NVS.
  */
 esp_err_t llm_proxy_init(void);
 
 /**
- * Save the Anthropic API key to NVS.
+ * Save the API key of the preferred provider to NVS.
  */
 esp_err_t llm_set_api_key(const char *api_key);
 
 /**
- * Save the model identifier to NVS.
+ * Save the model identifier of the preferred provider to NVS.
  */
 esp_err_t llm_set_model(const char *model);
+const char *llm_get_model(void);
 
 /**
- * Definir/lire le fournisseur LLM (Anthropic ou Kimi).
+ * Configure one backend. NULL leaves a field unchanged, "" resets it
+ * (key cleared, model and URL back to the defaults). A backend with a key
+ * is live: the router may send calls to it.
+ */
+esp_err_t llm_backend_configure(llm_provider_t p, const char *api_key,
+                                const char *model, const char *url);
+
+typedef struct {
+    const char *id;         /* "anthropic", "kimi", "openai" */
+    const char *label;
+    const char *model;
+    const char *url;
+    bool has_key;
+    bool preferred;
+} llm_backend_info_t;
+
+void llm_backend_get_info(llm_provider_t p, llm_backend_info_t *out);
+
+/**
+ * Save the model used once the primary one keeps answering 429/529
+ * (same provider). NULL or "" disables the fallback.
+ */
+esp_err_t llm_set_fallback_model(const char *model);
+const char *llm_get_fallback_model(void);
+
+/**
+ * Definir/lire le fournisseur prefere. Le routeur s'en ecarte seulement
+ * quand un autre backend est nettement plus sain.
  */
 esp_err_t llm_set_provider(llm_provider_t provider);
 llm_provider_t llm_get_provider(void);
 const char *llm_get_provider_name(void);
 
+/** "anthropic" / "kimi" / "openai" (CLI and NVS name) */
+const char *llm_provider_id(llm_provider_t p);
+bool llm_provider_from_id(const char *id, llm_provider_t *out);
+
 /**
  * Send a chat completion request to Anthropic Messages API (streaming).
  *
@@ -56,16 +92,31 @@ typedef struct {
     size_t input_len;
 } llm_tool_call_t;
 
+/* Token usage reported by the API for one call */
+typedef struct {
+    uint32_t input_tokens;          /* uncached prompt tokens */
+    uint32_t output_tokens;
+    uint32_t cache_read_tokens;     /* prompt tokens served from the prompt cache */
+    uint32_t cache_write_tokens;    /* prompt tokens written to the prompt cache */
+} llm_usage_t;
+
 typedef struct {
     char *text;                                  /* accumulated text blocks */
     size_t text_len;
     llm_tool_call_t calls[MIMI_MAX_TOOL_CALLS];
     int call_count;
     bool tool_use;                               /* stop_reason == "tool_use" */
+    llm_usage_t usage;
 } llm_response_t;
 
 void llm_response_free(llm_response_t *resp);
 
+/**
+ * Called from the LLM call's task for every text fragment as it arrives.
+ * text is not NUL-terminated beyond len and is only valid during the call.
+ */
+typedef void (*llm_delta_cb_t)(const char *text, size_t len, void *ctx);
+
 /**
  * Send a chat completion request with tools to Anthropic Messages API (streaming).
  *
@@ -79,3 +130,62 @@ esp_err_t llm_chat_tools(const char *system_prompt,
                          cJSON *messages,
                          const char *tools_json,
                          llm_response_t *resp);
+
+/* Serialized request fragments reused across the calls of one agent turn */
+typedef struct llm_body_cache llm_body_cache_t;
+
+/** Allocate an empty body cache (PSRAM). */
+llm_body_cache_t *llm_body_cache_create(void);
+
+/** Forget cached bytes (start of a new turn) and log what the last turn saved. */
+void llm_body_cache_reset(llm_body_cache_t *cache);
+
+void llm_body_cache_free(llm_body_cache_t *cache);
+
+/* Full request description for llm_chat_request() */
+typedef struct {
+    const char *system_prompt;
+    size_t system_static_len;   /* leading bytes of system_prompt that do not change
+                                 * between calls (prompt cache breakpoint), 0 = none */
+    cJSON *messages;            /* caller owns */
+    const char *tools_json;     /* or NULL; must stay valid and unchanged (parsed once) */
+    llm_delta_cb_t on_delta;    /* text fragments as they stream in, or NULL */
+    void *cb_ctx;               /* passed to on_delta */
+    llm_body_cache_t *body_cache; /* or NULL; messages may only be appended to
+                                   * between calls sharing a cache */
+    int64_t deadline_us;        /* esp_timer time after which no retry is started,
+                                 * 0 = MIMI_LLM_RETRY_BUDGET_MS from now */
+    const volatile bool *cancel; /* or NULL; set by another task to abandon the call */
+} llm_request_t;
+
+/**
+ * Send a chat request with tools, streaming the response.
+ * On Anthropic, the static system prefix and the tools array are marked
+ * with cache_control so repeated calls hit the prompt cache.
+ * Each attempt goes to the healthiest live backend (see llm_router.h);
+ * transient failures fail over to another backend at once, or are retried
+ * with jittered backoff until req->deadline_us, as long as no text was
+ * streamed yet.
+ * resp is complete (including resp->usage) once the call returns.
+ * @return ESP_OK, ESP_ERR_TIMEOUT if the API stayed rate limited / overloaded,
+ *         or ESP_ERR_NOT_FINISHED once req->cancel was set
+ */
+esp_err_t llm_chat_request(const llm_request_t *req, llm_response_t *resp);
+
+/* ── Connection statistics ─────────────────────────────────────── */
+
+typedef struct {
+    uint32_t requests;      /* HTTP requests sent */
+    uint32_t handshakes;    /* new TLS connections opened */
+    uint32_t reuses;        /* requests served on an already open connection */
+    uint32_t reconnects;    /* requests resent after a stale keep-alive connection */
+    uint32_t rate_limited;  /* attempts answered 429 / 529 / overloaded_error */
+    uint32_t retries;       /* attempts retried after a backoff */
+    uint32_t fallbacks;     /* calls switched to the fallback model */
+    uint32_t failovers;     /* attempts moved to another backend */
+} llm_conn_stats_t;
+
+/**
+ * Snapshot of the LLM connection counters since boot.
+ */
+void llm_get_conn_stats(llm_conn_stats_t *out);
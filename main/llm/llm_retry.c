@@ -0,0 +1,199 @@
+#include "llm_retry.h"
+#include "mimi_config.h"
+
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include "esp_random.h"
+#include "esp_log.h"
+
+static const char *TAG = "llm";
+
+static const char *const s_rl_buckets[LLM_RL_BUCKETS] = {
+    "requests", "tokens", "input-tokens", "output-tokens",
+};
+
+/* ── Server hints ─────────────────────────────────────────────── */
+
+#define CLOCK_VALID_EPOCH   1700000000  /* before this, the clock was never set */
+
+/* Days since 1970-01-01 (proleptic Gregorian) */
+static int64_t days_from_civil(int y, int m, int d)
+{
+    y -= (m <= 2);
+    int64_t era = (y >= 0 ? y : y - 399) / 400;
+    int yoe = (int)(y - era * 400);
+    int doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+/* "2025-01-31T12:00:05Z" → epoch seconds, -1 if malformed (offsets ignored, the API sends UTC) */
+static int64_t parse_rfc3339(const char *s)
+{
+    int y, mo, d, h, mi, sec;
+    if (sscanf(s, "%d-%d-%dT%d:%d:%d", &y, &mo, &d, &h, &mi, &sec) != 6) return -1;
+    return days_from_civil(y, mo, d) * 86400 + h * 3600 + mi * 60 + sec;
+}
+
+void llm_retry_hints_init(llm_retry_hints_t *h)
+{
+    h->retry_after_ms = -1;
+    for (int i = 0; i < LLM_RL_BUCKETS; i++) {
+        h->rl[i].remaining = -1;
+        h->rl[i].reset_ms = -1;
+    }
+}
+
+void llm_retry_hints_header(llm_retry_hints_t *h, const char *key, const char *value, time_t now)
+{
+    if (strcasecmp(key, "retry-after") == 0) {
+        /* delta-seconds; the HTTP-date form is not sent by the LLM APIs */
+        char *end;
+        double secs = strtod(value, &end);
+        if (end != value && secs >= 0 && secs < 3600) h->retry_after_ms = (int)(secs * 1000);
+        return;
+    }
+    if (strncasecmp(key, "anthropic-ratelimit-", 20) != 0) return;
+
+    const char *field = key + 20;
+    for (int i = 0; i < LLM_RL_BUCKETS; i++) {
+        size_t n = strlen(s_rl_buckets[i]);
+        if (strncasecmp(field, s_rl_buckets[i], n) != 0) continue;
+        if (strcasecmp(field + n, "-remaining") == 0) {
+            h->rl[i].remaining = atol(value);
+        } else if (strcasecmp(field + n, "-reset") == 0) {
+            int64_t at = parse_rfc3339(value);
+            if (at > 0 && now > CLOCK_VALID_EPOCH && at >= now && at - now < 3600) {
+                h->rl[i].reset_ms = (int)(at - now) * 1000;
+            }
+        }
+        return;
+    }
+}
+
+int llm_retry_hint_ms(const llm_retry_hints_t *h)
+{
+    if (h->retry_after_ms >= 0) return h->retry_after_ms;
+    int hint = -1;
+    for (int i = 0; i < LLM_RL_BUCKETS; i++) {
+        if (h->rl[i].remaining == 0 && h->rl[i].reset_ms > hint) hint = h->rl[i].reset_ms;
+    }
+    return hint;
+}
+
+/* ── Policy ───────────────────────────────────────────────────── */
+
+bool llm_retry_status(int status)
+{
+    return status == 408 || status == 429 || status == 500 || status == 502 ||
+           status == 503 || status == 504 || status == 529;
+}
+
+bool llm_retry_stream_error(const char *error, bool *overloaded)
+{
+    *overloaded = (strncmp(error, "overloaded_error", 16) == 0 ||
+                   strncmp(error, "rate_limit_error", 16) == 0);
+    return *overloaded || strncmp(error, "api_error", 9) == 0;
+}
+
+void llm_retry_classify(llm_attempt_t *at, esp_err_t http_err, esp_err_t stream_err,
+                        const char *stream_error)
+{
+    if (http_err == ESP_OK && at->status != 200) {
+        at->retryable = llm_retry_status(at->status);
+        at->overloaded = (at->status == 429 || at->status == 529);
+    } else if (http_err != ESP_OK) {
+        /* out of memory is ours, a cancel is no failure */
+        at->retryable = (http_err != ESP_ERR_NO_MEM && http_err != ESP_ERR_NOT_FINISHED);
+    } else if (stream_err == ESP_ERR_INVALID_RESPONSE) {
+        at->retryable = true;       /* connection dropped mid-stream, or an event lost */
+    } else if (stream_err != ESP_OK && stream_error[0]) {
+        at->retryable = llm_retry_stream_error(stream_error, &at->overloaded);
+    }
+}
+
+llm_retry_verdict_t llm_retry_verdict(int attempt, const llm_attempt_t *at)
+{
+    bool auth = (at->status == 401 || at->status == 403);
+    if (at->emitted || !(at->retryable || auth)) return LLM_RETRY_STOP;
+    if (attempt + 1 >= MIMI_LLM_RETRY_MAX) return LLM_RETRY_EXHAUSTED;
+    return LLM_RETRY_AGAIN;
+}
+
+int llm_retry_backoff_ms(int attempt, int hint_ms)
+{
+    int cap = MIMI_LLM_RETRY_BASE_MS << (attempt < 6 ? attempt : 6);
+    if (cap > MIMI_LLM_RETRY_MAX_DELAY_MS) cap = MIMI_LLM_RETRY_MAX_DELAY_MS;
+    int delay = cap / 2 + (int)(esp_random() % (uint32_t)(cap / 2 + 1));
+    if (hint_ms > delay) delay = hint_ms + (int)(esp_random() % 250);
+    return delay;
+}
+
+int llm_retry_delay_ms(int attempt, const llm_attempt_t *at, int64_t now_us, int64_t deadline_us)
+{
+    int delay = llm_retry_backoff_ms(attempt, at->hint_ms);
+    if (now_us + (int64_t)delay * 1000 > deadline_us) return -1;
+    return delay;
+}
+
+/* ── Loop ─────────────────────────────────────────────────────── */
+
+esp_err_t llm_retry_run(const llm_retry_ops_t *ops, int64_t deadline_us, llm_retry_counts_t *counts)
+{
+    int overloads = 0;
+    esp_err_t err;
+
+    for (int attempt = 0; ; attempt++) {
+        if (ops->cancelled(ops->ctx)) {
+            err = ESP_ERR_NOT_FINISHED;
+            break;
+        }
+        llm_attempt_t at;
+        err = ops->attempt(ops->ctx, &at);
+
+        /* Health: transport errors, 5xx/429 and bad keys count against the
+         * backend; other 4xx are our request's fault */
+        bool auth = (at.status == 401 || at.status == 403);
+        if (err == ESP_OK || at.retryable || auth) {
+            ops->report(ops->ctx, err == ESP_OK, at.ttfb_ms);
+        }
+
+        if (err == ESP_OK) break;
+        llm_retry_verdict_t verdict = llm_retry_verdict(attempt, &at);
+        if (verdict == LLM_RETRY_STOP) break;
+
+        if (at.overloaded) counts->rate_limited++;
+        if (verdict == LLM_RETRY_EXHAUSTED) {
+            if (at.overloaded) err = ESP_ERR_TIMEOUT;
+            break;
+        }
+
+        /* Another backend answers right away: no backoff */
+        if (ops->failover(ops->ctx, at.status)) {
+            overloads = 0;
+            counts->failovers++;
+            continue;
+        }
+        if (auth) break;
+
+        /* Fallback model after repeated overloads, for the rest of this call */
+        if (at.overloaded && ++overloads >= MIMI_LLM_FALLBACK_AFTER && ops->fallback(ops->ctx)) {
+            counts->fallbacks++;
+        }
+
+        int delay = llm_retry_delay_ms(attempt, &at, ops->now_us(ops->ctx), deadline_us);
+        if (delay < 0) {
+            ESP_LOGW(TAG, "Retry budget exhausted");
+            if (at.overloaded) err = ESP_ERR_TIMEOUT;
+            break;
+        }
+
+        ESP_LOGW(TAG, "Attempt %d failed (HTTP %d%s), retrying in %d ms",
+                 attempt + 1, at.status, at.hint_ms >= 0 ? ", server hint" : "", delay);
+        counts->retries++;
+        ops->wait(ops->ctx, delay);
+    }
+    return err;
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include "esp_err.h"
+
+/*
+ * Retry policy of LLM calls: server hints read from the response headers,
+ * which failures are transient, and the jittered exponential backoff within
+ * the call's deadline, and the loop of attempts built on them. llm_proxy
+ * supplies the attempt itself, the failover between backends, the clock and
+ * the wait; nothing here touches the network or FreeRTOS.
+ */
+
+/* Outcome of one HTTP attempt, as far as the retry loop cares */
+typedef struct {
+    int  status;            /* 0: no response */
+    bool retryable;         /* transient: 429, 5xx, 529, timeout, dropped stream */
+    bool overloaded;        /* 429 / 529 / overloaded_error: worth a fallback model */
+    bool emitted;           /* text already went to on_delta, a retry would repeat it */
+    int  hint_ms;           /* server-provided wait, -1 if none */
+    uint32_t ttfb_ms;       /* request start to first body byte, 0 if none */
+} llm_attempt_t;
+
+/* ── Server hints ─────────────────────────────────────────────── */
+
+/* anthropic-ratelimit-<bucket>-remaining / -reset */
+#define LLM_RL_BUCKETS  4
+
+typedef struct {
+    int retry_after_ms;     /* Retry-After header, -1 if absent */
+    struct {
+        long remaining;     /* -1: header absent */
+        int  reset_ms;      /* from now, -1: absent or clock not set */
+    } rl[LLM_RL_BUCKETS];
+} llm_retry_hints_t;
+
+void llm_retry_hints_init(llm_retry_hints_t *h);
+
+/** Note one response header; now is the wall clock (resets are absolute times). */
+void llm_retry_hints_header(llm_retry_hints_t *h, const char *key, const char *value, time_t now);
+
+/** Wait asked by the server: Retry-After, else the latest reset of an exhausted bucket, else -1. */
+int llm_retry_hint_ms(const llm_retry_hints_t *h);
+
+/* ── Policy ───────────────────────────────────────────────────── */
+
+/** HTTP statuses worth another attempt. */
+bool llm_retry_status(int status);
+
+/** Error event inside a 200 stream ("overloaded_error: Overloaded"). */
+bool llm_retry_stream_error(const char *error, bool *overloaded);
+
+/**
+ * Set at->retryable / at->overloaded for a failed attempt (at->status set).
+ * @param http_err      transport result; ESP_ERR_NOT_FINISHED: cancelled
+ * @param stream_err    result of parsing a 200 stream, ESP_OK if not reached
+ * @param stream_error  the stream's error event, "" if none
+ */
+void llm_retry_classify(llm_attempt_t *at, esp_err_t http_err, esp_err_t stream_err,
+                        const char *stream_error);
+
+typedef enum {
+    LLM_RETRY_STOP = 0,     /* permanent error, or text already streamed */
+    LLM_RETRY_EXHAUSTED,    /* transient, but MIMI_LLM_RETRY_MAX attempts made */
+    LLM_RETRY_AGAIN,        /* another attempt may follow */
+} llm_retry_verdict_t;
+
+/** What may follow failed attempt number attempt (0-based). 401/403 only allow a failover. */
+llm_retry_verdict_t llm_retry_verdict(int attempt, const llm_attempt_t *at);
+
+/** Exponential backoff with equal jitter, stretched to the server hint. */
+int llm_retry_backoff_ms(int attempt, int hint_ms);
+
+/**
+ * Wait before retrying on the same backend, or -1 if the next attempt would
+ * start after deadline_us (same clock as now_us).
+ */
+int llm_retry_delay_ms(int attempt, const llm_attempt_t *at, int64_t now_us, int64_t deadline_us);
+
+/* ── Loop ─────────────────────────────────────────────────────── */
+
+/* What the loop needs from the caller, all called with ctx */
+typedef struct {
+    /** One attempt on the current backend and model */
+    esp_err_t (*attempt)(void *ctx, llm_attempt_t *at);
+    /** Health report for the current backend */
+    void (*report)(void *ctx, bool ok, uint32_t ttfb_ms);
+    /** Switch to a backend not failed yet in this call; false if none is left */
+    bool (*failover)(void *ctx, int status);
+    /** Switch to the fallback model after repeated overloads; false if there is none */
+    bool (*fallback)(void *ctx);
+    bool (*cancelled)(void *ctx);
+    int64_t (*now_us)(void *ctx);
+    /** Backoff sleep, may return early on cancel */
+    void (*wait)(void *ctx, int ms);
+    void *ctx;
+} llm_retry_ops_t;
+
+typedef struct {
+    uint32_t retries;
+    uint32_t failovers;
+    uint32_t fallbacks;
+    uint32_t rate_limited;
+} llm_retry_counts_t;
+
+/**
+ * Attempts until one succeeds, a permanent error, MIMI_LLM_RETRY_MAX
+ * attempts, or the next one would start after deadline_us.
+ * @param counts  incremented, not cleared
+ * @return ESP_OK, the last attempt's error, ESP_ERR_NOT_FINISHED if cancelled,
+ *         or ESP_ERR_TIMEOUT when it gave up on an overloaded service
+ */
+esp_err_t llm_retry_run(const llm_retry_ops_t *ops, int64_t deadline_us, llm_retry_counts_t *counts);
@@ -0,0 +1,183 @@
+#include "llm_router.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char *TAG = "llm_router";
+
+#define WINDOW  MIMI_LLM_ROUTER_WINDOW
+
+typedef struct {
+    /* Ring of the last WINDOW attempts */
+    uint32_t ttfb_ms[WINDOW];
+    bool     ok[WINDOW];
+    uint8_t  head;
+    uint8_t  count;
+
+    uint32_t calls;
+    uint32_t failures;
+    uint8_t  consecutive_fail;
+
+    llm_cb_state_t state;
+    int64_t  open_until_us;
+    uint32_t cooldown_ms;   /* doubles after each failed probe */
+} backend_health_t;
+
+static backend_health_t s_health[LLM_PROVIDER_COUNT];
+static SemaphoreHandle_t s_lock = NULL;
+
+esp_err_t llm_router_init(void)
+{
+    if (!s_lock) {
+        s_lock = xSemaphoreCreateMutex();
+        if (!s_lock) return ESP_ERR_NO_MEM;
+    }
+    memset(s_health, 0, sizeof(s_health));
+    for (int p = 0; p < LLM_PROVIDER_COUNT; p++) {
+        s_health[p].cooldown_ms = MIMI_LLM_CB_COOLDOWN_MS;
+    }
+    return ESP_OK;
+}
+
+/* ── Window statistics (s_lock held) ──────────────────────────── */
+
+static int cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void window_stats(const backend_health_t *h, uint32_t *p50, uint32_t *p95, int *err_pct)
+{
+    uint32_t sorted[WINDOW];
+    int n = 0, fails = 0;
+    for (int i = 0; i < h->count; i++) {
+        if (h->ok[i]) sorted[n++] = h->ttfb_ms[i];
+        else fails++;
+    }
+    *err_pct = h->count ? fails * 100 / h->count : 0;
+    if (n == 0) {
+        *p50 = *p95 = 0;
+        return;
+    }
+    qsort(sorted, n, sizeof(sorted[0]), cmp_u32);
+    *p50 = sorted[(n - 1) / 2];
+    *p95 = sorted[(n - 1) * 95 / 100];
+}
+
+/* Open → half-open once the cool-down is over */
+static void refresh_state(backend_health_t *h, int64_t now)
+{
+    if (h->state == LLM_CB_OPEN && now >= h->open_until_us) {
+        h->state = LLM_CB_HALF_OPEN;
+    }
+}
+
+/* Lower is better: p95 inflated by the error rate */
+static uint32_t score(const backend_health_t *h)
+{
+    uint32_t p50, p95;
+    int err_pct;
+    window_stats(h, &p50, &p95, &err_pct);
+    if (p95 == 0) p95 = MIMI_LLM_ROUTER_DEFAULT_MS;   /* no data yet: neutral guess */
+    return p95 + p95 * (uint32_t)err_pct * 4 / 100;
+}
+
+/* ── Public API ───────────────────────────────────────────────── */
+
+int llm_router_rank(const bool usable[LLM_PROVIDER_COUNT], llm_provider_t preferred,
+                    llm_provider_t order[LLM_PROVIDER_COUNT])
+{
+    uint32_t scores[LLM_PROVIDER_COUNT];
+    int n = 0;
+    int64_t now = esp_timer_get_time();
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int p = 0; p < LLM_PROVIDER_COUNT; p++) {
+        if (!usable[p]) continue;
+        backend_health_t *h = &s_health[p];
+        refresh_state(h, now);
+        if (h->state == LLM_CB_OPEN) continue;
+
+        uint32_t sc = score(h);
+        if (p == (int)preferred) sc = sc * 100 / MIMI_LLM_ROUTER_PREFER_PCT;
+        /* A half-open backend gets its probe from the preferred slot only,
+         * otherwise after every healthy one */
+        if (h->state == LLM_CB_HALF_OPEN && p != (int)preferred) sc += 1000000;
+
+        /* Insertion sort, at most LLM_PROVIDER_COUNT entries */
+        int i = n++;
+        while (i > 0 && scores[i - 1] > sc) {
+            scores[i] = scores[i - 1];
+            order[i] = order[i - 1];
+            i--;
+        }
+        scores[i] = sc;
+        order[i] = (llm_provider_t)p;
+    }
+    xSemaphoreGive(s_lock);
+    return n;
+}
+
+void llm_router_report(llm_provider_t p, bool ok, uint32_t ttfb_ms)
+{
+    if (p >= LLM_PROVIDER_COUNT) return;
+    backend_health_t *h = &s_health[p];
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    h->ttfb_ms[h->head] = ok ? ttfb_ms : 0;
+    h->ok[h->head] = ok;
+    h->head = (h->head + 1) % WINDOW;
+    if (h->count < WINDOW) h->count++;
+    h->calls++;
+
+    if (ok) {
+        if (h->state != LLM_CB_CLOSED) ESP_LOGI(TAG, "%s recovered, circuit closed", llm_provider_id(p));
+        h->state = LLM_CB_CLOSED;
+        h->consecutive_fail = 0;
+        h->cooldown_ms = MIMI_LLM_CB_COOLDOWN_MS;
+    } else {
+        h->failures++;
+        h->consecutive_fail++;
+        bool trip = (h->state == LLM_CB_HALF_OPEN) ||
+                    (h->state == LLM_CB_CLOSED && h->consecutive_fail >= MIMI_LLM_CB_FAILURES);
+        if (trip) {
+            if (h->state == LLM_CB_HALF_OPEN) {
+                /* Probe failed: back off harder */
+                h->cooldown_ms *= 2;
+                if (h->cooldown_ms > MIMI_LLM_CB_COOLDOWN_MAX_MS) {
+                    h->cooldown_ms = MIMI_LLM_CB_COOLDOWN_MAX_MS;
+                }
+            }
+            h->state = LLM_CB_OPEN;
+            h->open_until_us = esp_timer_get_time() + (int64_t)h->cooldown_ms * 1000;
+            ESP_LOGW(TAG, "%s circuit open for %u ms after %u failures",
+                     llm_provider_id(p), (unsigned)h->cooldown_ms, (unsigned)h->consecutive_fail);
+        }
+    }
+    xSemaphoreGive(s_lock);
+}
+
+void llm_router_get_stats(llm_provider_t p, llm_route_stats_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    if (p >= LLM_PROVIDER_COUNT) return;
+    backend_health_t *h = &s_health[p];
+    int64_t now = esp_timer_get_time();
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    refresh_state(h, now);
+    int err_pct;
+    window_stats(h, &out->p50_ms, &out->p95_ms, &err_pct);
+    out->calls = h->calls;
+    out->failures = h->failures;
+    out->samples = h->count;
+    out->err_pct = (uint8_t)err_pct;
+    out->state = h->state;
+    if (h->state == LLM_CB_OPEN) out->open_ms = (uint32_t)((h->open_until_us - now) / 1000);
+    xSemaphoreGive(s_lock);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "llm/llm_proxy.h"
+
+/*
+ * Backend health for the LLM router: rolling time-to-first-byte percentiles,
+ * recent error rate and a circuit breaker per provider. llm_proxy asks for a
+ * ranking before each attempt and reports the outcome afterwards; nothing
+ * here touches the network.
+ */
+
+typedef enum {
+    LLM_CB_CLOSED = 0,      /* healthy, takes traffic */
+    LLM_CB_OPEN,            /* skipped until the cool-down ends */
+    LLM_CB_HALF_OPEN,       /* cool-down over, next call is a probe */
+} llm_cb_state_t;
+
+typedef struct {
+    uint32_t calls;
+    uint32_t failures;
+    uint32_t p50_ms;        /* time to first byte, successful calls in the window */
+    uint32_t p95_ms;
+    uint8_t  samples;       /* calls in the window */
+    uint8_t  err_pct;       /* failed calls in the window */
+    llm_cb_state_t state;
+    uint32_t open_ms;       /* cool-down left while open */
+} llm_route_stats_t;
+
+esp_err_t llm_router_init(void);
+
+/**
+ * Rank backends for the next attempt, best first.
+ * usable[p]: backend configured and not excluded by the caller.
+ * preferred gets a bias (MIMI_LLM_ROUTER_PREFER_PCT) so traffic only moves
+ * when another backend is clearly healthier.
+ * @return number of entries written to order (open circuits are left out)
+ */
+int llm_router_rank(const bool usable[LLM_PROVIDER_COUNT], llm_provider_t preferred,
+                    llm_provider_t order[LLM_PROVIDER_COUNT]);
+
+/**
+ * Record one attempt. ttfb_ms is ignored for failures.
+ */
+void llm_router_report(llm_provider_t p, bool ok, uint32_t ttfb_ms);
+
+void llm_router_get_stats(llm_provider_t p, llm_route_stats_t *out);
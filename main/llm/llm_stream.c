@@ -0,0 +1,441 @@
+#include "llm_stream.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include "esp_log.h"
+#include "llm/json_tok.h"
+
+static const char *TAG = "llm_stream";
+
+#define STREAM_LINE_MAX   (64 * 1024)   /* refuse pathological lines */
+
+/* ── Growable buffers ─────────────────────────────────────────── */
+
+static bool grow(char **buf, size_t *cap, size_t need)
+{
+    if (need <= *cap) return true;
+    size_t new_cap = *cap ? *cap : 256;
+    while (new_cap < need) new_cap *= 2;
+    char *tmp = realloc(*buf, new_cap);
+    if (!tmp) return false;
+    *buf = tmp;
+    *cap = new_cap;
+    return true;
+}
+
+static bool append(char **buf, size_t *len, size_t *cap, const char *src, size_t n)
+{
+    if (!grow(buf, cap, *len + n + 1)) return false;
+    memcpy(*buf + *len, src, n);
+    *len += n;
+    (*buf)[*len] = '\0';
+    return true;
+}
+
+/* ── Event accessors ──────────────────────────────────────────── */
+
+/* One tokenized event payload (s->data) */
+typedef struct {
+    const char *js;
+    const jtok_t *t;
+    int n;
+} ev_t;
+
+static int ev_get(const ev_t *ev, int obj, const char *key)
+{
+    return json_tok_get(ev->js, ev->t, ev->n, obj, key);
+}
+
+static bool ev_is(const ev_t *ev, int tok, const char *s)
+{
+    return json_tok_eq(ev->js, ev->t, tok, s);
+}
+
+/* Non-empty string token (Kimi repeats "id": "" / null on later fragments) */
+static bool ev_has_str(const ev_t *ev, int tok)
+{
+    return tok >= 0 && ev->t[tok].type == JTOK_STRING && json_tok_raw_len(ev->t, tok) > 0;
+}
+
+static void ev_copy(const ev_t *ev, int tok, char *dst, size_t size)
+{
+    json_tok_str(ev->js, ev->t, tok, dst, size);
+}
+
+/* Decode string token tok onto the end of a growable buffer.
+ * Returns bytes appended, or -1 when out of memory. */
+static int ev_append(llm_stream_t *s, const ev_t *ev, int tok,
+                     char **buf, size_t *len, size_t *cap)
+{
+    if (tok < 0 || ev->t[tok].type != JTOK_STRING) return 0;
+    size_t raw = json_tok_raw_len(ev->t, tok);
+    if (raw == 0) return 0;
+    if (!grow(buf, cap, *len + raw + 1)) {
+        s->failed = true;
+        return -1;
+    }
+    size_t n = json_tok_str(ev->js, ev->t, tok, *buf + *len, raw + 1);
+    *len += n;
+    return (int)n;
+}
+
+static void append_text(llm_stream_t *s, const ev_t *ev, int tok)
+{
+    llm_response_t *resp = s->resp;
+    size_t old = resp->text_len;
+    int n = ev_append(s, ev, tok, &resp->text, &resp->text_len, &s->text_cap);
+    if (n > 0 && s->on_delta) s->on_delta(resp->text + old, n, s->cb_ctx);
+}
+
+/* Copy a numeric usage field if present (absent fields keep earlier values) */
+static void usage_field(const ev_t *ev, int usage, const char *key, uint32_t *out)
+{
+    long v = json_tok_long(ev->js, ev->t, ev_get(ev, usage, key), -1);
+    if (v >= 0) *out = (uint32_t)v;
+}
+
+static void set_error(llm_stream_t *s, const ev_t *ev, int err)
+{
+    char etype[32], msg[96];
+    ev_copy(ev, ev_get(ev, err, "type"), etype, sizeof(etype));
+    ev_copy(ev, ev_get(ev, err, "message"), msg, sizeof(msg));
+    snprintf(s->error, sizeof(s->error), "%s: %s", etype[0] ? etype : "error", msg);
+    ESP_LOGE(TAG, "Stream error: %s", s->error);
+    s->failed = true;
+}
+
+/* ── Anthropic event handlers ─────────────────────────────────── */
+
+static void on_anthropic_usage(llm_stream_t *s, const ev_t *ev, int usage)
+{
+    if (usage < 0 || ev->t[usage].type != JTOK_OBJECT) return;
+    llm_usage_t *u = &s->resp->usage;
+    usage_field(ev, usage, "input_tokens", &u->input_tokens);
+    usage_field(ev, usage, "output_tokens", &u->output_tokens);
+    usage_field(ev, usage, "cache_read_input_tokens", &u->cache_read_tokens);
+    usage_field(ev, usage, "cache_creation_input_tokens", &u->cache_write_tokens);
+}
+
+static void on_block_start(llm_stream_t *s, const ev_t *ev)
+{
+    int block = ev_get(ev, 0, "content_block");
+    s->cur_call = -1;
+    if (!ev_is(ev, ev_get(ev, block, "type"), "tool_use")) return;
+
+    llm_response_t *resp = s->resp;
+    if (resp->call_count >= MIMI_MAX_TOOL_CALLS) {
+        ESP_LOGW(TAG, "Too many tool calls, ignoring extra tool_use block");
+        return;
+    }
+
+    llm_tool_call_t *call = &resp->calls[resp->call_count];
+    ev_copy(ev, ev_get(ev, block, "id"), call->id, sizeof(call->id));
+    ev_copy(ev, ev_get(ev, block, "name"), call->name, sizeof(call->name));
+
+    s->cur_call = resp->call_count++;
+}
+
+static void on_block_delta(llm_stream_t *s, const ev_t *ev)
+{
+    int delta = ev_get(ev, 0, "delta");
+    int dtype = ev_get(ev, delta, "type");
+
+    if (ev_is(ev, dtype, "text_delta")) {
+        append_text(s, ev, ev_get(ev, delta, "text"));
+
+    } else if (ev_is(ev, dtype, "input_json_delta")) {
+        if (s->cur_call < 0) return;
+        llm_tool_call_t *call = &s->resp->calls[s->cur_call];
+        ev_append(s, ev, ev_get(ev, delta, "partial_json"),
+                  &call->input, &call->input_len, &s->input_cap[s->cur_call]);
+    }
+}
+
+static void close_open_call(llm_stream_t *s)
+{
+    if (s->cur_call < 0) return;
+    llm_tool_call_t *call = &s->resp->calls[s->cur_call];
+    /* A tool with no arguments streams no input_json_delta at all */
+    if (!call->input) {
+        call->input = strdup("{}");
+        call->input_len = call->input ? 2 : 0;
+    }
+    s->cur_call = -1;
+}
+
+static void dispatch_anthropic(llm_stream_t *s, const ev_t *ev)
+{
+    int type = ev_get(ev, 0, "type");
+
+    if (ev_is(ev, type, "content_block_delta")) {
+        on_block_delta(s, ev);
+    } else if (ev_is(ev, type, "content_block_start")) {
+        on_block_start(s, ev);
+    } else if (ev_is(ev, type, "content_block_stop")) {
+        close_open_call(s);
+    } else if (ev_is(ev, type, "message_delta")) {
+        int stop = ev_get(ev, ev_get(ev, 0, "delta"), "stop_reason");
+        if (stop >= 0 && ev->t[stop].type == JTOK_STRING) {
+            s->resp->tool_use = ev_is(ev, stop, "tool_use");
+        }
+        on_anthropic_usage(s, ev, ev_get(ev, 0, "usage"));
+    } else if (ev_is(ev, type, "message_start")) {
+        on_anthropic_usage(s, ev, ev_get(ev, ev_get(ev, 0, "message"), "usage"));
+    } else if (ev_is(ev, type, "message_stop")) {
+        s->done = true;
+    } else if (ev_is(ev, type, "error")) {
+        set_error(s, ev, ev_get(ev, 0, "error"));
+    }
+    /* ping: nothing to do */
+}
+
+/* ── OpenAI / Kimi chunk handlers ─────────────────────────────── */
+
+static void close_all_calls(llm_stream_t *s)
+{
+    for (int i = 0; i < s->resp->call_count; i++) {
+        llm_tool_call_t *call = &s->resp->calls[i];
+        if (!call->input) {
+            call->input = strdup("{}");
+            call->input_len = call->input ? 2 : 0;
+        }
+    }
+}
+
+/* Slot in resp->calls for a tool_calls[].index, allocated on first sight */
+static llm_tool_call_t *oai_call_slot(llm_stream_t *s, int index, int *slot)
+{
+    llm_response_t *resp = s->resp;
+    for (int i = 0; i < resp->call_count; i++) {
+        if (s->oai_index[i] == index) {
+            *slot = i;
+            return &resp->calls[i];
+        }
+    }
+    if (resp->call_count >= MIMI_MAX_TOOL_CALLS) return NULL;
+    *slot = resp->call_count++;
+    s->oai_index[*slot] = index;
+    return &resp->calls[*slot];
+}
+
+static void on_oai_tool_call(llm_stream_t *s, const ev_t *ev, int tc)
+{
+    int index = (int)json_tok_long(ev->js, ev->t, ev_get(ev, tc, "index"), 0);
+
+    int slot;
+    llm_tool_call_t *call = oai_call_slot(s, index, &slot);
+    if (!call) {
+        ESP_LOGW(TAG, "Too many tool calls, ignoring tool_calls[%d]", index);
+        return;
+    }
+
+    /* id and name arrive once, on the first fragment of each call */
+    int id = ev_get(ev, tc, "id");
+    if (ev_has_str(ev, id)) ev_copy(ev, id, call->id, sizeof(call->id));
+
+    int func = ev_get(ev, tc, "function");
+    int name = ev_get(ev, func, "name");
+    if (ev_has_str(ev, name)) ev_copy(ev, name, call->name, sizeof(call->name));
+
+    ev_append(s, ev, ev_get(ev, func, "arguments"),
+              &call->input, &call->input_len, &s->input_cap[slot]);
+}
+
+/* OpenAI puts usage at the top level of the last chunk; Kimi puts it in
+ * choices[0].usage. prompt_tokens includes the cached part. */
+static void on_openai_usage(llm_stream_t *s, const ev_t *ev, int usage)
+{
+    if (usage < 0 || ev->t[usage].type != JTOK_OBJECT) return;
+    llm_usage_t *u = &s->resp->usage;
+    uint32_t prompt = 0, cached = 0;
+    usage_field(ev, usage, "prompt_tokens", &prompt);
+    usage_field(ev, usage, "cached_tokens", &cached);
+    usage_field(ev, ev_get(ev, usage, "prompt_tokens_details"), "cached_tokens", &cached);
+    usage_field(ev, usage, "completion_tokens", &u->output_tokens);
+    u->cache_read_tokens = cached;
+    u->input_tokens = (prompt > cached) ? prompt - cached : 0;
+}
+
+static void dispatch_openai(llm_stream_t *s, const ev_t *ev)
+{
+    int err = ev_get(ev, 0, "error");
+    if (err >= 0 && ev->t[err].type == JTOK_OBJECT) {
+        set_error(s, ev, err);
+        return;
+    }
+
+    on_openai_usage(s, ev, ev_get(ev, 0, "usage"));
+
+    int choice0 = json_tok_at(ev->t, ev->n, ev_get(ev, 0, "choices"), 0);
+    if (choice0 < 0) return;   /* usage-only chunk */
+    on_openai_usage(s, ev, ev_get(ev, choice0, "usage"));
+
+    int delta = ev_get(ev, choice0, "delta");
+    if (delta >= 0) {
+        append_text(s, ev, ev_get(ev, delta, "content"));
+
+        int calls = ev_get(ev, delta, "tool_calls");
+        if (calls >= 0 && ev->t[calls].type == JTOK_ARRAY) {
+            for (int i = 0; i < ev->t[calls].size && !s->failed; i++) {
+                on_oai_tool_call(s, ev, json_tok_at(ev->t, ev->n, calls, i));
+            }
+        }
+    }
+
+    /* finish_reason: "tool_calls" → continuer, "stop" / "length" → fin */
+    int finish = ev_get(ev, choice0, "finish_reason");
+    if (finish >= 0 && ev->t[finish].type == JTOK_STRING) {
+        s->resp->tool_use = ev_is(ev, finish, "tool_calls");
+        s->done = true;
+    }
+}
+
+static void dispatch_event(llm_stream_t *s)
+{
+    if (s->data_len == 0) return;
+
+    if (s->fmt == LLM_STREAM_OPENAI && strcmp(s->data, "[DONE]") == 0) {
+        s->done = true;
+        return;
+    }
+
+    /* Token array doubled for large events (tool_use inputs, long deltas):
+     * dropping one would silently corrupt the response */
+    int n;
+    while (1) {
+        if (!s->toks) {
+            s->toks = malloc(LLM_STREAM_MAX_TOKENS * sizeof(jtok_t));
+            if (!s->toks) {
+                s->failed = true;
+                return;
+            }
+            s->tok_cap = LLM_STREAM_MAX_TOKENS;
+        }
+        n = json_tok_parse(s->data, s->data_len, s->toks, s->tok_cap);
+        if (n != JTOK_ERR_NOMEM || s->tok_cap >= LLM_STREAM_TOKENS_LIMIT) break;
+
+        jtok_t *tmp = realloc(s->toks, 2 * s->tok_cap * sizeof(jtok_t));
+        if (!tmp) {
+            s->failed = true;
+            return;
+        }
+        s->toks = tmp;
+        s->tok_cap *= 2;
+    }
+    if (n <= 0 || s->toks[0].type != JTOK_OBJECT) {
+        ESP_LOGE(TAG, "Undecodable event (%d, %d bytes): %.80s", n, (int)s->data_len, s->data);
+        s->corrupt = true;
+        s->failed = true;
+        return;
+    }
+
+    ev_t ev = { .js = s->data, .t = s->toks, .n = n };
+    if (s->fmt == LLM_STREAM_OPENAI) {
+        dispatch_openai(s, &ev);
+    } else {
+        dispatch_anthropic(s, &ev);
+    }
+}
+
+/* ── SSE framing ──────────────────────────────────────────────── */
+
+static void process_line(llm_stream_t *s, char *line, size_t len)
+{
+    if (len > 0 && line[len - 1] == '\r') line[--len] = '\0';
+
+    if (len == 0) {
+        /* Blank line terminates the event */
+        dispatch_event(s);
+        s->data_len = 0;
+        if (s->data) s->data[0] = '\0';
+        return;
+    }
+
+    if (strncmp(line, "data:", 5) == 0) {
+        const char *val = line + 5;
+        if (*val == ' ') val++;
+        if (s->data_len > 0) {
+            append(&s->data, &s->data_len, &s->data_cap, "\n", 1);
+        }
+        if (!append(&s->data, &s->data_len, &s->data_cap, val, len - (val - line))) {
+            s->failed = true;
+        }
+    }
+    /* "event:", "id:", "retry:" and ":" comments carry nothing we need —
+     * every Messages API payload repeats its event name in "type", and
+     * chat completion chunks have no event name at all. */
+}
+
+void llm_stream_init(llm_stream_t *s, llm_stream_format_t fmt, llm_response_t *resp,
+                     llm_delta_cb_t on_delta, void *cb_ctx)
+{
+    memset(s, 0, sizeof(*s));
+    memset(resp, 0, sizeof(*resp));
+    s->fmt = fmt;
+    s->resp = resp;
+    s->on_delta = on_delta;
+    s->cb_ctx = cb_ctx;
+    s->cur_call = -1;
+}
+
+esp_err_t llm_stream_feed(llm_stream_t *s, const char *data, size_t len)
+{
+    size_t pos = 0;
+    while (pos < len && !s->failed) {
+        const char *nl = memchr(data + pos, '\n', len - pos);
+        size_t n = nl ? (size_t)(nl - (data + pos)) : len - pos;
+
+        if (s->line_len + n > STREAM_LINE_MAX ||
+            !append(&s->line, &s->line_len, &s->line_cap, data + pos, n)) {
+            ESP_LOGE(TAG, "SSE line too long or out of memory");
+            s->failed = true;
+            break;
+        }
+        pos += n;
+
+        if (nl) {
+            process_line(s, s->line, s->line_len);
+            s->line_len = 0;
+            pos++;  /* skip '\n' */
+        }
+    }
+
+    if (s->failed) return s->corrupt ? ESP_ERR_INVALID_RESPONSE : s->error[0] ? ESP_FAIL : ESP_ERR_NO_MEM;
+    return ESP_OK;
+}
+
+esp_err_t llm_stream_finish(llm_stream_t *s)
+{
+    if (s->line_len > 0) {
+        process_line(s, s->line, s->line_len);
+        s->line_len = 0;
+    }
+    dispatch_event(s);
+    s->data_len = 0;
+    if (s->fmt == LLM_STREAM_OPENAI) {
+        close_all_calls(s);
+    } else {
+        close_open_call(s);
+    }
+
+    if (s->failed) return s->corrupt ? ESP_ERR_INVALID_RESPONSE : s->error[0] ? ESP_FAIL : ESP_ERR_NO_MEM;
+    if (!s->done) {
+        ESP_LOGW(TAG, "Stream ended before the final event");
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    return ESP_OK;
+}
+
+void llm_stream_free(llm_stream_t *s)
+{
+    free(s->line);
+    free(s->data);
+    free(s->toks);
+    s->line = NULL;
+    s->data = NULL;
+    s->toks = NULL;
+    s->tok_cap = 0;
+    s->line_len = s->line_cap = 0;
+    s->data_len = s->data_cap = 0;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "llm/llm_proxy.h"
+#include "llm/json_tok.h"
+
+/*
+ * Incremental Server-Sent Events parser for streamed LLM responses
+ * ("stream": true), either Anthropic Messages events or OpenAI-style
+ * chat.completion.chunk objects (Kimi).
+ *
+ * Bytes are pushed in as they come off the socket (any chunking); complete
+ * events are decoded immediately into an llm_response_t, and text deltas are
+ * forwarded to the caller's callback. Nothing here touches the network or
+ * FreeRTOS, so a canned SSE transcript can be replayed through it on Linux.
+ */
+
+#define LLM_STREAM_MAX_TOKENS   128     /* JSON tokens per event to start with (chunks use ~40) */
+#define LLM_STREAM_TOKENS_LIMIT 4096    /* doubled up to this for larger events (tool schemas) */
+
+typedef enum {
+    LLM_STREAM_ANTHROPIC = 0,   /* /v1/messages events */
+    LLM_STREAM_OPENAI,          /* /v1/chat/completions chunks, "[DONE]" terminated */
+} llm_stream_format_t;
+
+typedef struct {
+    llm_stream_format_t fmt;
+    llm_response_t *resp;
+    llm_delta_cb_t  on_delta;
+    void           *cb_ctx;
+
+    /* SSE framing */
+    char   *line;           /* current (incomplete) line */
+    size_t  line_len;
+    size_t  line_cap;
+    char   *data;           /* accumulated "data:" payload of current event */
+    size_t  data_len;
+    size_t  data_cap;
+    jtok_t *toks;           /* token array for the current event (no DOM) */
+    int     tok_cap;
+
+    /* Decoding state */
+    size_t  text_cap;
+    size_t  input_cap[MIMI_MAX_TOOL_CALLS];
+    int     cur_call;       /* index in resp->calls of the open tool_use block, -1 if none */
+    int     oai_index[MIMI_MAX_TOOL_CALLS];  /* tool_calls[].index owning each slot */
+    bool    done;           /* message_stop / finish_reason seen */
+    bool    failed;         /* "error" event, undecodable event or out of memory */
+    bool    corrupt;        /* an event could not be decoded: its bytes are lost */
+    char    error[128];     /* error message from the API, if any */
+} llm_stream_t;
+
+/**
+ * Prepare a parser for the given wire format that fills resp (which is zeroed).
+ * on_delta may be NULL.
+ */
+void llm_stream_init(llm_stream_t *s, llm_stream_format_t fmt, llm_response_t *resp,
+                     llm_delta_cb_t on_delta, void *cb_ctx);
+
+/**
+ * Feed raw body bytes. Complete events are dispatched immediately.
+ * @return ESP_OK, ESP_ERR_NO_MEM, ESP_FAIL after an "error" event, or
+ *         ESP_ERR_INVALID_RESPONSE for an event that could not be decoded
+ *         (the response would be missing text or tool input bytes)
+ */
+esp_err_t llm_stream_feed(llm_stream_t *s, const char *data, size_t len);
+
+/**
+ * Flush a trailing event not followed by a blank line and close open blocks.
+ * @return ESP_OK if the stream ended cleanly (message_stop / finish_reason seen)
+ */
+esp_err_t llm_stream_finish(llm_stream_t *s);
+
+/**
+ * Release parser buffers. Does not free resp.
+ */
+void llm_stream_free(llm_stream_t *s);
@@ -0,0 +1,227 @@
+#include "llm_usage.h"
+
+#include <string.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "nvs.h"
+
+static const char *TAG = "llm_usage";
+
+#define USAGE_VERSION   1
+#define USAGE_MAX_CHATS MIMI_USAGE_MAX_CHATS
+
+/* Stored as one NVS blob; chats[] is kept most recently used first */
+typedef struct {
+    uint16_t version;
+    uint16_t day;                   /* UTC day of the today counters */
+    uint32_t default_budget;        /* 0 = unlimited */
+    uint8_t  count;
+    llm_usage_chat_t chats[USAGE_MAX_CHATS];
+} usage_table_t;
+
+static usage_table_t s_tab;
+static SemaphoreHandle_t s_lock = NULL;
+
+/* ── Helpers (s_lock held) ────────────────────────────────────── */
+
+/* Days since epoch; keeps the stored day until SNTP has set the clock */
+static uint16_t current_day(void)
+{
+    time_t now = time(NULL);
+    if (now < 1700000000) return s_tab.day;
+    return (uint16_t)(now / 86400);
+}
+
+static void roll_day(void)
+{
+    uint16_t d = current_day();
+    if (d == s_tab.day) return;
+    for (int i = 0; i < s_tab.count; i++) {
+        memset(&s_tab.chats[i].today, 0, sizeof(s_tab.chats[i].today));
+    }
+    s_tab.day = d;
+}
+
+static int find_chat(const char *chat_id)
+{
+    for (int i = 0; i < s_tab.count; i++) {
+        if (strcmp(s_tab.chats[i].chat_id, chat_id) == 0) return i;
+    }
+    return -1;
+}
+
+/* Move entry i to the front */
+static llm_usage_chat_t *touch(int i)
+{
+    if (i > 0) {
+        llm_usage_chat_t tmp = s_tab.chats[i];
+        memmove(&s_tab.chats[1], &s_tab.chats[0], i * sizeof(tmp));
+        s_tab.chats[0] = tmp;
+    }
+    return &s_tab.chats[0];
+}
+
+/* Entry for chat_id at the front, created if needed. A full table drops its
+ * least recently used chat, keeping chats with a budget override if it can. */
+static llm_usage_chat_t *get_chat(const char *chat_id)
+{
+    int i = find_chat(chat_id);
+    if (i >= 0) return touch(i);
+
+    if (s_tab.count == USAGE_MAX_CHATS) {
+        int victim = USAGE_MAX_CHATS - 1;
+        for (int j = USAGE_MAX_CHATS - 1; j >= 0; j--) {
+            if (s_tab.chats[j].budget == 0) {
+                victim = j;
+                break;
+            }
+        }
+        ESP_LOGI(TAG, "Dropping usage of chat %s", s_tab.chats[victim].chat_id);
+        memmove(&s_tab.chats[victim], &s_tab.chats[victim + 1],
+                (s_tab.count - victim - 1) * sizeof(s_tab.chats[0]));
+        s_tab.count--;
+    }
+
+    memmove(&s_tab.chats[1], &s_tab.chats[0], s_tab.count * sizeof(s_tab.chats[0]));
+    s_tab.count++;
+    llm_usage_chat_t *c = &s_tab.chats[0];
+    memset(c, 0, sizeof(*c));
+    strncpy(c->chat_id, chat_id, sizeof(c->chat_id) - 1);
+    return c;
+}
+
+static uint32_t budget_of(const llm_usage_chat_t *c)
+{
+    return c->budget ? c->budget : s_tab.default_budget;
+}
+
+static esp_err_t flush(void)
+{
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(MIMI_NVS_USAGE, NVS_READWRITE, &nvs);
+    if (err != ESP_OK) return err;
+    err = nvs_set_blob(nvs, MIMI_NVS_KEY_USAGE, &s_tab, sizeof(s_tab));
+    if (err == ESP_OK) err = nvs_commit(nvs);
+    nvs_close(nvs);
+    if (err != ESP_OK) ESP_LOGW(TAG, "Usage flush failed: %s", esp_err_to_name(err));
+    return err;
+}
+
+/* ── Public API ───────────────────────────────────────────────── */
+
+esp_err_t llm_usage_init(void)
+{
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock) return ESP_ERR_NO_MEM;
+
+    memset(&s_tab, 0, sizeof(s_tab));
+    nvs_handle_t nvs;
+    if (nvs_open(MIMI_NVS_USAGE, NVS_READONLY, &nvs) == ESP_OK) {
+        size_t len = sizeof(s_tab);
+        esp_err_t err = nvs_get_blob(nvs, MIMI_NVS_KEY_USAGE, &s_tab, &len);
+        nvs_close(nvs);
+        /* Layout changed (or no table yet): start over */
+        if (err != ESP_OK || len != sizeof(s_tab) || s_tab.version != USAGE_VERSION ||
+            s_tab.count > USAGE_MAX_CHATS) {
+            memset(&s_tab, 0, sizeof(s_tab));
+        }
+    }
+    if (s_tab.version != USAGE_VERSION) {
+        s_tab.version = USAGE_VERSION;
+        s_tab.default_budget = MIMI_USAGE_DAILY_BUDGET;
+    }
+
+    ESP_LOGI(TAG, "Usage table: %d chats, daily budget %u tokens%s",
+             s_tab.count, (unsigned)s_tab.default_budget,
+             s_tab.default_budget ? "" : " (unlimited)");
+    return ESP_OK;
+}
+
+esp_err_t llm_usage_check(const char *chat_id)
+{
+    esp_err_t err = ESP_OK;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    roll_day();
+    int i = find_chat(chat_id);
+    uint32_t budget = (i >= 0) ? budget_of(&s_tab.chats[i]) : s_tab.default_budget;
+    if (i >= 0 && budget && llm_usage_billed(&s_tab.chats[i].today) >= budget) {
+        ESP_LOGW(TAG, "Chat %s over its daily budget (%u/%u tokens)", chat_id,
+                 (unsigned)llm_usage_billed(&s_tab.chats[i].today), (unsigned)budget);
+        err = ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreGive(s_lock);
+    return err;
+}
+
+void llm_usage_record(const char *chat_id, const llm_usage_t *usage)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    roll_day();
+    llm_usage_chat_t *c = get_chat(chat_id);
+    llm_usage_totals_t *sets[2] = { &c->today, &c->total };
+    for (int k = 0; k < 2; k++) {
+        sets[k]->input_tokens += usage->input_tokens;
+        sets[k]->output_tokens += usage->output_tokens;
+        sets[k]->cache_read_tokens += usage->cache_read_tokens;
+        sets[k]->cache_write_tokens += usage->cache_write_tokens;
+        sets[k]->calls++;
+    }
+    xSemaphoreGive(s_lock);
+}
+
+void llm_usage_end_turn(const char *chat_id)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    roll_day();
+    llm_usage_chat_t *c = get_chat(chat_id);
+    c->today.turns++;
+    c->total.turns++;
+    flush();
+    xSemaphoreGive(s_lock);
+}
+
+esp_err_t llm_usage_set_budget(const char *chat_id, uint32_t tokens)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (chat_id) {
+        get_chat(chat_id)->budget = tokens;
+    } else {
+        s_tab.default_budget = tokens;
+    }
+    esp_err_t err = flush();
+    xSemaphoreGive(s_lock);
+    return err;
+}
+
+uint32_t llm_usage_get_default_budget(void)
+{
+    return s_tab.default_budget;
+}
+
+bool llm_usage_get_chat(int i, llm_usage_chat_t *out)
+{
+    bool ok = false;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    roll_day();
+    if (i >= 0 && i < s_tab.count) {
+        *out = s_tab.chats[i];
+        ok = true;
+    }
+    xSemaphoreGive(s_lock);
+    return ok;
+}
+
+esp_err_t llm_usage_reset(void)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < s_tab.count; i++) {
+        llm_usage_chat_t *c = &s_tab.chats[i];
+        memset(&c->today, 0, sizeof(c->today));
+        memset(&c->total, 0, sizeof(c->total));
+    }
+    esp_err_t err = flush();
+    xSemaphoreGive(s_lock);
+    return err;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "llm/llm_proxy.h"
+
+/*
+ * Token accounting per chat, kept as rolling counters (today + since boot of
+ * the table) in one NVS blob. Calls are added in RAM; the blob is written once
+ * per agent turn. A chat that spent its daily budget is refused before the
+ * next request goes out.
+ *
+ * Budgeted tokens = input + cache_write + output. Cache reads are counted
+ * but do not consume the budget (they do not count against the API's input
+ * rate limit either).
+ */
+
+typedef struct {
+    uint32_t input_tokens;
+    uint32_t output_tokens;
+    uint32_t cache_read_tokens;
+    uint32_t cache_write_tokens;
+    uint32_t calls;
+    uint32_t turns;
+} llm_usage_totals_t;
+
+typedef struct {
+    char chat_id[32];
+    llm_usage_totals_t today;       /* current UTC day */
+    llm_usage_totals_t total;       /* since the entry was created */
+    uint32_t budget;                /* daily budget for this chat, 0 = default */
+} llm_usage_chat_t;
+
+esp_err_t llm_usage_init(void);
+
+/** Tokens that count against the daily budget */
+static inline uint32_t llm_usage_billed(const llm_usage_totals_t *t)
+{
+    return t->input_tokens + t->cache_write_tokens + t->output_tokens;
+}
+
+/**
+ * Check the chat's daily budget before a request.
+ * @return ESP_OK, or ESP_ERR_INVALID_STATE once the budget is spent
+ */
+esp_err_t llm_usage_check(const char *chat_id);
+
+/** Add one call's usage (RAM only). */
+void llm_usage_record(const char *chat_id, const llm_usage_t *usage);
+
+/** Count a finished turn and write the counters to flash. */
+void llm_usage_end_turn(const char *chat_id);
+
+/**
+ * Daily token budget: chat_id NULL sets the default for all chats,
+ * otherwise an override for that chat. 0 = unlimited (default) or
+ * "use the default" (override).
+ */
+esp_err_t llm_usage_set_budget(const char *chat_id, uint32_t tokens);
+uint32_t llm_usage_get_default_budget(void);
+
+/**
+ * Copy chat entry i (0-based, most recently used first).
+ * @return false past the last entry
+ */
+bool llm_usage_get_chat(int i, llm_usage_chat_t *out);
+
+/** Forget all counters (budgets are kept). */
+esp_err_t llm_usage_reset(void);
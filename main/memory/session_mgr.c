@@ -6,7 +6,9 @@
 #include <stdlib.h>
 #include <dirent.h>
 #include <time.h>
+#include <sys/stat.h>
 #include "esp_log.h"
+#include "esp_heap_caps.h"
 #include "cJSON.h"
 
 static const char *TAG = "session";
@@ -16,6 +18,12 @@ static void session_path(const char *chat_id, char *buf, size_t size)
     snprintf(buf, size, "%s/tg_%s.jsonl", MIMI_SPIFFS_SESSION_DIR, chat_id);
 }
 
+/* Rolling summary of the compacted part, beside the JSONL */
+static void summary_path(const char *chat_id, char *buf, size_t size)
+{
+    snprintf(buf, size, "%s/tg_%s.sum", MIMI_SPIFFS_SESSION_DIR, chat_id);
+}
+
 esp_err_t session_mgr_init(void)
 {
     ESP_LOGI(TAG, "Session manager initialized at %s", MIMI_SPIFFS_SESSION_DIR);
@@ -125,9 +133,173 @@ esp_err_t session_get_history_json(const char *chat_id, char *buf, size_t size,
     return ESP_OK;
 }
 
+/* ── Compaction ───────────────────────────────────────────────── */
+
+esp_err_t session_get_summary(const char *chat_id, char *buf, size_t size)
+{
+    char path[64];
+    summary_path(chat_id, path, sizeof(path));
+
+    FILE *f = fopen(path, "r");
+    if (!f) return ESP_ERR_NOT_FOUND;
+    size_t n = fread(buf, 1, size - 1, f);
+    fclose(f);
+    buf[n] = '\0';
+    return n ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+uint32_t session_estimate_tokens(const char *chat_id)
+{
+    char path[64];
+    struct stat st;
+    uint32_t bytes = 0;
+
+    session_path(chat_id, path, sizeof(path));
+    if (stat(path, &st) == 0) bytes += st.st_size;
+    summary_path(chat_id, path, sizeof(path));
+    if (stat(path, &st) == 0) bytes += st.st_size;
+    return bytes / 4;   /* ~4 bytes per token, JSON overhead included */
+}
+
+/* Append "role: content\n\n" to a growing transcript; once it passes max the
+ * oldest bytes are dropped (they were out of the history window anyway). */
+static void transcript_add(char *t, size_t *len, size_t max, const char *role, const char *content)
+{
+    size_t clen = strlen(content);
+    if (clen > MIMI_SESSION_COMPACT_MSG_MAX) clen = MIMI_SESSION_COMPACT_MSG_MAX;
+    size_t need = strlen(role) + 2 + clen + 2;
+    if (need >= max) return;
+    if (*len + need >= max) {
+        size_t drop = *len + need - max + 1;
+        memmove(t, t + drop, *len - drop);
+        *len -= drop;
+    }
+    *len += snprintf(t + *len, max - *len, "%s: %.*s\n\n", role, (int)clen, content);
+}
+
+esp_err_t session_get_compactable(const char *chat_id, int keep, char **out, size_t max)
+{
+    char path[64];
+    session_path(chat_id, path, sizeof(path));
+    *out = NULL;
+
+    FILE *f = fopen(path, "r");
+    if (!f) return ESP_ERR_NOT_FOUND;
+
+    /* First pass: message count */
+    int total = 0, c;
+    while ((c = fgetc(f)) != EOF) {
+        if (c == '\n') total++;
+    }
+    if (total <= keep + 1) {
+        fclose(f);
+        return ESP_ERR_NOT_FOUND;     /* nothing worth summarizing */
+    }
+
+    char *line = heap_caps_malloc(MIMI_SESSION_LINE_MAX, MALLOC_CAP_SPIRAM);
+    char *t = heap_caps_malloc(max, MALLOC_CAP_SPIRAM);
+    if (!line || !t) {
+        free(line);
+        free(t);
+        fclose(f);
+        return ESP_ERR_NO_MEM;
+    }
+
+    /* Second pass: older messages (everything but the last keep) as text */
+    rewind(f);
+    size_t len = 0;
+    t[0] = '\0';
+    for (int i = 0; i < total - keep && fgets(line, MIMI_SESSION_LINE_MAX, f); i++) {
+        size_t l = strlen(line);
+        if (l && line[l - 1] != '\n' && !feof(f)) {
+            /* Longer than the line buffer: skip the rest of it */
+            while ((c = fgetc(f)) != EOF && c != '\n') {}
+            continue;
+        }
+        cJSON *obj = cJSON_Parse(line);
+        cJSON *role = cJSON_GetObjectItem(obj, "role");
+        cJSON *content = cJSON_GetObjectItem(obj, "content");
+        if (cJSON_IsString(role) && cJSON_IsString(content)) {
+            transcript_add(t, &len, max, role->valuestring, content->valuestring);
+        }
+        cJSON_Delete(obj);
+    }
+    fclose(f);
+    free(line);
+
+    *out = t;
+    return ESP_OK;
+}
+
+esp_err_t session_commit_compaction(const char *chat_id, const char *summary, int keep)
+{
+    char path[64], sum_path[64];
+    session_path(chat_id, path, sizeof(path));
+    summary_path(chat_id, sum_path, sizeof(sum_path));
+
+    /* Fixed short temp names: "<name>.tmp" can pass the 31 characters SPIFFS
+     * allows after the mount point. Both are opened before anything changes. */
+    static const char sum_tmp[] = MIMI_SPIFFS_SESSION_DIR "/s.tmp";
+    static const char jsonl_tmp[] = MIMI_SPIFFS_SESSION_DIR "/c.tmp";
+    FILE *in = fopen(path, "r");
+    FILE *sum_out = fopen(sum_tmp, "w");
+    FILE *out = fopen(jsonl_tmp, "w");
+    if (!in || !sum_out || !out) {
+        ESP_LOGE(TAG, "Cannot compact %s: open failed", chat_id);
+        if (in) fclose(in);
+        if (sum_out) fclose(sum_out);
+        if (out) fclose(out);
+        remove(sum_tmp);
+        remove(jsonl_tmp);
+        return ESP_FAIL;
+    }
+
+    /* New summary (replaces the previous one, which it already covers) */
+    bool ok = fputs(summary, sum_out) >= 0;
+    ok = (fclose(sum_out) == 0) && ok;
+
+    /* JSONL keeps only its last keep messages */
+    int total = 0, c;
+    while ((c = fgetc(in)) != EOF) {
+        if (c == '\n') total++;
+    }
+    rewind(in);
+    for (int skip = total - keep; skip > 0 && (c = fgetc(in)) != EOF; ) {
+        if (c == '\n') skip--;
+    }
+    char chunk[512];
+    size_t n;
+    while (ok && (n = fread(chunk, 1, sizeof(chunk), in)) > 0) {
+        ok = fwrite(chunk, 1, n, out) == n;
+    }
+    fclose(in);
+    ok = (fclose(out) == 0) && ok;
+    if (!ok) {
+        remove(sum_tmp);
+        remove(jsonl_tmp);
+        return ESP_FAIL;
+    }
+
+    /* Summary first: a crash in between only leaves messages that are in
+     * both the summary and the file */
+    remove(sum_path);
+    if (rename(sum_tmp, sum_path) != 0) {
+        remove(jsonl_tmp);
+        return ESP_FAIL;
+    }
+    remove(path);
+    if (rename(jsonl_tmp, path) != 0) return ESP_FAIL;
+
+    ESP_LOGI(TAG, "Session %s compacted: %d messages summarized, %d kept",
+             chat_id, total - keep, keep);
+    return ESP_OK;
+}
+
 esp_err_t session_clear(const char *chat_id)
 {
     char path[64];
+    summary_path(chat_id, path, sizeof(path));
+    remove(path);
     session_path(chat_id, path, sizeof(path));
 
     if (remove(path) == 0) {
@@ -2,6 +2,7 @@
 
 #include "esp_err.h"
 #include <stddef.h>
+#include <stdint.h>
 
 /**
  * Initialize session manager.
@@ -29,7 +30,31 @@ esp_err_t session_append(const char *chat_id, const char *role, const char *cont
 esp_err_t session_get_history_json(const char *chat_id, char *buf, size_t size, int max_msgs);
 
 /**
- * Clear a session (delete the file).
+ * Rolling summary of the messages removed by compaction.
+ * @return ESP_ERR_NOT_FOUND if the session was never compacted
+ */
+esp_err_t session_get_summary(const char *chat_id, char *buf, size_t size);
+
+/**
+ * Rough token count of a session (JSONL + summary bytes / 4).
+ */
+uint32_t session_estimate_tokens(const char *chat_id);
+
+/**
+ * Older messages (all but the last keep) as a "role: content" transcript,
+ * at most max bytes (newest kept). *out is PSRAM, caller frees.
+ * @return ESP_ERR_NOT_FOUND if there is not enough to compact
+ */
+esp_err_t session_get_compactable(const char *chat_id, int keep, char **out, size_t max);
+
+/**
+ * Store the new summary and drop all but the last keep messages from the JSONL.
+ * Uses fixed temp files in the session dir: callers serialize commits.
+ */
+esp_err_t session_commit_compaction(const char *chat_id, const char *summary, int keep);
+
+/**
+ * Clear a session (delete the file and its summary).
  */
 esp_err_t session_clear(const char *chat_id);
 
@@ -14,13 +14,19 @@
 #include "wifi/wifi_manager.h"
 #include "telegram/telegram_bot.h"
 #include "llm/llm_proxy.h"
+#include "llm/llm_usage.h"
 #include "agent/agent_loop.h"
+#include "agent/context_builder.h"
 #include "memory/memory_store.h"
 #include "memory/session_mgr.h"
 #include "gateway/ws_server.h"
 #include "cli/serial_cli.h"
 #include "proxy/http_proxy.h"
+#include "http/http_client.h"
+#include "pool/buf_pool.h"
+#include "perf/perf_trace.h"
 #include "tools/tool_registry.h"
+#include "tools/tool_runner.h"
 #include "portal/captive_portal.h"
 #include "ota/ota_manager.h"
 #ifdef MIMI_HAS_DISPLAY
@@ -78,21 +84,42 @@ static void outbound_dispatch_task(void *arg)
 {
     ESP_LOGI(TAG, "Outbound dispatch started");
 
+    uint32_t wait_ms = UINT32_MAX;
     while (1) {
         mimi_msg_t msg;
-        if (message_bus_pop_outbound(&msg, UINT32_MAX) != ESP_OK) continue;
-
-        ESP_LOGI(TAG, "Dispatching response to %s:%s", msg.channel, msg.chat_id);
+        message_bus_wait_outbound(wait_ms);
+        while (message_bus_pop_outbound(&msg, 0) == ESP_OK) {
+            ESP_LOGI(TAG, "Dispatching response to %s:%s", msg.channel, msg.chat_id);
+
+            if (strcmp(msg.channel, MIMI_CHAN_TELEGRAM) == 0) {
+                perf_span_t span = perf_begin(PERF_SEND_TG);
+                telegram_send_message(msg.chat_id, msg.content);
+                perf_end(span);
+            } else if (strcmp(msg.channel, MIMI_CHAN_WEBSOCKET) == 0) {
+                perf_span_t span = perf_begin(PERF_SEND_WS);
+                ws_server_send(msg.chat_id, msg.content);
+                perf_end(span);
+            } else {
+                ESP_LOGW(TAG, "Unknown channel: %s", msg.channel);
+            }
 
-        if (strcmp(msg.channel, MIMI_CHAN_TELEGRAM) == 0) {
-            telegram_send_message(msg.chat_id, msg.content);
-        } else if (strcmp(msg.channel, MIMI_CHAN_WEBSOCKET) == 0) {
-            ws_server_send(msg.chat_id, msg.content);
-        } else {
-            ESP_LOGW(TAG, "Unknown channel: %s", msg.channel);
+            free(msg.content);
         }
 
-        free(msg.content);
+        /* Typing indicators due, after the replies they may follow */
+        bool busy;
+        while (message_bus_next_activity(&msg, &busy, &wait_ms)) {
+            if (strcmp(msg.channel, MIMI_CHAN_TELEGRAM) == 0) {
+                /* Nothing to clear: the reply (or 5 s) ends it */
+                if (busy) {
+                    perf_span_t span = perf_begin(PERF_TYPING);
+                    telegram_send_typing(msg.chat_id);
+                    perf_end(span);
+                }
+            } else if (strcmp(msg.channel, MIMI_CHAN_WEBSOCKET) == 0) {
+                ws_server_send_status(msg.chat_id, busy ? "working" : "idle");
+            }
+        }
     }
 }
 
@@ -119,6 +146,9 @@ void app_main(void)
     ESP_ERROR_CHECK(init_nvs());
     ESP_ERROR_CHECK(esp_event_loop_create_default());
     ESP_ERROR_CHECK(init_spiffs());
+    /* Response slabs carved before anything else fragments PSRAM */
+    ESP_ERROR_CHECK(buf_pool_init());
+    ESP_ERROR_CHECK(perf_trace_init());
 
 #ifdef MIMI_HAS_DISPLAY
     /* Ecran : init tot pour afficher le splash */
@@ -139,12 +169,16 @@ void app_main(void)
     /* Initialize subsystems */
     ESP_ERROR_CHECK(message_bus_init());
     ESP_ERROR_CHECK(memory_store_init());
+    ESP_ERROR_CHECK(context_builder_init());
     ESP_ERROR_CHECK(session_mgr_init());
     ESP_ERROR_CHECK(wifi_manager_init());
     ESP_ERROR_CHECK(http_proxy_init());
+    ESP_ERROR_CHECK(http_client_init());
     ESP_ERROR_CHECK(telegram_bot_init());
     ESP_ERROR_CHECK(llm_proxy_init());
+    ESP_ERROR_CHECK(llm_usage_init());
     ESP_ERROR_CHECK(tool_registry_init());
+    ESP_ERROR_CHECK(tool_runner_init());
     ESP_ERROR_CHECK(agent_loop_init());
 
     /* Start Serial CLI first (works without WiFi) */
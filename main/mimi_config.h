@@ -48,9 +48,23 @@
 #define MIMI_AGENT_STACK             (12 * 1024)
 #define MIMI_AGENT_PRIO              6
 #define MIMI_AGENT_CORE              1
+#define MIMI_AGENT_WORKERS           3             /* concurrent turns (different chats), at most */
+#define MIMI_AGENT_PSRAM_RESERVE     (1024 * 1024) /* left free when sizing the worker count */
+#define MIMI_AGENT_CHAT_BACKLOG      4             /* messages waiting behind a chat's running turn */
+#define MIMI_AGENT_PREEMPT           1             /* a newer message restarts the chat's running turn */
+#define MIMI_AGENT_TOOL_MEMO         8             /* side-effecting tool results a preempted turn's rerun reuses */
+#define MIMI_AGENT_COALESCE_MS       300           /* wait for more messages before a chat's turn, 0: off */
+#define MIMI_AGENT_BURST_MS          2000          /* ...only if the chat's previous message is this recent */
+#define MIMI_AGENT_POP_POLL_MS       1000          /* idle workers recheck the compaction queue this often */
 #define MIMI_AGENT_MAX_HISTORY       20
 #define MIMI_AGENT_MAX_TOOL_ITER     10
+#define MIMI_AGENT_TURN_BUDGET_MS    (3 * 60 * 1000)  /* LLM retries stop past this point in a turn */
 #define MIMI_MAX_TOOL_CALLS          4
+#define MIMI_TOOL_OUTPUT_SIZE        (8 * 1024)
+#define MIMI_TOOL_WORKERS            2             /* + the agent task: parallel-safe calls at once */
+#define MIMI_TOOL_WORKER_STACK       (10 * 1024)   /* TLS handshakes for web_search */
+#define MIMI_TOOL_WORKER_PRIO        MIMI_AGENT_PRIO
+#define MIMI_TOOL_WORKER_CORE        MIMI_AGENT_CORE
 
 /* Timezone (POSIX TZ format) */
 #define MIMI_TIMEZONE                "PST8PDT,M3.2.0,M11.1.0"
@@ -61,17 +75,67 @@
 #define MIMI_LLM_API_URL             "https://api.anthropic.com/v1/messages"
 #define MIMI_LLM_API_VERSION         "2023-06-01"
 #define MIMI_LLM_STREAM_BUF_SIZE     (32 * 1024)
+#define MIMI_LLM_RETRY_MAX           5             /* attempts per call, first one included */
+#define MIMI_LLM_RETRY_BASE_MS       1000
+#define MIMI_LLM_RETRY_MAX_DELAY_MS  (20 * 1000)
+#define MIMI_LLM_RETRY_BUDGET_MS     (60 * 1000)   /* default deadline when the caller sets none */
+#define MIMI_LLM_FALLBACK_AFTER      2             /* overloaded attempts before the fallback model */
+
+/* HTTP client (all outbound requests) */
+#define MIMI_HTTP_TIMEOUT_MS         15000         /* default connect / read timeout */
+#define MIMI_HTTP_CANCEL_POLL_MS     200           /* blocking waits are sliced to see a cancel */
+#define MIMI_HTTP_DIRECT_POOL        4             /* kept-alive direct handles, all hosts */
+#define MIMI_HTTP_KEEPALIVE_IDLE_MS  (60 * 1000)   /* reconnect a handle idle for longer */
+#define MIMI_HTTP_STATS_HOSTS        8
+
+/* Proxy tunnels (CONNECT + TLS kept open between requests) */
+#define MIMI_PROXY_POOL_SIZE         3             /* idle tunnels kept, all hosts */
+#define MIMI_PROXY_IDLE_MS           (60 * 1000)   /* close an idle tunnel after this */
+#define MIMI_PROXY_SESSION_HOSTS     4             /* hosts with a cached TLS session ticket */
+#define MIMI_PROXY_DNS_TTL_S         300           /* re-resolve the proxy host after this */
+
+/* Response buffer pool (PSRAM slabs leased per HTTP call) */
+#define MIMI_BUF_POOL_SMALL_SIZE     (4 * 1024)
+#define MIMI_BUF_POOL_SMALL_COUNT    4
+#define MIMI_BUF_POOL_MEDIUM_SIZE    (16 * 1024)
+#define MIMI_BUF_POOL_MEDIUM_COUNT   3
+#define MIMI_BUF_POOL_LARGE_SIZE     (64 * 1024)
+#define MIMI_BUF_POOL_LARGE_COUNT    1
 
 /* Kimi API (Moonshot AI — format OpenAI-compatible) */
 #define MIMI_KIMI_API_URL            "https://api.moonshot.ai/v1/chat/completions"
 #define MIMI_KIMI_DEFAULT_MODEL      "kimi-k2.5"
 
+/* Generic OpenAI-compatible backend (URL configurable with llm_backend) */
+#define MIMI_OPENAI_API_URL          "https://api.openai.com/v1/chat/completions"
+#define MIMI_OPENAI_DEFAULT_MODEL    "gpt-4o-mini"
+
+/* LLM router: backend health and circuit breaker */
+#define MIMI_LLM_ROUTER_WINDOW       32            /* attempts kept per backend */
+#define MIMI_LLM_ROUTER_DEFAULT_MS   3000          /* assumed TTFB before any sample */
+#define MIMI_LLM_ROUTER_PREFER_PCT   150           /* preferred backend wins unless another is 1.5x better */
+#define MIMI_LLM_CB_FAILURES         3             /* consecutive failures that open the circuit */
+#define MIMI_LLM_CB_COOLDOWN_MS      (30 * 1000)
+#define MIMI_LLM_CB_COOLDOWN_MAX_MS  (5 * 60 * 1000)
+
+/* Token usage accounting */
+#define MIMI_USAGE_MAX_CHATS         16            /* chats tracked, least recently used dropped */
+#define MIMI_USAGE_DAILY_BUDGET      0             /* default tokens per chat per UTC day, 0 = unlimited */
+
 /* Message Bus */
 #define MIMI_BUS_QUEUE_LEN           8
+#define MIMI_BUS_ACTIVITY_SLOTS      8             /* chats with a typing indicator at once */
+#define MIMI_TYPING_REFRESH_MS       4500          /* Telegram shows "typing" for 5 s */
 #define MIMI_OUTBOUND_STACK          (8 * 1024)
 #define MIMI_OUTBOUND_PRIO           5
 #define MIMI_OUTBOUND_CORE           0
 
+/* Perf trace (perf/perf_trace.h) */
+#define MIMI_PERF_RING_EVENTS        2048          /* recent spans kept, 24 B each (power of two) */
+#define MIMI_PERF_JSON_SPANS         32            /* recent spans in `perf --json` */
+#define MIMI_PERF_TRACE_SECONDS      10            /* default window of a trace export */
+#define MIMI_PERF_TRACE_THREADS      32            /* distinct (core, task) pairs in an export */
+
 /* Memory / SPIFFS */
 #define MIMI_SPIFFS_BASE             "/spiffs"
 #define MIMI_SPIFFS_CONFIG_DIR       "/spiffs/config"
@@ -82,6 +146,16 @@
 #define MIMI_USER_FILE               "/spiffs/config/USER.md"
 #define MIMI_CONTEXT_BUF_SIZE        (16 * 1024)
 #define MIMI_SESSION_MAX_MSGS        20
+#define MIMI_SESSION_LINE_MAX        (8 * 1024)    /* longest JSONL line read back */
+
+/* Session compaction (rolling summary, run while the agent is idle) */
+#define MIMI_SESSION_COMPACT_TOKENS  4000          /* estimated session tokens that trigger it */
+#define MIMI_SESSION_COMPACT_KEEP    6             /* recent messages kept verbatim */
+#define MIMI_SESSION_COMPACT_IDLE_MS (20 * 1000)   /* agent idle time before compacting */
+#define MIMI_SESSION_COMPACT_INPUT   (24 * 1024)   /* transcript bytes sent to the summarizer */
+#define MIMI_SESSION_COMPACT_MSG_MAX 2000          /* bytes per message in that transcript */
+#define MIMI_SESSION_SUMMARY_MAX     (4 * 1024)    /* summary bytes kept / injected */
+#define MIMI_SESSION_COMPACT_PENDING 4             /* chats waiting for compaction */
 
 /* WebSocket Gateway */
 #define MIMI_WS_PORT                 18789
@@ -188,6 +262,7 @@
 #define MIMI_NVS_LLM                 "llm_config"
 #define MIMI_NVS_PROXY               "proxy_config"
 #define MIMI_NVS_SEARCH              "search_config"
+#define MIMI_NVS_USAGE               "usage"
 
 /* Firmware Version */
 #define MIMI_FW_VERSION          "1.4.0"
@@ -203,4 +278,9 @@
 #define MIMI_NVS_KEY_PROXY_HOST      "host"
 #define MIMI_NVS_KEY_PROXY_PORT      "port"
 #define MIMI_NVS_KEY_PROVIDER        "provider"
+#define MIMI_NVS_KEY_FALLBACK        "fallback_model"
+#define MIMI_NVS_KEY_BACKEND_KEY     "key_%s"      /* per backend, %s = provider id */
+#define MIMI_NVS_KEY_BACKEND_MODEL   "model_%s"
+#define MIMI_NVS_KEY_BACKEND_URL     "url_%s"
+#define MIMI_NVS_KEY_USAGE           "table"
 
@@ -10,7 +10,8 @@
 
 #include "ota_manager.h"
 #include "mimi_config.h"
-#include "proxy/http_proxy.h"
+#include "http/http_client.h"
+#include "pool/buf_pool.h"
 
 #include <string.h>
 #include <stdlib.h>
@@ -88,95 +89,64 @@ static bool is_hardware_compatible(const char *remote_tag)
 
 /* --- HTTP helper pour GET GitHub API --- */
 
-typedef struct {
-    char *data;
-    size_t len;
-    size_t cap;
-} resp_buf_t;
-
-static esp_err_t http_event_cb(esp_http_client_event_t *evt)
-{
-    resp_buf_t *rb = (resp_buf_t *)evt->user_data;
-    if (evt->event_id == HTTP_EVENT_ON_DATA && rb) {
-        if (rb->len + evt->data_len < rb->cap - 1) { /* -1 pour le null terminator */
-            memcpy(rb->data + rb->len, evt->data, evt->data_len);
-            rb->len += evt->data_len;
-            rb->data[rb->len] = '\0';
-        } else {
-            ESP_LOGW(TAG, "Buffer plein, données tronquées!");
-        }
-    }
-    return ESP_OK;
-}
-
-static char *github_api_get(const char *url, size_t *out_len)
+/* Body into out (leased here, released by the caller on success) */
+static esp_err_t github_api_get(const char *url, buf_lease_t *out)
 {
-    /* Buffer dynamique qui grandit si nécessaire */
-    size_t initial_cap = 8192; /* Doublé par rapport à avant */
-    resp_buf_t rb = {
-        .data = heap_caps_calloc(1, initial_cap, MALLOC_CAP_SPIRAM),
-        .len = 0,
-        .cap = initial_cap,
-    };
-    if (!rb.data) {
-        ESP_LOGE(TAG, "Failed to allocate response buffer");
-        return NULL;
-    }
-
-    esp_http_client_config_t config = {
-        .url = url,
-        .event_handler = http_event_cb,
-        .user_data = &rb,
+    char host[64], path[160];
+    int port;
+    bool plain;
+    http_client_parse_url(url, host, sizeof(host), &port, &plain, path, sizeof(path));
+
+    http_req_t req = {
+        .method = "GET",
+        .host = host,
+        .port = port,
+        .plain_http = plain,
+        .path = path,
+        .headers = {
+            /* GitHub API requiert User-Agent */
+            { "User-Agent", "LilyClaw-OTA/" MIMI_FW_VERSION },
+            { "Accept", "application/vnd.github.v3+json" },
+        },
         .timeout_ms = 15000,
-        .buffer_size = 4096,
-        .crt_bundle_attach = esp_crt_bundle_attach,
     };
 
-    esp_http_client_handle_t client = esp_http_client_init(&config);
-    if (!client) {
-        ESP_LOGE(TAG, "Failed to init HTTP client");
-        free(rb.data);
-        return NULL;
+    if (buf_pool_acquire(out, 8192) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to allocate response buffer");
+        return ESP_ERR_NO_MEM;
     }
 
-    /* GitHub API requiert User-Agent */
-    esp_http_client_set_header(client, "User-Agent", "LilyClaw-OTA/" MIMI_FW_VERSION);
-    esp_http_client_set_header(client, "Accept", "application/vnd.github.v3+json");
-
     /* Retry avec backoff exponentiel */
     int retries = 3;
     esp_err_t err = ESP_FAIL;
-    int status = 0;
-    
+    http_result_t res = {0};
+
     for (int i = 0; i < retries; i++) {
         if (i > 0) {
             int delay_ms = (1 << i) * 1000; /* 2s, 4s, 8s */
             ESP_LOGW(TAG, "Retry %d/%d après %d ms...", i, retries, delay_ms);
             vTaskDelay(pdMS_TO_TICKS(delay_ms));
         }
-        
-        err = esp_http_client_perform(client);
-        status = esp_http_client_get_status_code(client);
-        
-        if (err == ESP_OK && status == 200) {
+
+        out->len = 0;
+        out->data[0] = '\0';
+        err = http_client_fetch(&req, out, &res);
+
+        if (err == ESP_OK && res.status == 200) {
             break; /* Succès */
         }
-        
-        ESP_LOGW(TAG, "Tentative %d échouée: err=%s status=%d", 
-                 i + 1, esp_err_to_name(err), status);
-    }
 
-    esp_http_client_cleanup(client);
-
-    if (err != ESP_OK || status != 200) {
-        ESP_LOGE(TAG, "GitHub API failed après %d tentatives: err=%s status=%d", 
-                 retries, esp_err_to_name(err), status);
-        free(rb.data);
-        return NULL;
+        ESP_LOGW(TAG, "Tentative %d échouée: err=%s status=%d",
+                 i + 1, esp_err_to_name(err), res.status);
     }
 
-    if (out_len) *out_len = rb.len;
-    return rb.data;
+    if (err != ESP_OK || res.status != 200) {
+        ESP_LOGE(TAG, "GitHub API failed après %d tentatives: err=%s status=%d",
+                 retries, esp_err_to_name(err), res.status);
+        buf_pool_release(out);
+        return (err != ESP_OK) ? err : ESP_FAIL;
+    }
+    return ESP_OK;
 }
 
 /* --- Vérification SHA256 --- */
@@ -214,17 +184,16 @@ esp_err_t ota_check_update(ota_update_info_t *info)
     ESP_LOGI(TAG, "Checking for updates (current: v%s, variant: %s)",
              MIMI_FW_VERSION, ota_get_variant());
 
-    size_t json_len = 0;
-    char *json = github_api_get(MIMI_GITHUB_RELEASES_URL, &json_len);
-    if (!json) {
+    buf_lease_t json;
+    if (github_api_get(MIMI_GITHUB_RELEASES_URL, &json) != ESP_OK) {
         ESP_LOGE(TAG, "Failed to fetch release info");
         return ESP_FAIL;
     }
-    
-    ESP_LOGI(TAG, "Réponse API: %d bytes", json_len);
 
-    cJSON *root = cJSON_Parse(json);
-    free(json);
+    ESP_LOGI(TAG, "Réponse API: %d bytes", (int)json.len);
+
+    cJSON *root = cJSON_Parse(json.data);
+    buf_pool_release(&json);
     if (!root) {
         ESP_LOGE(TAG, "Failed to parse release JSON");
         return ESP_FAIL;
@@ -0,0 +1,307 @@
+#include "perf_trace.h"
+#include "mimi_config.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "cJSON.h"
+
+static const char *TAG = "perf";
+
+/* Histogram buckets: values below 8 us exactly, then 8 sub-buckets per power
+ * of two up to 2^32 us */
+#define HIST_SUB        8
+#define HIST_BUCKETS    ((32 - 2) * HIST_SUB)
+
+typedef struct {
+    int64_t  start_us;
+    uint32_t dur_us;
+    uint8_t  phase;
+    uint8_t  core;
+    char     task[10];
+} perf_event_t;
+
+typedef struct {
+    uint32_t buckets[HIST_BUCKETS];
+    uint32_t count;
+    uint32_t max_us;
+    uint64_t total_us;
+} perf_hist_t;
+
+static const char *const s_phase_names[PERF_PHASE_COUNT] = {
+    [PERF_TURN]         = "turn",
+    [PERF_PROMPT]       = "prompt",
+    [PERF_HISTORY]      = "history",
+    [PERF_LLM_CALL]     = "llm_call",
+    [PERF_LLM_BODY]     = "llm_body",
+    [PERF_LLM_HTTP]     = "llm_http",
+    [PERF_LLM_TTFB]     = "llm_ttfb",
+    [PERF_TOOL]         = "tool",
+    [PERF_SESSION_SAVE] = "session_save",
+    [PERF_SEND_TG]      = "send_tg",
+    [PERF_SEND_WS]      = "send_ws",
+    [PERF_TYPING]       = "typing",
+    [PERF_TG_POLL]      = "tg_poll",
+    [PERF_TG_UPDATES]   = "tg_updates",
+    [PERF_DISP_FRAME]   = "disp_frame",
+    [PERF_SONAR]        = "sonar",
+    [PERF_BATTERY]      = "battery",
+};
+
+static perf_event_t *s_ring = NULL;     /* PSRAM, MIMI_PERF_RING_EVENTS */
+static uint32_t s_ring_head = 0;        /* events written so far */
+static perf_hist_t *s_hist = NULL;      /* PSRAM, one per phase */
+static SemaphoreHandle_t s_lock = NULL;
+
+static int bucket_of(uint32_t v)
+{
+    if (v < HIST_SUB) return (int)v;
+    int e = 31 - __builtin_clz(v);      /* >= 3 */
+    return (e - 2) * HIST_SUB + (int)((v >> (e - 3)) & (HIST_SUB - 1));
+}
+
+/* Highest value that falls in bucket b */
+static uint32_t bucket_top(int b)
+{
+    if (b < HIST_SUB) return (uint32_t)b;
+    int e = b / HIST_SUB + 2;
+    uint64_t low = (uint64_t)(HIST_SUB + b % HIST_SUB) << (e - 3);
+    uint64_t top = low + (1ull << (e - 3)) - 1;
+    return top > UINT32_MAX ? UINT32_MAX : (uint32_t)top;
+}
+
+esp_err_t perf_trace_init(void)
+{
+    s_ring = heap_caps_calloc(MIMI_PERF_RING_EVENTS, sizeof(perf_event_t), MALLOC_CAP_SPIRAM);
+    s_hist = heap_caps_calloc(PERF_PHASE_COUNT, sizeof(perf_hist_t), MALLOC_CAP_SPIRAM);
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_ring || !s_hist || !s_lock) {
+        ESP_LOGE(TAG, "Failed to allocate trace buffers");
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(TAG, "Perf trace initialized (%d events, %d KB PSRAM)", MIMI_PERF_RING_EVENTS,
+             (int)((MIMI_PERF_RING_EVENTS * sizeof(perf_event_t) +
+                    PERF_PHASE_COUNT * sizeof(perf_hist_t)) / 1024));
+    return ESP_OK;
+}
+
+perf_span_t perf_begin(perf_phase_t phase)
+{
+    return (perf_span_t){ .t0 = esp_timer_get_time(), .phase = phase };
+}
+
+void perf_end(perf_span_t span)
+{
+    perf_record(span.phase, span.t0, esp_timer_get_time() - span.t0);
+}
+
+void perf_record(perf_phase_t phase, int64_t start_us, int64_t dur_us)
+{
+    if (!s_lock || phase >= PERF_PHASE_COUNT) return;
+    uint32_t dur = dur_us < 0 ? 0 : (dur_us > UINT32_MAX ? UINT32_MAX : (uint32_t)dur_us);
+
+    perf_event_t ev = {
+        .start_us = start_us,
+        .dur_us = dur,
+        .phase = (uint8_t)phase,
+        .core = (uint8_t)xPortGetCoreID(),
+    };
+    strncpy(ev.task, pcTaskGetName(NULL), sizeof(ev.task) - 1);
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_ring[s_ring_head++ % MIMI_PERF_RING_EVENTS] = ev;
+    perf_hist_t *h = &s_hist[phase];
+    h->buckets[bucket_of(dur)]++;
+    h->count++;
+    h->total_us += dur;
+    if (dur > h->max_us) h->max_us = dur;
+    xSemaphoreGive(s_lock);
+}
+
+const char *perf_phase_name(perf_phase_t phase)
+{
+    return phase < PERF_PHASE_COUNT ? s_phase_names[phase] : "?";
+}
+
+/* s_lock held. Top of the bucket holding the pct-th percentile, capped at max. */
+static uint32_t hist_percentile(const perf_hist_t *h, int pct)
+{
+    if (!h->count) return 0;
+    uint32_t rank = (uint32_t)(((uint64_t)h->count * pct + 99) / 100);
+    uint32_t seen = 0;
+    for (int b = 0; b < HIST_BUCKETS; b++) {
+        seen += h->buckets[b];
+        if (seen >= rank) {
+            uint32_t top = bucket_top(b);
+            return top < h->max_us ? top : h->max_us;
+        }
+    }
+    return h->max_us;
+}
+
+void perf_get_stats(perf_phase_t phase, perf_stats_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    if (!s_lock || phase >= PERF_PHASE_COUNT) return;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    const perf_hist_t *h = &s_hist[phase];
+    out->count = h->count;
+    out->max_us = h->max_us;
+    out->total_us = h->total_us;
+    out->p50_us = hist_percentile(h, 50);
+    out->p95_us = hist_percentile(h, 95);
+    out->p99_us = hist_percentile(h, 99);
+    xSemaphoreGive(s_lock);
+}
+
+void perf_reset(void)
+{
+    if (!s_lock) return;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    memset(s_hist, 0, PERF_PHASE_COUNT * sizeof(perf_hist_t));
+    s_ring_head = 0;
+    xSemaphoreGive(s_lock);
+}
+
+char *perf_dump_json(void)
+{
+    cJSON *root = cJSON_CreateObject();
+    if (!root) return NULL;
+    cJSON_AddNumberToObject(root, "uptime_us", (double)esp_timer_get_time());
+
+    cJSON *phases = cJSON_AddArrayToObject(root, "phases");
+    for (int p = 0; p < PERF_PHASE_COUNT; p++) {
+        perf_stats_t st;
+        perf_get_stats((perf_phase_t)p, &st);
+        cJSON *o = cJSON_CreateObject();
+        cJSON_AddStringToObject(o, "name", s_phase_names[p]);
+        cJSON_AddNumberToObject(o, "count", st.count);
+        cJSON_AddNumberToObject(o, "avg_us", st.count ? (double)(st.total_us / st.count) : 0);
+        cJSON_AddNumberToObject(o, "p50_us", st.p50_us);
+        cJSON_AddNumberToObject(o, "p95_us", st.p95_us);
+        cJSON_AddNumberToObject(o, "p99_us", st.p99_us);
+        cJSON_AddNumberToObject(o, "max_us", st.max_us);
+        cJSON_AddItemToArray(phases, o);
+    }
+
+    /* Most recent spans, oldest first */
+    cJSON *recent = cJSON_AddArrayToObject(root, "recent");
+    if (s_lock) {
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        uint32_t n = s_ring_head < MIMI_PERF_JSON_SPANS ? s_ring_head : MIMI_PERF_JSON_SPANS;
+        for (uint32_t i = s_ring_head - n; i != s_ring_head; i++) {
+            const perf_event_t *ev = &s_ring[i % MIMI_PERF_RING_EVENTS];
+            cJSON *o = cJSON_CreateObject();
+            cJSON_AddStringToObject(o, "phase", s_phase_names[ev->phase]);
+            cJSON_AddStringToObject(o, "task", ev->task);
+            cJSON_AddNumberToObject(o, "core", ev->core);
+            cJSON_AddNumberToObject(o, "start_us", (double)ev->start_us);
+            cJSON_AddNumberToObject(o, "dur_us", ev->dur_us);
+            cJSON_AddItemToArray(recent, o);
+        }
+        xSemaphoreGive(s_lock);
+    }
+
+    char *json = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    return json;
+}
+
+/* ── Chrome trace export ──────────────────────────────────────── */
+
+typedef struct {
+    char    task[10];
+    uint8_t core;
+} trace_thread_t;
+
+static void jw_i64(json_writer_t *w, int64_t v)
+{
+    char num[24];
+    snprintf(num, sizeof(num), "%" PRId64, v);
+    jw_lit(w, num);
+}
+
+/* tid of (core, task), added on first sight; 0 once the table is full */
+static int thread_id(trace_thread_t *threads, int *count, const perf_event_t *ev)
+{
+    for (int i = 0; i < *count; i++) {
+        if (threads[i].core == ev->core && strcmp(threads[i].task, ev->task) == 0) return i + 1;
+    }
+    if (*count >= MIMI_PERF_TRACE_THREADS) return 0;
+    memcpy(threads[*count].task, ev->task, sizeof(ev->task));
+    threads[*count].core = ev->core;
+    return ++*count;
+}
+
+esp_err_t perf_export_chrome(uint32_t seconds, json_sink_fn_t sink, void *ctx)
+{
+    if (!s_lock) return ESP_ERR_INVALID_STATE;
+
+    /* Snapshot, so the sink never runs under the lock */
+    perf_event_t *evs = heap_caps_malloc(MIMI_PERF_RING_EVENTS * sizeof(perf_event_t),
+                                         MALLOC_CAP_SPIRAM);
+    if (!evs) return ESP_ERR_NO_MEM;
+    int64_t since = seconds ? esp_timer_get_time() - (int64_t)seconds * 1000000 : INT64_MIN;
+    int n = 0;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    uint32_t avail = s_ring_head < MIMI_PERF_RING_EVENTS ? s_ring_head : MIMI_PERF_RING_EVENTS;
+    for (uint32_t i = s_ring_head - avail; i != s_ring_head; i++) {
+        const perf_event_t *ev = &s_ring[i % MIMI_PERF_RING_EVENTS];
+        if (ev->start_us + ev->dur_us >= since) evs[n++] = *ev;
+    }
+    xSemaphoreGive(s_lock);
+
+    trace_thread_t threads[MIMI_PERF_TRACE_THREADS];
+    int thread_count = 0;
+    for (int i = 0; i < n; i++) thread_id(threads, &thread_count, &evs[i]);
+
+    json_writer_t w;
+    json_writer_init(&w, sink, ctx);
+    jw_lit(&w, "{\"type\":\"trace\",\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    for (int c = 0; c < portNUM_PROCESSORS; c++) {
+        jw_lit(&w, c ? ",\n" : "\n");
+        jw_lit(&w, "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":");
+        jw_int(&w, c);
+        jw_lit(&w, ",\"tid\":0,\"args\":{\"name\":\"Core ");
+        jw_int(&w, c);
+        jw_lit(&w, "\"}}");
+    }
+    for (int t = 0; t < thread_count; t++) {
+        jw_lit(&w, ",\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":");
+        jw_int(&w, threads[t].core);
+        jw_lit(&w, ",\"tid\":");
+        jw_int(&w, t + 1);
+        jw_lit(&w, ",\"args\":{\"name\":");
+        jw_str(&w, threads[t].task);
+        jw_lit(&w, "}}");
+    }
+    for (int i = 0; i < n; i++) {
+        const perf_event_t *ev = &evs[i];
+        jw_lit(&w, ",\n{\"ph\":\"X\",\"cat\":\"mimi\",\"name\":");
+        jw_str(&w, s_phase_names[ev->phase]);
+        jw_lit(&w, ",\"pid\":");
+        jw_int(&w, ev->core);
+        jw_lit(&w, ",\"tid\":");
+        jw_int(&w, thread_id(threads, &thread_count, ev));
+        jw_lit(&w, ",\"ts\":");
+        jw_i64(&w, ev->start_us);
+        jw_lit(&w, ",\"dur\":");
+        jw_i64(&w, ev->dur_us);
+        jw_lit(&w, "}");
+    }
+    jw_lit(&w, "\n]}");
+    free(evs);
+
+    esp_err_t err = jw_flush(&w);
+    if (err == ESP_OK) ESP_LOGI(TAG, "Exported %d spans (%d tasks)", n, thread_count);
+    return err;
+}
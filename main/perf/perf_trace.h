@@ -0,0 +1,80 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include "llm/json_writer.h"
+
+/*
+ * Lightweight phase tracing. A span is opened with perf_begin() and closed
+ * with perf_end(); each closed span goes into a PSRAM ring of recent events
+ * and into a log-linear (HDR-style, ~12% resolution) histogram per phase,
+ * from which p50/p95/p99 are read. Spans are no-ops before perf_trace_init().
+ * Besides the turn phases, the Core 0 tasks (Telegram polling, outbound,
+ * display, body animation, battery) record their work so the ring can be
+ * exported as a timeline (perf_export_chrome).
+ */
+
+typedef enum {
+    PERF_TURN = 0,          /* whole agent turn */
+    PERF_PROMPT,            /* system prompt build */
+    PERF_HISTORY,           /* session history load + parse */
+    PERF_LLM_CALL,          /* llm_chat_request, retries included */
+    PERF_LLM_BODY,          /* request body encoding */
+    PERF_LLM_HTTP,          /* one HTTP attempt, whole response */
+    PERF_LLM_TTFB,          /* request sent → first response byte */
+    PERF_TOOL,              /* one tool_registry_execute */
+    PERF_SESSION_SAVE,
+    PERF_SEND_TG,           /* outbound dispatch, per message */
+    PERF_SEND_WS,
+    PERF_TYPING,            /* typing indicator send */
+    PERF_TG_POLL,           /* getUpdates long poll */
+    PERF_TG_UPDATES,        /* handling the updates it returned */
+    PERF_DISP_FRAME,        /* display: draw + flush one frame */
+    PERF_SONAR,             /* body animator: ultrasonic read */
+    PERF_BATTERY,           /* battery ADC read */
+    PERF_PHASE_COUNT
+} perf_phase_t;
+
+typedef struct {
+    int64_t      t0;
+    perf_phase_t phase;
+} perf_span_t;
+
+typedef struct {
+    uint32_t count;
+    uint32_t p50_us;
+    uint32_t p95_us;
+    uint32_t p99_us;
+    uint32_t max_us;
+    uint64_t total_us;
+} perf_stats_t;
+
+/** Allocate the ring and histograms in PSRAM (early in boot). */
+esp_err_t perf_trace_init(void);
+
+perf_span_t perf_begin(perf_phase_t phase);
+void perf_end(perf_span_t span);
+
+/** Record a span measured elsewhere (esp_timer times). */
+void perf_record(perf_phase_t phase, int64_t start_us, int64_t dur_us);
+
+const char *perf_phase_name(perf_phase_t phase);
+
+void perf_get_stats(perf_phase_t phase, perf_stats_t *out);
+
+/** Clear histograms and the event ring. */
+void perf_reset(void);
+
+/**
+ * Stats of every phase plus the most recent spans, as JSON.
+ * @return heap string for the caller to free, NULL if out of memory
+ */
+char *perf_dump_json(void);
+
+/**
+ * Spans of the last `seconds` (0: the whole ring) as Chrome Trace Event
+ * JSON, one event per line: one process per core, one thread per task.
+ * Opens in Perfetto or chrome://tracing (scripts/trace_to_perfetto.py).
+ */
+esp_err_t perf_export_chrome(uint32_t seconds, json_sink_fn_t sink, void *ctx);
@@ -0,0 +1,221 @@
+#include "buf_pool.h"
+#include "mimi_config.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+
+static const char *TAG = "buf_pool";
+
+#define POOL_MAX_SLABS  (MIMI_BUF_POOL_SMALL_COUNT + MIMI_BUF_POOL_MEDIUM_COUNT + \
+                         MIMI_BUF_POOL_LARGE_COUNT)
+
+static const size_t s_class_size[BUF_POOL_CLASSES] = {
+    MIMI_BUF_POOL_SMALL_SIZE, MIMI_BUF_POOL_MEDIUM_SIZE, MIMI_BUF_POOL_LARGE_SIZE,
+};
+static const uint8_t s_class_count[BUF_POOL_CLASSES] = {
+    MIMI_BUF_POOL_SMALL_COUNT, MIMI_BUF_POOL_MEDIUM_COUNT, MIMI_BUF_POOL_LARGE_COUNT,
+};
+
+/* Slabs are laid out class by class: [small...][medium...][large] */
+typedef struct {
+    char   *mem;
+    uint8_t cls;
+    bool    busy;
+} slab_t;
+
+static slab_t s_slabs[POOL_MAX_SLABS];
+static int s_slab_count = 0;
+static SemaphoreHandle_t s_lock = NULL;
+static buf_pool_stats_t s_stats = {0};
+
+static size_t largest_psram_block(void)
+{
+    return heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM);
+}
+
+esp_err_t buf_pool_init(void)
+{
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock) return ESP_ERR_NO_MEM;
+
+    s_stats.largest_before = largest_psram_block();
+
+    for (int c = 0; c < BUF_POOL_CLASSES; c++) {
+        s_stats.class_size[c] = s_class_size[c];
+        for (int i = 0; i < s_class_count[c]; i++) {
+            char *mem = heap_caps_malloc(s_class_size[c], MALLOC_CAP_SPIRAM);
+            if (!mem) {
+                /* Not fatal: leases fall back to the heap */
+                ESP_LOGW(TAG, "Could not carve %d B slab", (int)s_class_size[c]);
+                continue;
+            }
+            s_slabs[s_slab_count++] = (slab_t){ .mem = mem, .cls = (uint8_t)c };
+            s_stats.class_total[c]++;
+            s_stats.class_free[c]++;
+        }
+    }
+
+    s_stats.largest_after = largest_psram_block();
+    s_stats.largest_min = s_stats.largest_after;
+
+    ESP_LOGI(TAG, "%d slabs ready, largest PSRAM block %d -> %d bytes",
+             s_slab_count, (int)s_stats.largest_before, (int)s_stats.largest_after);
+    return ESP_OK;
+}
+
+/* ── Slab bookkeeping (s_lock held) ───────────────────────────── */
+
+static int slab_take(size_t min_cap)
+{
+    for (int i = 0; i < s_slab_count; i++) {
+        slab_t *sl = &s_slabs[i];
+        if (!sl->busy && s_class_size[sl->cls] >= min_cap) {
+            sl->busy = true;
+            s_stats.class_free[sl->cls]--;
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void slab_give(int slot)
+{
+    s_slabs[slot].busy = false;
+    s_stats.class_free[s_slabs[slot].cls]++;
+}
+
+/* Point b at a buffer of at least min_cap bytes, slab first */
+static esp_err_t lease_alloc(buf_lease_t *b, size_t min_cap)
+{
+    int slot = -1;
+    if (s_lock) {
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        slot = slab_take(min_cap);
+        if (slot >= 0) s_stats.hits++;
+        else s_stats.misses++;
+        xSemaphoreGive(s_lock);
+    }
+
+    if (slot >= 0) {
+        b->data = s_slabs[slot].mem;
+        b->cap = s_class_size[s_slabs[slot].cls];
+        b->slot = (int16_t)slot;
+        return ESP_OK;
+    }
+
+    b->data = heap_caps_malloc(min_cap, MALLOC_CAP_SPIRAM);
+    if (!b->data) return ESP_ERR_NO_MEM;
+    b->cap = min_cap;
+    b->slot = -1;
+    return ESP_OK;
+}
+
+static void lease_free(char *data, int16_t slot)
+{
+    if (slot < 0) {
+        free(data);
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    slab_give(slot);
+    xSemaphoreGive(s_lock);
+}
+
+/* ── Public API ───────────────────────────────────────────────── */
+
+esp_err_t buf_pool_acquire(buf_lease_t *b, size_t min_cap)
+{
+    memset(b, 0, sizeof(*b));
+    if (min_cap == 0) min_cap = 1;
+
+    esp_err_t err = lease_alloc(b, min_cap);
+    if (err != ESP_OK) return err;
+    b->data[0] = '\0';
+
+    if (s_lock) {
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        s_stats.leases++;
+        if (++s_stats.in_use > s_stats.peak_in_use) s_stats.peak_in_use = s_stats.in_use;
+        xSemaphoreGive(s_lock);
+    }
+    return ESP_OK;
+}
+
+esp_err_t buf_pool_reserve(buf_lease_t *b, size_t extra)
+{
+    size_t need = b->len + extra + 1;
+    if (need <= b->cap) return ESP_OK;
+
+    /* Heap-backed lease past the largest class: plain realloc, doubling */
+    if (b->slot < 0 && b->cap >= MIMI_BUF_POOL_LARGE_SIZE) {
+        size_t new_cap = b->cap * 2;
+        while (new_cap < need) new_cap *= 2;
+        char *tmp = heap_caps_realloc(b->data, new_cap, MALLOC_CAP_SPIRAM);
+        if (!tmp) return ESP_ERR_NO_MEM;
+        b->data = tmp;
+        b->cap = new_cap;
+    } else {
+        /* Next class that fits, or the heap beyond the largest one */
+        size_t want = need;
+        for (int c = 0; c < BUF_POOL_CLASSES; c++) {
+            if (s_class_size[c] >= need) {
+                want = s_class_size[c];
+                break;
+            }
+        }
+
+        buf_lease_t nb = {0};
+        esp_err_t err = lease_alloc(&nb, want);
+        if (err != ESP_OK) return err;
+        memcpy(nb.data, b->data, b->len);
+        lease_free(b->data, b->slot);
+        b->data = nb.data;
+        b->cap = nb.cap;
+        b->slot = nb.slot;
+    }
+
+    if (s_lock) {
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        s_stats.grows++;
+        xSemaphoreGive(s_lock);
+    }
+    return ESP_OK;
+}
+
+esp_err_t buf_pool_append(buf_lease_t *b, const char *data, size_t len)
+{
+    esp_err_t err = buf_pool_reserve(b, len);
+    if (err != ESP_OK) return err;
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+    b->data[b->len] = '\0';
+    return ESP_OK;
+}
+
+void buf_pool_release(buf_lease_t *b)
+{
+    if (!b->data) return;
+    lease_free(b->data, b->slot);
+    memset(b, 0, sizeof(*b));
+
+    if (s_lock) {
+        size_t largest = largest_psram_block();
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        if (s_stats.in_use) s_stats.in_use--;
+        if (largest < s_stats.largest_min) s_stats.largest_min = largest;
+        xSemaphoreGive(s_lock);
+    }
+}
+
+void buf_pool_get_stats(buf_pool_stats_t *out)
+{
+    if (s_lock) xSemaphoreTake(s_lock, portMAX_DELAY);
+    *out = s_stats;
+    if (s_lock) xSemaphoreGive(s_lock);
+    out->largest_now = largest_psram_block();
+}
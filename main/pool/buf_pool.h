@@ -0,0 +1,71 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Shared PSRAM buffer pool for HTTP response bodies (LLM, Telegram, search).
+ *
+ * A few fixed slabs per size class are carved out of PSRAM once at boot and
+ * leased out per request, so the poll / chat loops stop doing calloc +
+ * realloc + free on every call. A lease that outgrows its slab moves to the
+ * next class; bodies bigger than the largest class (or a class with no free
+ * slab) fall back to a plain heap allocation.
+ */
+
+#define BUF_POOL_CLASSES    3
+
+typedef struct {
+    char   *data;       /* always NUL-terminated at data[len] */
+    size_t  len;
+    size_t  cap;
+    int16_t slot;       /* pool slab index, -1 = heap allocation */
+} buf_lease_t;
+
+typedef struct {
+    uint32_t leases;        /* buf_pool_acquire calls */
+    uint32_t hits;          /* served from a slab */
+    uint32_t misses;        /* fell back to the heap */
+    uint32_t grows;         /* lease moved to a bigger buffer */
+    uint32_t in_use;
+    uint32_t peak_in_use;
+    size_t   class_size[BUF_POOL_CLASSES];
+    uint8_t  class_free[BUF_POOL_CLASSES];
+    uint8_t  class_total[BUF_POOL_CLASSES];
+    size_t   largest_before;    /* largest free PSRAM block before the slabs were carved */
+    size_t   largest_after;     /* ... right after */
+    size_t   largest_now;
+    size_t   largest_min;       /* lowest value seen when a lease was released */
+} buf_pool_stats_t;
+
+/**
+ * Carve the slabs out of PSRAM. Call early, before the heap fragments.
+ */
+esp_err_t buf_pool_init(void);
+
+/**
+ * Lease a buffer of at least min_cap bytes (len = 0, data[0] = '\0').
+ */
+esp_err_t buf_pool_acquire(buf_lease_t *b, size_t min_cap);
+
+/**
+ * Append bytes, moving the lease to a bigger buffer when needed.
+ */
+esp_err_t buf_pool_append(buf_lease_t *b, const char *data, size_t len);
+
+/**
+ * Make room for at least extra more bytes after len (for direct reads
+ * into data + len). Keeps one byte for the terminator.
+ */
+esp_err_t buf_pool_reserve(buf_lease_t *b, size_t extra);
+
+/**
+ * Return the buffer to the pool (or the heap). Safe on a zeroed lease.
+ */
+void buf_pool_release(buf_lease_t *b);
+
+/**
+ * Snapshot of pool usage and PSRAM fragmentation counters.
+ */
+void buf_pool_get_stats(buf_pool_stats_t *out);
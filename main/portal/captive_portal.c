@@ -114,6 +114,7 @@ static const char PORTAL_HTML[] =
 "<select id='provider' onchange='providerChanged()'>"
 "<option value='anthropic'>Anthropic (Claude)</option>"
 "<option value='kimi'>Moonshot AI (Kimi)</option>"
+"<option value='openai'>OpenAI</option>"
 "</select></div>"
 "<div class='field'><label>API Key</label>"
 "<div class='input-wrap'><input type='password' id='api_key' placeholder='sk-ant-api03-...'>"
@@ -156,6 +157,7 @@ static const char PORTAL_HTML[] =
 "var m=document.getElementById('model');"
 "var k=document.getElementById('api_key');"
 "if(p==='kimi'){m.placeholder='kimi-k2.5';k.placeholder='sk-...'}"
+"else if(p==='openai'){m.placeholder='gpt-4o-mini';k.placeholder='sk-...'}"
 "else{m.placeholder='claude-opus-4-5';k.placeholder='sk-ant-api03-...'}}"
 
 "function showStatus(msg,ok){"
@@ -219,20 +221,10 @@ static char *build_config_json(void)
     cJSON_AddStringToObject(root, "wifi_ssid", buf);
 
     /* Provider */
-    cJSON_AddStringToObject(root, "provider",
-        llm_get_provider() == LLM_PROVIDER_KIMI ? "kimi" : "anthropic");
+    cJSON_AddStringToObject(root, "provider", llm_provider_id(llm_get_provider()));
 
     /* Model (non masque) */
-    buf[0] = '\0';
-    if (nvs_open(MIMI_NVS_LLM, NVS_READONLY, &nvs) == ESP_OK) {
-        size_t len = sizeof(buf);
-        if (nvs_get_str(nvs, MIMI_NVS_KEY_MODEL, buf, &len) != ESP_OK) buf[0] = '\0';
-        nvs_close(nvs);
-    }
-    if (buf[0] == '\0' && MIMI_SECRET_MODEL[0]) {
-        strncpy(buf, MIMI_SECRET_MODEL, sizeof(buf) - 1);
-    }
-    cJSON_AddStringToObject(root, "model", buf);
+    cJSON_AddStringToObject(root, "model", llm_get_model());
 
     /* Proxy host (non masque) */
     buf[0] = '\0';
@@ -342,11 +334,11 @@ static esp_err_t handler_save(httpd_req_t *req)
     /* Provider */
     cJSON *provider = cJSON_GetObjectItem(root, "provider");
     if (provider && cJSON_IsString(provider) && provider->valuestring[0]) {
-        llm_provider_t p = (strcmp(provider->valuestring, "kimi") == 0)
-                           ? LLM_PROVIDER_KIMI : LLM_PROVIDER_ANTHROPIC;
+        llm_provider_t p = LLM_PROVIDER_ANTHROPIC;
+        llm_provider_from_id(provider->valuestring, &p);
         llm_set_provider(p);
         saved++;
-        ESP_LOGI(TAG, "Provider saved: %s", provider->valuestring);
+        ESP_LOGI(TAG, "Provider saved: %s", llm_provider_id(p));
     }
 
     /* API key */
@@ -2,6 +2,7 @@
 #include "mimi_config.h"
 #include "display/display_ui.h"
 #include "sleep_manager.h"
+#include "perf/perf_trace.h"
 
 #include "esp_adc/adc_oneshot.h"
 #include "esp_adc/adc_cali.h"
@@ -145,7 +146,9 @@ static void battery_task(void *arg)
              s_voltage_mv, s_percent, s_charging ? "[CHARGE]" : "[DECHARGE]");
 
     while (1) {
+        perf_span_t span = perf_begin(PERF_BATTERY);
         battery_read();
+        perf_end(span);
 
         /* Basculer l'affichage en mode charge si necessaire */
         display_state_t cur = display_ui_get_state();
@@ -4,14 +4,20 @@
 #include <string.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <sys/socket.h>
+#include <sys/select.h>
 #include <netdb.h>
 #include <unistd.h>
 
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "nvs.h"
 #include "esp_tls.h"
 #include "esp_crt_bundle.h"
+#include "esp_http_client.h"
 
 static const char *TAG = "proxy";
 
@@ -24,8 +30,24 @@ __attribute__((constructor)) static void proxy_log_level(void)
 static char     s_proxy_host[64] = {0};
 static uint16_t s_proxy_port     = 0;
 
+static SemaphoreHandle_t s_pool_lock = NULL;   /* idle pool, address and session caches, stats */
+static proxy_pool_stats_t s_pool_stats;
+static uint32_t s_proxy_gen = 0;    /* bumped by every flush: older tunnels go through an old proxy */
+
+/* Current generation, for a tunnel about to be opened */
+static uint32_t proxy_gen(void)
+{
+    xSemaphoreTake(s_pool_lock, portMAX_DELAY);
+    uint32_t gen = s_proxy_gen;
+    xSemaphoreGive(s_pool_lock);
+    return gen;
+}
+
 esp_err_t http_proxy_init(void)
 {
+    s_pool_lock = xSemaphoreCreateMutex();
+    if (!s_pool_lock) return ESP_ERR_NO_MEM;
+
     /* Start with build-time defaults */
     if (MIMI_SECRET_PROXY_HOST[0] != '\0' && MIMI_SECRET_PROXY_PORT[0] != '\0') {
         strncpy(s_proxy_host, MIMI_SECRET_PROXY_HOST, sizeof(s_proxy_host) - 1);
@@ -64,8 +86,13 @@ esp_err_t http_proxy_set(const char *host, uint16_t port)
     ESP_ERROR_CHECK(nvs_commit(nvs));
     nvs_close(nvs);
 
+    /* Address first, then the flush: a tunnel opened or released meanwhile
+     * is of the old generation, so it is never pooled or reused */
+    xSemaphoreTake(s_pool_lock, portMAX_DELAY);
     strncpy(s_proxy_host, host, sizeof(s_proxy_host) - 1);
     s_proxy_port = port;
+    xSemaphoreGive(s_pool_lock);
+    proxy_pool_flush();
     ESP_LOGI(TAG, "Proxy set to %s:%d", s_proxy_host, s_proxy_port);
     return ESP_OK;
 }
@@ -79,8 +106,11 @@ esp_err_t http_proxy_clear(void)
     nvs_commit(nvs);
     nvs_close(nvs);
 
+    xSemaphoreTake(s_pool_lock, portMAX_DELAY);
     s_proxy_host[0] = '\0';
     s_proxy_port = 0;
+    xSemaphoreGive(s_pool_lock);
+    proxy_pool_flush();
     ESP_LOGI(TAG, "Proxy cleared");
     return ESP_OK;
 }
@@ -95,51 +125,221 @@ bool http_proxy_is_enabled(void)
 struct proxy_conn {
     int         sock;   /* raw TCP socket (for timeout control) */
     esp_tls_t  *tls;    /* esp_tls handle owns TLS + socket lifecycle */
+    char        host[64];
+    uint16_t    port;
+    bool        reused;     /* taken from the idle pool */
+    bool        reusable;   /* last response read to its end, keep-alive allowed */
+    uint32_t    gen;        /* s_proxy_gen when it was opened */
+    int64_t     idle_since_us;
 };
 
-/* Read a line from socket (up to CR-LF). Returns length or -1. */
-static int sock_read_line(int fd, char *buf, int max, int timeout_ms)
+/* ── TLS session tickets ──────────────────────────────────────── */
+
+#ifdef CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+typedef struct {
+    char     host[64];
+    uint16_t port;
+    uint8_t  users;         /* handshakes currently using the ticket */
+    esp_tls_client_session_t *session;
+} tls_ticket_t;
+
+static tls_ticket_t s_tickets[MIMI_PROXY_SESSION_HOSTS];
+
+static tls_ticket_t *ticket_find(const char *host, int port)
 {
-    int pos = 0;
-    struct timeval tv = { .tv_sec = timeout_ms / 1000, .tv_usec = (timeout_ms % 1000) * 1000 };
-    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    for (int i = 0; i < MIMI_PROXY_SESSION_HOSTS; i++) {
+        if (s_tickets[i].session && s_tickets[i].port == port &&
+            strcmp(s_tickets[i].host, host) == 0) {
+            return &s_tickets[i];
+        }
+    }
+    return NULL;
+}
 
-    while (pos < max - 1) {
-        char c;
-        int r = recv(fd, &c, 1, 0);
-        if (r <= 0) return -1;
-        if (c == '\n') { buf[pos] = '\0'; return pos; }
-        if (c != '\r') buf[pos++] = c;
+/* Cached ticket for host:port (pinned until ticket_put), or NULL */
+static esp_tls_client_session_t *ticket_get(const char *host, int port)
+{
+    xSemaphoreTake(s_pool_lock, portMAX_DELAY);
+    tls_ticket_t *t = ticket_find(host, port);
+    if (t) {
+        t->users++;
+        s_pool_stats.ticket_offers++;
     }
-    buf[pos] = '\0';
-    return pos;
+    xSemaphoreGive(s_pool_lock);
+    return t ? t->session : NULL;
 }
 
-/* Open TCP + CONNECT tunnel, returns socket fd or -1 */
-static int open_connect_tunnel(const char *host, int port, int timeout_ms)
+/* Unpin the ticket used for the handshake and store the one the server
+ * just issued. A ticket still pinned by another handshake is left alone. */
+static void ticket_put(const char *host, int port, bool used, esp_tls_t *tls)
+{
+    esp_tls_client_session_t *fresh = tls ? esp_tls_get_client_session(tls) : NULL;
+
+    xSemaphoreTake(s_pool_lock, portMAX_DELAY);
+    tls_ticket_t *t = ticket_find(host, port);
+    if (t && used) t->users--;
+    if (fresh) {
+        if (!t) {
+            /* Free slot, else the first unpinned one */
+            for (int i = 0; i < MIMI_PROXY_SESSION_HOSTS && !t; i++) {
+                if (!s_tickets[i].session) t = &s_tickets[i];
+            }
+            for (int i = 0; i < MIMI_PROXY_SESSION_HOSTS && !t; i++) {
+                if (s_tickets[i].users == 0) t = &s_tickets[i];
+            }
+            if (t) {
+                if (t->session) esp_tls_free_client_session(t->session);
+                t->session = NULL;
+                t->users = 0;
+                strncpy(t->host, host, sizeof(t->host) - 1);
+                t->host[sizeof(t->host) - 1] = '\0';
+                t->port = (uint16_t)port;
+            }
+        }
+        if (t && t->users == 0) {
+            if (t->session) esp_tls_free_client_session(t->session);
+            t->session = fresh;
+            fresh = NULL;
+        }
+    }
+    xSemaphoreGive(s_pool_lock);
+    if (fresh) esp_tls_free_client_session(fresh);
+}
+
+static void tickets_clear(void)
+{
+    for (int i = 0; i < MIMI_PROXY_SESSION_HOSTS; i++) {
+        if (s_tickets[i].session && s_tickets[i].users == 0) {
+            esp_tls_free_client_session(s_tickets[i].session);
+            s_tickets[i].session = NULL;
+        }
+    }
+}
+
+static int tickets_count(void)
+{
+    int n = 0;
+    for (int i = 0; i < MIMI_PROXY_SESSION_HOSTS; i++) {
+        if (s_tickets[i].session) n++;
+    }
+    return n;
+}
+#else
+static void tickets_clear(void) { }
+static int tickets_count(void) { return 0; }
+#endif
+
+/* ── Proxy address cache ──────────────────────────────────────── */
+
+/* The proxy address is resolved once and reused for MIMI_PROXY_DNS_TTL_S
+ * (lwIP does not report record TTLs); a failed connect drops it. */
+static struct sockaddr_in s_proxy_addr;
+static int64_t s_proxy_addr_until_us = 0;
+
+static void proxy_addr_forget(void)
 {
+    xSemaphoreTake(s_pool_lock, portMAX_DELAY);
+    s_proxy_addr_until_us = 0;
+    xSemaphoreGive(s_pool_lock);
+}
+
+static bool proxy_addr_get(struct sockaddr_in *out)
+{
+    int64_t now = esp_timer_get_time();
+    xSemaphoreTake(s_pool_lock, portMAX_DELAY);
+    uint32_t gen = s_proxy_gen;
+    bool hit = now < s_proxy_addr_until_us;
+    if (hit) {
+        *out = s_proxy_addr;
+        s_pool_stats.dns_hits++;
+    }
+    xSemaphoreGive(s_pool_lock);
+    if (hit) return true;
+
     struct addrinfo hints = { .ai_family = AF_INET, .ai_socktype = SOCK_STREAM };
     struct addrinfo *res = NULL;
     char port_str[8];
     snprintf(port_str, sizeof(port_str), "%d", s_proxy_port);
-
     if (getaddrinfo(s_proxy_host, port_str, &hints, &res) != 0 || !res) {
         ESP_LOGE(TAG, "DNS resolve failed for proxy %s", s_proxy_host);
-        return -1;
+        return false;
+    }
+    memcpy(out, res->ai_addr, sizeof(*out));
+    freeaddrinfo(res);
+
+    xSemaphoreTake(s_pool_lock, portMAX_DELAY);
+    if (gen == s_proxy_gen) {   /* else the proxy changed while resolving */
+        s_proxy_addr = *out;
+        s_proxy_addr_until_us = now + (int64_t)MIMI_PROXY_DNS_TTL_S * 1000000;
+    }
+    s_pool_stats.dns_lookups++;
+    xSemaphoreGive(s_pool_lock);
+    return true;
+}
+
+static bool is_cancelled(const volatile bool *cancel)
+{
+    return cancel && *cancel;
+}
+
+/* Wait until sock is readable (or writable), in slices of
+ * MIMI_HTTP_CANCEL_POLL_MS so that a cancel is seen.
+ * @return true when ready, false on timeout, error or cancel */
+static bool wait_sock(int sock, bool for_write, int timeout_ms, const volatile bool *cancel)
+{
+    int64_t until = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+    while (!is_cancelled(cancel)) {
+        int64_t left_ms = (until - esp_timer_get_time()) / 1000;
+        if (left_ms <= 0) return false;
+        int slice = left_ms < MIMI_HTTP_CANCEL_POLL_MS ? (int)left_ms : MIMI_HTTP_CANCEL_POLL_MS;
+        fd_set set;
+        FD_ZERO(&set);
+        FD_SET(sock, &set);
+        struct timeval tv = { .tv_sec = 0, .tv_usec = slice * 1000 };
+        int n = select(sock + 1, for_write ? NULL : &set, for_write ? &set : NULL, NULL, &tv);
+        if (n > 0) return true;
+        if (n < 0 && errno != EINTR) return false;
+    }
+    return false;
+}
+
+/* Non-blocking connect, waited for with wait_sock(); the socket is blocking again after */
+static bool connect_sock(int sock, const struct sockaddr_in *addr, int timeout_ms,
+                         const volatile bool *cancel)
+{
+    int flags = fcntl(sock, F_GETFL, 0);
+    fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+    bool ok = connect(sock, (const struct sockaddr *)addr, sizeof(*addr)) == 0;
+    if (!ok && errno == EINPROGRESS && wait_sock(sock, true, timeout_ms, cancel)) {
+        int so_err = 0;
+        socklen_t len = sizeof(so_err);
+        ok = getsockopt(sock, SOL_SOCKET, SO_ERROR, &so_err, &len) == 0 && so_err == 0;
     }
+    fcntl(sock, F_SETFL, flags);
+    return ok;
+}
+
+/* Open TCP + CONNECT tunnel, returns socket fd or -1 */
+static int open_connect_tunnel(const char *host, int port, int timeout_ms,
+                               const volatile bool *cancel, int *recvs)
+{
+    struct sockaddr_in addr;
+    if (!proxy_addr_get(&addr)) return -1;
 
     int sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (sock < 0) { freeaddrinfo(res); return -1; }
+    if (sock < 0) return -1;
 
+    /* Kept for the whole CONNECT exchange; proxy_conn_read sets its own */
     struct timeval tv = { .tv_sec = timeout_ms / 1000, .tv_usec = (timeout_ms % 1000) * 1000 };
     setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
     setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
 
-    if (connect(sock, res->ai_addr, res->ai_addrlen) != 0) {
+    if (!connect_sock(sock, &addr, timeout_ms, cancel)) {
+        if (is_cancelled(cancel)) { close(sock); return -1; }
         ESP_LOGE(TAG, "TCP connect to proxy %s:%d failed", s_proxy_host, s_proxy_port);
-        freeaddrinfo(res); close(sock); return -1;
+        proxy_addr_forget();    /* re-resolve next time, the address may have moved */
+        close(sock); return -1;
     }
-    freeaddrinfo(res);
     ESP_LOGI(TAG, "Connected to proxy %s:%d", s_proxy_host, s_proxy_port);
 
     char req[256];
@@ -150,34 +350,45 @@ static int open_connect_tunnel(const char *host, int port, int timeout_ms)
         ESP_LOGE(TAG, "Failed to send CONNECT"); close(sock); return -1;
     }
 
-    char line[256];
-    if (sock_read_line(sock, line, sizeof(line), timeout_ms) < 0) {
+    char resp[512];
+    /* The proxy answers once it reached the target: wait for it in slices */
+    if (!wait_sock(sock, false, timeout_ms, cancel) ||
+        proxy_read_connect_response(sock, resp, sizeof(resp), recvs) < 0) {
+        if (is_cancelled(cancel)) { close(sock); return -1; }
         ESP_LOGE(TAG, "No response from proxy"); close(sock); return -1;
     }
-    if (strstr(line, "200") == NULL) {
-        ESP_LOGE(TAG, "CONNECT rejected: %s", line); close(sock); return -1;
+    /* Status line: "HTTP/1.x 200 ..." */
+    const char *sp = strchr(resp, ' ');
+    if (strncmp(resp, "HTTP/", 5) != 0 || !sp || atoi(sp + 1) != 200) {
+        char *eol = strstr(resp, "\r\n");
+        if (eol) *eol = '\0';
+        ESP_LOGE(TAG, "CONNECT rejected: %s", resp); close(sock); return -1;
     }
 
-    /* Consume remaining response headers */
-    while (sock_read_line(sock, line, sizeof(line), timeout_ms) > 0) { }
-
     ESP_LOGI(TAG, "CONNECT tunnel established to %s:%d", host, port);
     return sock;
 }
 
-proxy_conn_t *proxy_conn_open(const char *host, int port, int timeout_ms)
+proxy_conn_t *proxy_conn_open(const char *host, int port, int timeout_ms,
+                              const volatile bool *cancel)
 {
     if (!http_proxy_is_enabled()) {
         ESP_LOGE(TAG, "proxy_conn_open called but no proxy configured");
         return NULL;
     }
 
-    int sock = open_connect_tunnel(host, port, timeout_ms);
+    int64_t t0 = esp_timer_get_time();
+    uint32_t gen = proxy_gen();
+    int recvs = 0;
+    int sock = open_connect_tunnel(host, port, timeout_ms, cancel, &recvs);
     if (sock < 0) return NULL;
 
     proxy_conn_t *conn = calloc(1, sizeof(*conn));
     if (!conn) { close(sock); return NULL; }
     conn->sock = sock;
+    strncpy(conn->host, host, sizeof(conn->host) - 1);
+    conn->port = (uint16_t)port;
+    conn->gen = gen;
 
     /* ── TLS handshake via esp_tls over tunnel ───────────────── */
     conn->tls = esp_tls_init();
@@ -194,22 +405,47 @@ proxy_conn_t *proxy_conn_open(const char *host, int port, int timeout_ms)
         .crt_bundle_attach = esp_crt_bundle_attach,
         .timeout_ms = timeout_ms,
     };
+#ifdef CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+    cfg.client_session = ticket_get(host, port);
+#endif
 
-    int ret = esp_tls_conn_new_sync(host, strlen(host), port, &cfg, conn->tls);
+    int ret;
+    if (!cancel) {
+        ret = esp_tls_conn_new_sync(host, strlen(host), port, &cfg, conn->tls);
+    } else {
+        /* Step by step: on the blocking socket each step waits at most one
+         * SO_RCVTIMEO slice for the server, then returns 0 (in progress) */
+        struct timeval tv = { .tv_sec = 0, .tv_usec = MIMI_HTTP_CANCEL_POLL_MS * 1000 };
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        int64_t until = t0 + (int64_t)timeout_ms * 1000;
+        while ((ret = esp_tls_conn_new_async(host, strlen(host), port, &cfg, conn->tls)) == 0) {
+            if (is_cancelled(cancel) || esp_timer_get_time() > until) break;
+        }
+    }
+#ifdef CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+    ticket_put(host, port, cfg.client_session != NULL, ret > 0 ? conn->tls : NULL);
+#endif
     if (ret <= 0) {
-        ESP_LOGE(TAG, "TLS handshake failed over proxy tunnel");
+        if (!is_cancelled(cancel)) ESP_LOGE(TAG, "TLS handshake failed over proxy tunnel");
         esp_tls_conn_destroy(conn->tls);
         /* esp_tls_conn_destroy closes the socket */
         free(conn);
         return NULL;
     }
 
-    ESP_LOGI(TAG, "TLS handshake OK with %s:%d via proxy", host, port);
+    uint32_t ms = (uint32_t)((esp_timer_get_time() - t0) / 1000);
+    xSemaphoreTake(s_pool_lock, portMAX_DELAY);
+    s_pool_stats.opens++;
+    s_pool_stats.open_ms_total += ms;
+    s_pool_stats.connect_recvs += recvs;
+    xSemaphoreGive(s_pool_lock);
+    ESP_LOGI(TAG, "TLS handshake OK with %s:%d via proxy (%u ms)", host, port, (unsigned)ms);
     return conn;
 }
 
 int proxy_conn_write(proxy_conn_t *conn, const char *data, int len)
 {
+    conn->reusable = false;     /* until its response has been read */
     int written = 0;
     while (written < len) {
         ssize_t ret = esp_tls_conn_write(conn->tls, data + written, len - written);
@@ -231,7 +467,8 @@ int proxy_conn_read(proxy_conn_t *conn, char *buf, int len, int timeout_ms)
     setsockopt(conn->sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
 
     ssize_t ret = esp_tls_conn_read(conn->tls, buf, len);
-    if (ret == ESP_TLS_ERR_SSL_WANT_READ) return 0;
+    /* Blocking socket: WANT_READ only comes from SO_RCVTIMEO expiring */
+    if (ret == ESP_TLS_ERR_SSL_WANT_READ) return PROXY_READ_TIMEOUT;
     if (ret == 0) return 0;
     if (ret < 0) {
         ESP_LOGE(TAG, "esp_tls_conn_read error: %d", (int)ret);
@@ -248,3 +485,154 @@ void proxy_conn_close(proxy_conn_t *conn)
     }
     free(conn);
 }
+
+/* ── Tunnel pool ──────────────────────────────────────────────── */
+
+/* LIFO: the most recently released tunnel is the least likely to be stale */
+static proxy_conn_t *s_idle[MIMI_PROXY_POOL_SIZE];
+static int s_idle_count = 0;
+
+/* An idle tunnel must have nothing to read: EOF means the peer closed it,
+ * and unsolicited bytes (close_notify, a late response) make it unusable. */
+static bool conn_is_alive(proxy_conn_t *conn)
+{
+    if (esp_tls_get_bytes_avail(conn->tls) > 0) return false;
+    char c;
+    int r = recv(conn->sock, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (r >= 0) return false;
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+}
+
+/* Remove s_idle[i] (s_pool_lock held) */
+static proxy_conn_t *idle_take(int i)
+{
+    proxy_conn_t *conn = s_idle[i];
+    memmove(&s_idle[i], &s_idle[i + 1], (s_idle_count - i - 1) * sizeof(s_idle[0]));
+    s_idle_count--;
+    return conn;
+}
+
+proxy_conn_t *proxy_conn_acquire(const char *host, int port, int timeout_ms,
+                                 const volatile bool *cancel)
+{
+    proxy_conn_t *dead[MIMI_PROXY_POOL_SIZE];
+    int ndead = 0;
+    proxy_conn_t *conn = NULL;
+    int64_t now = esp_timer_get_time();
+
+    xSemaphoreTake(s_pool_lock, portMAX_DELAY);
+    for (int i = s_idle_count - 1; i >= 0; i--) {
+        proxy_conn_t *c = s_idle[i];
+        if (c->gen != s_proxy_gen || now - c->idle_since_us > (int64_t)MIMI_PROXY_IDLE_MS * 1000) {
+            s_pool_stats.expired++;
+            dead[ndead++] = idle_take(i);
+        } else if (!conn && c->port == port && strcmp(c->host, host) == 0) {
+            idle_take(i);
+            if (conn_is_alive(c)) {
+                conn = c;
+                s_pool_stats.reuses++;
+            } else {
+                s_pool_stats.stale++;
+                dead[ndead++] = c;
+            }
+        }
+    }
+    xSemaphoreGive(s_pool_lock);
+
+    for (int i = 0; i < ndead; i++) proxy_conn_close(dead[i]);
+    if (conn) {
+        conn->reused = true;
+        ESP_LOGI(TAG, "Reusing tunnel to %s:%d", host, port);
+        return conn;
+    }
+    return proxy_conn_open(host, port, timeout_ms, cancel);
+}
+
+void proxy_conn_release(proxy_conn_t *conn)
+{
+    if (!conn) return;
+    if (!conn->reusable || !http_proxy_is_enabled()) {
+        proxy_conn_close(conn);
+        return;
+    }
+
+    proxy_conn_t *evicted = NULL;
+    conn->idle_since_us = esp_timer_get_time();
+    xSemaphoreTake(s_pool_lock, portMAX_DELAY);
+    if (conn->gen != s_proxy_gen) {
+        evicted = conn;         /* opened through the previous proxy */
+    } else {
+        if (s_idle_count == MIMI_PROXY_POOL_SIZE) evicted = idle_take(0);   /* oldest */
+        s_idle[s_idle_count++] = conn;
+    }
+    xSemaphoreGive(s_pool_lock);
+    proxy_conn_close(evicted);
+}
+
+bool proxy_conn_is_reused(const proxy_conn_t *conn)
+{
+    return conn->reused;
+}
+
+void proxy_pool_flush(void)
+{
+    if (!s_pool_lock) return;
+    proxy_conn_t *dead[MIMI_PROXY_POOL_SIZE];
+    xSemaphoreTake(s_pool_lock, portMAX_DELAY);
+    int ndead = s_idle_count;
+    memcpy(dead, s_idle, ndead * sizeof(dead[0]));
+    s_idle_count = 0;
+    s_proxy_gen++;
+    s_proxy_addr_until_us = 0;
+    tickets_clear();
+    xSemaphoreGive(s_pool_lock);
+    for (int i = 0; i < ndead; i++) proxy_conn_close(dead[i]);
+}
+
+void proxy_pool_get_stats(proxy_pool_stats_t *out)
+{
+    xSemaphoreTake(s_pool_lock, portMAX_DELAY);
+    *out = s_pool_stats;
+    out->idle = (uint8_t)s_idle_count;
+    out->sessions = (uint8_t)tickets_count();
+    xSemaphoreGive(s_pool_lock);
+}
+
+/* ── HTTP/1.1 response reader ─────────────────────────────────── */
+
+#define PROXY_READ_CHUNK  2048
+
+esp_err_t proxy_conn_read_response(proxy_conn_t *conn, proxy_resp_t *r, int timeout_ms,
+                                   const volatile bool *cancel)
+{
+    char buf[PROXY_READ_CHUNK];
+    bool got_any = false;
+    int quiet_ms = 0;           /* since the last byte */
+    int slice = (cancel && timeout_ms > MIMI_HTTP_CANCEL_POLL_MS)
+        ? MIMI_HTTP_CANCEL_POLL_MS : timeout_ms;
+    conn->reusable = false;
+    while (!proxy_resp_done(r)) {
+        int n = proxy_conn_read(conn, buf, sizeof(buf), slice);
+        if (n == PROXY_READ_TIMEOUT) {
+            /* Silence is not an end of body: the server may still be working */
+            quiet_ms += slice;
+            if (is_cancelled(cancel)) return ESP_ERR_NOT_FINISHED;
+            if (quiet_ms < timeout_ms) continue;
+            return ESP_ERR_TIMEOUT;
+        }
+        quiet_ms = 0;
+        if (n <= 0) {
+            /* End of connection: only complete for a close-delimited body */
+            if (r->state == PROXY_RESP_BODY && r->content_len < 0 && !r->chunked) {
+                r->state = PROXY_RESP_DONE;
+                return ESP_OK;
+            }
+            return got_any ? ESP_ERR_HTTP_INCOMPLETE_DATA : ESP_ERR_HTTP_CONNECTION_CLOSED;
+        }
+        got_any = true;
+        esp_err_t err = proxy_resp_feed(r, buf, n);
+        if (err != ESP_OK) return err;
+    }
+    conn->reusable = r->keep_alive;
+    return ESP_OK;
+}
@@ -2,7 +2,9 @@
 
 #include "esp_err.h"
 #include <stddef.h>
+#include <stdint.h>
 #include <stdbool.h>
+#include "proxy/proxy_resp.h"
 
 /**
  * Initialize proxy module.
@@ -34,15 +36,88 @@ typedef struct proxy_conn proxy_conn_t;
  * 2) Send HTTP CONNECT to target host:port
  * 3) TLS handshake over the tunnel
  *
+ * cancel: or NULL; once set by another task, the waits of each step give up
+ * within MIMI_HTTP_CANCEL_POLL_MS.
  * Returns NULL on failure.
  */
-proxy_conn_t *proxy_conn_open(const char *host, int port, int timeout_ms);
+proxy_conn_t *proxy_conn_open(const char *host, int port, int timeout_ms,
+                              const volatile bool *cancel);
 
 /** Write raw bytes through the TLS tunnel. Returns bytes written or -1. */
 int proxy_conn_write(proxy_conn_t *conn, const char *data, int len);
 
-/** Read raw bytes from the TLS tunnel. Returns bytes read or -1. */
+#define PROXY_READ_TIMEOUT  (-2)
+
+/**
+ * Read raw bytes from the TLS tunnel.
+ * @return bytes read, 0 once the server closed the tunnel, PROXY_READ_TIMEOUT
+ *         if nothing arrived within timeout_ms, -1 on error (reset)
+ */
 int proxy_conn_read(proxy_conn_t *conn, char *buf, int len, int timeout_ms);
 
 /** Close and free the connection. */
 void proxy_conn_close(proxy_conn_t *conn);
+
+/* ── Tunnel pool ──────────────────────────────────────────────── */
+
+/*
+ * Idle tunnels are kept per host:port for MIMI_PROXY_IDLE_MS, so back-to-back
+ * requests skip DNS, CONNECT and the TLS handshake. A tunnel is only pooled
+ * after a response was read to its end with keep-alive allowed. When a new
+ * tunnel is needed, the host's cached TLS session ticket (if any) is offered
+ * for an abbreviated handshake.
+ */
+
+typedef struct {
+    uint32_t opens;         /* new tunnels (CONNECT + TLS handshake) */
+    uint32_t ticket_offers; /* handshakes that offered a cached session ticket */
+    uint32_t reuses;        /* acquires served by an idle tunnel */
+    uint32_t stale;         /* idle tunnels found closed by the peer */
+    uint32_t expired;       /* idle tunnels closed after MIMI_PROXY_IDLE_MS */
+    uint32_t open_ms_total; /* time spent opening tunnels (DNS to TLS done) */
+    uint32_t dns_lookups;   /* proxy address resolved */
+    uint32_t dns_hits;      /* proxy address taken from the cache */
+    uint32_t connect_recvs; /* recv calls spent on CONNECT responses */
+    uint8_t  idle;          /* tunnels in the pool now */
+    uint8_t  sessions;      /* hosts with a cached ticket */
+} proxy_pool_stats_t;
+
+/**
+ * Take a healthy idle tunnel to host:port, or open a new one (see proxy_conn_open).
+ * Returns NULL on failure.
+ */
+proxy_conn_t *proxy_conn_acquire(const char *host, int port, int timeout_ms,
+                                 const volatile bool *cancel);
+
+/**
+ * Give the tunnel back: pooled if its last response completed with
+ * keep-alive, closed otherwise.
+ */
+void proxy_conn_release(proxy_conn_t *conn);
+
+/** True if the tunnel came from the pool (it may have gone stale meanwhile). */
+bool proxy_conn_is_reused(const proxy_conn_t *conn);
+
+/**
+ * Close every idle tunnel and forget the session tickets. Tunnels in use are
+ * closed when released instead of going back to the pool.
+ */
+void proxy_pool_flush(void);
+
+void proxy_pool_get_stats(proxy_pool_stats_t *out);
+
+/* ── HTTP/1.1 response reader ─────────────────────────────────── */
+
+/**
+ * Read from conn into r until the response is complete, waiting at most
+ * timeout_ms for each read. A body without length ends when the server
+ * closes the connection. cancel: or NULL, checked every MIMI_HTTP_CANCEL_POLL_MS
+ * while no byte arrives.
+ * @return ESP_OK when complete, ESP_ERR_HTTP_CONNECTION_CLOSED if the
+ *         connection ended (closed or reset) before any response byte,
+ *         ESP_ERR_HTTP_INCOMPLETE_DATA if it ended later, ESP_ERR_TIMEOUT if
+ *         the server went quiet for timeout_ms, ESP_ERR_NOT_FINISHED once
+ *         *cancel was set, or the on_body error
+ */
+esp_err_t proxy_conn_read_response(proxy_conn_t *conn, proxy_resp_t *r, int timeout_ms,
+                                   const volatile bool *cancel);
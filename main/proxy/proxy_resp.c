@@ -0,0 +1,152 @@
+#include "proxy_resp.h"
+
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+
+void proxy_resp_init(proxy_resp_t *r, const proxy_resp_cb_t *cb, bool head)
+{
+    memset(r, 0, sizeof(*r));
+    if (cb) r->cb = *cb;
+    r->head = head;
+    r->content_len = -1;
+    r->state = PROXY_RESP_STATUS;
+}
+
+/* Blank line after the headers: pick the body framing (RFC 9112 6.3) */
+static void resp_headers_done(proxy_resp_t *r)
+{
+    if (r->status >= 100 && r->status < 200) {
+        /* Interim response (100 Continue): the real one follows */
+        proxy_resp_cb_t cb = r->cb;
+        proxy_resp_init(r, &cb, r->head);
+        return;
+    }
+    if (r->head || r->status == 204 || r->status == 304) {
+        r->state = PROXY_RESP_DONE;
+    } else if (r->chunked) {
+        r->state = PROXY_RESP_CHUNK_SIZE;
+    } else if (r->content_len >= 0) {
+        r->left = (size_t)r->content_len;
+        r->state = r->left ? PROXY_RESP_BODY : PROXY_RESP_DONE;
+    } else {
+        r->keep_alive = false;      /* delimited by close */
+        r->state = PROXY_RESP_BODY;
+    }
+}
+
+static void resp_on_line(proxy_resp_t *r)
+{
+    char *line = r->line;
+    switch (r->state) {
+    case PROXY_RESP_STATUS:
+        if (strncmp(line, "HTTP/", 5) == 0) {
+            const char *sp = strchr(line, ' ');
+            if (sp) r->status = atoi(sp + 1);
+            r->keep_alive = (strncmp(line, "HTTP/1.1", 8) == 0);
+            if (r->cb.on_status) r->cb.on_status(r->cb.ctx, r->status);
+        }
+        r->state = PROXY_RESP_HEADERS;
+        break;
+    case PROXY_RESP_HEADERS: {
+        if (line[0] == '\0') {
+            resp_headers_done(r);
+            break;
+        }
+        char *colon = strchr(line, ':');
+        if (!colon) break;
+        *colon = '\0';
+        const char *value = colon + 1;
+        while (*value == ' ' || *value == '\t') value++;
+
+        if (strcasecmp(line, "Transfer-Encoding") == 0) {
+            r->chunked = (strcasestr(value, "chunked") != NULL);
+        } else if (strcasecmp(line, "Content-Length") == 0) {
+            r->content_len = atol(value);
+        } else if (strcasecmp(line, "Connection") == 0) {
+            if (strcasestr(value, "close")) r->keep_alive = false;
+        } else if (r->cb.on_header) {
+            r->cb.on_header(r->cb.ctx, line, value);
+        }
+        break;
+    }
+    case PROXY_RESP_CHUNK_SIZE:
+        r->left = strtoul(line, NULL, 16);     /* chunk extensions ignored */
+        r->state = r->left ? PROXY_RESP_CHUNK_DATA : PROXY_RESP_TRAILERS;
+        break;
+    case PROXY_RESP_CHUNK_END:
+        r->state = PROXY_RESP_CHUNK_SIZE;
+        break;
+    case PROXY_RESP_TRAILERS:
+        if (line[0] == '\0') r->state = PROXY_RESP_DONE;
+        break;
+    default:
+        break;
+    }
+}
+
+esp_err_t proxy_resp_feed(proxy_resp_t *r, const char *data, size_t len)
+{
+    size_t pos = 0;
+    while (pos < len && r->state != PROXY_RESP_DONE) {
+        if (r->state == PROXY_RESP_BODY || r->state == PROXY_RESP_CHUNK_DATA) {
+            size_t n = len - pos;
+            bool bounded = (r->state == PROXY_RESP_CHUNK_DATA || r->content_len >= 0);
+            if (bounded && n > r->left) n = r->left;
+            if (r->cb.on_body) {
+                esp_err_t err = r->cb.on_body(r->cb.ctx, data + pos, n);
+                if (err != ESP_OK) return err;
+            }
+            pos += n;
+            if (bounded) {
+                r->left -= n;
+                if (r->left == 0) {
+                    r->state = (r->state == PROXY_RESP_CHUNK_DATA)
+                        ? PROXY_RESP_CHUNK_END : PROXY_RESP_DONE;
+                }
+            }
+            continue;
+        }
+
+        /* Line-oriented states */
+        char c = data[pos++];
+        if (c == '\n') {
+            if (r->line_len > 0 && r->line[r->line_len - 1] == '\r') r->line_len--;
+            r->line[r->line_len] = '\0';
+            resp_on_line(r);
+            r->line_len = 0;
+        } else if (r->line_len < sizeof(r->line) - 1) {
+            r->line[r->line_len++] = c;
+        }
+    }
+    return ESP_OK;
+}
+
+/* ── CONNECT response ─────────────────────────────────────────── */
+
+/* Up to the blank line everything belongs to the proxy's response, so what a
+ * peek shows is consumed in one recv; the tunnel bytes after it are left in
+ * the socket for the TLS layer. */
+int proxy_read_connect_response(int fd, char *buf, int max, int *recvs)
+{
+    int len = 0;
+    while (len < max - 1) {
+        int n = recv(fd, buf + len, max - 1 - len, MSG_PEEK);
+        if (n <= 0) return -1;
+        buf[len + n] = '\0';
+
+        /* The terminator may straddle the previous pass */
+        int from = len > 3 ? len - 3 : 0;
+        char *end = strstr(buf + from, "\r\n\r\n");
+        int take = end ? (int)(end + 4 - (buf + len)) : n;
+        if (recv(fd, buf + len, take, 0) != take) return -1;
+        len += take;
+        *recvs += 2;
+        if (end) {
+            buf[len] = '\0';
+            return len;
+        }
+    }
+    return -1;      /* headers larger than buf */
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * Incremental response framing for requests sent over a tunnel: status line,
+ * headers, then a body delimited by Content-Length, chunked encoding or the
+ * end of the connection. The caller knows the response is over as soon as
+ * the last body byte arrives instead of waiting for the server to close.
+ * TLS and the tunnel pool stay in http_proxy.c; the CONNECT reader below
+ * only needs a plain socket, so all of this also runs on Linux.
+ */
+
+typedef struct {
+    void (*on_status)(void *ctx, int status);
+    /* Not called for Content-Length, Transfer-Encoding and Connection */
+    void (*on_header)(void *ctx, const char *key, const char *value);
+    esp_err_t (*on_body)(void *ctx, const char *data, size_t len);
+    void *ctx;
+} proxy_resp_cb_t;                  /* every callback is optional */
+
+typedef enum {
+    PROXY_RESP_STATUS, PROXY_RESP_HEADERS, PROXY_RESP_CHUNK_SIZE, PROXY_RESP_CHUNK_DATA,
+    PROXY_RESP_CHUNK_END, PROXY_RESP_TRAILERS, PROXY_RESP_BODY, PROXY_RESP_DONE,
+} proxy_resp_state_t;
+
+typedef struct {
+    proxy_resp_cb_t cb;
+    int    status;
+    bool   head;            /* response to HEAD: no body whatever the headers say */
+    bool   chunked;
+    bool   keep_alive;      /* HTTP/1.1 without "Connection: close" */
+    long   content_len;     /* -1: not given */
+    proxy_resp_state_t state;
+    size_t left;            /* bytes left in the current chunk / body */
+    size_t line_len;
+    char   line[256];       /* longer header lines are truncated */
+} proxy_resp_t;
+
+void proxy_resp_init(proxy_resp_t *r, const proxy_resp_cb_t *cb, bool head);
+
+/**
+ * Feed received bytes. Stops at the end of the response; bytes past it
+ * are ignored.
+ * @return ESP_OK, or the first error returned by on_body
+ */
+esp_err_t proxy_resp_feed(proxy_resp_t *r, const char *data, size_t len);
+
+static inline bool proxy_resp_done(const proxy_resp_t *r)
+{
+    return r->state == PROXY_RESP_DONE;
+}
+
+/* ── CONNECT response ─────────────────────────────────────────── */
+
+/**
+ * Read the proxy's answer to CONNECT from fd into buf (NUL-terminated, CR-LF
+ * kept), two recv calls per pass (peek, then consume), never reading past
+ * the blank line. recvs is incremented by the recv calls made.
+ * @return the header length, or -1 on error, close or headers larger than buf
+ */
+int proxy_read_connect_response(int fd, char *buf, int max, int *recvs);
@@ -1,8 +1,11 @@
 #include "telegram_bot.h"
 #include "mimi_config.h"
 #include "bus/message_bus.h"
-#include "proxy/http_proxy.h"
+#include "http/http_client.h"
+#include "pool/buf_pool.h"
 #include "ota/ota_manager.h"
+#include "agent/agent_loop.h"
+#include "perf/perf_trace.h"
 #ifdef MIMI_HAS_DISPLAY
 #include "power/sleep_manager.h"
 #include "display/display_ui.h"
@@ -13,9 +16,6 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_log.h"
-#include "esp_http_client.h"
-#include "esp_crt_bundle.h"
-#include "esp_heap_caps.h"
 #include "nvs.h"
 #include "cJSON.h"
 
@@ -24,155 +24,30 @@ static const char *TAG = "telegram";
 static char s_bot_token[128] = MIMI_SECRET_TG_TOKEN;
 static int64_t s_update_offset = 0;
 
-/* HTTP response accumulator */
-typedef struct {
-    char *buf;
-    size_t len;
-    size_t cap;
-} http_resp_t;
-
-static esp_err_t http_event_handler(esp_http_client_event_t *evt)
-{
-    http_resp_t *resp = (http_resp_t *)evt->user_data;
-    if (evt->event_id == HTTP_EVENT_ON_DATA) {
-        if (resp->len + evt->data_len >= resp->cap) {
-            size_t new_cap = resp->cap * 2;
-            if (new_cap < resp->len + evt->data_len + 1) {
-                new_cap = resp->len + evt->data_len + 1;
-            }
-            char *tmp = heap_caps_realloc(resp->buf, new_cap, MALLOC_CAP_SPIRAM);
-            if (!tmp) return ESP_ERR_NO_MEM;
-            resp->buf = tmp;
-            resp->cap = new_cap;
-        }
-        memcpy(resp->buf + resp->len, evt->data, evt->data_len);
-        resp->len += evt->data_len;
-        resp->buf[resp->len] = '\0';
-    }
-    return ESP_OK;
-}
-
-/* ── Proxy path: manual HTTP over CONNECT tunnel ────────────── */
-
-static char *tg_api_call_via_proxy(const char *path, const char *post_data)
-{
-    proxy_conn_t *conn = proxy_conn_open("api.telegram.org", 443,
-                                          (MIMI_TG_POLL_TIMEOUT_S + 5) * 1000);
-    if (!conn) return NULL;
-
-    /* Build HTTP request */
-    char header[512];
-    int hlen;
-    if (post_data) {
-        hlen = snprintf(header, sizeof(header),
-            "POST /bot%s/%s HTTP/1.1\r\n"
-            "Host: api.telegram.org\r\n"
-            "Content-Type: application/json\r\n"
-            "Content-Length: %d\r\n"
-            "Connection: close\r\n\r\n",
-            s_bot_token, path, (int)strlen(post_data));
-    } else {
-        hlen = snprintf(header, sizeof(header),
-            "GET /bot%s/%s HTTP/1.1\r\n"
-            "Host: api.telegram.org\r\n"
-            "Connection: close\r\n\r\n",
-            s_bot_token, path);
-    }
-
-    if (proxy_conn_write(conn, header, hlen) < 0) {
-        proxy_conn_close(conn);
-        return NULL;
-    }
-    if (post_data && proxy_conn_write(conn, post_data, strlen(post_data)) < 0) {
-        proxy_conn_close(conn);
-        return NULL;
-    }
-
-    /* Read response — accumulate until connection close */
-    size_t cap = 4096, len = 0;
-    char *buf = heap_caps_calloc(1, cap, MALLOC_CAP_SPIRAM);
-    if (!buf) { proxy_conn_close(conn); return NULL; }
-
-    int timeout = (MIMI_TG_POLL_TIMEOUT_S + 5) * 1000;
-    while (1) {
-        if (len + 1024 >= cap) {
-            cap *= 2;
-            char *tmp = heap_caps_realloc(buf, cap, MALLOC_CAP_SPIRAM);
-            if (!tmp) break;
-            buf = tmp;
-        }
-        int n = proxy_conn_read(conn, buf + len, cap - len - 1, timeout);
-        if (n <= 0) break;
-        len += n;
-    }
-    buf[len] = '\0';
-    proxy_conn_close(conn);
-
-    /* Skip HTTP headers — find \r\n\r\n */
-    char *body = strstr(buf, "\r\n\r\n");
-    if (!body) { free(buf); return NULL; }
-    body += 4;
-
-    /* Return just the body */
-    char *result = strdup(body);
-    free(buf);
-    return result;
-}
-
-/* ── Direct path: esp_http_client ───────────────────────────── */
-
-static char *tg_api_call_direct(const char *method, const char *post_data)
+/* On success out holds the response body; release it with buf_pool_release() */
+static esp_err_t tg_api_call(const char *method, const char *post_data, buf_lease_t *out)
 {
-    char url[256];
-    snprintf(url, sizeof(url), "https://api.telegram.org/bot%s/%s", s_bot_token, method);
-
-    http_resp_t resp = {
-        .buf = heap_caps_calloc(1, 4096, MALLOC_CAP_SPIRAM),
-        .len = 0,
-        .cap = 4096,
-    };
-    if (!resp.buf) return NULL;
-
-    esp_http_client_config_t config = {
-        .url = url,
-        .event_handler = http_event_handler,
-        .user_data = &resp,
+    char path[320];
+    snprintf(path, sizeof(path), "/bot%s/%s", s_bot_token, method);
+
+    http_req_t req = {
+        .method = post_data ? "POST" : "GET",
+        .host = "api.telegram.org",
+        .path = path,
+        .body = post_data,
+        .body_len = post_data ? strlen(post_data) : 0,
+        .accept_gzip = true,
         .timeout_ms = (MIMI_TG_POLL_TIMEOUT_S + 5) * 1000,
-        .buffer_size = 2048,
-        .buffer_size_tx = 2048,
-        .crt_bundle_attach = esp_crt_bundle_attach,
     };
+    if (post_data) req.headers[0] = (http_header_t){ "Content-Type", "application/json" };
 
-    esp_http_client_handle_t client = esp_http_client_init(&config);
-    if (!client) {
-        free(resp.buf);
-        return NULL;
-    }
-
-    if (post_data) {
-        esp_http_client_set_method(client, HTTP_METHOD_POST);
-        esp_http_client_set_header(client, "Content-Type", "application/json");
-        esp_http_client_set_post_field(client, post_data, strlen(post_data));
-    }
-
-    esp_err_t err = esp_http_client_perform(client);
-    esp_http_client_cleanup(client);
-
+    if (buf_pool_acquire(out, 4096) != ESP_OK) return ESP_ERR_NO_MEM;
+    esp_err_t err = http_client_fetch(&req, out, NULL);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "HTTP request failed: %s", esp_err_to_name(err));
-        free(resp.buf);
-        return NULL;
+        buf_pool_release(out);
     }
-
-    return resp.buf;
-}
-
-static char *tg_api_call(const char *method, const char *post_data)
-{
-    if (http_proxy_is_enabled()) {
-        return tg_api_call_via_proxy(method, post_data);
-    }
-    return tg_api_call_direct(method, post_data);
+    return err;
 }
 
 static void process_updates(const char *json_str)
@@ -230,6 +105,12 @@ static void process_updates(const char *json_str)
             continue;
         }
 
+        if (strcmp(text->valuestring, "/stop") == 0) {
+            telegram_send_message(chat_id_str, agent_loop_cancel(chat_id_str)
+                                  ? "Stopped." : "Nothing to stop.");
+            continue;
+        }
+
         if (strcmp(text->valuestring, "/update") == 0) {
             telegram_send_message(chat_id_str, "Checking for updates...");
             ota_update_info_t info;
@@ -290,10 +171,15 @@ static void telegram_poll_task(void *arg)
                  "getUpdates?offset=%" PRId64 "&timeout=%d",
                  s_update_offset, MIMI_TG_POLL_TIMEOUT_S);
 
-        char *resp = tg_api_call(params, NULL);
-        if (resp) {
-            process_updates(resp);
-            free(resp);
+        buf_lease_t resp;
+        perf_span_t span = perf_begin(PERF_TG_POLL);
+        esp_err_t err = tg_api_call(params, NULL, &resp);
+        perf_end(span);
+        if (err == ESP_OK) {
+            span = perf_begin(PERF_TG_UPDATES);
+            process_updates(resp.data);
+            perf_end(span);
+            buf_pool_release(&resp);
         } else {
             /* Back off on error */
             vTaskDelay(pdMS_TO_TICKS(3000));
@@ -374,17 +260,18 @@ esp_err_t telegram_send_message(const char *chat_id, const char *text)
         free(segment);
 
         if (json_str) {
-            char *resp = tg_api_call("sendMessage", json_str);
+            buf_lease_t resp;
+            esp_err_t call_err = tg_api_call("sendMessage", json_str, &resp);
             free(json_str);
-            if (resp) {
+            if (call_err == ESP_OK) {
                 /* Check for Markdown parse error, retry as plain text */
-                cJSON *root = cJSON_Parse(resp);
+                cJSON *root = cJSON_Parse(resp.data);
                 if (root) {
                     cJSON *ok_field = cJSON_GetObjectItem(root, "ok");
                     if (!cJSON_IsTrue(ok_field)) {
                         ESP_LOGW(TAG, "Markdown send failed, retrying plain");
                         cJSON_Delete(root);
-                        free(resp);
+                        buf_pool_release(&resp);
 
                         /* Retry without parse_mode */
                         cJSON *body2 = cJSON_CreateObject();
@@ -399,16 +286,18 @@ esp_err_t telegram_send_message(const char *chat_id, const char *text)
                         char *json2 = cJSON_PrintUnformatted(body2);
                         cJSON_Delete(body2);
                         if (json2) {
-                            char *resp2 = tg_api_call("sendMessage", json2);
+                            buf_lease_t resp2;
+                            if (tg_api_call("sendMessage", json2, &resp2) == ESP_OK) {
+                                buf_pool_release(&resp2);
+                            }
                             free(json2);
-                            free(resp2);
                         }
                     } else {
                         cJSON_Delete(root);
-                        free(resp);
+                        buf_pool_release(&resp);
                     }
                 } else {
-                    free(resp);
+                    buf_pool_release(&resp);
                 }
             }
         }
@@ -419,6 +308,24 @@ esp_err_t telegram_send_message(const char *chat_id, const char *text)
     return ESP_OK;
 }
 
+esp_err_t telegram_send_typing(const char *chat_id)
+{
+    if (s_bot_token[0] == '\0') return ESP_ERR_INVALID_STATE;
+
+    cJSON *body = cJSON_CreateObject();
+    cJSON_AddStringToObject(body, "chat_id", chat_id);
+    cJSON_AddStringToObject(body, "action", "typing");
+    char *json_str = cJSON_PrintUnformatted(body);
+    cJSON_Delete(body);
+    if (!json_str) return ESP_ERR_NO_MEM;
+
+    buf_lease_t resp;
+    esp_err_t err = tg_api_call("sendChatAction", json_str, &resp);
+    free(json_str);
+    if (err == ESP_OK) buf_pool_release(&resp);
+    return err;
+}
+
 esp_err_t telegram_set_token(const char *token)
 {
     nvs_handle_t nvs;
@@ -20,6 +20,12 @@ esp_err_t telegram_bot_start(void);
  */
 esp_err_t telegram_send_message(const char *chat_id, const char *text);
 
+/**
+ * Show "typing..." in a chat (sendChatAction). Telegram clears it after
+ * 5 s or when the next message arrives.
+ */
+esp_err_t telegram_send_typing(const char *chat_id);
+
 /**
  * Save the Telegram bot token to NVS.
  */
@@ -3,6 +3,7 @@
 #include "tools/tool_get_time.h"
 #include "tools/tool_files.h"
 #include "tools/tool_ota.h"
+#include "perf/perf_trace.h"
 #ifdef MIMI_HAS_SERVOS
 #include "tools/tool_servo.h"
 #include "tools/tool_perception.h"
@@ -69,6 +70,7 @@ esp_err_t tool_registry_init(void)
             "\"properties\":{\"query\":{\"type\":\"string\",\"description\":\"The search query\"}},"
             "\"required\":[\"query\"]}",
         .execute = tool_web_search_execute,
+        .parallel_safe = true,
     };
     register_tool(&ws);
 
@@ -81,6 +83,7 @@ esp_err_t tool_registry_init(void)
             "\"properties\":{},"
             "\"required\":[]}",
         .execute = tool_get_time_execute,
+        .parallel_safe = true,
     };
     register_tool(&gt);
 
@@ -93,6 +96,7 @@ esp_err_t tool_registry_init(void)
             "\"properties\":{\"path\":{\"type\":\"string\",\"description\":\"Absolute path starting with /spiffs/\"}},"
             "\"required\":[\"path\"]}",
         .execute = tool_read_file_execute,
+        .parallel_safe = true,
     };
     register_tool(&rf);
 
@@ -132,6 +136,7 @@ esp_err_t tool_registry_init(void)
             "\"properties\":{\"prefix\":{\"type\":\"string\",\"description\":\"Optional path prefix filter, e.g. /spiffs/memory/\"}},"
             "\"required\":[]}",
         .execute = tool_list_dir_execute,
+        .parallel_safe = true,
     };
     register_tool(&ld);
 
@@ -144,6 +149,7 @@ esp_err_t tool_registry_init(void)
             "\"properties\":{},"
             "\"required\":[]}",
         .execute = tool_check_update_execute,
+        .parallel_safe = true,
     };
     register_tool(&cu);
 
@@ -264,7 +270,10 @@ esp_err_t tool_registry_execute(const char *name, const char *input_json,
     for (int i = 0; i < s_tool_count; i++) {
         if (strcmp(s_tools[i].name, name) == 0) {
             ESP_LOGI(TAG, "Executing tool: %s", name);
-            return s_tools[i].execute(input_json, output, output_size);
+            perf_span_t span = perf_begin(PERF_TOOL);
+            esp_err_t err = s_tools[i].execute(input_json, output, output_size);
+            perf_end(span);
+            return err;
         }
     }
 
@@ -272,3 +281,11 @@ esp_err_t tool_registry_execute(const char *name, const char *input_json,
     snprintf(output, output_size, "Error: unknown tool '%s'", name);
     return ESP_ERR_NOT_FOUND;
 }
+
+bool tool_registry_is_parallel_safe(const char *name)
+{
+    for (int i = 0; i < s_tool_count; i++) {
+        if (strcmp(s_tools[i].name, name) == 0) return s_tools[i].parallel_safe;
+    }
+    return false;
+}
@@ -0,0 +1,119 @@
+#include "tool_runner.h"
+#include "tool_registry.h"
+#include "mimi_config.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+
+static const char *TAG = "tool_run";
+
+typedef struct {
+    tool_job_t       *job;
+    SemaphoreHandle_t done;     /* given once the job is finished */
+} work_item_t;
+
+static QueueHandle_t s_work = NULL;
+static SemaphoreHandle_t s_serial = NULL;   /* other calls: one at a time, across agent workers */
+
+static void run_job(tool_job_t *job, char *buf, size_t size)
+{
+    buf[0] = '\0';
+    tool_registry_execute(job->name, job->input, buf, size);
+    job->output = strdup(buf);
+}
+
+static void tool_worker_task(void *arg)
+{
+    char *buf = (char *)arg;    /* own output buffer, PSRAM */
+    work_item_t item;
+
+    while (1) {
+        if (xQueueReceive(s_work, &item, portMAX_DELAY) != pdTRUE) continue;
+        run_job(item.job, buf, MIMI_TOOL_OUTPUT_SIZE);
+        xSemaphoreGive(item.done);
+    }
+}
+
+esp_err_t tool_runner_init(void)
+{
+    s_work = xQueueCreate(MIMI_TOOL_WORKERS * 2, sizeof(work_item_t));
+    s_serial = xSemaphoreCreateMutex();
+    if (!s_work || !s_serial) return ESP_ERR_NO_MEM;
+
+    for (int i = 0; i < MIMI_TOOL_WORKERS; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "tool_w%d", i);
+        char *buf = heap_caps_calloc(1, MIMI_TOOL_OUTPUT_SIZE, MALLOC_CAP_SPIRAM);
+        if (!buf || xTaskCreatePinnedToCore(tool_worker_task, name, MIMI_TOOL_WORKER_STACK, buf,
+                                            MIMI_TOOL_WORKER_PRIO, NULL,
+                                            MIMI_TOOL_WORKER_CORE) != pdPASS) {
+            ESP_LOGE(TAG, "Failed to start tool worker %d", i);
+            free(buf);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    ESP_LOGI(TAG, "Tool runner initialized (%d workers)", MIMI_TOOL_WORKERS);
+    return ESP_OK;
+}
+
+/* Parallel-safe calls: all but the first go to the workers, the first runs
+ * here. A full queue just means running that one here as well.
+ * Returns how many ran on a worker. */
+static int run_group(tool_job_t *jobs, int count, char *scratch, size_t scratch_size)
+{
+    SemaphoreHandle_t done = (count > 1) ? xSemaphoreCreateCounting(count, 0) : NULL;
+    if (!done) {
+        for (int i = 0; i < count; i++) run_job(&jobs[i], scratch, scratch_size);
+        return 0;
+    }
+
+    int queued = 0;
+    for (int i = 1; i < count; i++) {
+        work_item_t item = { .job = &jobs[i], .done = done };
+        if (xQueueSend(s_work, &item, 0) == pdTRUE) {
+            queued++;
+        } else {
+            run_job(&jobs[i], scratch, scratch_size);
+        }
+    }
+    run_job(&jobs[0], scratch, scratch_size);
+
+    for (int i = 0; i < queued; i++) xSemaphoreTake(done, portMAX_DELAY);
+    vSemaphoreDelete(done);
+    return queued;
+}
+
+void tool_runner_run(tool_job_t *jobs, int count, char *scratch, size_t scratch_size)
+{
+    int64_t t0 = esp_timer_get_time();
+    int on_workers = 0;
+
+    for (int i = 0; i < count; ) {
+        /* Longest run of parallel-safe calls from i; anything else runs alone */
+        if (!s_work || !tool_registry_is_parallel_safe(jobs[i].name)) {
+            if (s_serial) xSemaphoreTake(s_serial, portMAX_DELAY);
+            run_job(&jobs[i], scratch, scratch_size);
+            if (s_serial) xSemaphoreGive(s_serial);
+            i++;
+            continue;
+        }
+        int n = 1;
+        while (i + n < count && tool_registry_is_parallel_safe(jobs[i + n].name)) n++;
+        on_workers += run_group(&jobs[i], n, scratch, scratch_size);
+        i += n;
+    }
+
+    if (count > 1) {
+        ESP_LOGI(TAG, "%d tool calls in %d ms (%d on workers)", count,
+                 (int)((esp_timer_get_time() - t0) / 1000), on_workers);
+    }
+}
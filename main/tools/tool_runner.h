@@ -0,0 +1,29 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stddef.h>
+
+/*
+ * Runs the tool calls of one LLM response. Consecutive parallel-safe calls
+ * (mimi_tool_t.parallel_safe) run at the same time: the first on the calling
+ * task, the others on a small pool of worker tasks, each with its own output
+ * buffer. Any other call waits for the calls before it and runs alone (one
+ * such call at a time across all agent workers), so servo, display and
+ * sensor tools and file writes keep their order.
+ */
+
+typedef struct {
+    const char *name;
+    const char *input;      /* JSON */
+    char       *output;     /* set by tool_runner_run(): heap string for the caller to free,
+                               NULL if out of memory */
+} tool_job_t;
+
+/** Create the worker tasks (after tool_registry_init). */
+esp_err_t tool_runner_init(void);
+
+/**
+ * Run jobs[0..count) and fill in their outputs, in the original order.
+ * scratch is the caller's output buffer for the calls it runs itself.
+ */
+void tool_runner_run(tool_job_t *jobs, int count, char *scratch, size_t scratch_size);
@@ -0,0 +1,147 @@
+#!/usr/bin/env python3
+"""Turn a MimiClaw trace dump into a Chrome/Perfetto trace file.
+
+The device exports its recent spans (perf/perf_trace.c) as Chrome Trace
+Event JSON, either on the serial console:
+
+    mimi> perf -t 10
+
+or over the WebSocket gateway, by sending {"type":"trace","seconds":10}.
+
+Input is a serial capture (anything around the "--- trace begin/end ---"
+markers is ignored, and log lines that got interleaved with the dump are
+dropped) or a saved WebSocket frame. With --ws the trace is fetched
+directly (needs `pip install websocket-client`).
+
+The output opens in https://ui.perfetto.dev or chrome://tracing: one
+process per core, one track per task. A per-core busy summary is printed
+to spot contention between the Core 0 tasks.
+
+Usage:
+    trace_to_perfetto.py capture.log [-o trace.json]
+    trace_to_perfetto.py --ws ws://192.168.1.42:18789/ [--seconds 10] [-o trace.json]
+"""
+
+import argparse
+import json
+import re
+import sys
+from collections import defaultdict
+
+BEGIN = "--- trace begin ---"
+END = "--- trace end ---"
+
+# ESP-IDF log lines, possibly colored, possibly cut into the middle of a dump line
+LOG_LINE = re.compile(r"(?:\x1b\[[0-9;]*m)?[EWIDV] \(\d+\) [^:\n]+:[^\n]*?(?:\x1b\[0m)?\r?\n")
+ANSI = re.compile(r"\x1b\[[0-9;]*m")
+
+
+def extract(text):
+    """The trace JSON object found in a serial capture or a WS frame."""
+    start = text.rfind(BEGIN)
+    if start >= 0:
+        end = text.find(END, start)
+        if end < 0:
+            sys.exit("error: trace end marker missing, capture cut short?")
+        text = text[start + len(BEGIN):end]
+    text = LOG_LINE.sub("", text)
+    text = ANSI.sub("", text).strip()
+    try:
+        return json.loads(text)
+    except json.JSONDecodeError as e:
+        sys.exit(f"error: not a trace dump ({e})")
+
+
+def fetch_ws(url, seconds):
+    try:
+        import websocket  # websocket-client
+    except ImportError:
+        sys.exit("error: --ws needs `pip install websocket-client`")
+    ws = websocket.create_connection(url, timeout=15)
+    try:
+        ws.send(json.dumps({"type": "trace", "seconds": seconds}))
+        while True:
+            frame = ws.recv()
+            msg = json.loads(frame)
+            if msg.get("type") == "trace":
+                return msg
+    finally:
+        ws.close()
+
+
+def summarize(trace):
+    events = trace.get("traceEvents", [])
+    procs, threads = {}, {}
+    for ev in events:
+        if ev.get("ph") != "M":
+            continue
+        if ev["name"] == "process_name":
+            procs[ev["pid"]] = ev["args"]["name"]
+        elif ev["name"] == "thread_name":
+            threads[(ev["pid"], ev["tid"])] = ev["args"]["name"]
+
+    spans = [ev for ev in events if ev.get("ph") == "X"]
+    if not spans:
+        print("No spans in the trace window.")
+        return
+    t0 = min(ev["ts"] for ev in spans)
+    t1 = max(ev["ts"] + ev["dur"] for ev in spans)
+    window = max(t1 - t0, 1)
+
+    # Busy time per task: union of its spans (nested phases counted once)
+    per_thread = defaultdict(list)
+    phases = defaultdict(lambda: [0, 0])
+    for ev in spans:
+        per_thread[(ev["pid"], ev["tid"])].append((ev["ts"], ev["ts"] + ev["dur"]))
+        phases[ev["name"]][0] += 1
+        phases[ev["name"]][1] += ev["dur"]
+    busy = {}
+    for key, ivs in per_thread.items():
+        total, cur_s, cur_e = 0, None, None
+        for s, e in sorted(ivs):
+            if cur_e is None or s > cur_e:
+                if cur_e is not None:
+                    total += cur_e - cur_s
+                cur_s, cur_e = s, e
+            else:
+                cur_e = max(cur_e, e)
+        busy[key] = total + (cur_e - cur_s)
+
+    print(f"{len(spans)} spans over {window / 1e6:.2f} s")
+    for pid in sorted({k[0] for k in busy}):
+        print(f"{procs.get(pid, f'pid {pid}')}:")
+        rows = sorted(((d, tid) for (p, tid), d in busy.items() if p == pid), reverse=True)
+        for d, tid in rows:
+            name = threads.get((pid, tid), f"tid {tid}")
+            print(f"  {name:<12} {d / 1e3:10.1f} ms busy ({100.0 * d / window:5.1f}% of window)")
+    print("Phases:")
+    for name, (n, d) in sorted(phases.items(), key=lambda kv: -kv[1][1]):
+        print(f"  {name:<12} {n:6d} x  avg {d / n / 1e3:9.2f} ms")
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    ap.add_argument("input", nargs="?", help="serial capture or saved WS frame ('-' for stdin)")
+    ap.add_argument("--ws", metavar="URL", help="fetch the trace from the WebSocket gateway")
+    ap.add_argument("--seconds", type=int, default=10, help="window to request with --ws (0: all)")
+    ap.add_argument("-o", "--output", default="trace.json")
+    args = ap.parse_args()
+
+    if args.ws:
+        trace = fetch_ws(args.ws, args.seconds)
+    elif args.input:
+        src = sys.stdin if args.input == "-" else open(args.input, encoding="utf-8", errors="replace")
+        with src:
+            trace = extract(src.read())
+    else:
+        ap.error("give a capture file or --ws")
+
+    trace.pop("type", None)
+    with open(args.output, "w", encoding="utf-8") as f:
+        json.dump(trace, f)
+    summarize(trace)
+    print(f"Wrote {args.output}: open it in https://ui.perfetto.dev")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,219 @@
+/*
+ * Request body cache over a recorded 10-iteration agent turn
+ * (data/turn_10.json: system prompt, the registry's tools, history, then one
+ * tool call per iteration). Each iteration's body is built as llm_attempt()
+ * builds it (measure pass, then send pass into a socket stand-in), once from
+ * scratch and once through the cache. The bytes must be identical; time and
+ * allocations per iteration are printed side by side.
+ *
+ * Built optimized and without sanitizers; malloc/calloc/realloc are wrapped
+ * at link time to count the allocations of the code under test.
+ */
+
+#include "host_test.h"
+#include "llm/llm_body.h"
+
+#include <time.h>
+
+#define ROUNDS      200             /* whole turns replayed per provider */
+#define MAX_ITERS   16
+#define BODY_MAX    (128 * 1024)
+
+/* ── Allocation count ─────────────────────────────────────────── */
+
+static unsigned long s_allocs;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t size);
+
+void *__wrap_malloc(size_t size) { s_allocs++; return __real_malloc(size); }
+void *__wrap_calloc(size_t n, size_t size) { s_allocs++; return __real_calloc(n, size); }
+void *__wrap_realloc(void *p, size_t size) { s_allocs++; return __real_realloc(p, size); }
+
+/* ── Socket stand-in ──────────────────────────────────────────── */
+
+typedef struct {
+    char *buf;
+    size_t len;
+} wire_t;
+
+static esp_err_t wire_sink(void *ctx, const char *data, size_t len)
+{
+    wire_t *w = (wire_t *)ctx;
+    if (w->len + len > BODY_MAX) return ESP_ERR_NO_MEM;
+    memcpy(w->buf + w->len, data, len);
+    w->len += len;
+    return ESP_OK;
+}
+
+/* ── Recorded turn ────────────────────────────────────────────── */
+
+typedef struct {
+    cJSON *doc;
+    const char *system;
+    size_t static_len;
+    cJSON *tools;               /* in the provider's wire format */
+    cJSON *pending;             /* messages not sent yet */
+    cJSON *messages;            /* what the agent passes to llm_chat_request() */
+    int first;                  /* messages in the first call */
+} turn_t;
+
+/* Tools as get_tools_tree() prepares them: Anthropic gets a prompt cache
+ * breakpoint on the last tool, OpenAI-format backends get function objects */
+static void prepare_tools(cJSON *tools, llm_provider_t p)
+{
+    if (!is_openai_fmt(p)) {
+        cJSON *cc = cJSON_CreateObject();
+        cJSON_AddStringToObject(cc, "type", "ephemeral");
+        cJSON_AddItemToObject(tools->child->prev, "cache_control", cc);
+        return;
+    }
+    for (cJSON *tool = tools->child; tool; tool = tool->next) {
+        cJSON *func = cJSON_CreateObject();
+        while (tool->child) {
+            cJSON *field = cJSON_DetachItemFromArray(tool, 0);
+            cJSON_AddItemToObject(func, strcmp(field->string, "input_schema") == 0
+                                  ? "parameters" : field->string, field);
+        }
+        cJSON_AddStringToObject(tool, "type", "function");
+        cJSON_AddItemToObject(tool, "function", func);
+    }
+}
+
+static void turn_load(turn_t *t, const char *json, llm_provider_t p)
+{
+    t->doc = cJSON_Parse(json);
+    CHECK(t->doc != NULL);
+    t->system = cJSON_GetObjectItem(t->doc, "system")->valuestring;
+    t->static_len = (size_t)cJSON_GetObjectItem(t->doc, "system_static_len")->valueint;
+    t->first = cJSON_GetObjectItem(t->doc, "first_call_messages")->valueint;
+    t->tools = cJSON_GetObjectItem(t->doc, "tools");
+    prepare_tools(t->tools, p);
+    t->pending = cJSON_GetObjectItem(t->doc, "messages");
+    t->messages = cJSON_CreateArray();
+}
+
+/* Move the next n recorded messages into the conversation, as the agent
+ * appends the assistant's tool calls and their results */
+static void turn_append(turn_t *t, int n)
+{
+    for (int i = 0; i < n && t->pending->child; i++) {
+        cJSON_AddItemToArray(t->messages, cJSON_DetachItemFromArray(t->pending, 0));
+    }
+}
+
+static void turn_free(turn_t *t)
+{
+    cJSON_Delete(t->messages);
+    cJSON_Delete(t->doc);
+}
+
+/* ── Benchmark ────────────────────────────────────────────────── */
+
+typedef struct {
+    size_t body_len;
+    int64_t ns[2];              /* [0] from scratch, [1] cached */
+    unsigned long allocs[2];
+} iter_stats_t;
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* One request body the way llm_attempt() produces it */
+static void build_body(const llm_body_ctx_t *ctx, llm_body_cache_t *cache, wire_t *out,
+                       int64_t *ns, unsigned long *allocs)
+{
+    unsigned long a0 = s_allocs;
+    int64_t t0 = now_ns();
+
+    llm_body_t post = { .emit = llm_body_emit_chat, .arg = ctx };
+    if (cache && llm_body_cache_update(cache, ctx) == ESP_OK) {
+        post.emit = llm_body_emit_cached;
+        post.arg = cache;
+    }
+    llm_body_measure(&post);
+    out->len = 0;
+    CHECK(llm_body_send(&post, wire_sink, out) == ESP_OK);
+
+    *ns += now_ns() - t0;
+    *allocs = s_allocs - a0;
+    CHECK(out->len == post.len);
+}
+
+static void bench_provider(const char *json, llm_provider_t p, const char *label)
+{
+    static char plain_buf[BODY_MAX], cached_buf[BODY_MAX];
+    wire_t plain = { plain_buf, 0 }, cached = { cached_buf, 0 };
+    iter_stats_t st[MAX_ITERS] = {0};
+    int iters = 0;
+
+    llm_body_cache_t *cache = llm_body_cache_create();
+    for (int round = 0; round < ROUNDS && !FAILED(); round++) {
+        turn_t t;
+        turn_load(&t, json, p);
+        llm_request_t req = {
+            .system_prompt = t.system,
+            .system_static_len = t.static_len,
+            .messages = t.messages,
+            .body_cache = cache,
+        };
+        llm_body_ctx_t ctx = { .req = &req, .provider = p, .tools = t.tools };
+        strcpy(ctx.model, is_openai_fmt(p) ? MIMI_KIMI_DEFAULT_MODEL : MIMI_LLM_DEFAULT_MODEL);
+
+        llm_body_cache_reset(cache);
+        turn_append(&t, t.first);
+        int i = 0;
+        for (; i < MAX_ITERS && !FAILED(); i++) {
+            build_body(&ctx, NULL, &plain, &st[i].ns[0], &st[i].allocs[0]);
+            build_body(&ctx, cache, &cached, &st[i].ns[1], &st[i].allocs[1]);
+            CHECK(plain.len == cached.len && memcmp(plain.buf, cached.buf, plain.len) == 0);
+            if (FAILED()) fprintf(stderr, "  %s, iteration %d: bodies differ\n", label, i + 1);
+            st[i].body_len = plain.len;
+            if (!t.pending->child) break;
+            turn_append(&t, 2);
+        }
+        iters = i + 1;
+        turn_free(&t);
+    }
+    llm_body_cache_free(cache);
+    if (FAILED()) return;
+
+    printf("\n%s, %d iterations (mean of %d turns)\n", label, iters, ROUNDS);
+    printf("  iter   body B   scratch us  allocs   cached us  allocs\n");
+    int64_t ns[2] = {0};
+    unsigned long allocs[2] = {0};
+    for (int i = 0; i < iters; i++) {
+        printf("  %4d  %7zu   %10.1f  %6lu   %9.1f  %6lu\n", i + 1, st[i].body_len,
+               st[i].ns[0] / 1e3 / ROUNDS, st[i].allocs[0],
+               st[i].ns[1] / 1e3 / ROUNDS, st[i].allocs[1]);
+        for (int k = 0; k < 2; k++) {
+            ns[k] += st[i].ns[k];
+            allocs[k] += st[i].allocs[k];
+        }
+    }
+    printf("  turn            %10.1f  %6lu   %9.1f  %6lu   (%.0f%% of the time saved)\n",
+           ns[0] / 1e3 / ROUNDS, allocs[0], ns[1] / 1e3 / ROUNDS, allocs[1],
+           100.0 * (double)(ns[0] - ns[1]) / (double)ns[0]);
+
+    CHECK(iters == 10);
+    /* Only the appended messages are encoded: allocations never grow with
+     * the history, and an OpenAI-format turn no longer translates each
+     * message twice per call */
+    CHECK(allocs[1] <= allocs[0]);
+    if (is_openai_fmt(p)) CHECK(allocs[1] * 4 < allocs[0]);
+}
+
+int main(void)
+{
+    size_t len;
+    char *json = read_data("turn_10.json", &len);
+    bench_provider(json, LLM_PROVIDER_ANTHROPIC, "Anthropic");
+    bench_provider(json, LLM_PROVIDER_KIMI, "Kimi (OpenAI format)");
+    free(json);
+    return test_result("bench_body_cache");
+}
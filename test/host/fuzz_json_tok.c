@@ -0,0 +1,228 @@
+/*
+ * Fuzz target for json_tok_parse and the SSE decoder built on it.
+ *
+ * With clang the target is also linked against libFuzzer (fuzz_json_tok_libfuzzer,
+ * not run by ctest):
+ *   _gate_build/fuzz_json_tok_libfuzzer -max_total_time=600 test/host/data
+ *
+ * Otherwise main() below is the driver: with file arguments it replays them
+ * (crash reproducers, or AFL's @@), without it runs the seed transcripts and
+ * a fixed number of random mutations of them (MIMI_FUZZ_ITERATIONS, default
+ * 20000), so every ctest run covers the same inputs.
+ */
+
+#include "host_test.h"
+#include "llm/json_tok.h"
+#include "llm/llm_stream.h"
+
+#include <stdint.h>
+
+#define FUZZ_MAX_TOKENS 256
+
+#define FUZZ_ASSERT(cond) do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: invariant failed: %s\n", __FILE__, __LINE__, #cond); \
+            abort(); \
+        } \
+    } while (0)
+
+static void check_tokens(const char *js, size_t len, const jtok_t *toks, int count)
+{
+    for (int i = 0; i < count; i++) {
+        const jtok_t *t = &toks[i];
+        FUZZ_ASSERT(t->type >= JTOK_OBJECT && t->type <= JTOK_PRIMITIVE);
+        FUZZ_ASSERT(t->start >= 0 && t->start <= t->end && (size_t)t->end <= len);
+        FUZZ_ASSERT(t->parent >= -1 && t->parent < i);
+        if (t->parent >= 0) {
+            const jtok_t *p = &toks[t->parent];
+            FUZZ_ASSERT(p->type == JTOK_OBJECT || p->type == JTOK_ARRAY);
+            FUZZ_ASSERT(t->start > p->start && t->end < p->end);
+        }
+
+        int children = 0;
+        for (int j = i + 1; j < count; j++) children += (toks[j].parent == i);
+        FUZZ_ASSERT(children == t->size);
+
+        int next = json_tok_skip(toks, count, i);
+        FUZZ_ASSERT(next > i && next <= count);
+
+        if (t->type == JTOK_STRING) {
+            /* Decoded length never exceeds the raw length; a short buffer
+             * truncates without overflowing */
+            size_t raw = json_tok_raw_len(toks, i);
+            char *out = malloc(raw + 1);
+            FUZZ_ASSERT(json_tok_str(js, toks, i, out, raw + 1) <= raw);
+            free(out);
+            char small[4];
+            FUZZ_ASSERT(json_tok_str(js, toks, i, small, sizeof(small)) < sizeof(small));
+        } else if (t->type == JTOK_PRIMITIVE) {
+            (void)json_tok_long(js, toks, i, 0);
+            (void)json_tok_is_null(js, toks, i);
+        } else if (t->type == JTOK_OBJECT) {
+            int v = json_tok_get(js, toks, count, i, "type");
+            FUZZ_ASSERT(v >= -1 && v < count);
+        } else {
+            for (int k = -1; k <= t->size; k++) {
+                int e = json_tok_at(toks, count, i, k);
+                FUZZ_ASSERT(e >= -1 && e < count);
+                FUZZ_ASSERT((k >= 0 && k < t->size) == (e >= 0));
+            }
+        }
+    }
+}
+
+static void fuzz_tokenizer(const char *js, size_t len)
+{
+    static jtok_t toks[FUZZ_MAX_TOKENS];
+    int count = json_tok_parse(js, len, toks, FUZZ_MAX_TOKENS);
+    FUZZ_ASSERT(count >= JTOK_ERR_PART && count <= FUZZ_MAX_TOKENS);
+    if (count < 0) return;
+
+    check_tokens(js, len, toks, count);
+
+    /* The same input with exactly enough tokens parses identically; one
+     * fewer must report NOMEM, never a partial success */
+    FUZZ_ASSERT(json_tok_parse(js, len, toks, count) == count);
+    if (count > 0) FUZZ_ASSERT(json_tok_parse(js, len, toks, count - 1) == JTOK_ERR_NOMEM);
+}
+
+static void fuzz_stream(const char *data, size_t len, llm_stream_format_t fmt, size_t cut)
+{
+    llm_response_t resp;
+    llm_stream_t s;
+    llm_stream_init(&s, fmt, &resp, NULL, NULL);
+    if (cut > len) cut = len;
+    if (llm_stream_feed(&s, data, cut) == ESP_OK) {
+        llm_stream_feed(&s, data + cut, len - cut);
+    }
+    llm_stream_finish(&s);
+
+    FUZZ_ASSERT(resp.call_count >= 0 && resp.call_count <= MIMI_MAX_TOOL_CALLS);
+    FUZZ_ASSERT(resp.text_len == 0 || (resp.text && resp.text[resp.text_len] == '\0'));
+    for (int i = 0; i < resp.call_count; i++) {
+        FUZZ_ASSERT(resp.calls[i].input_len == 0 ||
+                    (resp.calls[i].input && resp.calls[i].input[resp.calls[i].input_len] == '\0'));
+    }
+
+    llm_stream_free(&s);
+    free(resp.text);
+    for (int i = 0; i < resp.call_count; i++) free(resp.calls[i].input);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    const char *js = (const char *)data;
+
+    fuzz_tokenizer(js, size);
+
+    /* First byte picks the split point, so chunk boundaries get fuzzed too */
+    size_t cut = size ? data[0] : 0;
+    fuzz_stream(js, size, LLM_STREAM_ANTHROPIC, cut);
+    fuzz_stream(js, size, LLM_STREAM_OPENAI, cut);
+    return 0;
+}
+
+#ifndef MIMI_LIBFUZZER
+
+static uint32_t s_rng = 0x6d696d69;
+
+static uint32_t rnd(void)
+{
+    /* xorshift32: deterministic, so a failing iteration can be rerun */
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 17;
+    s_rng ^= s_rng << 5;
+    return s_rng;
+}
+
+static void run(const char *buf, size_t len)
+{
+    /* Exact-size heap copy so ASan catches any read past the end */
+    uint8_t *copy = malloc(len ? len : 1);
+    memcpy(copy, buf, len);
+    LLVMFuzzerTestOneInput(copy, len);
+    free(copy);
+}
+
+static size_t mutate(char *buf, size_t len, size_t cap)
+{
+    static const char interesting[] = "{}[]\",:\\u0n";
+    int edits = 1 + (int)(rnd() % 8);
+    for (int e = 0; e < edits && len > 0; e++) {
+        size_t p = rnd() % len;
+        switch (rnd() % 5) {
+        case 0: buf[p] = (char)rnd(); break;
+        case 1: buf[p] = interesting[rnd() % (sizeof(interesting) - 1)]; break;
+        case 2: len = p; break;                                 /* truncate */
+        case 3: memmove(buf + p, buf + p + 1, len - p - 1); len--; break;
+        case 4:
+            if (len < cap) {                                    /* duplicate a byte */
+                memmove(buf + p + 1, buf + p, len - p);
+                len++;
+            }
+            break;
+        }
+    }
+    return len;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1) {
+        for (int i = 1; i < argc; i++) {
+            FILE *f = fopen(argv[i], "rb");
+            if (!f) {
+                fprintf(stderr, "cannot open %s\n", argv[i]);
+                return 2;
+            }
+            static char buf[1 << 20];
+            size_t n = fread(buf, 1, sizeof(buf), f);
+            fclose(f);
+            run(buf, n);
+        }
+        printf("fuzz_json_tok: %d input(s) OK\n", argc - 1);
+        return 0;
+    }
+
+    static const char *files[] = {
+        "anthropic_tool_use.sse", "anthropic_overloaded.sse",
+        "kimi_tool_calls.sse", "openai_text.sse",
+    };
+    static const char *json[] = {
+        "{\"a\":[1,-2.5e3,true,false,null,\"x\\\"\\\\\\/\\b\\f\\n\\r\\t\"],\"b\":{}}",
+        "\"\\ud83c\\udf26 \\ud800 \\udc00 \\u00e9\"",
+        "[[[[[[[[[[]]]]]]]]]]",
+        "{\"type\":\"content_block_delta\",\"index\":0,\"delta\":{\"type\":\"text_delta\",\"text\":\"\"}}",
+    };
+    enum { NSEEDS = sizeof(files) / sizeof(files[0]) + sizeof(json) / sizeof(json[0]) };
+    char *seeds[NSEEDS];
+    size_t seed_len[NSEEDS];
+    int n = 0;
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++, n++) {
+        seeds[n] = read_data(files[i], &seed_len[n]);
+    }
+    for (size_t i = 0; i < sizeof(json) / sizeof(json[0]); i++, n++) {
+        seeds[n] = strdup(json[i]);
+        seed_len[n] = strlen(json[i]);
+    }
+
+    const char *env = getenv("MIMI_FUZZ_ITERATIONS");
+    long iterations = env ? atol(env) : 20000;
+
+    for (int i = 0; i < NSEEDS; i++) run(seeds[i], seed_len[i]);
+
+    static char buf[8192];
+    for (long it = 0; it < iterations; it++) {
+        int k = (int)(rnd() % NSEEDS);
+        size_t len = seed_len[k] < sizeof(buf) ? seed_len[k] : sizeof(buf);
+        memcpy(buf, seeds[k], len);
+        len = mutate(buf, len, sizeof(buf));
+        run(buf, len);
+    }
+
+    for (int i = 0; i < NSEEDS; i++) free(seeds[i]);
+    printf("fuzz_json_tok: %d seeds, %ld mutations OK\n", NSEEDS, iterations);
+    return 0;
+}
+
+#endif
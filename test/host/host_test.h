@@ -0,0 +1,65 @@
+#pragma once
+
+/*
+ * Helpers shared by the host tests: no framework, a failed CHECK prints its
+ * location and the test exits non-zero once it is done.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int s_failures = 0;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+            s_failures++; \
+        } \
+    } while (0)
+
+#define CHECK_STR(got, want) do { \
+        const char *g_ = (got), *w_ = (want); \
+        if (!g_ || strcmp(g_, w_) != 0) { \
+            fprintf(stderr, "%s:%d: CHECK_STR failed: %s\n  got:  \"%s\"\n  want: \"%s\"\n", \
+                    __FILE__, __LINE__, #got, g_ ? g_ : "(null)", w_); \
+            s_failures++; \
+        } \
+    } while (0)
+
+/* Stop a loop over many splits once something failed: one report is enough */
+#define FAILED() (s_failures > 0)
+
+static inline int test_result(const char *name)
+{
+    if (s_failures) {
+        fprintf(stderr, "%s: %d check(s) failed\n", name, s_failures);
+        return 1;
+    }
+    printf("%s: OK\n", name);
+    return 0;
+}
+
+/* Whole file from the data directory, NUL-terminated. Exits if missing. */
+static inline char *read_data(const char *name, size_t *len)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", TEST_DATA_DIR, name);
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "cannot open %s\n", path);
+        exit(2);
+    }
+    fseek(f, 0, SEEK_END);
+    long n = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *buf = malloc((size_t)n + 1);
+    if (!buf || fread(buf, 1, (size_t)n, f) != (size_t)n) {
+        fprintf(stderr, "cannot read %s\n", path);
+        exit(2);
+    }
+    buf[n] = '\0';
+    fclose(f);
+    *len = (size_t)n;
+    return buf;
+}
@@ -0,0 +1,261 @@
+/*
+ * Host stand-in for the cJSON functions the tested modules call. Nodes are
+ * laid out and linked as in cJSON (child->prev is the last element), and the
+ * allocations match: one per node, one per copied string or key. Parsing
+ * goes through json_tok, printing through json_writer.
+ */
+
+#include "cJSON.h"
+#include "llm/json_tok.h"
+#include "llm/json_writer.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+static char *copy_str(const char *s, size_t len)
+{
+    char *p = malloc(len + 1);
+    if (!p) return NULL;
+    memcpy(p, s, len);
+    p[len] = '\0';
+    return p;
+}
+
+static cJSON *new_item(int type)
+{
+    cJSON *item = calloc(1, sizeof(cJSON));
+    if (item) item->type = type;
+    return item;
+}
+
+void cJSON_Delete(cJSON *item)
+{
+    while (item) {
+        cJSON *next = item->next;
+        if (!(item->type & cJSON_IsReference)) {
+            cJSON_Delete(item->child);
+            free(item->valuestring);
+        }
+        if (!(item->type & cJSON_StringIsConst)) free(item->string);
+        free(item);
+        item = next;
+    }
+}
+
+/* ── Create ───────────────────────────────────────────────────── */
+
+cJSON *cJSON_CreateNull(void) { return new_item(cJSON_NULL); }
+cJSON *cJSON_CreateBool(cJSON_bool b) { return new_item(b ? cJSON_True : cJSON_False); }
+cJSON *cJSON_CreateArray(void) { return new_item(cJSON_Array); }
+cJSON *cJSON_CreateObject(void) { return new_item(cJSON_Object); }
+
+cJSON *cJSON_CreateNumber(double num)
+{
+    cJSON *item = new_item(cJSON_Number);
+    if (item) {
+        item->valuedouble = num;
+        item->valueint = (int)num;
+    }
+    return item;
+}
+
+cJSON *cJSON_CreateString(const char *string)
+{
+    cJSON *item = new_item(cJSON_String);
+    if (item && !(item->valuestring = copy_str(string, strlen(string)))) {
+        free(item);
+        return NULL;
+    }
+    return item;
+}
+
+cJSON *cJSON_CreateStringReference(const char *string)
+{
+    cJSON *item = new_item(cJSON_String | cJSON_IsReference);
+    if (item) item->valuestring = (char *)string;
+    return item;
+}
+
+/* ── Add / detach ─────────────────────────────────────────────── */
+
+cJSON_bool cJSON_AddItemToArray(cJSON *array, cJSON *item)
+{
+    if (!array || !item || array == item) return false;
+    cJSON *first = array->child;
+    if (!first) {
+        array->child = item;
+        item->prev = item;
+        item->next = NULL;
+    } else {
+        cJSON *last = first->prev;
+        last->next = item;
+        item->prev = last;
+        item->next = NULL;
+        first->prev = item;
+    }
+    return true;
+}
+
+cJSON_bool cJSON_AddItemToObject(cJSON *object, const char *string, cJSON *item)
+{
+    if (!object || !string || !item) return false;
+    char *key = copy_str(string, strlen(string));
+    if (!key) return false;
+    if (!(item->type & cJSON_StringIsConst)) free(item->string);
+    item->string = key;
+    item->type &= ~cJSON_StringIsConst;
+    return cJSON_AddItemToArray(object, item);
+}
+
+cJSON *cJSON_AddStringToObject(cJSON *object, const char *name, const char *string)
+{
+    cJSON *item = cJSON_CreateString(string);
+    if (cJSON_AddItemToObject(object, name, item)) return item;
+    cJSON_Delete(item);
+    return NULL;
+}
+
+cJSON *cJSON_AddNullToObject(cJSON *object, const char *name)
+{
+    cJSON *item = cJSON_CreateNull();
+    if (cJSON_AddItemToObject(object, name, item)) return item;
+    cJSON_Delete(item);
+    return NULL;
+}
+
+cJSON *cJSON_DetachItemFromArray(cJSON *array, int which)
+{
+    cJSON *item = array ? array->child : NULL;
+    while (item && which-- > 0) item = item->next;
+    if (!item) return NULL;
+
+    if (item != array->child) item->prev->next = item->next;
+    if (item->next) item->next->prev = item->prev;
+    if (item == array->child) {
+        array->child = item->next;
+    } else if (!item->next) {
+        array->child->prev = item->prev;
+    }
+    item->prev = item->next = NULL;
+    return item;
+}
+
+/* ── Lookup ───────────────────────────────────────────────────── */
+
+cJSON *cJSON_GetObjectItem(const cJSON *object, const char *string)
+{
+    cJSON *item;
+    if (!object || !string) return NULL;
+    cJSON_ArrayForEach(item, object) {
+        if (item->string && strcasecmp(item->string, string) == 0) return item;
+    }
+    return NULL;
+}
+
+int cJSON_GetArraySize(const cJSON *array)
+{
+    int n = 0;
+    cJSON *item;
+    if (!array) return 0;
+    cJSON_ArrayForEach(item, array) n++;
+    return n;
+}
+
+cJSON_bool cJSON_IsString(const cJSON *item) { return item && (item->type & 0xFF) == cJSON_String; }
+cJSON_bool cJSON_IsArray(const cJSON *item) { return item && (item->type & 0xFF) == cJSON_Array; }
+
+/* ── Parse (json_tok) ─────────────────────────────────────────── */
+
+static cJSON *build(const char *js, const jtok_t *toks, int count, int i)
+{
+    const jtok_t *t = &toks[i];
+    cJSON *item = NULL;
+
+    switch (t->type) {
+    case JTOK_OBJECT:
+    case JTOK_ARRAY: {
+        item = new_item(t->type == JTOK_OBJECT ? cJSON_Object : cJSON_Array);
+        int j = i + 1;
+        int n = (t->type == JTOK_OBJECT) ? t->size / 2 : t->size;
+        for (int k = 0; item && k < n; k++) {
+            char *key = NULL;
+            if (t->type == JTOK_OBJECT) {
+                key = malloc(json_tok_raw_len(toks, j) + 1);
+                json_tok_str(js, toks, j, key, json_tok_raw_len(toks, j) + 1);
+                j++;
+            }
+            cJSON *child = build(js, toks, count, j);
+            if (!child) {
+                free(key);
+                cJSON_Delete(item);
+                return NULL;
+            }
+            child->string = key;
+            cJSON_AddItemToArray(item, child);
+            j = json_tok_skip(toks, count, j);
+        }
+        break;
+    }
+    case JTOK_STRING:
+        item = new_item(cJSON_String);
+        if (item) {
+            item->valuestring = malloc(json_tok_raw_len(toks, i) + 1);
+            json_tok_str(js, toks, i, item->valuestring, json_tok_raw_len(toks, i) + 1);
+        }
+        break;
+    case JTOK_PRIMITIVE:
+        if (js[t->start] == 't') {
+            item = cJSON_CreateBool(true);
+        } else if (js[t->start] == 'f') {
+            item = cJSON_CreateBool(false);
+        } else if (js[t->start] == 'n') {
+            item = cJSON_CreateNull();
+        } else {
+            item = cJSON_CreateNumber(strtod(js + t->start, NULL));
+        }
+        break;
+    default:
+        break;
+    }
+    return item;
+}
+
+cJSON *cJSON_Parse(const char *value)
+{
+    size_t len = strlen(value);
+    int max = (int)(len / 2) + 2;
+    jtok_t *toks = malloc((size_t)max * sizeof(jtok_t));
+    if (!toks) return NULL;
+
+    int count = json_tok_parse(value, len, toks, max);
+    cJSON *root = (count > 0) ? build(value, toks, count, 0) : NULL;
+    free(toks);
+    return root;
+}
+
+/* ── Print (json_writer) ──────────────────────────────────────── */
+
+static esp_err_t print_sink(void *ctx, const char *data, size_t len)
+{
+    char **p = (char **)ctx;
+    memcpy(*p, data, len);
+    *p += len;
+    return ESP_OK;
+}
+
+char *cJSON_PrintUnformatted(const cJSON *item)
+{
+    json_writer_t w;
+    json_writer_init(&w, NULL, NULL);
+    jw_value(&w, item);
+
+    char *out = malloc(w.total + 1);
+    if (!out) return NULL;
+    char *p = out;
+    json_writer_init(&w, print_sink, &p);
+    jw_value(&w, item);
+    jw_flush(&w);
+    *p = '\0';
+    return out;
+}
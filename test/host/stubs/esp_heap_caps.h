@@ -0,0 +1,16 @@
+#pragma once
+
+/* Host stand-in for ESP-IDF's esp_heap_caps.h: every region is the C heap */
+
+#include <stddef.h>
+#include <stdlib.h>
+
+#define MALLOC_CAP_SPIRAM   (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+#define MALLOC_CAP_8BIT     (1 << 2)
+#define MALLOC_CAP_DEFAULT  (1 << 12)
+
+static inline void *heap_caps_malloc(size_t size, unsigned caps) { return malloc(size); }
+static inline void *heap_caps_calloc(size_t n, size_t size, unsigned caps) { return calloc(n, size); }
+static inline void *heap_caps_realloc(void *p, size_t size, unsigned caps) { return realloc(p, size); }
+static inline void heap_caps_free(void *p) { free(p); }
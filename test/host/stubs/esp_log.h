@@ -0,0 +1,18 @@
+#pragma once
+
+/* Host stand-in for ESP-IDF's esp_log.h. Errors and warnings go to stderr
+ * when MIMI_HOST_LOG is set in the environment (the tests provoke many on
+ * purpose); the rest is compiled (arguments still type-checked) but not printed */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MIMI_HOST_LOG_(lvl, tag, fmt, ...) do { \
+        if (getenv("MIMI_HOST_LOG")) fprintf(stderr, lvl " %s: " fmt "\n", tag, ##__VA_ARGS__); \
+    } while (0)
+
+#define ESP_LOGE(tag, fmt, ...) MIMI_HOST_LOG_("E", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) MIMI_HOST_LOG_("W", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...) do { if (0) printf(fmt, ##__VA_ARGS__); } while (0)
+#define ESP_LOGD(tag, fmt, ...) do { if (0) printf(fmt, ##__VA_ARGS__); } while (0)
+#define ESP_LOGV(tag, fmt, ...) do { if (0) printf(fmt, ##__VA_ARGS__); } while (0)
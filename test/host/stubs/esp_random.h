@@ -0,0 +1,8 @@
+#pragma once
+
+/* Host stand-in for ESP-IDF's esp_random.h: each test defines esp_random()
+ * so it controls the jitter */
+
+#include <stdint.h>
+
+uint32_t esp_random(void);
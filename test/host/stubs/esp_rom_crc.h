@@ -0,0 +1,11 @@
+#pragma once
+
+/* Host stand-in for the ROM CRC: same CRC-32 (IEEE, pre/post inverted) as zlib */
+
+#include <stdint.h>
+#include <zlib.h>
+
+static inline uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len)
+{
+    return (uint32_t)crc32(crc, buf, len);
+}
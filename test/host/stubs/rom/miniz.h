@@ -0,0 +1,73 @@
+#pragma once
+
+/*
+ * Host stand-in for the ROM inflater: the tinfl_decompress() calling
+ * convention on top of zlib raw inflate. zlib keeps its own window, so the
+ * caller's ring is only used as output space, which is all http_gzip needs.
+ * zlib's state lives inside the decompressor (bump allocator), so freeing
+ * the owner mid-stream leaks nothing, as with the real tinfl.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <zlib.h>
+
+#define TINFL_LZ_DICT_SIZE          32768
+#define TINFL_FLAG_HAS_MORE_INPUT   2
+
+typedef enum {
+    TINFL_STATUS_BAD_PARAM = -3,
+    TINFL_STATUS_ADLER32_MISMATCH = -2,
+    TINFL_STATUS_FAILED = -1,
+    TINFL_STATUS_DONE = 0,
+    TINFL_STATUS_NEEDS_MORE_INPUT = 1,
+    TINFL_STATUS_HAS_MORE_OUTPUT = 2,
+} tinfl_status;
+
+typedef struct {
+    int started;
+    z_stream zs;
+    size_t arena_used;
+    _Alignas(16) unsigned char arena[48 * 1024];
+} tinfl_decompressor;
+
+static inline voidpf tinfl_host_alloc_(voidpf opaque, uInt items, uInt size)
+{
+    tinfl_decompressor *r = (tinfl_decompressor *)opaque;
+    size_t n = ((size_t)items * size + 15) & ~(size_t)15;
+    if (r->arena_used + n > sizeof(r->arena)) return Z_NULL;
+    void *p = r->arena + r->arena_used;
+    r->arena_used += n;
+    return p;
+}
+
+static inline void tinfl_host_free_(voidpf opaque, voidpf p) { }
+
+#define tinfl_init(r) do { (r)->started = 0; } while (0)
+
+static inline tinfl_status tinfl_decompress(tinfl_decompressor *r, const uint8_t *in, size_t *in_size,
+                                            uint8_t *out_start, uint8_t *out_next, size_t *out_size,
+                                            uint32_t flags)
+{
+    if (!r->started) {
+        memset(&r->zs, 0, sizeof(r->zs));
+        r->arena_used = 0;
+        r->zs.zalloc = tinfl_host_alloc_;
+        r->zs.zfree = tinfl_host_free_;
+        r->zs.opaque = r;
+        if (inflateInit2(&r->zs, -15) != Z_OK) return TINFL_STATUS_BAD_PARAM;
+        r->started = 1;
+    }
+    r->zs.next_in = (Bytef *)in;
+    r->zs.avail_in = (uInt)*in_size;
+    r->zs.next_out = out_next;
+    r->zs.avail_out = (uInt)*out_size;
+    int rc = inflate(&r->zs, Z_NO_FLUSH);
+    *in_size -= r->zs.avail_in;
+    *out_size -= r->zs.avail_out;
+    if (rc == Z_STREAM_END) return TINFL_STATUS_DONE;
+    if (rc != Z_OK && rc != Z_BUF_ERROR) return TINFL_STATUS_FAILED;
+    if (r->zs.avail_out == 0) return TINFL_STATUS_HAS_MORE_OUTPUT;
+    return TINFL_STATUS_NEEDS_MORE_INPUT;
+}
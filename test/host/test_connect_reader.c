@@ -0,0 +1,128 @@
+/*
+ * proxy_read_connect_response against a stand-in proxy on a socketpair: the
+ * proxy's answer arrives in one or several segments, immediately followed by
+ * the first TLS bytes of the tunnel. The reader must return exactly the
+ * headers, leave every tunnel byte in the socket, and spend a couple of recv
+ * calls per segment where reading line by line cost one per byte.
+ */
+
+#include "host_test.h"
+#include "proxy/proxy_resp.h"
+
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+static const char s_answer[] =
+    "HTTP/1.1 200 Connection established\r\n"
+    "Proxy-Agent: stand-in/1.0\r\n"
+    "\r\n";
+
+/* TLS ServerHello record header and a few bytes: must stay in the socket */
+static const char s_tunnel[] = "\x16\x03\x03\x00\x5d\x02\x00\x00\x59\x03\x03";
+#define TUNNEL_LEN (sizeof(s_tunnel) - 1)
+
+typedef struct {
+    int fd;
+    const char *data;
+    size_t len;
+    size_t cut;                 /* first segment length; the rest follows later */
+    bool close_after;
+} proxy_t;
+
+static void *stand_in_proxy(void *arg)
+{
+    proxy_t *p = (proxy_t *)arg;
+    usleep(2000);               /* the reader is blocked in its first peek by now */
+    CHECK(write(p->fd, p->data + p->cut, p->len - p->cut) == (ssize_t)(p->len - p->cut));
+    if (p->close_after) shutdown(p->fd, SHUT_WR);
+    return NULL;
+}
+
+/* Run the reader while the proxy sends data in two segments split at cut */
+static int run(const char *data, size_t len, size_t cut, bool close_after,
+               char *buf, int max, int *recvs, char *rest, size_t *rest_len)
+{
+    int sv[2];
+    CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+
+    proxy_t p = { .fd = sv[1], .data = data, .len = len, .cut = cut, .close_after = close_after };
+    CHECK(write(sv[1], data, cut) == (ssize_t)cut);
+    pthread_t th;
+    pthread_create(&th, NULL, stand_in_proxy, &p);
+
+    *recvs = 0;
+    int n = proxy_read_connect_response(sv[0], buf, max, recvs);
+
+    pthread_join(th, NULL);
+    shutdown(sv[1], SHUT_WR);
+    *rest_len = 0;
+    ssize_t k;
+    while ((k = recv(sv[0], rest + *rest_len, 64, 0)) > 0) *rest_len += (size_t)k;
+    close(sv[0]);
+    close(sv[1]);
+    return n;
+}
+
+/* What the old reader cost: one recv per header byte */
+static int line_reader_recvs(void)
+{
+    return (int)strlen(s_answer);
+}
+
+static void test_segments(void)
+{
+    char wire[256];
+    size_t hlen = strlen(s_answer);
+    memcpy(wire, s_answer, hlen);
+    memcpy(wire + hlen, s_tunnel, TUNNEL_LEN);
+    size_t len = hlen + TUNNEL_LEN;
+
+    int worst = 0;
+    for (size_t cut = 1; cut <= len && !FAILED(); cut++) {
+        char buf[512], rest[256];
+        size_t rest_len;
+        int recvs;
+        int n = run(wire, len, cut, false, buf, sizeof(buf), &recvs, rest, &rest_len);
+
+        CHECK(n == (int)hlen);
+        CHECK_STR(buf, s_answer);
+        CHECK(rest_len == TUNNEL_LEN && memcmp(rest, s_tunnel, TUNNEL_LEN) == 0);
+        /* One peek + one read per pass; the second segment may already be
+         * there by the first peek, which only saves a pass */
+        CHECK(cut >= hlen ? recvs == 2 : (recvs == 2 || recvs == 4));
+        if (FAILED()) fprintf(stderr, "  first segment of %zu bytes\n", cut);
+        if (recvs > worst) worst = recvs;
+    }
+    printf("CONNECT answer of %zu bytes: at most %d recv calls (line reader: %d)\n",
+           hlen, worst, line_reader_recvs());
+}
+
+static void test_errors(void)
+{
+    char buf[512], rest[256];
+    size_t rest_len;
+    int recvs;
+
+    /* Proxy closes before the blank line */
+    static const char cut_short[] = "HTTP/1.1 502 Bad Gateway\r\nServer: x\r\n";
+    CHECK(run(cut_short, sizeof(cut_short) - 1, 10, true,
+              buf, sizeof(buf), &recvs, rest, &rest_len) == -1);
+
+    /* Headers larger than the buffer */
+    CHECK(run(s_answer, strlen(s_answer), strlen(s_answer), false,
+              buf, 32, &recvs, rest, &rest_len) == -1);
+
+    /* A refusal is still returned whole: the caller checks the status */
+    static const char refused[] = "HTTP/1.1 407 Proxy Authentication Required\r\n\r\n";
+    CHECK(run(refused, sizeof(refused) - 1, 5, false,
+              buf, sizeof(buf), &recvs, rest, &rest_len) == (int)sizeof(refused) - 1);
+    CHECK_STR(buf, refused);
+}
+
+int main(void)
+{
+    test_segments();
+    test_errors();
+    return test_result("test_connect_reader");
+}
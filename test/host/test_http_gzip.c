@@ -0,0 +1,247 @@
+/*
+ * http_gzip: gzip streams produced by zlib are decoded identically however
+ * the compressed bytes are cut, the CRC-32 and length in the trailer are
+ * enforced, and truncated or corrupt streams are reported.
+ */
+
+#include "host_test.h"
+#include "http/http_gzip.h"
+
+#include <zlib.h>
+
+typedef struct {
+    char  *buf;
+    size_t len;
+    size_t cap;
+    int    fail_at;         /* return an error once this many bytes arrived, -1: never */
+} out_t;
+
+static esp_err_t on_out(void *ctx, const char *data, size_t len)
+{
+    out_t *o = (out_t *)ctx;
+    CHECK(len > 0 && len <= 32768);    /* at most one window per call */
+    if (o->len + len > o->cap) {
+        o->cap = (o->len + len) * 2;
+        o->buf = realloc(o->buf, o->cap);
+    }
+    memcpy(o->buf + o->len, data, len);
+    o->len += len;
+    if (o->fail_at >= 0 && o->len >= (size_t)o->fail_at) return ESP_ERR_NO_MEM;
+    return ESP_OK;
+}
+
+/* Search results / Telegram updates look like this: repetitive JSON with some
+ * noise, large enough to wrap the 32 KB window several times */
+static unsigned char *make_payload(size_t len)
+{
+    unsigned char *p = malloc(len);
+    uint32_t x = 12345;
+    size_t i = 0;
+    while (i < len) {
+        char rec[160];
+        x = x * 1103515245u + 12345u;
+        int n = snprintf(rec, sizeof(rec),
+                         "{\"update_id\":%u,\"message\":{\"chat\":{\"id\":%u},\"text\":\"m\xc3\xa9t\xc3\xa9o %08x\"}},",
+                         (unsigned)i, x >> 16, x);
+        for (int k = 0; k < n && i < len; k++) p[i++] = (unsigned char)rec[k];
+        if ((x >> 8) % 7 == 0 && i < len) p[i++] = (unsigned char)(x >> 3);   /* a stray byte */
+    }
+    return p;
+}
+
+/* Standard gzip member from zlib (windowBits 31: minimal 10-byte header) */
+static unsigned char *gzip_zlib(const unsigned char *in, size_t len, size_t *out_len)
+{
+    z_stream zs = {0};
+    CHECK(deflateInit2(&zs, 6, Z_DEFLATED, 31, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+    size_t cap = deflateBound(&zs, len) + 32;
+    unsigned char *out = malloc(cap);
+    zs.next_in = (Bytef *)in;
+    zs.avail_in = (uInt)len;
+    zs.next_out = out;
+    zs.avail_out = (uInt)cap;
+    CHECK(deflate(&zs, Z_FINISH) == Z_STREAM_END);
+    *out_len = zs.total_out;
+    deflateEnd(&zs);
+    return out;
+}
+
+static void put_le32(unsigned char *p, uint32_t v)
+{
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+    p[3] = (unsigned char)(v >> 24);
+}
+
+/* Member with every optional header field: FEXTRA, FNAME, FCOMMENT, FHCRC */
+static unsigned char *gzip_all_fields(const unsigned char *in, size_t len, size_t *out_len)
+{
+    static const unsigned char head[] = {
+        0x1f, 0x8b, 8, 0x02 | 0x04 | 0x08 | 0x10, 0, 0, 0, 0, 0, 3,
+        5, 0, 'A', 'P', 1, 0, 'x',              /* FEXTRA: XLEN 5 */
+        'r', 'e', 'p', 'l', 'y', '.', 'j', 's', 'o', 'n', 0,
+        'f', 'r', 'o', 'm', ' ', 't', 'e', 's', 't', 0,
+    };
+    z_stream zs = {0};
+    CHECK(deflateInit2(&zs, 9, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+    size_t cap = sizeof(head) + 2 + deflateBound(&zs, len) + 8;
+    unsigned char *out = malloc(cap);
+    memcpy(out, head, sizeof(head));
+    size_t n = sizeof(head);
+    uint32_t hcrc = (uint32_t)crc32(0, out, (uInt)n);
+    out[n++] = (unsigned char)hcrc;
+    out[n++] = (unsigned char)(hcrc >> 8);
+
+    zs.next_in = (Bytef *)in;
+    zs.avail_in = (uInt)len;
+    zs.next_out = out + n;
+    zs.avail_out = (uInt)(cap - n);
+    CHECK(deflate(&zs, Z_FINISH) == Z_STREAM_END);
+    n += zs.total_out;
+    deflateEnd(&zs);
+
+    put_le32(out + n, (uint32_t)crc32(0, in, (uInt)len));
+    put_le32(out + n + 4, (uint32_t)len);
+    *out_len = n + 8;
+    return out;
+}
+
+/* Decode gz in pieces of `step` bytes (0: cut once at `cut`) */
+static esp_err_t decode(const unsigned char *gz, size_t len, size_t step, size_t cut, out_t *o)
+{
+    http_gzip_t *d = http_gzip_new();
+    CHECK(d != NULL);
+    esp_err_t err = ESP_OK;
+    if (step == 0) {
+        err = http_gzip_feed(d, (const char *)gz, cut, on_out, o);
+        if (err == ESP_OK) err = http_gzip_feed(d, (const char *)gz + cut, len - cut, on_out, o);
+    } else {
+        for (size_t pos = 0; pos < len && err == ESP_OK; pos += step) {
+            size_t n = (len - pos < step) ? len - pos : step;
+            err = http_gzip_feed(d, (const char *)gz + pos, n, on_out, o);
+        }
+    }
+    if (err == ESP_OK) err = http_gzip_finish(d);
+    http_gzip_free(d);
+    return err;
+}
+
+static void check_round_trip(const char *what, const unsigned char *gz, size_t gz_len,
+                             const unsigned char *plain, size_t plain_len,
+                             size_t step, size_t cut)
+{
+    out_t o = { .fail_at = -1 };
+    esp_err_t err = decode(gz, gz_len, step, cut, &o);
+    int before = s_failures;
+    CHECK(err == ESP_OK);
+    CHECK(o.len == plain_len);
+    CHECK(o.len == plain_len && memcmp(o.buf, plain, plain_len) == 0);
+    if (s_failures != before) fprintf(stderr, "  %s, step %zu, cut %zu\n", what, step, cut);
+    free(o.buf);
+}
+
+static void test_every_split(void)
+{
+    size_t plain_len = 3000, gz_len;
+    unsigned char *plain = make_payload(plain_len);
+
+    unsigned char *gz = gzip_all_fields(plain, plain_len, &gz_len);
+    for (size_t cut = 0; cut <= gz_len && !FAILED(); cut++) {
+        check_round_trip("all header fields", gz, gz_len, plain, plain_len, 0, cut);
+    }
+    check_round_trip("all header fields", gz, gz_len, plain, plain_len, 1, 0);
+    free(gz);
+
+    gz = gzip_zlib(plain, plain_len, &gz_len);
+    for (size_t cut = 0; cut <= gz_len && !FAILED(); cut++) {
+        check_round_trip("zlib", gz, gz_len, plain, plain_len, 0, cut);
+    }
+    free(gz);
+    free(plain);
+}
+
+static void test_large_body(void)
+{
+    /* Several times the window: output wraps the ring and comes in pieces */
+    size_t plain_len = 300 * 1024, gz_len;
+    unsigned char *plain = make_payload(plain_len);
+    unsigned char *gz = gzip_zlib(plain, plain_len, &gz_len);
+    static const size_t steps[] = { 1, 7, 536, 1460, 2048, 16384, SIZE_MAX };
+    for (size_t i = 0; i < sizeof(steps) / sizeof(steps[0]); i++) {
+        check_round_trip("large", gz, gz_len, plain, plain_len, steps[i] < gz_len ? steps[i] : gz_len, 0);
+    }
+
+    /* A stored (incompressible) body */
+    for (size_t i = 0; i < plain_len; i++) plain[i] = (unsigned char)(i * 2654435761u >> 13);
+    free(gz);
+    gz = gzip_zlib(plain, plain_len, &gz_len);
+    check_round_trip("incompressible", gz, gz_len, plain, plain_len, 1460, 0);
+    free(gz);
+    free(plain);
+}
+
+static void test_bad_streams(void)
+{
+    size_t plain_len = 3000, gz_len;
+    unsigned char *plain = make_payload(plain_len);
+    unsigned char *gz = gzip_all_fields(plain, plain_len, &gz_len);
+    out_t o = { .fail_at = -1 };
+
+    /* Cut anywhere: incomplete (an empty body alone is accepted) */
+    for (size_t len = 1; len < gz_len && !FAILED(); len++) {
+        o.len = 0;
+        CHECK(decode(gz, len, 0, len / 2, &o) == ESP_ERR_INVALID_RESPONSE);
+        if (FAILED()) fprintf(stderr, "  truncated at %zu of %zu\n", len, gz_len);
+    }
+    o.len = 0;
+    CHECK(decode(gz, 0, 0, 0, &o) == ESP_OK && o.len == 0);
+
+    /* CRC-32 and ISIZE are checked */
+    unsigned char *bad = malloc(gz_len);
+    memcpy(bad, gz, gz_len);
+    bad[gz_len - 8] ^= 0x01;
+    o.len = 0;
+    CHECK(decode(bad, gz_len, 1460, 0, &o) == ESP_ERR_INVALID_RESPONSE);
+    memcpy(bad, gz, gz_len);
+    bad[gz_len - 1] ^= 0x80;
+    o.len = 0;
+    CHECK(decode(bad, gz_len, 1460, 0, &o) == ESP_ERR_INVALID_RESPONSE);
+
+    /* Not gzip at all (a plain JSON error body) */
+    static const char json[] = "{\"ok\":false,\"error_code\":429,\"description\":\"Too Many Requests\"}";
+    o.len = 0;
+    CHECK(decode((const unsigned char *)json, sizeof(json) - 1, 1460, 0, &o) == ESP_ERR_INVALID_RESPONSE);
+
+    /* Corrupt deflate data: reserved block type 3 in the first block header */
+    size_t zl;
+    unsigned char *z = gzip_zlib(plain, plain_len, &zl);
+    z[10] |= 0x06;
+    o.len = 0;
+    CHECK(decode(z, zl, 1460, 0, &o) == ESP_ERR_INVALID_RESPONSE);
+    free(z);
+
+    /* An error from the output callback stops the decoder and is returned */
+    size_t big_len = 200 * 1024, big_gz_len;
+    unsigned char *big = make_payload(big_len);
+    unsigned char *big_gz = gzip_zlib(big, big_len, &big_gz_len);
+    out_t stop = { .fail_at = 100 };
+    CHECK(decode(big_gz, big_gz_len, big_gz_len, 0, &stop) == ESP_ERR_NO_MEM);
+    CHECK(stop.len >= 100 && stop.len <= 32768);
+    free(big_gz);
+    free(big);
+
+    free(stop.buf);
+    free(o.buf);
+    free(bad);
+    free(gz);
+    free(plain);
+}
+
+int main(void)
+{
+    test_every_split();
+    test_large_body();
+    test_bad_streams();
+    return test_result("test_http_gzip");
+}
@@ -0,0 +1,206 @@
+/*
+ * json_writer: the counting pass (NULL sink) must announce exactly the bytes
+ * the sending pass delivers, whatever the position of the 512-byte buffer
+ * boundaries, and the output must be what cJSON_PrintUnformatted prints.
+ */
+
+#include "host_test.h"
+#include "llm/json_writer.h"
+#include "llm/json_tok.h"
+
+#include <limits.h>
+#include <math.h>
+
+/* ── Hand-built cJSON trees (the stub header has no constructors) ── */
+
+static cJSON s_nodes[64];
+static int s_node_count;
+
+static cJSON *node(int type, const char *key)
+{
+    cJSON *n = &s_nodes[s_node_count++];
+    memset(n, 0, sizeof(*n));
+    n->type = type;
+    n->string = (char *)key;
+    return n;
+}
+
+static cJSON *num(const char *key, double d)
+{
+    cJSON *n = node(cJSON_Number, key);
+    n->valuedouble = d;
+    /* cJSON saturates valueint */
+    n->valueint = (d >= INT_MAX) ? INT_MAX : (d <= INT_MIN) ? INT_MIN : (int)d;
+    return n;
+}
+
+static cJSON *str(const char *key, const char *s)
+{
+    cJSON *n = node(cJSON_String, key);
+    n->valuestring = (char *)s;
+    return n;
+}
+
+static cJSON *add(cJSON *parent, cJSON *child)
+{
+    cJSON **p = &parent->child;
+    while (*p) {
+        child->prev = *p;
+        p = &(*p)->next;
+    }
+    *p = child;
+    return child;
+}
+
+/* A tool-use conversation turn with every value type and escape */
+static cJSON *build_tree(void)
+{
+    s_node_count = 0;
+    cJSON *root = node(cJSON_Object, NULL);
+    add(root, str("role", "assistant"));
+    cJSON *content = add(root, node(cJSON_Array, "content"));
+
+    cJSON *text = add(content, node(cJSON_Object, NULL));
+    add(text, str("type", "text"));
+    add(text, str("text", "Il a dit \"bonjour\"\n\tC:\\tmp\\a\b\f\r\x01\x1f / caf\xc3\xa9 \xf0\x9f\x8c\xa6"));
+
+    cJSON *tool = add(content, node(cJSON_Object, NULL));
+    add(tool, str("type", "tool_use"));
+    add(tool, str("id", "toolu_01T1x1fJ34qAmk2tNTrN7Up6"));
+    add(tool, str("name", "web_search"));
+    cJSON *input = add(tool, node(cJSON_Object, "input"));
+    add(input, str("query", "m\xc3\xa9t\xc3\xa9o"));
+    add(input, num("count", 3));
+    cJSON *nums = add(input, node(cJSON_Array, "nums"));
+    add(nums, num(NULL, 0));
+    add(nums, num(NULL, -3));
+    add(nums, num(NULL, 2.5));
+    add(nums, num(NULL, 0.1));
+    add(nums, num(NULL, 1.0 / 3.0));
+    add(nums, num(NULL, 1e300));
+    add(nums, num(NULL, -1e-7));
+    add(nums, num(NULL, NAN));
+    add(input, node(cJSON_True, "t"));
+    add(input, node(cJSON_False, "f"));
+    add(input, node(cJSON_NULL, "n"));
+    add(input, node(cJSON_Object, "empty_obj"));
+    add(input, node(cJSON_Array, "empty_arr"));
+    add(input, str("nullstr", NULL));
+    cJSON *raw = add(input, node(cJSON_Raw, "raw"));
+    raw->valuestring = "{\"pre\":1}";
+    return root;
+}
+
+static const char s_expected[] =
+    "{\"role\":\"assistant\",\"content\":["
+    "{\"type\":\"text\",\"text\":\"Il a dit \\\"bonjour\\\"\\n\\tC:\\\\tmp\\\\a\\b\\f\\r\\u0001\\u001f / "
+    "caf\xc3\xa9 \xf0\x9f\x8c\xa6\"},"
+    "{\"type\":\"tool_use\",\"id\":\"toolu_01T1x1fJ34qAmk2tNTrN7Up6\",\"name\":\"web_search\","
+    "\"input\":{\"query\":\"m\xc3\xa9t\xc3\xa9o\",\"count\":3,"
+    "\"nums\":[0,-3,2.5,0.1,0.33333333333333331,1e+300,-1e-07,null],"
+    "\"t\":true,\"f\":false,\"n\":null,\"empty_obj\":{},\"empty_arr\":[],\"nullstr\":\"\","
+    "\"raw\":{\"pre\":1}}}]}";
+
+/* ── Sinks ─────────────────────────────────────────────────────── */
+
+typedef struct {
+    char out[8192];
+    size_t len;
+    int calls;
+    size_t max_chunk;
+    int fail_after;         /* fail the call after this many, -1: never */
+} sink_t;
+
+static esp_err_t sink(void *ctx, const char *data, size_t len)
+{
+    sink_t *k = (sink_t *)ctx;
+    if (k->fail_after >= 0 && k->calls >= k->fail_after) {
+        k->calls++;
+        return ESP_ERR_TIMEOUT;
+    }
+    k->calls++;
+    CHECK(len > 0);
+    if (len > k->max_chunk) k->max_chunk = len;
+    if (k->len + len <= sizeof(k->out)) memcpy(k->out + k->len, data, len);
+    k->len += len;
+    return ESP_OK;
+}
+
+/* What the request builders do: some literal structure, then the tree */
+static void emit(json_writer_t *w, size_t pad)
+{
+    for (size_t i = 0; i < pad; i++) jw_raw(w, " ", 1);
+    jw_lit(w, "{\"messages\":");
+    jw_value(w, build_tree());
+    jw_lit(w, ",\"max_tokens\":");
+    jw_int(w, 4096);
+    jw_lit(w, ",\"system\":");
+    jw_strn(w, "a\"b\nc", 5);
+    jw_lit(w, "}");
+}
+
+static void test_tree_output(void)
+{
+    sink_t k = { .fail_after = -1 };
+    json_writer_t w;
+    json_writer_init(&w, sink, &k);
+    jw_value(&w, build_tree());
+    CHECK(jw_flush(&w) == ESP_OK);
+    k.out[k.len] = '\0';
+    CHECK_STR(k.out, s_expected);
+    CHECK(w.total == strlen(s_expected));
+
+    /* And the body parses back */
+    jtok_t toks[128];
+    CHECK(json_tok_parse(k.out, k.len, toks, 128) > 0);
+}
+
+static void test_measure_equals_send(void)
+{
+    /* Shift the content across a whole buffer so every escape, number and
+     * literal straddles a flush boundary at some padding */
+    for (size_t pad = 0; pad <= JSON_WRITER_BUF_SIZE && !FAILED(); pad++) {
+        json_writer_t count;
+        json_writer_init(&count, NULL, NULL);
+        emit(&count, pad);
+        CHECK(jw_flush(&count) == ESP_OK);
+
+        sink_t k = { .fail_after = -1 };
+        json_writer_t w;
+        json_writer_init(&w, sink, &k);
+        emit(&w, pad);
+        CHECK(jw_flush(&w) == ESP_OK);
+
+        CHECK(count.total == w.total);
+        CHECK(k.len == w.total);
+        CHECK(k.max_chunk <= JSON_WRITER_BUF_SIZE);
+        CHECK(k.calls == (int)((k.len + JSON_WRITER_BUF_SIZE - 1) / JSON_WRITER_BUF_SIZE));
+        CHECK(memcmp(k.out + pad, "{\"messages\":", 12) == 0);
+        CHECK(memcmp(k.out + pad + 12, s_expected, strlen(s_expected)) == 0);
+        if (FAILED()) fprintf(stderr, "  at pad %zu\n", pad);
+    }
+}
+
+static void test_sink_error_sticky(void)
+{
+    sink_t k = { .fail_after = 1 };
+    json_writer_t w;
+    json_writer_init(&w, sink, &k);
+    emit(&w, JSON_WRITER_BUF_SIZE);     /* several buffers' worth */
+    CHECK(jw_flush(&w) == ESP_ERR_TIMEOUT);
+    CHECK(k.calls == 2);                /* nothing sent after the failure */
+    CHECK(k.len == JSON_WRITER_BUF_SIZE);
+
+    json_writer_t count;
+    json_writer_init(&count, NULL, NULL);
+    emit(&count, JSON_WRITER_BUF_SIZE);
+    CHECK(w.total == count.total);      /* still counted */
+}
+
+int main(void)
+{
+    test_tree_output();
+    test_measure_equals_send();
+    test_sink_error_sticky();
+    return test_result("test_json_writer");
+}
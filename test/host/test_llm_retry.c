@@ -0,0 +1,470 @@
+/*
+ * LLM retry loop (llm_retry_run(), which llm_chat_request() runs) against
+ * scripted stand-in backends: each attempt gets the next canned response
+ * (status + headers, a stream error, or a timeout), time is simulated, and
+ * the schedule must honour the server hints, the backoff bounds,
+ * MIMI_LLM_RETRY_MAX, the call's deadline, failover, the fallback model and
+ * cancellation.
+ */
+
+#include "host_test.h"
+#include "llm/llm_retry.h"
+#include "mimi_config.h"
+#include "esp_err.h"
+
+#include <stdint.h>
+
+/* ── Jitter source ────────────────────────────────────────────── */
+
+static enum { RND_MIN, RND_XORSHIFT } s_rnd_mode = RND_XORSHIFT;
+static uint32_t s_rng = 0x72657472;
+
+uint32_t esp_random(void)
+{
+    switch (s_rnd_mode) {
+    case RND_MIN: return 0;
+    default:
+        s_rng ^= s_rng << 13;
+        s_rng ^= s_rng >> 17;
+        s_rng ^= s_rng << 5;
+        return s_rng;
+    }
+}
+
+/* ── Stand-in API ─────────────────────────────────────────────── */
+
+#define NOW_EPOCH   1760700000      /* 2025-10-17T11:20:00Z */
+#define BACKENDS    2
+
+typedef struct {
+    int status;                     /* 0: timeout, no response */
+    const char *headers[4][2];
+    const char *stream_error;       /* error event in a 200 stream */
+    bool emitted;                   /* some text was streamed before the failure */
+} canned_t;
+
+typedef struct {
+    int attempts;
+    bool ok;
+    bool timed_out;                 /* gave up on overloads: ESP_ERR_TIMEOUT */
+    esp_err_t err;
+    int waits[MIMI_LLM_RETRY_MAX];
+    int backend[MIMI_LLM_RETRY_MAX];    /* which backend each attempt went to */
+    bool fallback[MIMI_LLM_RETRY_MAX];  /* ...and whether on the fallback model */
+    int reports_ok, reports_fail;
+    llm_retry_counts_t counts;
+    int64_t elapsed_ms;
+} outcome_t;
+
+/* Backends each answer from their own script; time is simulated */
+typedef struct {
+    const canned_t *script[BACKENDS];
+    int len[BACKENDS];
+    int next[BACKENDS];
+    int backend;
+    uint32_t failed;
+    bool has_fallback, on_fallback;
+    int cancel_after;               /* cancelled once that many attempts were made, 0: never */
+    int64_t now_us;
+    outcome_t *o;
+} api_t;
+
+/* An attempt as llm_attempt() turns a response into one */
+static esp_err_t api_attempt(void *arg, llm_attempt_t *at)
+{
+    api_t *api = (api_t *)arg;
+    int b = api->backend;
+    CHECK(api->next[b] < api->len[b]);      /* script long enough */
+    const canned_t *c = &api->script[b][api->next[b] < api->len[b] ? api->next[b]++ : api->len[b] - 1];
+    outcome_t *o = api->o;
+    if (o->attempts < MIMI_LLM_RETRY_MAX) {
+        o->backend[o->attempts] = b;
+        o->fallback[o->attempts] = api->on_fallback;
+    }
+    o->attempts++;
+    api->now_us += 300 * 1000;              /* each attempt takes 300 ms */
+
+    *at = (llm_attempt_t){ .status = c->status, .hint_ms = -1, .ttfb_ms = c->status ? 250 : 0 };
+    llm_retry_hints_t h;
+    llm_retry_hints_init(&h);
+    for (int i = 0; i < 4 && c->headers[i][0]; i++) {
+        llm_retry_hints_header(&h, c->headers[i][0], c->headers[i][1],
+                               NOW_EPOCH + (time_t)(api->now_us / 1000000));
+    }
+    at->hint_ms = llm_retry_hint_ms(&h);
+
+    esp_err_t http_err = c->status ? ESP_OK : ESP_ERR_TIMEOUT;
+    esp_err_t stream_err = c->stream_error ? ESP_FAIL : ESP_OK;
+    llm_retry_classify(at, http_err, stream_err, c->stream_error ? c->stream_error : "");
+    at->emitted = c->emitted;
+    if (http_err != ESP_OK) return http_err;
+    return c->status != 200 ? ESP_FAIL : stream_err;
+}
+
+static void api_report(void *arg, bool ok, uint32_t ttfb_ms)
+{
+    api_t *api = (api_t *)arg;
+    if (ok) api->o->reports_ok++;
+    else api->o->reports_fail++;
+}
+
+static bool api_failover(void *arg, int status)
+{
+    api_t *api = (api_t *)arg;
+    api->failed |= 1u << api->backend;
+    for (int b = 0; b < BACKENDS; b++) {
+        if (api->script[b] && !(api->failed & (1u << b))) {
+            api->backend = b;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool api_fallback(void *arg)
+{
+    api_t *api = (api_t *)arg;
+    if (!api->has_fallback || api->on_fallback) return false;
+    api->on_fallback = true;
+    return true;
+}
+
+static bool api_cancelled(void *arg)
+{
+    api_t *api = (api_t *)arg;
+    return api->cancel_after && api->o->attempts >= api->cancel_after;
+}
+
+static int64_t api_now_us(void *arg)
+{
+    return ((api_t *)arg)->now_us;
+}
+
+static void api_wait(void *arg, int ms)
+{
+    api_t *api = (api_t *)arg;
+    if (api->o->attempts - 1 < MIMI_LLM_RETRY_MAX) api->o->waits[api->o->attempts - 1] = ms;
+    api->now_us += (int64_t)ms * 1000;
+}
+
+/* llm_retry_run(), the loop of llm_chat_request(), against api */
+static outcome_t run(api_t *api, int budget_ms)
+{
+    outcome_t o = {0};
+    api->o = &o;
+    const llm_retry_ops_t ops = {
+        .attempt = api_attempt,
+        .report = api_report,
+        .failover = api_failover,
+        .fallback = api_fallback,
+        .cancelled = api_cancelled,
+        .now_us = api_now_us,
+        .wait = api_wait,
+        .ctx = api,
+    };
+    o.err = llm_retry_run(&ops, (int64_t)budget_ms * 1000, &o.counts);
+    o.ok = (o.err == ESP_OK);
+    o.timed_out = (o.err == ESP_ERR_TIMEOUT);
+    o.elapsed_ms = api->now_us / 1000;
+    return o;
+}
+
+/* One backend, no fallback model */
+static outcome_t simulate(const canned_t *script, int n, int budget_ms)
+{
+    api_t api = { .script = { script }, .len = { n } };
+    return run(&api, budget_ms);
+}
+
+#define SCRIPT(...) (const canned_t[]){ __VA_ARGS__ }, (int)(sizeof((const canned_t[]){ __VA_ARGS__ }) / sizeof(canned_t))
+
+static void test_overloaded_then_ok(void)
+{
+    s_rnd_mode = RND_XORSHIFT;
+    for (int trial = 0; trial < 200; trial++) {
+        outcome_t o = simulate(SCRIPT({ .status = 529 }, { .status = 529 }, { .status = 200 }),
+                               MIMI_LLM_RETRY_BUDGET_MS);
+        CHECK(o.ok && o.attempts == 3);
+        CHECK(o.waits[0] >= MIMI_LLM_RETRY_BASE_MS / 2 && o.waits[0] <= MIMI_LLM_RETRY_BASE_MS);
+        CHECK(o.waits[1] >= MIMI_LLM_RETRY_BASE_MS && o.waits[1] <= 2 * MIMI_LLM_RETRY_BASE_MS);
+    }
+}
+
+static void test_retry_after(void)
+{
+    s_rnd_mode = RND_XORSHIFT;
+    outcome_t o = simulate(SCRIPT({ .status = 429, .headers = { { "Retry-After", "7" } } },
+                                  { .status = 200 }),
+                           MIMI_LLM_RETRY_BUDGET_MS);
+    CHECK(o.ok && o.attempts == 2);
+    CHECK(o.waits[0] >= 7000 && o.waits[0] < 7250);
+
+    /* Longer than the deadline allows: give up at once instead of sleeping */
+    o = simulate(SCRIPT({ .status = 429, .headers = { { "retry-after", "90" } } },
+                        { .status = 200 }),
+                 MIMI_LLM_RETRY_BUDGET_MS);
+    CHECK(!o.ok && o.timed_out && o.attempts == 1);
+    CHECK(o.elapsed_ms < 1000);
+
+    /* Two long waits: the second would pass the deadline */
+    o = simulate(SCRIPT({ .status = 529, .headers = { { "retry-after", "40" } } },
+                        { .status = 529, .headers = { { "retry-after", "40" } } },
+                        { .status = 200 }),
+                 MIMI_LLM_RETRY_BUDGET_MS);
+    CHECK(!o.ok && o.timed_out && o.attempts == 2);
+    CHECK(o.elapsed_ms <= MIMI_LLM_RETRY_BUDGET_MS);
+}
+
+static void test_ratelimit_reset(void)
+{
+    s_rnd_mode = RND_MIN;
+    /* Tokens exhausted until 11:20:12 (12 s from the first answer); the
+     * requests bucket still has room, so its later reset is irrelevant */
+    outcome_t o = simulate(SCRIPT({ .status = 429, .headers = {
+                                        { "anthropic-ratelimit-requests-remaining", "5" },
+                                        { "anthropic-ratelimit-requests-reset", "2025-10-17T11:20:50Z" },
+                                        { "anthropic-ratelimit-tokens-remaining", "0" },
+                                        { "anthropic-ratelimit-tokens-reset", "2025-10-17T11:20:12Z" } } },
+                                  { .status = 200 }),
+                           MIMI_LLM_RETRY_BUDGET_MS);
+    CHECK(o.ok && o.attempts == 2);
+    CHECK(o.waits[0] == 12000);
+}
+
+static void test_all_overloaded(void)
+{
+    s_rnd_mode = RND_MIN;       /* shortest waits: the attempt limit ends it */
+    outcome_t o = simulate(SCRIPT({ .status = 529 }, { .status = 529 }, { .status = 529 },
+                                  { .status = 529 }, { .status = 529 }, { .status = 529 }),
+                           MIMI_LLM_RETRY_BUDGET_MS);
+    CHECK(!o.ok && o.timed_out);
+    CHECK(o.attempts == MIMI_LLM_RETRY_MAX);
+    for (int i = 0; i + 1 < MIMI_LLM_RETRY_MAX; i++) {
+        int cap = MIMI_LLM_RETRY_BASE_MS << i;
+        if (cap > MIMI_LLM_RETRY_MAX_DELAY_MS) cap = MIMI_LLM_RETRY_MAX_DELAY_MS;
+        CHECK(o.waits[i] == cap / 2);
+    }
+    CHECK(o.elapsed_ms <= MIMI_LLM_RETRY_BUDGET_MS);
+
+    /* A short deadline cuts the schedule before MIMI_LLM_RETRY_MAX */
+    o = simulate(SCRIPT({ .status = 503 }, { .status = 503 }, { .status = 503 },
+                        { .status = 503 }, { .status = 503 }),
+                 4000);
+    CHECK(!o.ok && !o.timed_out && o.attempts == 3);
+    CHECK(o.elapsed_ms <= 4000);
+}
+
+static void test_not_retried(void)
+{
+    s_rnd_mode = RND_XORSHIFT;
+    /* Our request's fault */
+    outcome_t o = simulate(SCRIPT({ .status = 400 }, { .status = 200 }), MIMI_LLM_RETRY_BUDGET_MS);
+    CHECK(!o.ok && o.attempts == 1);
+    /* Bad key: only another backend could help, no backoff on this one */
+    o = simulate(SCRIPT({ .status = 401 }, { .status = 200 }), MIMI_LLM_RETRY_BUDGET_MS);
+    CHECK(!o.ok && o.attempts == 1 && o.elapsed_ms < 1000);
+    /* Text already reached the user: a retry would repeat it */
+    o = simulate(SCRIPT({ .status = 200, .stream_error = "overloaded_error: Overloaded", .emitted = true },
+                        { .status = 200 }),
+                 MIMI_LLM_RETRY_BUDGET_MS);
+    CHECK(!o.ok && o.attempts == 1);
+    o = simulate(SCRIPT({ .status = 200, .stream_error = "invalid_request_error: prompt is too long" },
+                        { .status = 200 }),
+                 MIMI_LLM_RETRY_BUDGET_MS);
+    CHECK(!o.ok && o.attempts == 1);
+}
+
+static void test_transient(void)
+{
+    s_rnd_mode = RND_XORSHIFT;
+    /* Timeout, then an overloaded_error event inside a 200 stream, then OK */
+    outcome_t o = simulate(SCRIPT({ .status = 0 },
+                                  { .status = 200, .stream_error = "overloaded_error: Overloaded" },
+                                  { .status = 200 }),
+                           MIMI_LLM_RETRY_BUDGET_MS);
+    CHECK(o.ok && o.attempts == 3);
+
+    llm_attempt_t at = { .status = 401, .hint_ms = -1 };
+    CHECK(llm_retry_verdict(0, &at) == LLM_RETRY_AGAIN);    /* failover allowed */
+    at = (llm_attempt_t){ .status = 502, .retryable = true, .hint_ms = -1 };
+    CHECK(llm_retry_verdict(MIMI_LLM_RETRY_MAX - 1, &at) == LLM_RETRY_EXHAUSTED);
+}
+
+static void test_hints(void)
+{
+    const time_t now = NOW_EPOCH;
+    llm_retry_hints_t h;
+
+    llm_retry_hints_init(&h);
+    CHECK(llm_retry_hint_ms(&h) == -1);
+    llm_retry_hints_header(&h, "Retry-After", "1.5", now);
+    CHECK(llm_retry_hint_ms(&h) == 1500);
+
+    /* Retry-After wins over a bucket reset */
+    llm_retry_hints_header(&h, "anthropic-ratelimit-input-tokens-remaining", "0", now);
+    llm_retry_hints_header(&h, "Anthropic-RateLimit-Input-Tokens-Reset", "2025-10-17T11:20:50Z", now);
+    CHECK(llm_retry_hint_ms(&h) == 1500);
+
+    /* Latest reset among exhausted buckets */
+    llm_retry_hints_init(&h);
+    llm_retry_hints_header(&h, "anthropic-ratelimit-input-tokens-remaining", "0", now);
+    llm_retry_hints_header(&h, "anthropic-ratelimit-input-tokens-reset", "2025-10-17T11:20:12Z", now);
+    llm_retry_hints_header(&h, "anthropic-ratelimit-output-tokens-remaining", "0", now);
+    llm_retry_hints_header(&h, "anthropic-ratelimit-output-tokens-reset", "2025-10-17T11:20:50Z", now);
+    CHECK(llm_retry_hint_ms(&h) == 50000);
+
+    /* Ignored: garbage, negative or hour-long Retry-After, resets in the
+     * past or more than an hour away, and any reset while the clock is unset */
+    llm_retry_hints_init(&h);
+    llm_retry_hints_header(&h, "retry-after", "Fri, 17 Oct 2025 11:21:00 GMT", now);
+    llm_retry_hints_header(&h, "retry-after", "-3", now);
+    llm_retry_hints_header(&h, "retry-after", "7200", now);
+    llm_retry_hints_header(&h, "anthropic-ratelimit-tokens-remaining", "0", now);
+    llm_retry_hints_header(&h, "anthropic-ratelimit-tokens-reset", "2025-10-17T11:19:55Z", now);
+    llm_retry_hints_header(&h, "anthropic-ratelimit-requests-remaining", "0", now);
+    llm_retry_hints_header(&h, "anthropic-ratelimit-requests-reset", "2025-10-17T12:26:40Z", now);
+    CHECK(llm_retry_hint_ms(&h) == -1);
+    llm_retry_hints_header(&h, "anthropic-ratelimit-tokens-reset", "2025-10-17T11:20:12Z", 12);
+    CHECK(llm_retry_hint_ms(&h) == -1);
+    llm_retry_hints_header(&h, "anthropic-ratelimit-tokens-reset", "not a date", now);
+    CHECK(llm_retry_hint_ms(&h) == -1);
+}
+
+static void test_classification(void)
+{
+    static const int retry[] = { 408, 429, 500, 502, 503, 504, 529 };
+    static const int final[] = { 200, 400, 401, 403, 404, 413, 422 };
+    for (size_t i = 0; i < sizeof(retry) / sizeof(retry[0]); i++) CHECK(llm_retry_status(retry[i]));
+    for (size_t i = 0; i < sizeof(final) / sizeof(final[0]); i++) CHECK(!llm_retry_status(final[i]));
+
+    bool overloaded;
+    CHECK(llm_retry_stream_error("rate_limit_error: slow down", &overloaded) && overloaded);
+    CHECK(llm_retry_stream_error("api_error: Internal server error", &overloaded) && !overloaded);
+    CHECK(!llm_retry_stream_error("authentication_error: invalid x-api-key", &overloaded) && !overloaded);
+}
+
+static void test_backoff_bounds(void)
+{
+    s_rnd_mode = RND_XORSHIFT;
+    for (int attempt = 0; attempt < 12; attempt++) {
+        int cap = MIMI_LLM_RETRY_BASE_MS << (attempt < 6 ? attempt : 6);
+        if (cap > MIMI_LLM_RETRY_MAX_DELAY_MS) cap = MIMI_LLM_RETRY_MAX_DELAY_MS;
+        int lo = cap, hi = 0;
+        for (int i = 0; i < 2000; i++) {
+            int d = llm_retry_backoff_ms(attempt, -1);
+            if (d < lo) lo = d;
+            if (d > hi) hi = d;
+        }
+        CHECK(lo >= cap / 2 && hi <= cap);
+        CHECK(hi - lo > cap / 4);           /* actually jittered */
+    }
+    /* A hint below the backoff does not shorten it */
+    s_rnd_mode = RND_MIN;
+    CHECK(llm_retry_backoff_ms(3, 100) == (MIMI_LLM_RETRY_BASE_MS << 3) / 2);
+}
+
+#define SCRIPT_OF(...) (const canned_t[]){ __VA_ARGS__ }
+
+static void test_failover(void)
+{
+    s_rnd_mode = RND_XORSHIFT;
+    /* Overloaded primary: the second backend answers at once, no backoff */
+    api_t api = {
+        .script = { SCRIPT_OF({ .status = 529 }), SCRIPT_OF({ .status = 200 }) },
+        .len = { 1, 1 },
+    };
+    outcome_t o = run(&api, MIMI_LLM_RETRY_BUDGET_MS);
+    CHECK(o.ok && o.attempts == 2);
+    CHECK(o.backend[0] == 0 && o.backend[1] == 1);
+    CHECK(o.waits[0] == 0 && o.elapsed_ms == 600);
+    CHECK(o.counts.failovers == 1 && o.counts.retries == 0 && o.counts.rate_limited == 1);
+    CHECK(o.reports_fail == 1 && o.reports_ok == 1);
+
+    /* Bad key on the primary: failover, but never a retry on the same one */
+    api = (api_t){
+        .script = { SCRIPT_OF({ .status = 401 }), SCRIPT_OF({ .status = 503 }, { .status = 200 }) },
+        .len = { 1, 2 },
+    };
+    o = run(&api, MIMI_LLM_RETRY_BUDGET_MS);
+    CHECK(o.ok && o.attempts == 3);
+    CHECK(o.backend[1] == 1 && o.backend[2] == 1);
+    CHECK(o.counts.failovers == 1 && o.counts.retries == 1);
+
+    /* Both fail: back off on the last one left */
+    api = (api_t){
+        .script = { SCRIPT_OF({ .status = 0 }), SCRIPT_OF({ .status = 0 }, { .status = 0 }, { .status = 200 }) },
+        .len = { 1, 3 },
+    };
+    o = run(&api, MIMI_LLM_RETRY_BUDGET_MS);
+    CHECK(o.ok && o.attempts == 4);
+    CHECK(o.waits[1] > 0 && o.waits[2] > 0);
+    CHECK(o.reports_fail == 3 && o.reports_ok == 1);
+
+    /* A 400 is our request's fault: no failover, no health report */
+    api = (api_t){
+        .script = { SCRIPT_OF({ .status = 400 }), SCRIPT_OF({ .status = 200 }) },
+        .len = { 1, 1 },
+    };
+    o = run(&api, MIMI_LLM_RETRY_BUDGET_MS);
+    CHECK(!o.ok && o.attempts == 1 && o.reports_fail == 0);
+}
+
+static void test_fallback_model(void)
+{
+    s_rnd_mode = RND_MIN;
+    api_t api = {
+        .script = { SCRIPT_OF({ .status = 529 }, { .status = 529 }, { .status = 529 }, { .status = 200 }) },
+        .len = { 4 },
+        .has_fallback = true,
+    };
+    outcome_t o = run(&api, MIMI_LLM_RETRY_BUDGET_MS);
+    CHECK(o.ok && o.attempts == 4);
+    for (int i = 0; i < 4; i++) CHECK(o.fallback[i] == (i >= MIMI_LLM_FALLBACK_AFTER));
+    CHECK(o.counts.fallbacks == 1);
+
+    /* Not for errors that are not overloads */
+    api = (api_t){
+        .script = { SCRIPT_OF({ .status = 503 }, { .status = 503 }, { .status = 503 }, { .status = 200 }) },
+        .len = { 4 },
+        .has_fallback = true,
+    };
+    o = run(&api, MIMI_LLM_RETRY_BUDGET_MS);
+    CHECK(o.ok && o.counts.fallbacks == 0 && !o.fallback[3]);
+}
+
+static void test_cancel(void)
+{
+    s_rnd_mode = RND_MIN;
+    api_t api = {
+        .script = { SCRIPT_OF({ .status = 529 }, { .status = 200 }) },
+        .len = { 2 },
+        .cancel_after = 1,
+    };
+    outcome_t o = run(&api, MIMI_LLM_RETRY_BUDGET_MS);
+    CHECK(o.err == ESP_ERR_NOT_FINISHED && o.attempts == 1);
+
+    /* Cancelled transfer: no retry, and not held against the backend */
+    llm_attempt_t at = { .hint_ms = -1 };
+    llm_retry_classify(&at, ESP_ERR_NOT_FINISHED, ESP_OK, "");
+    CHECK(!at.retryable && llm_retry_verdict(0, &at) == LLM_RETRY_STOP);
+    at = (llm_attempt_t){ .status = 200, .hint_ms = -1 };
+    llm_retry_classify(&at, ESP_OK, ESP_ERR_INVALID_RESPONSE, "");
+    CHECK(at.retryable && !at.overloaded);
+}
+
+int main(void)
+{
+    test_classification();
+    test_hints();
+    test_backoff_bounds();
+    test_overloaded_then_ok();
+    test_retry_after();
+    test_ratelimit_reset();
+    test_all_overloaded();
+    test_not_retried();
+    test_transient();
+    test_failover();
+    test_fallback_model();
+    test_cancel();
+    return test_result("test_llm_retry");
+}
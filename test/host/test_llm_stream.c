@@ -0,0 +1,262 @@
+/*
+ * Replays recorded SSE transcripts through llm_stream, cut at every byte
+ * boundary and fed one byte at a time, and checks the decoded response:
+ * text, streamed deltas, tool calls, stop reason and usage.
+ */
+
+#include "host_test.h"
+#include "llm/llm_stream.h"
+
+typedef struct {
+    const char *id;
+    const char *name;
+    const char *input;
+} want_call_t;
+
+typedef struct {
+    const char *file;
+    llm_stream_format_t fmt;
+    esp_err_t finish;           /* expected llm_stream_finish() result */
+    const char *error;          /* expected s.error prefix, or NULL */
+    const char *text;
+    bool tool_use;
+    int call_count;
+    want_call_t calls[MIMI_MAX_TOOL_CALLS];
+    llm_usage_t usage;
+} transcript_t;
+
+static const transcript_t s_transcripts[] = {
+    {
+        .file = "anthropic_tool_use.sse",
+        .fmt = LLM_STREAM_ANTHROPIC,
+        .finish = ESP_OK,
+        .text = "Je regarde la m\xc3\xa9t\xc3\xa9o \xc3\xa0 Paris \xe2\x80\x94 un instant.\n"
+                "\"Pluie\" ou soleil ? \xf0\x9f\x8c\xa6",
+        .tool_use = true,
+        .call_count = 2,
+        .calls = {
+            { "toolu_01T1x1fJ34qAmk2tNTrN7Up6", "web_search",
+              "{\"query\": \"m\xc3\xa9t\xc3\xa9o Paris demain\", \"count\": 3}" },
+            { "toolu_01Ab4yTNmkUPLrJ9fEcq8xXw", "get_current_time", "{}" },
+        },
+        .usage = { .input_tokens = 412, .output_tokens = 89, .cache_read_tokens = 2890 },
+    },
+    {
+        .file = "anthropic_overloaded.sse",
+        .fmt = LLM_STREAM_ANTHROPIC,
+        .finish = ESP_FAIL,
+        .error = "overloaded_error: Overloaded",
+        .text = NULL,
+        .usage = { .input_tokens = 1530, .output_tokens = 1 },
+    },
+    {
+        .file = "kimi_tool_calls.sse",
+        .fmt = LLM_STREAM_OPENAI,
+        .finish = ESP_OK,
+        .text = "Je v\xc3\xa9rifie l'heure et le temps.",
+        .tool_use = true,
+        .call_count = 2,
+        .calls = {
+            { "get_current_time:0", "get_current_time", "{}" },
+            { "web_search:1", "web_search", "{\"query\": \"m\xc3\xa9t\xc3\xa9o Lyon\"}" },
+        },
+        .usage = { .input_tokens = 418, .output_tokens = 61, .cache_read_tokens = 1792 },
+    },
+    {
+        .file = "openai_text.sse",
+        .fmt = LLM_STREAM_OPENAI,
+        .finish = ESP_OK,
+        .text = "Bonjour ! Il est 14\xc2\xa0h 05.",
+        .usage = { .input_tokens = 341, .output_tokens = 14, .cache_read_tokens = 1536 },
+    },
+};
+
+/* Text deltas as the agent would stream them to a WebSocket client */
+typedef struct {
+    char buf[1024];
+    size_t len;
+} deltas_t;
+
+static void on_delta(const char *text, size_t len, void *ctx)
+{
+    deltas_t *d = (deltas_t *)ctx;
+    if (d->len + len < sizeof(d->buf)) {
+        memcpy(d->buf + d->len, text, len);
+        d->len += len;
+        d->buf[d->len] = '\0';
+    }
+}
+
+static void free_response(llm_response_t *r)
+{
+    free(r->text);
+    for (int i = 0; i < r->call_count; i++) free(r->calls[i].input);
+}
+
+/* Feed data in the pieces given by cuts (ascending offsets), then check */
+static void replay(const transcript_t *t, const char *data, size_t len,
+                   const size_t *cuts, int ncuts, const char *how)
+{
+    llm_response_t resp;
+    llm_stream_t s;
+    deltas_t deltas = {0};
+    llm_stream_init(&s, t->fmt, &resp, on_delta, &deltas);
+
+    esp_err_t err = ESP_OK;
+    size_t pos = 0;
+    for (int i = 0; i <= ncuts && err == ESP_OK; i++) {
+        size_t end = (i < ncuts) ? cuts[i] : len;
+        err = llm_stream_feed(&s, data + pos, end - pos);
+        pos = end;
+    }
+    if (err == ESP_OK) err = llm_stream_finish(&s);
+
+    int before = s_failures;
+    CHECK(err == t->finish);
+    if (t->error) CHECK(strncmp(s.error, t->error, strlen(t->error)) == 0);
+    if (t->text) {
+        CHECK_STR(resp.text, t->text);
+        CHECK(resp.text_len == strlen(t->text));
+        CHECK_STR(deltas.buf, t->text);
+    } else {
+        CHECK(resp.text_len == 0 && deltas.len == 0);
+    }
+    CHECK(resp.tool_use == t->tool_use);
+    CHECK(resp.call_count == t->call_count);
+    for (int i = 0; i < t->call_count && i < resp.call_count; i++) {
+        CHECK_STR(resp.calls[i].id, t->calls[i].id);
+        CHECK_STR(resp.calls[i].name, t->calls[i].name);
+        CHECK_STR(resp.calls[i].input, t->calls[i].input);
+        CHECK(resp.calls[i].input_len == strlen(t->calls[i].input));
+    }
+    CHECK(resp.usage.input_tokens == t->usage.input_tokens);
+    CHECK(resp.usage.output_tokens == t->usage.output_tokens);
+    CHECK(resp.usage.cache_read_tokens == t->usage.cache_read_tokens);
+    CHECK(resp.usage.cache_write_tokens == t->usage.cache_write_tokens);
+    if (s_failures != before) fprintf(stderr, "  in %s, %s\n", t->file, how);
+
+    llm_stream_free(&s);
+    free_response(&resp);
+}
+
+static void run_transcript(const transcript_t *t, const char *data, size_t len, const char *variant)
+{
+    char how[96];
+
+    /* In one piece */
+    snprintf(how, sizeof(how), "%s, whole", variant);
+    replay(t, data, len, NULL, 0, how);
+
+    /* Cut in two at every byte boundary */
+    for (size_t cut = 1; cut < len && !FAILED(); cut++) {
+        snprintf(how, sizeof(how), "%s, cut at %zu", variant, cut);
+        replay(t, data, len, &cut, 1, how);
+    }
+
+    /* One byte at a time */
+    size_t *cuts = malloc(len * sizeof(size_t));
+    for (size_t i = 0; i + 1 < len; i++) cuts[i] = i + 1;
+    snprintf(how, sizeof(how), "%s, byte by byte", variant);
+    replay(t, data, len, cuts, (int)len - 1, how);
+    free(cuts);
+}
+
+/* Same transcript with CR-LF line endings (some proxies rewrite them) */
+static char *to_crlf(const char *data, size_t len, size_t *out_len)
+{
+    char *out = malloc(2 * len + 1);
+    size_t n = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (data[i] == '\n') out[n++] = '\r';
+        out[n++] = data[i];
+    }
+    out[n] = '\0';
+    *out_len = n;
+    return out;
+}
+
+/* An event with far more tokens than the initial array holds must still be
+ * decoded (tool_use block carrying a large input object) */
+static void test_large_event(void)
+{
+    size_t cap = 16384, n = 0;
+    char *sse = malloc(cap);
+    n += snprintf(sse + n, cap - n,
+                  "event: content_block_start\n"
+                  "data: {\"type\":\"content_block_start\",\"index\":0,\"content_block\":"
+                  "{\"type\":\"tool_use\",\"id\":\"toolu_big\",\"name\":\"write_file\",\"input\":{");
+    for (int i = 0; i < 400; i++) {
+        n += snprintf(sse + n, cap - n, "%s\"k%d\":[%d,true,null]", i ? "," : "", i, i);
+    }
+    n += snprintf(sse + n, cap - n,
+                  "}}}\n\n"
+                  "data: {\"type\":\"content_block_delta\",\"index\":0,\"delta\":"
+                  "{\"type\":\"input_json_delta\",\"partial_json\":\"{\\\"path\\\": \\\"/spiffs/a\\\"}\"}}\n\n"
+                  "data: {\"type\":\"content_block_stop\",\"index\":0}\n\n"
+                  "data: {\"type\":\"message_delta\",\"delta\":{\"stop_reason\":\"tool_use\"},"
+                  "\"usage\":{\"output_tokens\":7}}\n\n"
+                  "data: {\"type\":\"message_stop\"}\n\n");
+
+    llm_response_t resp;
+    llm_stream_t s;
+    llm_stream_init(&s, LLM_STREAM_ANTHROPIC, &resp, NULL, NULL);
+    CHECK(llm_stream_feed(&s, sse, n) == ESP_OK);
+    CHECK(llm_stream_finish(&s) == ESP_OK);
+    CHECK(s.tok_cap > LLM_STREAM_MAX_TOKENS);
+    CHECK(resp.call_count == 1 && resp.tool_use);
+    CHECK_STR(resp.calls[0].name, "write_file");
+    CHECK_STR(resp.calls[0].input, "{\"path\": \"/spiffs/a\"}");
+    llm_stream_free(&s);
+    free_response(&resp);
+    free(sse);
+}
+
+/* An event that cannot be decoded fails the stream instead of losing bytes */
+static void test_corrupt_event(void)
+{
+    static const char sse[] =
+        "data: {\"type\":\"content_block_start\",\"index\":0,\"content_block\":{\"type\":\"text\",\"text\":\"\"}}\n\n"
+        "data: {\"type\":\"content_block_delta\",\"index\":0,\"delta\":{\"type\":\"text_delta\",\"text\":\"Hel\n\n"
+        "data: {\"type\":\"message_stop\"}\n\n";
+    llm_response_t resp;
+    llm_stream_t s;
+    llm_stream_init(&s, LLM_STREAM_ANTHROPIC, &resp, NULL, NULL);
+    CHECK(llm_stream_feed(&s, sse, sizeof(sse) - 1) == ESP_ERR_INVALID_RESPONSE);
+    CHECK(llm_stream_finish(&s) == ESP_ERR_INVALID_RESPONSE);
+    llm_stream_free(&s);
+    free_response(&resp);
+}
+
+/* A stream cut before its final event is reported as such (retryable) */
+static void test_truncated(void)
+{
+    size_t len;
+    char *data = read_data("anthropic_tool_use.sse", &len);
+    char *stop = strstr(data, "event: message_stop");
+    llm_response_t resp;
+    llm_stream_t s;
+    llm_stream_init(&s, LLM_STREAM_ANTHROPIC, &resp, NULL, NULL);
+    CHECK(llm_stream_feed(&s, data, (size_t)(stop - data)) == ESP_OK);
+    CHECK(llm_stream_finish(&s) == ESP_ERR_INVALID_RESPONSE);
+    llm_stream_free(&s);
+    free_response(&resp);
+    free(data);
+}
+
+int main(void)
+{
+    for (size_t i = 0; i < sizeof(s_transcripts) / sizeof(s_transcripts[0]); i++) {
+        const transcript_t *t = &s_transcripts[i];
+        size_t len, crlf_len;
+        char *data = read_data(t->file, &len);
+        run_transcript(t, data, len, "LF");
+        char *crlf = to_crlf(data, len, &crlf_len);
+        run_transcript(t, crlf, crlf_len, "CRLF");
+        free(crlf);
+        free(data);
+    }
+    test_large_event();
+    test_corrupt_event();
+    test_truncated();
+    return test_result("test_llm_stream");
+}
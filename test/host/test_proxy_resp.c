@@ -0,0 +1,264 @@
+/*
+ * proxy_resp: HTTP/1.1 response framing over a tunnel. Each recorded response
+ * is fed whole, cut at every byte boundary and one byte at a time; status,
+ * headers, body, keep-alive and the end of the response must not depend on
+ * how the bytes arrived.
+ */
+
+#include "host_test.h"
+#include "proxy/proxy_resp.h"
+
+typedef struct {
+    const char *name;
+    bool head;                  /* request was HEAD */
+    const char *wire;           /* bytes as read from the tunnel */
+    int status;
+    const char *headers;        /* "key=value;" for every on_header call */
+    const char *body;
+    bool done;                  /* complete without the connection closing */
+    bool keep_alive;
+} resp_case_t;
+
+static const resp_case_t s_cases[] = {
+    {
+        .name = "content-length, pipelined bytes after it",
+        .wire = "HTTP/1.1 200 OK\r\n"
+                "Content-Type: application/json\r\n"
+                "content-length: 26\r\n"
+                "retry-after: 7\r\n"
+                "\r\n"
+                "{\"ok\":true,\"result\":[42]}\n"
+                "HTTP/1.1 500 Not Ours\r\n\r\n",
+        .status = 200,
+        .headers = "Content-Type=application/json;retry-after=7;",
+        .body = "{\"ok\":true,\"result\":[42]}\n",
+        .done = true,
+        .keep_alive = true,
+    },
+    {
+        .name = "chunked with extensions and trailers",
+        .wire = "HTTP/1.1 200 OK\r\n"
+                "Content-Type: text/event-stream\r\n"
+                "Transfer-Encoding: chunked\r\n"
+                "\r\n"
+                "1a;name=\"x\"\r\n"
+                "data: {\"type\":\"ping\"}\n\n   \r\n"
+                "A\r\n"
+                "0123456789\r\n"
+                "0\r\n"
+                "X-Trailer: yes\r\n"
+                "\r\n"
+                "garbage",
+        .status = 200,
+        .headers = "Content-Type=text/event-stream;",
+        .body = "data: {\"type\":\"ping\"}\n\n   0123456789",
+        .done = true,
+        .keep_alive = true,
+    },
+    {
+        .name = "delimited by close",
+        .wire = "HTTP/1.1 200 OK\r\n"
+                "Server: stand-in\r\n"
+                "\r\n"
+                "until the peer closes\r\n\r\nmore",
+        .status = 200,
+        .headers = "Server=stand-in;",
+        .body = "until the peer closes\r\n\r\nmore",
+        .done = false,
+        .keep_alive = false,
+    },
+    {
+        .name = "100 Continue first",
+        .wire = "HTTP/1.1 100 Continue\r\n"
+                "\r\n"
+                "HTTP/1.1 429 Too Many Requests\r\n"
+                "Content-Length: 5\r\n"
+                "Connection: close\r\n"
+                "\r\n"
+                "slow!",
+        .status = 429,
+        .headers = "",
+        .body = "slow!",
+        .done = true,
+        .keep_alive = false,
+    },
+    {
+        .name = "HEAD with a length",
+        .head = true,
+        .wire = "HTTP/1.1 200 OK\r\n"
+                "Content-Length: 1234\r\n"
+                "ETag: \"v1\"\r\n"
+                "\r\n",
+        .status = 200,
+        .headers = "ETag=\"v1\";",
+        .body = "",
+        .done = true,
+        .keep_alive = true,
+    },
+    {
+        .name = "304 without body",
+        .wire = "HTTP/1.1 304 Not Modified\r\n"
+                "Content-Length: 99\r\n"
+                "\r\n",
+        .status = 304,
+        .headers = "",
+        .body = "",
+        .done = true,
+        .keep_alive = true,
+    },
+    {
+        .name = "empty body, HTTP/1.0, bare LF",
+        .wire = "HTTP/1.0 204 No Content\n"
+                "X-Id:\tabc\n"
+                "\n",
+        .status = 204,
+        .headers = "X-Id=abc;",
+        .body = "",
+        .done = true,
+        .keep_alive = false,
+    },
+    {
+        .name = "Content-Length: 0",
+        .wire = "HTTP/1.1 200 OK\r\n"
+                "Content-Length: 0\r\n"
+                "\r\n"
+                "x",
+        .status = 200,
+        .headers = "",
+        .body = "",
+        .done = true,
+        .keep_alive = true,
+    },
+};
+
+typedef struct {
+    int status;
+    char headers[512];
+    char body[512];
+    size_t body_len;
+    size_t fail_at;             /* on_body fails once the body reaches this, 0: never */
+} got_t;
+
+static void on_status(void *ctx, int status)
+{
+    got_t *g = (got_t *)ctx;
+    g->status = status;
+}
+
+static void on_header(void *ctx, const char *key, const char *value)
+{
+    got_t *g = (got_t *)ctx;
+    size_t n = strlen(g->headers);
+    snprintf(g->headers + n, sizeof(g->headers) - n, "%s=%s;", key, value);
+}
+
+static esp_err_t on_body(void *ctx, const char *data, size_t len)
+{
+    got_t *g = (got_t *)ctx;
+    CHECK(len > 0);
+    if (g->body_len + len < sizeof(g->body)) {
+        memcpy(g->body + g->body_len, data, len);
+        g->body[g->body_len + len] = '\0';
+    }
+    g->body_len += len;
+    if (g->fail_at && g->body_len >= g->fail_at) return ESP_ERR_NO_MEM;
+    return ESP_OK;
+}
+
+/* Feed wire in the pieces given by cuts, stopping once the response is done
+ * (as proxy_conn_read_response does), then check */
+static void replay(const resp_case_t *c, const size_t *cuts, int ncuts, const char *how)
+{
+    got_t g = {0};
+    proxy_resp_cb_t cb = { on_status, on_header, on_body, &g };
+    proxy_resp_t r;
+    proxy_resp_init(&r, &cb, c->head);
+
+    size_t len = strlen(c->wire), pos = 0;
+    for (int i = 0; i <= ncuts && !proxy_resp_done(&r); i++) {
+        size_t end = (i < ncuts) ? cuts[i] : len;
+        CHECK(proxy_resp_feed(&r, c->wire + pos, end - pos) == ESP_OK);
+        pos = end;
+    }
+
+    int before = s_failures;
+    CHECK(r.status == c->status);
+    CHECK(g.status == c->status);
+    CHECK_STR(g.headers, c->headers);
+    CHECK_STR(g.body, c->body);
+    CHECK(g.body_len == strlen(c->body));
+    CHECK(proxy_resp_done(&r) == c->done);
+    if (!c->done) CHECK(r.state == PROXY_RESP_BODY && r.content_len < 0 && !r.chunked);
+    CHECK(r.keep_alive == c->keep_alive);
+    if (s_failures != before) fprintf(stderr, "  in \"%s\", %s\n", c->name, how);
+}
+
+static void test_cases(void)
+{
+    for (size_t i = 0; i < sizeof(s_cases) / sizeof(s_cases[0]); i++) {
+        const resp_case_t *c = &s_cases[i];
+        size_t len = strlen(c->wire);
+        char how[48];
+
+        replay(c, NULL, 0, "whole");
+        for (size_t cut = 0; cut <= len && !FAILED(); cut++) {
+            snprintf(how, sizeof(how), "cut at %zu", cut);
+            replay(c, &cut, 1, how);
+        }
+        size_t *cuts = malloc(len * sizeof(size_t));
+        for (size_t k = 0; k < len; k++) cuts[k] = k + 1;
+        replay(c, cuts, (int)len, "byte by byte");
+        free(cuts);
+    }
+}
+
+/* An on_body error stops the feed and is returned as is */
+static void test_body_error(void)
+{
+    got_t g = { .fail_at = 10 };
+    proxy_resp_cb_t cb = { NULL, NULL, on_body, &g };
+    proxy_resp_t r;
+    proxy_resp_init(&r, &cb, false);
+    const char *wire = s_cases[1].wire;
+    CHECK(proxy_resp_feed(&r, wire, strlen(wire)) == ESP_ERR_NO_MEM);
+    CHECK(g.body_len >= 10);
+    CHECK(!proxy_resp_done(&r));
+}
+
+/* Callbacks are optional */
+static void test_no_callbacks(void)
+{
+    proxy_resp_t r;
+    proxy_resp_init(&r, NULL, false);
+    const char *wire = s_cases[1].wire;
+    CHECK(proxy_resp_feed(&r, wire, strlen(wire)) == ESP_OK);
+    CHECK(proxy_resp_done(&r) && r.status == 200);
+}
+
+/* A header line longer than the line buffer is truncated, not overflowed,
+ * and the framing after it is intact */
+static void test_long_header(void)
+{
+    char wire[1024];
+    int n = snprintf(wire, sizeof(wire), "HTTP/1.1 200 OK\r\nSet-Cookie: ");
+    memset(wire + n, 'c', 600);
+    n += 600;
+    n += snprintf(wire + n, sizeof(wire) - n, "\r\nContent-Length: 3\r\n\r\nabc");
+
+    got_t g = {0};
+    proxy_resp_cb_t cb = { NULL, NULL, on_body, &g };
+    proxy_resp_t r;
+    proxy_resp_init(&r, &cb, false);
+    CHECK(proxy_resp_feed(&r, wire, (size_t)n) == ESP_OK);
+    CHECK(proxy_resp_done(&r));
+    CHECK_STR(g.body, "abc");
+}
+
+int main(void)
+{
+    test_cases();
+    test_body_error();
+    test_no_callbacks();
+    test_long_header();
+    return test_result("test_proxy_resp");
+}